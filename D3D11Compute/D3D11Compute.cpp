@@ -17,6 +17,8 @@
 #include <math.h>
 #include <stdlib.h>
 #include <chrono>
+#include <string>
+#include "../D3D12Compute/ShaderCache.h"
 
 #ifndef SAFE_RELEASE
 #define SAFE_RELEASE(p)      { if (p) { (p)->Release(); (p)=nullptr; } }
@@ -424,20 +426,46 @@ HRESULT CreateComputeShader( LPCWSTR pSrcFile, LPCSTR pFunctionName,
     // We generally prefer to use the higher CS shader profile when possible as CS 5.0 is better performance on 11-class hardware
     LPCSTR pProfile = ( pDevice->GetFeatureLevel() >= D3D_FEATURE_LEVEL_11_0 ) ? "cs_5_0" : "cs_4_0";
 
+    // Release builds reuse the DXBC blob of an earlier run from the shader cache
+    // shared with D3D12Compute. D3D11 can't load the DXIL precompiled by DXC.
+    std::wstring cachePath;
+#ifndef _DEBUG
+    ID3DBlob* pSourceBlob = nullptr;
+    if ( SUCCEEDED( D3DReadFileToBlob( str, &pSourceBlob ) ) )
+    {
+        std::string key = ShaderCacheKey( pSourceBlob->GetBufferPointer(), pSourceBlob->GetBufferSize(),
+                                          pFunctionName, pProfile, ShaderDefines() );
+        std::string path = ShaderCachePath( SHADER_CACHE_DIR, key );
+        cachePath.assign( path.begin(), path.end() );
+        SAFE_RELEASE( pSourceBlob );
+    }
+#endif
+
     ID3DBlob* pErrorBlob = nullptr;
     ID3DBlob* pBlob = nullptr;
-    hr = D3DCompileFromFile( str, nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, pFunctionName, pProfile, 
-                             dwShaderFlags, 0, &pBlob, &pErrorBlob );
-    if ( FAILED(hr) )
+    if ( cachePath.empty() || FAILED( D3DReadFileToBlob( cachePath.c_str(), &pBlob ) ) )
     {
-        if ( pErrorBlob )
-            OutputDebugStringA( (char*)pErrorBlob->GetBufferPointer() );
+        hr = D3DCompileFromFile( str, nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, pFunctionName, pProfile, 
+                                 dwShaderFlags, 0, &pBlob, &pErrorBlob );
+        if ( FAILED(hr) )
+        {
+            if ( pErrorBlob )
+                OutputDebugStringA( (char*)pErrorBlob->GetBufferPointer() );
 
-        SAFE_RELEASE( pErrorBlob );
-        SAFE_RELEASE( pBlob );    
+            SAFE_RELEASE( pErrorBlob );
+            SAFE_RELEASE( pBlob );    
 
-        return hr;
-    }    
+            return hr;
+        }
+
+        if ( !cachePath.empty() )
+        {
+            // The cache only saves time, so failing to write it isn't an error.
+            std::string cacheDir( SHADER_CACHE_DIR );
+            CreateDirectoryW( std::wstring( cacheDir.begin(), cacheDir.end() ).c_str(), nullptr );
+            D3DWriteBlobToFile( pBlob, cachePath.c_str(), TRUE );
+        }
+    }
 
     hr = pDevice->CreateComputeShader( pBlob->GetBufferPointer(), pBlob->GetBufferSize(), nullptr, ppShaderOut );
 
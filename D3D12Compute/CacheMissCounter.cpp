@@ -0,0 +1,128 @@
+// CacheMissCounter.cpp : Hardware cache-miss counts of the CPU GEMMs.
+//
+
+#include "pch.h"
+#include "CacheMissCounter.h"
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+CacheMissCounter::CacheMissCounter() :
+    m_fd(-1)
+{
+#if defined(__linux__)
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    // Threads started while the counter runs add their counts when they exit.
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    m_fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+}
+
+CacheMissCounter::~CacheMissCounter()
+{
+#if defined(__linux__)
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+#endif
+}
+
+bool CacheMissCounter::Available() const
+{
+    return m_fd >= 0;
+}
+
+void CacheMissCounter::Start()
+{
+#if defined(__linux__)
+    if (m_fd >= 0)
+    {
+        ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+uint64_t CacheMissCounter::Stop()
+{
+    uint64_t count = 0;
+#if defined(__linux__)
+    if (m_fd >= 0)
+    {
+        ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(m_fd, &count, sizeof(count)) != sizeof(count))
+        {
+            count = 0;
+        }
+    }
+#endif
+    return count;
+}
+
+#ifdef CACHE_MISS_COUNTER_MAIN
+// Standalone build that compares the tile orders of CpuMatmulRaster on Linux:
+//     g++ -O2 -mavx2 -mfma -std=c++14 -DCACHE_MISS_COUNTER_MAIN CacheMissCounter.cpp CpuMatmul.cpp -pthread -o raster_bench
+//     ./raster_bench 2048 8192 1024
+#include "CpuMatmul.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s <M> <N> <K> [groupM]\n", argv[0]);
+        return 1;
+    }
+    const int M = atoi(argv[1]);
+    const int N = atoi(argv[2]);
+    const int K = atoi(argv[3]);
+    const int groupM = argc > 4 ? atoi(argv[4]) : 8;
+    std::vector<float> a(size_t(M) * K);
+    std::vector<float> b(size_t(K) * N);
+    std::vector<float> c(size_t(M) * N);
+    for (float& value : a)
+    {
+        value = (float)rand() / float(RAND_MAX);
+    }
+    for (float& value : b)
+    {
+        value = (float)rand() / float(RAND_MAX);
+    }
+
+    CacheMissCounter counter;
+    printf("%-14s %12s %16s\n", "Order", "GFLOPS", "Cache misses");
+    for (int raster = RASTER_ROW_MAJOR; raster <= RASTER_HILBERT; raster++)
+    {
+        counter.Start();
+        auto start = std::chrono::steady_clock::now();
+        CpuMatmulRaster(a.data(), b.data(), c.data(), M, N, K, 32, 128, TileRaster(raster), groupM);
+        auto end = std::chrono::steady_clock::now();
+        const unsigned long long misses = counter.Stop();
+        const double timeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        if (counter.Available())
+        {
+            printf("%-14s %12.2f %16llu\n", TileRasterName(TileRaster(raster)), 2.0 * M * N * K / timeUS / 1000, misses);
+        }
+        else
+        {
+            printf("%-14s %12.2f %16s\n", TileRasterName(TileRaster(raster)), 2.0 * M * N * K / timeUS / 1000, "n/a");
+        }
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,26 @@
+// CacheMissCounter.h : Hardware cache-miss counts of the CPU GEMMs, read from
+// perf_event_open on Linux. Elsewhere the counter is never available, so callers
+// just leave the column out.
+
+#pragma once
+#include <cstdint>
+
+// Counts last-level cache misses (PERF_COUNT_HW_CACHE_MISSES) of the calling
+// thread and of the threads it starts between Start() and Stop().
+class CacheMissCounter
+{
+public:
+    CacheMissCounter();
+    ~CacheMissCounter();
+    CacheMissCounter(const CacheMissCounter&) = delete;
+    CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+    // False without perf support or permission (see /proc/sys/kernel/perf_event_paranoid).
+    bool Available() const;
+    void Start();
+    // Misses since Start(), or 0 if the counter isn't available.
+    uint64_t Stop();
+
+private:
+    int m_fd;
+};
@@ -0,0 +1,2127 @@
+// CpuMatmul.cpp : Host-side reference and SIMD implementations of the GEMM variants.
+//
+
+#include "pch.h"
+#include "CpuMatmul.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+#if defined(__AVX2__)
+    inline int HorizontalSum(__m256i v)
+    {
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(sum);
+    }
+#endif
+
+    // Raw int32 dot product of two int8 vectors of length K.
+    inline int DotInt8(const int8_t* a, const int8_t* b, int K, int sumB)
+    {
+        int k = 0;
+        int acc = 0;
+#if defined(__AVXVNNI__) || (defined(__AVX512VNNI__) && defined(__AVX512VL__))
+        // vpdpbusd multiplies unsigned by signed bytes, so A is biased by 128 and
+        // the bias is removed with the column sum of B afterwards.
+        const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80));
+        __m256i vacc = _mm256_setzero_si256();
+        for (; k + 32 <= K; k += 32)
+        {
+            __m256i va = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k)), bias);
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k));
+            vacc = _mm256_dpbusd_epi32(vacc, va, vb);
+        }
+        int sumBTail = 0;
+        for (int i = k; i < K; i++)
+        {
+            sumBTail += b[i];
+        }
+        acc = HorizontalSum(vacc) - 128 * (sumB - sumBTail);
+#elif defined(__AVX2__)
+        // maddubs saturates its int16 pair sums for int8 inputs, so widen to int16
+        // first and use madd, which keeps the int32 accumulation exact.
+        __m256i vacc = _mm256_setzero_si256();
+        for (; k + 16 <= K; k += 16)
+        {
+            __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + k)));
+            __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + k)));
+            vacc = _mm256_add_epi32(vacc, _mm256_madd_epi16(va, vb));
+        }
+        acc = HorizontalSum(vacc);
+        (void)sumB;
+#else
+        (void)sumB;
+#endif
+        for (; k < K; k++)
+        {
+            acc += int(a[k]) * int(b[k]);
+        }
+        return acc;
+    }
+
+    inline float UnpackInt4(uint32_t word, int index)
+    {
+        return float(int32_t(word << (28 - 4 * index)) >> 28);
+    }
+}
+
+void ParallelFor(int begin, int end, const std::function<void(int, int)>& func)
+{
+    int count = end - begin;
+    if (count <= 0)
+    {
+        return;
+    }
+    int threadCount = std::max(1, std::min(count, int(std::thread::hardware_concurrency())));
+    int chunk = (count + threadCount - 1) / threadCount;
+    std::vector<std::thread> threads;
+    for (int start = begin; start < end; start += chunk)
+    {
+        int stop = std::min(end, start + chunk);
+        threads.emplace_back(func, start, stop);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void CpuMatmulReference(const float* A, const float* B, double* C, int M, int N, int K)
+{
+    ParallelFor(0, M, [=](int rowBegin, int rowEnd) {
+        for (int m = rowBegin; m < rowEnd; m++)
+        {
+            double* c = C + size_t(m) * N;
+            std::fill(c, c + N, 0.0);
+            for (int k = 0; k < K; k++)
+            {
+                const double a = A[size_t(m) * K + k];
+                const float* b = B + size_t(k) * N;
+                for (int n = 0; n < N; n++)
+                {
+                    c[n] += a * b[n];
+                }
+            }
+        }
+    });
+}
+
+void QuantizeInt8(const float* src, int rows, int cols, int rowStride, int colStride,
+                  int8_t* dst, QuantParams* params)
+{
+    ParallelFor(0, rows, [=](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; r++)
+        {
+            const float* row = src + size_t(r) * rowStride;
+            // The range always contains 0 so that 0.0f is exactly representable.
+            float minValue = 0.0f;
+            float maxValue = 0.0f;
+            for (int c = 0; c < cols; c++)
+            {
+                float value = row[size_t(c) * colStride];
+                minValue = std::min(minValue, value);
+                maxValue = std::max(maxValue, value);
+            }
+            float scale = (maxValue - minValue) / 255.0f;
+            if (scale == 0.0f)
+            {
+                scale = 1.0f;
+            }
+            int zeroPoint = int(std::lround(-128.0f - minValue / scale));
+            zeroPoint = std::max(-128, std::min(127, zeroPoint));
+
+            int sum = 0;
+            int8_t* out = dst + size_t(r) * cols;
+            for (int c = 0; c < cols; c++)
+            {
+                int q = int(std::lround(row[size_t(c) * colStride] / scale)) + zeroPoint;
+                q = std::max(-128, std::min(127, q));
+                out[c] = static_cast<int8_t>(q);
+                sum += q;
+            }
+            params[r] = { scale, zeroPoint, sum, 0 };
+        }
+    });
+}
+
+void CpuMatmulInt8(const int8_t* A8, const int8_t* B8t, const QuantParams* paramsA,
+                   const QuantParams* paramsB, float* C, int M, int N, int K)
+{
+    ParallelFor(0, M, [=](int rowBegin, int rowEnd) {
+        for (int m = rowBegin; m < rowEnd; m++)
+        {
+            const int8_t* a = A8 + size_t(m) * K;
+            const QuantParams& pa = paramsA[m];
+            for (int n = 0; n < N; n++)
+            {
+                const QuantParams& pb = paramsB[n];
+                int dot = DotInt8(a, B8t + size_t(n) * K, K, pb.sum);
+                // sum((a - za) * (b - zb)) expanded so that only the raw int8 dot
+                // product has to be computed per output element.
+                int acc = dot - pb.zeroPoint * pa.sum - pa.zeroPoint * pb.sum + K * pa.zeroPoint * pb.zeroPoint;
+                C[size_t(m) * N + n] = pa.scale * pb.scale * float(acc);
+            }
+        }
+    });
+}
+
+void QuantizeInt4Groupwise(const float* B, int K, int N, int groupSize, uint32_t* Bq, float* scales)
+{
+    const int wordsPerRow = N / 8;
+    const int groupCount = (K + groupSize - 1) / groupSize;
+    ParallelFor(0, wordsPerRow, [=](int wordBegin, int wordEnd) {
+        for (int word = wordBegin; word < wordEnd; word++)
+        {
+            for (int g = 0; g < groupCount; g++)
+            {
+                int kBegin = g * groupSize;
+                int kEnd = std::min(K, kBegin + groupSize);
+                float groupScales[8];
+                for (int i = 0; i < 8; i++)
+                {
+                    int n = word * 8 + i;
+                    float maxAbs = 0.0f;
+                    for (int k = kBegin; k < kEnd; k++)
+                    {
+                        maxAbs = std::max(maxAbs, std::abs(B[size_t(k) * N + n]));
+                    }
+                    groupScales[i] = maxAbs > 0.0f ? maxAbs / 7.0f : 1.0f;
+                    scales[size_t(g) * N + n] = groupScales[i];
+                }
+                for (int k = kBegin; k < kEnd; k++)
+                {
+                    uint32_t packed = 0;
+                    for (int i = 0; i < 8; i++)
+                    {
+                        int q = int(std::lround(B[size_t(k) * N + word * 8 + i] / groupScales[i]));
+                        q = std::max(-8, std::min(7, q));
+                        packed |= (uint32_t(q) & 0xF) << (4 * i);
+                    }
+                    Bq[size_t(k) * wordsPerRow + word] = packed;
+                }
+            }
+        }
+    });
+}
+
+void CpuMatmulInt4(const float* A, const uint32_t* Bq, const float* scales, float* C,
+                   int M, int N, int K, int groupSize)
+{
+    const int wordsPerRow = N / 8;
+    const int groupCount = (K + groupSize - 1) / groupSize;
+    // Split over columns so the M = 1 decode case still uses every core.
+    ParallelFor(0, wordsPerRow, [=](int wordBegin, int wordEnd) {
+        for (int m = 0; m < M; m++)
+        {
+            const float* a = A + size_t(m) * K;
+            for (int word = wordBegin; word < wordEnd; word++)
+            {
+                float* c = C + size_t(m) * N + word * 8;
+#if defined(__AVX2__)
+                const __m256i shifts = _mm256_setr_epi32(28, 24, 20, 16, 12, 8, 4, 0);
+                __m256 acc = _mm256_setzero_ps();
+                for (int g = 0; g < groupCount; g++)
+                {
+                    int kEnd = std::min(K, (g + 1) * groupSize);
+                    __m256 groupAcc = _mm256_setzero_ps();
+                    for (int k = g * groupSize; k < kEnd; k++)
+                    {
+                        // Move nibble i to the top of lane i, then shift back arithmetically to sign extend.
+                        __m256i packed = _mm256_set1_epi32(int(Bq[size_t(k) * wordsPerRow + word]));
+                        __m256i q = _mm256_srai_epi32(_mm256_sllv_epi32(packed, shifts), 28);
+                        groupAcc = _mm256_fmadd_ps(_mm256_set1_ps(a[k]), _mm256_cvtepi32_ps(q), groupAcc);
+                    }
+                    acc = _mm256_fmadd_ps(groupAcc, _mm256_loadu_ps(scales + size_t(g) * N + word * 8), acc);
+                }
+                _mm256_storeu_ps(c, acc);
+#else
+                float acc[8] = {};
+                for (int g = 0; g < groupCount; g++)
+                {
+                    int kEnd = std::min(K, (g + 1) * groupSize);
+                    float groupAcc[8] = {};
+                    for (int k = g * groupSize; k < kEnd; k++)
+                    {
+                        uint32_t packed = Bq[size_t(k) * wordsPerRow + word];
+                        for (int i = 0; i < 8; i++)
+                        {
+                            groupAcc[i] += a[k] * UnpackInt4(packed, i);
+                        }
+                    }
+                    for (int i = 0; i < 8; i++)
+                    {
+                        acc[i] += groupAcc[i] * scales[size_t(g) * N + word * 8 + i];
+                    }
+                }
+                for (int i = 0; i < 8; i++)
+                {
+                    c[i] = acc[i];
+                }
+#endif
+            }
+        }
+    });
+}
+
+const char* AccumulationModeName(AccumulationMode mode)
+{
+    switch (mode)
+    {
+    case ACCUMULATE_KAHAN:
+        return "kahan";
+    case ACCUMULATE_FP64:
+        return "fp64";
+    case ACCUMULATE_PAIRWISE:
+        return "pairwise";
+    default:
+        return "naive";
+    }
+}
+
+namespace
+{
+    // Rows of A and columns of B handled together by one block of the fp32/fp64 GEMMs.
+    const int GEMM_BLOCK_M = 4;
+    const int GEMM_BLOCK_N = CPU_PACK_PANEL_N;
+
+    // p[r][0, count) += a[r] * b[0, count) for `rows` rows.
+    inline void MultiplyAddRows(float (*p)[GEMM_BLOCK_N], const float* a, int rows, const float* b, int count)
+    {
+        for (int r = 0; r < rows; r++)
+        {
+            int n = 0;
+#if defined(__AVX2__)
+            __m256 va = _mm256_set1_ps(a[r]);
+            for (; n + 8 <= count; n += 8)
+            {
+                __m256 acc = _mm256_loadu_ps(p[r] + n);
+                _mm256_storeu_ps(p[r] + n, _mm256_fmadd_ps(va, _mm256_loadu_ps(b + n), acc));
+            }
+#endif
+            for (; n < count; n++)
+            {
+                p[r][n] += a[r] * b[n];
+            }
+        }
+    }
+
+    // c[r][0, cols) += sum over k of panelA[k][r] * panelB[k * ldb + (0, cols)].
+    void MultiplyAddPanel(const float (*panelA)[GEMM_BLOCK_M], int rows, int depth,
+                          const float* panelB, int ldb, float* const* c, int cols)
+    {
+        for (int k = 0; k < depth; k++)
+        {
+            const float* b = panelB + size_t(k) * ldb;
+            for (int r = 0; r < rows; r++)
+            {
+                const float a = panelA[k][r];
+                int n = 0;
+#if defined(__AVX2__)
+                __m256 va = _mm256_set1_ps(a);
+                for (; n + 8 <= cols; n += 8)
+                {
+                    _mm256_storeu_ps(c[r] + n, _mm256_fmadd_ps(va, _mm256_loadu_ps(b + n), _mm256_loadu_ps(c[r] + n)));
+                }
+#endif
+                for (; n < cols; n++)
+                {
+                    c[r][n] += a * b[n];
+                }
+            }
+        }
+    }
+}
+
+void CpuMatmulFloat(const float* A, const float* B, float* C, int M, int N, int K, AccumulationMode mode)
+{
+    const int rowBlocks = (M + GEMM_BLOCK_M - 1) / GEMM_BLOCK_M;
+    ParallelFor(0, rowBlocks, [=](int blockBegin, int blockEnd) {
+        typedef float Block[GEMM_BLOCK_M][GEMM_BLOCK_N];
+        Block partial;
+        Block total;
+        Block comp;
+        double total64[GEMM_BLOCK_M][GEMM_BLOCK_N];
+        // Pending block sums of the pairwise tree and the tree level of each.
+        std::vector<Block> pairStack(32);
+        std::vector<int> pairLevels;
+
+        for (int block = blockBegin; block < blockEnd; block++)
+        {
+            const int m0 = block * GEMM_BLOCK_M;
+            const int rows = std::min(GEMM_BLOCK_M, M - m0);
+            for (int n0 = 0; n0 < N; n0 += GEMM_BLOCK_N)
+            {
+                const int cols = std::min(GEMM_BLOCK_N, N - n0);
+                for (int r = 0; r < rows; r++)
+                {
+                    std::fill(total[r], total[r] + cols, 0.0f);
+                    std::fill(comp[r], comp[r] + cols, 0.0f);
+                    std::fill(total64[r], total64[r] + cols, 0.0);
+                }
+                pairLevels.clear();
+
+                for (int k0 = 0; k0 < K; k0 += ACCUMULATE_BLOCK_K)
+                {
+                    const int kEnd = std::min(K, k0 + ACCUMULATE_BLOCK_K);
+                    // NAIVE keeps one running fp32 sum; the other modes sum the block separately.
+                    float (*target)[GEMM_BLOCK_N] = mode == ACCUMULATE_NAIVE ? total : partial;
+                    if (mode != ACCUMULATE_NAIVE)
+                    {
+                        for (int r = 0; r < rows; r++)
+                        {
+                            std::fill(partial[r], partial[r] + cols, 0.0f);
+                        }
+                    }
+                    for (int k = k0; k < kEnd; k++)
+                    {
+                        float a[GEMM_BLOCK_M];
+                        for (int r = 0; r < rows; r++)
+                        {
+                            a[r] = A[size_t(m0 + r) * K + k];
+                        }
+                        MultiplyAddRows(target, a, rows, B + size_t(k) * N + n0, cols);
+                    }
+
+                    if (mode == ACCUMULATE_KAHAN)
+                    {
+                        // Needs strict IEEE semantics; fast-math would reassociate this away.
+                        for (int r = 0; r < rows; r++)
+                        {
+                            for (int n = 0; n < cols; n++)
+                            {
+                                float y = partial[r][n] - comp[r][n];
+                                float t = total[r][n] + y;
+                                comp[r][n] = (t - total[r][n]) - y;
+                                total[r][n] = t;
+                            }
+                        }
+                    }
+                    else if (mode == ACCUMULATE_FP64)
+                    {
+                        for (int r = 0; r < rows; r++)
+                        {
+                            for (int n = 0; n < cols; n++)
+                            {
+                                total64[r][n] += partial[r][n];
+                            }
+                        }
+                    }
+                    else if (mode == ACCUMULATE_PAIRWISE)
+                    {
+                        // Binary counter: merge equal-level sums so each addition
+                        // combines two sums over the same number of blocks.
+                        int level = 0;
+                        while (!pairLevels.empty() && pairLevels.back() == level)
+                        {
+                            Block& top = pairStack[pairLevels.size() - 1];
+                            for (int r = 0; r < rows; r++)
+                            {
+                                for (int n = 0; n < cols; n++)
+                                {
+                                    partial[r][n] += top[r][n];
+                                }
+                            }
+                            pairLevels.pop_back();
+                            level++;
+                        }
+                        std::copy(&partial[0][0], &partial[0][0] + GEMM_BLOCK_M * GEMM_BLOCK_N, &pairStack[pairLevels.size()][0][0]);
+                        pairLevels.push_back(level);
+                    }
+                }
+
+                if (mode == ACCUMULATE_PAIRWISE)
+                {
+                    while (!pairLevels.empty())
+                    {
+                        Block& top = pairStack[pairLevels.size() - 1];
+                        for (int r = 0; r < rows; r++)
+                        {
+                            for (int n = 0; n < cols; n++)
+                            {
+                                total[r][n] += top[r][n];
+                            }
+                        }
+                        pairLevels.pop_back();
+                    }
+                }
+                for (int r = 0; r < rows; r++)
+                {
+                    float* c = C + size_t(m0 + r) * N + n0;
+                    for (int n = 0; n < cols; n++)
+                    {
+                        c[n] = mode == ACCUMULATE_FP64 ? float(total64[r][n]) : total[r][n];
+                    }
+                }
+            }
+        }
+    });
+}
+
+void CpuMatmulDouble(const double* A, const double* B, double* C, int M, int N, int K)
+{
+    // Same blocking as CpuMatmulFloat: four rows of C share every row segment of
+    // B loaded, and the C segment stays in L1 while K is swept.
+    const int rowBlocks = (M + GEMM_BLOCK_M - 1) / GEMM_BLOCK_M;
+    ParallelFor(0, rowBlocks, [=](int blockBegin, int blockEnd) {
+        for (int block = blockBegin; block < blockEnd; block++)
+        {
+            const int m0 = block * GEMM_BLOCK_M;
+            const int rows = std::min(GEMM_BLOCK_M, M - m0);
+            for (int n0 = 0; n0 < N; n0 += GEMM_BLOCK_N)
+            {
+                const int cols = std::min(GEMM_BLOCK_N, N - n0);
+                for (int r = 0; r < rows; r++)
+                {
+                    std::fill(C + size_t(m0 + r) * N + n0, C + size_t(m0 + r) * N + n0 + cols, 0.0);
+                }
+                for (int k = 0; k < K; k++)
+                {
+                    const double* b = B + size_t(k) * N + n0;
+                    for (int r = 0; r < rows; r++)
+                    {
+                        const double a = A[size_t(m0 + r) * K + k];
+                        double* c = C + size_t(m0 + r) * N + n0;
+                        int n = 0;
+#if defined(__AVX2__)
+                        __m256d va = _mm256_set1_pd(a);
+                        for (; n + 4 <= cols; n += 4)
+                        {
+                            _mm256_storeu_pd(c + n, _mm256_fmadd_pd(va, _mm256_loadu_pd(b + n), _mm256_loadu_pd(c + n)));
+                        }
+#endif
+                        for (; n < cols; n++)
+                        {
+                            c[n] += a * b[n];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+void TransposeMatrix(const float* src, int rows, int cols, float* dst)
+{
+    const int block = 32;
+    for (int r0 = 0; r0 < rows; r0 += block)
+    {
+        const int rEnd = std::min(rows, r0 + block);
+        for (int c0 = 0; c0 < cols; c0 += block)
+        {
+            const int cEnd = std::min(cols, c0 + block);
+            for (int r = r0; r < rEnd; r++)
+            {
+                for (int c = c0; c < cEnd; c++)
+                {
+                    dst[size_t(c) * rows + r] = src[size_t(r) * cols + c];
+                }
+            }
+        }
+    }
+}
+
+void CpuMatmulTrans(const float* A, int lda, bool transA, const float* B, int ldb, bool transB,
+                    float* C, int ldc, int M, int N, int K)
+{
+    const int rowBlocks = (M + GEMM_BLOCK_M - 1) / GEMM_BLOCK_M;
+    ParallelFor(0, rowBlocks, [=](int blockBegin, int blockEnd) {
+        // Each thread packs its own B panel, which is amortized over all of its
+        // row blocks, instead of synchronizing with the other threads.
+        std::vector<float> panelB(size_t(ACCUMULATE_BLOCK_K) * GEMM_BLOCK_N);
+        float panelA[ACCUMULATE_BLOCK_K][GEMM_BLOCK_M];
+        for (int block = blockBegin; block < blockEnd; block++)
+        {
+            const int m0 = block * GEMM_BLOCK_M;
+            const int rows = std::min(GEMM_BLOCK_M, M - m0);
+            for (int r = 0; r < rows; r++)
+            {
+                std::fill(C + size_t(m0 + r) * ldc, C + size_t(m0 + r) * ldc + N, 0.0f);
+            }
+        }
+
+        for (int n0 = 0; n0 < N; n0 += GEMM_BLOCK_N)
+        {
+            const int cols = std::min(GEMM_BLOCK_N, N - n0);
+            for (int k0 = 0; k0 < K; k0 += ACCUMULATE_BLOCK_K)
+            {
+                const int depth = std::min(ACCUMULATE_BLOCK_K, K - k0);
+                // Pack op(B)[k0 : k0 + depth, n0 : n0 + cols] as rows of K, reading
+                // along the contiguous dimension of either layout.
+                if (transB)
+                {
+                    for (int n = 0; n < cols; n++)
+                    {
+                        const float* src = B + size_t(n0 + n) * ldb + k0;
+                        for (int k = 0; k < depth; k++)
+                        {
+                            panelB[size_t(k) * GEMM_BLOCK_N + n] = src[k];
+                        }
+                    }
+                }
+                else
+                {
+                    for (int k = 0; k < depth; k++)
+                    {
+                        std::copy(B + size_t(k0 + k) * ldb + n0, B + size_t(k0 + k) * ldb + n0 + cols, &panelB[size_t(k) * GEMM_BLOCK_N]);
+                    }
+                }
+
+                for (int block = blockBegin; block < blockEnd; block++)
+                {
+                    const int m0 = block * GEMM_BLOCK_M;
+                    const int rows = std::min(GEMM_BLOCK_M, M - m0);
+                    // Pack op(A)[m0 : m0 + rows, k0 : k0 + depth] k-major.
+                    for (int k = 0; k < depth; k++)
+                    {
+                        for (int r = 0; r < rows; r++)
+                        {
+                            panelA[k][r] = transA ? A[size_t(k0 + k) * lda + m0 + r] : A[size_t(m0 + r) * lda + k0 + k];
+                        }
+                    }
+
+                    float* c[GEMM_BLOCK_M];
+                    for (int r = 0; r < rows; r++)
+                    {
+                        c[r] = C + size_t(m0 + r) * ldc + n0;
+                    }
+                    MultiplyAddPanel(panelA, rows, depth, panelB.data(), GEMM_BLOCK_N, c, cols);
+                }
+            }
+        }
+    });
+}
+
+namespace
+{
+    // Columns of C per block of CpuGemvVectorMatrix: eight AVX registers of sums.
+    const int GEMV_BLOCK_N = 64;
+}
+
+void CpuGemvVectorMatrix(const float* A, const float* B, float* C, int M, int N, int K)
+{
+    const int blocks = (N + GEMV_BLOCK_N - 1) / GEMV_BLOCK_N;
+    ParallelFor(0, blocks, [=](int blockBegin, int blockEnd) {
+        for (int m = 0; m < M; m++)
+        {
+            const float* a = A + size_t(m) * K;
+            for (int block = blockBegin; block < blockEnd; block++)
+            {
+                const int n0 = block * GEMV_BLOCK_N;
+                const int cols = std::min(GEMV_BLOCK_N, N - n0);
+                float* c = C + size_t(m) * N + n0;
+#if defined(__AVX2__)
+                if (cols == GEMV_BLOCK_N)
+                {
+                    __m256 acc[GEMV_BLOCK_N / 8];
+                    for (int j = 0; j < GEMV_BLOCK_N / 8; j++)
+                    {
+                        acc[j] = _mm256_setzero_ps();
+                    }
+                    for (int k = 0; k < K; k++)
+                    {
+                        const float* b = B + size_t(k) * N + n0;
+                        __m256 va = _mm256_set1_ps(a[k]);
+                        for (int j = 0; j < GEMV_BLOCK_N / 8; j++)
+                        {
+                            acc[j] = _mm256_fmadd_ps(va, _mm256_loadu_ps(b + 8 * j), acc[j]);
+                        }
+                    }
+                    for (int j = 0; j < GEMV_BLOCK_N / 8; j++)
+                    {
+                        _mm256_storeu_ps(c + 8 * j, acc[j]);
+                    }
+                    continue;
+                }
+#endif
+                float acc[GEMV_BLOCK_N] = {};
+                for (int k = 0; k < K; k++)
+                {
+                    const float* b = B + size_t(k) * N + n0;
+                    for (int n = 0; n < cols; n++)
+                    {
+                        acc[n] += a[k] * b[n];
+                    }
+                }
+                std::copy(acc, acc + cols, c);
+            }
+        }
+    });
+}
+
+void CpuGemmSmallM(const float* A, const float* B, float* C, int M, int N, int K)
+{
+    // Up to 16 rows of a GEMM_BLOCK_N wide panel of C (16 KB) stay in L1 while K
+    // is swept, so B is streamed from memory exactly once for all of them.
+    const int maxRows = 16;
+    const int panels = (N + GEMM_BLOCK_N - 1) / GEMM_BLOCK_N;
+    ParallelFor(0, panels, [=](int panelBegin, int panelEnd) {
+        float acc[maxRows][GEMM_BLOCK_N];
+        float a[maxRows];
+        for (int panel = panelBegin; panel < panelEnd; panel++)
+        {
+            const int n0 = panel * GEMM_BLOCK_N;
+            const int cols = std::min(GEMM_BLOCK_N, N - n0);
+            for (int m0 = 0; m0 < M; m0 += maxRows)
+            {
+                const int rows = std::min(maxRows, M - m0);
+                for (int r = 0; r < rows; r++)
+                {
+                    std::fill(acc[r], acc[r] + cols, 0.0f);
+                }
+                for (int k = 0; k < K; k++)
+                {
+                    for (int r = 0; r < rows; r++)
+                    {
+                        a[r] = A[size_t(m0 + r) * K + k];
+                    }
+                    MultiplyAddRows(acc, a, rows, B + size_t(k) * N + n0, cols);
+                }
+                for (int r = 0; r < rows; r++)
+                {
+                    std::copy(acc[r], acc[r] + cols, C + size_t(m0 + r) * N + n0);
+                }
+            }
+        }
+    });
+}
+
+void CpuGemvMatrixVector(const float* A, const float* x, float* y, int M, int K)
+{
+    ParallelFor(0, M, [=](int rowBegin, int rowEnd) {
+        for (int m = rowBegin; m < rowEnd; m++)
+        {
+            const float* a = A + size_t(m) * K;
+            int k = 0;
+            float sum = 0.0f;
+#if defined(__AVX2__)
+            // Four independent sums hide the FMA latency.
+            __m256 acc[4] = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+            for (; k + 32 <= K; k += 32)
+            {
+                for (int j = 0; j < 4; j++)
+                {
+                    acc[j] = _mm256_fmadd_ps(_mm256_loadu_ps(a + k + 8 * j), _mm256_loadu_ps(x + k + 8 * j), acc[j]);
+                }
+            }
+            __m256 total = _mm256_add_ps(_mm256_add_ps(acc[0], acc[1]), _mm256_add_ps(acc[2], acc[3]));
+            float lanes[8];
+            _mm256_storeu_ps(lanes, total);
+            for (int i = 0; i < 8; i++)
+            {
+                sum += lanes[i];
+            }
+#endif
+            for (; k < K; k++)
+            {
+                sum += a[k] * x[k];
+            }
+            y[m] = sum;
+        }
+    });
+}
+
+size_t PackedPanelsSize(int K, int N, int panelK, int panelN)
+{
+    const size_t paddedK = size_t(K + panelK - 1) / panelK * panelK;
+    const size_t paddedN = size_t(N + panelN - 1) / panelN * panelN;
+    return paddedK * paddedN;
+}
+
+void PackPanels(const float* B, int K, int N, int panelK, int panelN, float* packed)
+{
+    const int paddedK = (K + panelK - 1) / panelK * panelK;
+    const int panels = (N + panelN - 1) / panelN;
+    for (int p = 0; p < panels; p++)
+    {
+        const int n0 = p * panelN;
+        const int cols = std::min(panelN, N - n0);
+        float* panel = packed + size_t(p) * paddedK * panelN;
+        for (int k = 0; k < paddedK; k++)
+        {
+            float* dst = panel + size_t(k) * panelN;
+            if (k < K)
+            {
+                std::copy(B + size_t(k) * N + n0, B + size_t(k) * N + n0 + cols, dst);
+                std::fill(dst + cols, dst + panelN, 0.0f);
+            }
+            else
+            {
+                std::fill(dst, dst + panelN, 0.0f);
+            }
+        }
+    }
+}
+
+void CpuMatmulPacked(const float* A, const float* packedB, float* C, int M, int N, int K)
+{
+    const int rowBlocks = (M + GEMM_BLOCK_M - 1) / GEMM_BLOCK_M;
+    ParallelFor(0, rowBlocks, [=](int blockBegin, int blockEnd) {
+        float panelA[ACCUMULATE_BLOCK_K][GEMM_BLOCK_M];
+        for (int block = blockBegin; block < blockEnd; block++)
+        {
+            const int m0 = block * GEMM_BLOCK_M;
+            const int rows = std::min(GEMM_BLOCK_M, M - m0);
+            for (int r = 0; r < rows; r++)
+            {
+                std::fill(C + size_t(m0 + r) * N, C + size_t(m0 + r + 1) * N, 0.0f);
+            }
+        }
+
+        for (int n0 = 0; n0 < N; n0 += GEMM_BLOCK_N)
+        {
+            const int cols = std::min(GEMM_BLOCK_N, N - n0);
+            const float* panel = packedB + size_t(n0) * K;
+            for (int k0 = 0; k0 < K; k0 += ACCUMULATE_BLOCK_K)
+            {
+                const int depth = std::min(ACCUMULATE_BLOCK_K, K - k0);
+                for (int block = blockBegin; block < blockEnd; block++)
+                {
+                    const int m0 = block * GEMM_BLOCK_M;
+                    const int rows = std::min(GEMM_BLOCK_M, M - m0);
+                    for (int k = 0; k < depth; k++)
+                    {
+                        for (int r = 0; r < rows; r++)
+                        {
+                            panelA[k][r] = A[size_t(m0 + r) * K + k0 + k];
+                        }
+                    }
+
+                    float* c[GEMM_BLOCK_M];
+                    for (int r = 0; r < rows; r++)
+                    {
+                        c[r] = C + size_t(m0 + r) * N + n0;
+                    }
+                    MultiplyAddPanel(panelA, rows, depth, panel + size_t(k0) * GEMM_BLOCK_N, GEMM_BLOCK_N, c, cols);
+                }
+            }
+        }
+    });
+}
+
+int PaddedLeadingDimension(int cols, int alignment, int alignmentBytes)
+{
+    int ld = (cols + alignment - 1) / alignment * alignment;
+    if ((ld / alignment) * alignmentBytes % 512 == 0)
+    {
+        ld += 128 / alignmentBytes * alignment;
+    }
+    return ld;
+}
+
+int EdgeTileCount(int M, int N, int tileM, int tileN)
+{
+    const int nEdgeTiles = N % tileN != 0 ? M / tileM : 0;
+    const int mEdgeTiles = M % tileM != 0 ? (N + tileN - 1) / tileN : 0;
+    return nEdgeTiles + mEdgeTiles;
+}
+
+void EdgeTileOrigin(int index, int M, int N, int tileM, int tileN, int& row0, int& col0)
+{
+    const int nEdgeTiles = N % tileN != 0 ? M / tileM : 0;
+    if (index < nEdgeTiles)
+    {
+        row0 = index * tileM;
+        col0 = N / tileN * tileN;
+    }
+    else
+    {
+        row0 = M / tileM * tileM;
+        col0 = (index - nEdgeTiles) * tileN;
+    }
+}
+
+namespace
+{
+    // C[m0 : m0 + rows, n0 : n0 + cols] = A[m0 : m0 + rows, :] * B[:, n0 : n0 + cols].
+    // EDGE = false is only used for full tiles, whose width is a multiple of 8,
+    // so the vectorized build drops the remainder loop.
+    template <bool EDGE>
+    void MultiplyTile(const float* A, const float* B, float* C, int N, int K, int m0, int n0, int rows, int cols)
+    {
+        for (int r = 0; r < rows; r++)
+        {
+            std::fill(C + size_t(m0 + r) * N + n0, C + size_t(m0 + r) * N + n0 + cols, 0.0f);
+        }
+        for (int k = 0; k < K; k++)
+        {
+            const float* b = B + size_t(k) * N + n0;
+            for (int r = 0; r < rows; r++)
+            {
+                const float a = A[size_t(m0 + r) * K + k];
+                float* c = C + size_t(m0 + r) * N + n0;
+                int n = 0;
+#if defined(__AVX2__)
+                __m256 va = _mm256_set1_ps(a);
+                for (; n + 8 <= cols; n += 8)
+                {
+                    _mm256_storeu_ps(c + n, _mm256_fmadd_ps(va, _mm256_loadu_ps(b + n), _mm256_loadu_ps(c + n)));
+                }
+                if (!EDGE)
+                {
+                    continue;
+                }
+#endif
+                for (; n < cols; n++)
+                {
+                    c[n] += a * b[n];
+                }
+            }
+        }
+    }
+}
+
+void CpuMatmulSplitEdges(const float* A, const float* B, float* C, int M, int N, int K, int tileM, int tileN)
+{
+    const int fullTilesX = N / tileN;
+    const int fullTiles = (M / tileM) * fullTilesX;
+    ParallelFor(0, fullTiles, [=](int tileBegin, int tileEnd) {
+        for (int tile = tileBegin; tile < tileEnd; tile++)
+        {
+            MultiplyTile<false>(A, B, C, N, K, tile / fullTilesX * tileM, tile % fullTilesX * tileN, tileM, tileN);
+        }
+    });
+    ParallelFor(0, EdgeTileCount(M, N, tileM, tileN), [=](int tileBegin, int tileEnd) {
+        for (int tile = tileBegin; tile < tileEnd; tile++)
+        {
+            int m0;
+            int n0;
+            EdgeTileOrigin(tile, M, N, tileM, tileN, m0, n0);
+            MultiplyTile<true>(A, B, C, N, K, m0, n0, std::min(tileM, M - m0), std::min(tileN, N - n0));
+        }
+    });
+}
+
+namespace
+{
+    // Copies rows [rowBegin, rowEnd) of the depth columns of A at (m0, k0) into
+    // tile, whose rows are tileK floats apart.
+    inline void StageATile(const float* A, int K, int m0, int k0, int rowBegin, int rowEnd, int depth, int tileK, float* tile)
+    {
+        for (int r = rowBegin; r < rowEnd; r++)
+        {
+            const float* a = A + size_t(m0 + r) * K + k0;
+            std::copy(a, a + depth, tile + size_t(r) * tileK);
+        }
+    }
+
+    // c[0, count) += a * b[0, count).
+    inline void MultiplyAddRow(float* c, float a, const float* b, int count)
+    {
+        int n = 0;
+#if defined(__AVX2__)
+        __m256 va = _mm256_set1_ps(a);
+        for (; n + 8 <= count; n += 8)
+        {
+            _mm256_storeu_ps(c + n, _mm256_fmadd_ps(va, _mm256_loadu_ps(b + n), _mm256_loadu_ps(c + n)));
+        }
+#endif
+        for (; n < count; n++)
+        {
+            c[n] += a * b[n];
+        }
+    }
+}
+
+void CpuMatmulPrefetch(const float* A, const float* B, float* C, int M, int N, int K,
+                       int tileM, int tileN, int tileK, bool doubleBuffer)
+{
+    const int tilesX = (N + tileN - 1) / tileN;
+    const int tiles = (M + tileM - 1) / tileM * tilesX;
+    const int steps = (K + tileK - 1) / tileK;
+    ParallelFor(0, tiles, [=](int tileBegin, int tileEnd) {
+        std::vector<float> buffers(size_t(2) * tileM * tileK);
+        for (int tile = tileBegin; tile < tileEnd; tile++)
+        {
+            const int m0 = tile / tilesX * tileM;
+            const int n0 = tile % tilesX * tileN;
+            const int rows = std::min(tileM, M - m0);
+            const int cols = std::min(tileN, N - n0);
+            for (int r = 0; r < rows; r++)
+            {
+                std::fill(C + size_t(m0 + r) * N + n0, C + size_t(m0 + r) * N + n0 + cols, 0.0f);
+            }
+
+            float* current = buffers.data();
+            float* next = current + size_t(tileM) * tileK;
+            if (doubleBuffer && steps > 0)
+            {
+                StageATile(A, K, m0, 0, 0, rows, std::min(tileK, K), tileK, current);
+            }
+            for (int s = 0; s < steps; s++)
+            {
+                const int k0 = s * tileK;
+                const int depth = std::min(tileK, K - k0);
+                const int nextDepth = std::min(tileK, K - k0 - tileK);
+                if (!doubleBuffer)
+                {
+                    StageATile(A, K, m0, k0, 0, rows, depth, tileK, current);
+                }
+                for (int k = 0; k < depth; k++)
+                {
+                    if (doubleBuffer && nextDepth > 0)
+                    {
+                        // Spread the copy of the next block over the k steps of this one.
+                        StageATile(A, K, m0, k0 + tileK, k * rows / depth, (k + 1) * rows / depth, nextDepth, tileK, next);
+                    }
+                    const float* b = B + size_t(k0 + k) * N + n0;
+                    for (int r = 0; r < rows; r++)
+                    {
+                        MultiplyAddRow(C + size_t(m0 + r) * N + n0, current[size_t(r) * tileK + k], b, cols);
+                    }
+                }
+                if (doubleBuffer)
+                {
+                    std::swap(current, next);
+                }
+            }
+        }
+    });
+}
+
+void CpuMatmulStreamK(const float* A, const float* B, float* C, int M, int N, int K,
+                      int tileM, int tileN, int tileK, int workers, bool streamK)
+{
+    const int tilesX = (N + tileN - 1) / tileN;
+    const int tiles = (M + tileM - 1) / tileM * tilesX;
+    const int itersPerTile = (K + tileK - 1) / tileK;
+    if (tiles == 0 || itersPerTile == 0)
+    {
+        return;
+    }
+    const int totalIters = tiles * itersPerTile;
+    // Data-parallel shares are rounded up to whole tiles.
+    const int unit = streamK ? 1 : itersPerTile;
+    const int itersPerWorker = (totalIters / unit + workers - 1) / workers * unit;
+    const size_t tileSize = size_t(tileM) * tileN;
+    // Slots 2w and 2w + 1 hold the partial first and last tile of worker w.
+    std::vector<float> workspace(2 * workers * tileSize);
+    auto workspaceSlot = [=](int worker, int tile) {
+        return 2 * worker + (tile == worker * itersPerWorker / itersPerTile ? 0 : 1);
+    };
+
+    std::vector<std::thread> threads;
+    for (int worker = 0; worker < workers; worker++)
+    {
+        threads.emplace_back([=, &workspace]() {
+            std::vector<float> acc(tileSize);
+            int iter = worker * itersPerWorker;
+            const int iterEnd = std::min(iter + itersPerWorker, totalIters);
+            while (iter < iterEnd)
+            {
+                const int tile = iter / itersPerTile;
+                const int kBegin = iter - tile * itersPerTile;
+                const int kEnd = std::min(itersPerTile, kBegin + iterEnd - iter);
+                const int m0 = tile / tilesX * tileM;
+                const int n0 = tile % tilesX * tileN;
+                const int rows = std::min(tileM, M - m0);
+                const int cols = std::min(tileN, N - n0);
+
+                std::fill(acc.begin(), acc.end(), 0.0f);
+                for (int k = kBegin * tileK; k < std::min(K, kEnd * tileK); k++)
+                {
+                    const float* b = B + size_t(k) * N + n0;
+                    for (int r = 0; r < rows; r++)
+                    {
+                        MultiplyAddRow(&acc[size_t(r) * tileN], A[size_t(m0 + r) * K + k], b, cols);
+                    }
+                }
+
+                const bool wholeTile = kBegin == 0 && kEnd == itersPerTile;
+                for (int r = 0; r < rows; r++)
+                {
+                    float* out = wholeTile ? C + size_t(m0 + r) * N + n0
+                                           : &workspace[workspaceSlot(worker, tile) * tileSize + size_t(r) * tileN];
+                    std::copy(&acc[size_t(r) * tileN], &acc[size_t(r) * tileN] + cols, out);
+                }
+                iter += kEnd - kBegin;
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    // The fix-up: add the partial sums of every tile that was split between workers.
+    ParallelFor(0, tiles, [&](int tileBegin, int tileEnd) {
+        for (int tile = tileBegin; tile < tileEnd; tile++)
+        {
+            const int firstWorker = tile * itersPerTile / itersPerWorker;
+            const int lastWorker = ((tile + 1) * itersPerTile - 1) / itersPerWorker;
+            if (firstWorker == lastWorker)
+            {
+                continue;
+            }
+            const int m0 = tile / tilesX * tileM;
+            const int n0 = tile % tilesX * tileN;
+            const int rows = std::min(tileM, M - m0);
+            const int cols = std::min(tileN, N - n0);
+            for (int r = 0; r < rows; r++)
+            {
+                float* c = C + size_t(m0 + r) * N + n0;
+                std::fill(c, c + cols, 0.0f);
+                for (int worker = firstWorker; worker <= lastWorker; worker++)
+                {
+                    const float* partial = &workspace[workspaceSlot(worker, tile) * tileSize + size_t(r) * tileN];
+                    for (int n = 0; n < cols; n++)
+                    {
+                        c[n] += partial[n];
+                    }
+                }
+            }
+        }
+    });
+}
+
+const char* TileRasterName(TileRaster raster)
+{
+    switch (raster)
+    {
+    case RASTER_ROW_MAJOR:
+        return "row-major";
+    case RASTER_COLUMN_MAJOR:
+        return "column-major";
+    case RASTER_GROUPED_M:
+        return "grouped-M";
+    case RASTER_MORTON:
+        return "Morton";
+    case RASTER_HILBERT:
+        return "Hilbert";
+    }
+    return "unknown";
+}
+
+namespace
+{
+    // Side of the power-of-two square covering a tilesX x tilesY grid.
+    int RasterSide(int tilesX, int tilesY)
+    {
+        int side = 1;
+        while (side < tilesX || side < tilesY)
+        {
+            side *= 2;
+        }
+        return side;
+    }
+
+    // The even bits of v packed into the low half.
+    inline int CompactBits(unsigned v)
+    {
+        v &= 0x55555555u;
+        v = (v | (v >> 1)) & 0x33333333u;
+        v = (v | (v >> 2)) & 0x0f0f0f0fu;
+        v = (v | (v >> 4)) & 0x00ff00ffu;
+        v = (v | (v >> 8)) & 0x0000ffffu;
+        return int(v);
+    }
+}
+
+int TileRasterCount(TileRaster raster, int tilesX, int tilesY)
+{
+    if (raster == RASTER_MORTON || raster == RASTER_HILBERT)
+    {
+        const int side = RasterSide(tilesX, tilesY);
+        return side * side;
+    }
+    return tilesX * tilesY;
+}
+
+bool TileRasterTile(TileRaster raster, int index, int tilesX, int tilesY, int groupM, int& x, int& y)
+{
+    switch (raster)
+    {
+    case RASTER_ROW_MAJOR:
+        x = index % tilesX;
+        y = index / tilesX;
+        break;
+    case RASTER_COLUMN_MAJOR:
+        x = index / tilesY;
+        y = index % tilesY;
+        break;
+    case RASTER_GROUPED_M:
+    {
+        const int band = index / (groupM * tilesX);
+        const int rows = std::min(groupM, tilesY - band * groupM);
+        const int inBand = index - band * groupM * tilesX;
+        x = inBand / rows;
+        y = band * groupM + inBand % rows;
+        break;
+    }
+    case RASTER_MORTON:
+        x = CompactBits(unsigned(index));
+        y = CompactBits(unsigned(index) >> 1);
+        break;
+    case RASTER_HILBERT:
+    {
+        // The classic d2xy walk, rotating each quadrant into place.
+        const int side = RasterSide(tilesX, tilesY);
+        int t = index;
+        x = 0;
+        y = 0;
+        for (int s = 1; s < side; s *= 2)
+        {
+            const int rx = 1 & (t / 2);
+            const int ry = 1 & (t ^ rx);
+            if (ry == 0)
+            {
+                if (rx == 1)
+                {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+                std::swap(x, y);
+            }
+            x += s * rx;
+            y += s * ry;
+            t /= 4;
+        }
+        break;
+    }
+    }
+    return x < tilesX && y < tilesY;
+}
+
+void CpuMatmulRaster(const float* A, const float* B, float* C, int M, int N, int K,
+                     int tileM, int tileN, TileRaster raster, int groupM)
+{
+    const int tilesX = (N + tileN - 1) / tileN;
+    const int tilesY = (M + tileM - 1) / tileM;
+    const int count = TileRasterCount(raster, tilesX, tilesY);
+    const int workers = std::max(1, int(std::thread::hardware_concurrency()));
+    std::atomic<int> next(0);
+    std::vector<std::thread> threads;
+    for (int worker = 0; worker < workers; worker++)
+    {
+        threads.emplace_back([&]() {
+            for (int index = next++; index < count; index = next++)
+            {
+                int x;
+                int y;
+                if (TileRasterTile(raster, index, tilesX, tilesY, groupM, x, y))
+                {
+                    MultiplyTile<true>(A, B, C, N, K, y * tileM, x * tileN,
+                                       std::min(tileM, M - y * tileM), std::min(tileN, N - x * tileN));
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+int ConvOutputHeight(const ConvShape& shape)
+{
+    return (shape.height + 2 * shape.pad - shape.kernelH) / shape.stride + 1;
+}
+
+int ConvOutputWidth(const ConvShape& shape)
+{
+    return (shape.width + 2 * shape.pad - shape.kernelW) / shape.stride + 1;
+}
+
+int ConvGemmK(const ConvShape& shape)
+{
+    return shape.kernelH * shape.kernelW * shape.channels;
+}
+
+namespace
+{
+    // Input index of tap (c, kh, kw) of output pixel (n, oh, ow), or -1 where
+    // the tap falls in the padding.
+    inline int ConvInputIndex(const ConvShape& shape, int n, int oh, int ow, int c, int kh, int kw)
+    {
+        const int ih = oh * shape.stride - shape.pad + kh;
+        const int iw = ow * shape.stride - shape.pad + kw;
+        if (ih < 0 || ih >= shape.height || iw < 0 || iw >= shape.width)
+        {
+            return -1;
+        }
+        return shape.nchw ? ((n * shape.channels + c) * shape.height + ih) * shape.width + iw
+                          : ((n * shape.height + ih) * shape.width + iw) * shape.channels + c;
+    }
+
+    // Output pixels multiplied together by CpuConv2D, so each row of the
+    // weights loaded serves all of them.
+    const int CONV_BLOCK_PIXELS = 4;
+}
+
+void Im2Col(const float* input, const ConvShape& shape, int ldk, float* A)
+{
+    const int outH = ConvOutputHeight(shape);
+    const int outW = ConvOutputWidth(shape);
+    const int K = ConvGemmK(shape);
+    ParallelFor(0, shape.batch * outH * outW, [&](int rowBegin, int rowEnd) {
+        for (int row = rowBegin; row < rowEnd; row++)
+        {
+            const int n = row / (outH * outW);
+            const int oh = row / outW % outH;
+            const int ow = row % outW;
+            float* a = A + size_t(row) * ldk;
+            for (int k = 0; k < K; k++)
+            {
+                const int c = shape.nchw ? k / (shape.kernelH * shape.kernelW) : k % shape.channels;
+                const int kh = shape.nchw ? k / shape.kernelW % shape.kernelH : k / shape.channels / shape.kernelW;
+                const int kw = shape.nchw ? k % shape.kernelW : k / shape.channels % shape.kernelW;
+                const int index = ConvInputIndex(shape, n, oh, ow, c, kh, kw);
+                a[k] = index >= 0 ? input[index] : 0.0f;
+            }
+            std::fill(a + K, a + ldk, 0.0f);
+        }
+    });
+}
+
+void CpuConv2D(const float* input, const float* weights, float* output, const ConvShape& shape)
+{
+    const int outH = ConvOutputHeight(shape);
+    const int outW = ConvOutputWidth(shape);
+    const int plane = outH * outW;
+    const int OC = shape.outChannels;
+    const int M = shape.batch * plane;
+    const int blocks = (M + CONV_BLOCK_PIXELS - 1) / CONV_BLOCK_PIXELS;
+    ParallelFor(0, blocks, [&](int blockBegin, int blockEnd) {
+        std::vector<float> acc(size_t(CONV_BLOCK_PIXELS) * OC);
+        for (int block = blockBegin; block < blockEnd; block++)
+        {
+            const int row0 = block * CONV_BLOCK_PIXELS;
+            const int pixels = std::min(CONV_BLOCK_PIXELS, M - row0);
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            for (int c = 0; c < shape.channels; c++)
+            {
+                for (int kh = 0; kh < shape.kernelH; kh++)
+                {
+                    for (int kw = 0; kw < shape.kernelW; kw++)
+                    {
+                        const int k = shape.nchw ? (c * shape.kernelH + kh) * shape.kernelW + kw
+                                                 : (kh * shape.kernelW + kw) * shape.channels + c;
+                        const float* b = weights + size_t(k) * OC;
+                        for (int p = 0; p < pixels; p++)
+                        {
+                            const int row = row0 + p;
+                            const int index = ConvInputIndex(shape, row / plane, row / outW % outH, row % outW, c, kh, kw);
+                            if (index >= 0)
+                            {
+                                MultiplyAddRow(&acc[size_t(p) * OC], input[index], b, OC);
+                            }
+                        }
+                    }
+                }
+            }
+            for (int p = 0; p < pixels; p++)
+            {
+                const int row = row0 + p;
+                if (shape.nchw)
+                {
+                    for (int oc = 0; oc < OC; oc++)
+                    {
+                        output[(size_t(row / plane) * OC + oc) * plane + row % plane] = acc[size_t(p) * OC + oc];
+                    }
+                }
+                else
+                {
+                    std::copy(&acc[size_t(p) * OC], &acc[size_t(p) * OC] + OC, output + size_t(row) * OC);
+                }
+            }
+        }
+    });
+}
+
+namespace
+{
+    // Query rows and keys per block of CpuAttention. One block of scores is
+    // 16 x 64 floats, so it stays in L1 next to the query rows.
+    const int ATTENTION_BLOCK_M = 16;
+    const int ATTENTION_BLOCK_N = 64;
+
+    inline float DotFloat(const float* a, const float* b, int count)
+    {
+        int k = 0;
+        float sum = 0.0f;
+#if defined(__AVX2__)
+        __m256 acc = _mm256_setzero_ps();
+        for (; k + 8 <= count; k += 8)
+        {
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k), acc);
+        }
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+        sum = _mm_cvtss_f32(half);
+#endif
+        for (; k < count; k++)
+        {
+            sum += a[k] * b[k];
+        }
+        return sum;
+    }
+}
+
+void CpuAttentionReference(const float* Q, const float* K, const float* V, double* O, int M, int keys, int headDim)
+{
+    const double scale = 1.0 / std::sqrt(double(headDim));
+    ParallelFor(0, M, [=](int rowBegin, int rowEnd) {
+        std::vector<double> scores(keys);
+        for (int m = rowBegin; m < rowEnd; m++)
+        {
+            double rowMax = -HUGE_VAL;
+            for (int j = 0; j < keys; j++)
+            {
+                double s = 0.0;
+                for (int d = 0; d < headDim; d++)
+                {
+                    s += double(Q[size_t(m) * headDim + d]) * K[size_t(j) * headDim + d];
+                }
+                scores[j] = s * scale;
+                rowMax = std::max(rowMax, scores[j]);
+            }
+            double rowSum = 0.0;
+            for (int j = 0; j < keys; j++)
+            {
+                scores[j] = std::exp(scores[j] - rowMax);
+                rowSum += scores[j];
+            }
+            double* o = O + size_t(m) * headDim;
+            std::fill(o, o + headDim, 0.0);
+            for (int j = 0; j < keys; j++)
+            {
+                for (int d = 0; d < headDim; d++)
+                {
+                    o[d] += scores[j] / rowSum * V[size_t(j) * headDim + d];
+                }
+            }
+        }
+    });
+}
+
+void CpuAttention(const float* Q, const float* K, const float* V, float* O, int M, int keys, int headDim)
+{
+    const float scale = 1.0f / std::sqrt(float(headDim));
+    const int blocks = (M + ATTENTION_BLOCK_M - 1) / ATTENTION_BLOCK_M;
+    ParallelFor(0, blocks, [=](int blockBegin, int blockEnd) {
+        std::vector<float> q(size_t(ATTENTION_BLOCK_M) * headDim);
+        std::vector<float> acc(size_t(ATTENTION_BLOCK_M) * headDim);
+        float scores[ATTENTION_BLOCK_M][ATTENTION_BLOCK_N];
+        float rowMax[ATTENTION_BLOCK_M];
+        float rowSum[ATTENTION_BLOCK_M];
+        for (int block = blockBegin; block < blockEnd; block++)
+        {
+            const int row0 = block * ATTENTION_BLOCK_M;
+            const int rows = std::min(ATTENTION_BLOCK_M, M - row0);
+            for (size_t i = 0; i < size_t(rows) * headDim; i++)
+            {
+                q[i] = Q[size_t(row0) * headDim + i] * scale;
+            }
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            std::fill(rowMax, rowMax + rows, -HUGE_VALF);
+            std::fill(rowSum, rowSum + rows, 0.0f);
+            for (int key0 = 0; key0 < keys; key0 += ATTENTION_BLOCK_N)
+            {
+                const int cols = std::min(ATTENTION_BLOCK_N, keys - key0);
+                for (int r = 0; r < rows; r++)
+                {
+                    for (int j = 0; j < cols; j++)
+                    {
+                        scores[r][j] = DotFloat(&q[size_t(r) * headDim], K + size_t(key0 + j) * headDim, headDim);
+                    }
+                }
+                // Online softmax: O and the row sum so far are rescaled by how much
+                // the running maximum grew, then the block's keys are added.
+                for (int r = 0; r < rows; r++)
+                {
+                    const float blockMax = std::max(rowMax[r], *std::max_element(scores[r], scores[r] + cols));
+                    const float correction = std::exp(rowMax[r] - blockMax);
+                    float* o = &acc[size_t(r) * headDim];
+                    rowSum[r] *= correction;
+                    for (int d = 0; d < headDim; d++)
+                    {
+                        o[d] *= correction;
+                    }
+                    for (int j = 0; j < cols; j++)
+                    {
+                        const float p = std::exp(scores[r][j] - blockMax);
+                        rowSum[r] += p;
+                        MultiplyAddRow(o, p, V + size_t(key0 + j) * headDim, headDim);
+                    }
+                    rowMax[r] = blockMax;
+                }
+            }
+            for (int r = 0; r < rows; r++)
+            {
+                for (int d = 0; d < headDim; d++)
+                {
+                    O[size_t(row0 + r) * headDim + d] = acc[size_t(r) * headDim + d] / rowSum[r];
+                }
+            }
+        }
+    });
+}
+
+void CpuAttentionUnfused(const float* Q, const float* K, const float* V, float* O, int M, int keys, int headDim)
+{
+    std::vector<float> transposedK(size_t(headDim) * keys);
+    TransposeMatrix(K, keys, headDim, transposedK.data());
+    std::vector<float> scores(size_t(M) * keys);
+    CpuMatmulFloat(Q, transposedK.data(), scores.data(), M, keys, headDim, ACCUMULATE_NAIVE);
+    const float scale = 1.0f / std::sqrt(float(headDim));
+    ParallelFor(0, M, [&](int rowBegin, int rowEnd) {
+        for (int m = rowBegin; m < rowEnd; m++)
+        {
+            float* s = &scores[size_t(m) * keys];
+            const float rowMax = *std::max_element(s, s + keys) * scale;
+            float rowSum = 0.0f;
+            for (int j = 0; j < keys; j++)
+            {
+                s[j] = std::exp(s[j] * scale - rowMax);
+                rowSum += s[j];
+            }
+            for (int j = 0; j < keys; j++)
+            {
+                s[j] /= rowSum;
+            }
+        }
+    });
+    CpuMatmulFloat(scores.data(), V, O, M, headDim, keys, ACCUMULATE_NAIVE);
+}
+
+namespace
+{
+    // Sum of values[p] * x[colIdx[p]] over count nonzeros, gathering x with AVX2.
+    inline float SparseDot(const float* values, const int* colIdx, const float* x, int count)
+    {
+        int p = 0;
+        float sum = 0.0f;
+#if defined(__AVX2__)
+        __m256 acc = _mm256_setzero_ps();
+        for (; p + 8 <= count; p += 8)
+        {
+            __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colIdx + p));
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(values + p), _mm256_i32gather_ps(x, index, 4), acc);
+        }
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+        sum = _mm_cvtss_f32(half);
+#endif
+        for (; p < count; p++)
+        {
+            sum += values[p] * x[colIdx[p]];
+        }
+        return sum;
+    }
+
+    // c[0, N) = the product of the nonzeros [begin, end) of A with their rows of B.
+    inline void SparseRowTimesDense(const CsrMatrix& A, int begin, int end, const float* B, float* c, int N)
+    {
+        if (N == 1)
+        {
+            c[0] = SparseDot(A.values.data() + begin, A.colIdx.data() + begin, B, end - begin);
+            return;
+        }
+        std::fill(c, c + N, 0.0f);
+        for (int p = begin; p < end; p++)
+        {
+            MultiplyAddRow(c, A.values[p], B + size_t(A.colIdx[p]) * N, N);
+        }
+    }
+}
+
+void CpuSpmmReference(const CsrMatrix& A, const float* B, double* C, int N)
+{
+    ParallelFor(0, A.rows, [&](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; r++)
+        {
+            double* c = C + size_t(r) * N;
+            std::fill(c, c + N, 0.0);
+            for (int p = A.rowPtr[r]; p < A.rowPtr[r + 1]; p++)
+            {
+                const float* b = B + size_t(A.colIdx[p]) * N;
+                for (int n = 0; n < N; n++)
+                {
+                    c[n] += double(A.values[p]) * b[n];
+                }
+            }
+        }
+    });
+}
+
+void CpuSpmm(const CsrMatrix& A, const float* B, float* C, int N)
+{
+    const int nonZeros = int(A.values.size());
+    const int workers = std::max(1, std::min(nonZeros, int(std::thread::hardware_concurrency())));
+    auto shareBegin = [=](int worker) {
+        return int(int64_t(nonZeros) * worker / workers);
+    };
+    // The row holding nonzero p; empty rows before it are skipped.
+    auto rowOf = [&](int p) {
+        return int(std::upper_bound(A.rowPtr.begin(), A.rowPtr.end(), p) - A.rowPtr.begin()) - 1;
+    };
+
+    // Empty rows belong to no share.
+    ParallelFor(0, A.rows, [&](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; r++)
+        {
+            if (A.rowPtr[r] == A.rowPtr[r + 1])
+            {
+                std::fill(C + size_t(r) * N, C + size_t(r + 1) * N, 0.0f);
+            }
+        }
+    });
+    if (nonZeros == 0)
+    {
+        return;
+    }
+
+    // Slots 2w and 2w + 1 hold the partial first and last row of worker w.
+    std::vector<float> partials(size_t(2) * workers * N);
+    std::vector<std::thread> threads;
+    for (int worker = 0; worker < workers; worker++)
+    {
+        threads.emplace_back([&, worker]() {
+            const int begin = shareBegin(worker);
+            const int end = shareBegin(worker + 1);
+            for (int r = rowOf(begin); r < A.rows && A.rowPtr[r] < end; r++)
+            {
+                const int rowBegin = A.rowPtr[r];
+                const int rowEnd = A.rowPtr[r + 1];
+                if (rowBegin == rowEnd)
+                {
+                    continue;
+                }
+                if (rowBegin >= begin && rowEnd <= end)
+                {
+                    SparseRowTimesDense(A, rowBegin, rowEnd, B, C + size_t(r) * N, N);
+                }
+                else
+                {
+                    float* partial = &partials[size_t(2 * worker + (rowBegin < begin ? 0 : 1)) * N];
+                    SparseRowTimesDense(A, std::max(rowBegin, begin), std::min(rowEnd, end), B, partial, N);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    // The fix-up: a row is split where a share begins inside it, and gets the
+    // sum of the partial rows of every worker whose share overlaps it.
+    int lastSplitRow = -1;
+    for (int worker = 1; worker < workers; worker++)
+    {
+        const int r = rowOf(shareBegin(worker));
+        if (A.rowPtr[r] == shareBegin(worker) || r == lastSplitRow)
+        {
+            continue;
+        }
+        lastSplitRow = r;
+        float* c = C + size_t(r) * N;
+        std::fill(c, c + N, 0.0f);
+        for (int w = 0; w < workers; w++)
+        {
+            const int begin = shareBegin(w);
+            if (begin >= A.rowPtr[r + 1] || shareBegin(w + 1) <= A.rowPtr[r])
+            {
+                continue;
+            }
+            const float* partial = &partials[size_t(2 * w + (A.rowPtr[r] < begin ? 0 : 1)) * N];
+            for (int n = 0; n < N; n++)
+            {
+                c[n] += partial[n];
+            }
+        }
+    }
+}
+
+void CpuSpmmBlockedEll(const BlockedEllMatrix& A, const float* B, float* C, int N)
+{
+    const int blockSize = A.blockSize;
+    const int blockRows = (A.rows + blockSize - 1) / blockSize;
+    ParallelFor(0, blockRows, [&](int blockRowBegin, int blockRowEnd) {
+        for (int br = blockRowBegin; br < blockRowEnd; br++)
+        {
+            const int rows = std::min(blockSize, A.rows - br * blockSize);
+            float* c = C + size_t(br) * blockSize * N;
+            std::fill(c, c + size_t(rows) * N, 0.0f);
+            for (int slot = 0; slot < A.ellCols; slot++)
+            {
+                const size_t block = size_t(br) * A.ellCols + slot;
+                const int k0 = A.blockCols[block] * blockSize;
+                if (k0 < 0)
+                {
+                    break;
+                }
+                const float* values = &A.values[block * blockSize * blockSize];
+                const int depth = std::min(blockSize, A.cols - k0);
+                for (int r = 0; r < rows; r++)
+                {
+                    for (int kk = 0; kk < depth; kk++)
+                    {
+                        MultiplyAddRow(c + size_t(r) * N, values[r * blockSize + kk], B + size_t(k0 + kk) * N, N);
+                    }
+                }
+            }
+        }
+    });
+}
+
+TileMask BuildTileMask(const float* A, const float* B, int M, int N, int K, int tileM, int tileN, int tileK,
+                       bool maskA, bool maskB)
+{
+    TileMask mask = {};
+    mask.tileM = tileM;
+    mask.tileN = tileN;
+    mask.tileK = tileK;
+    mask.tilesM = (M + tileM - 1) / tileM;
+    mask.tilesN = (N + tileN - 1) / tileN;
+    mask.tilesK = (K + tileK - 1) / tileK;
+    mask.wordsK = (mask.tilesK + 31) / 32;
+    mask.bits.assign(size_t(mask.tilesM + mask.tilesN) * mask.wordsK, 0);
+    uint32_t* bitsA = mask.bits.data();
+    uint32_t* bitsB = bitsA + size_t(mask.tilesM) * mask.wordsK;
+    auto set = [&](uint32_t* row, int kTile) { row[kTile / 32] |= 1u << (kTile % 32); };
+
+    ParallelFor(0, mask.tilesM, [&](int tileBegin, int tileEnd) {
+        for (int i = tileBegin; i < tileEnd; i++)
+        {
+            uint32_t* row = bitsA + size_t(i) * mask.wordsK;
+            for (int kt = 0; kt < mask.tilesK; kt++)
+            {
+                const int k0 = kt * tileK;
+                const int depth = std::min(tileK, K - k0);
+                bool occupied = !maskA;
+                for (int r = i * tileM; r < std::min(M, (i + 1) * tileM) && !occupied; r++)
+                {
+                    const float* a = A + size_t(r) * K + k0;
+                    occupied = std::any_of(a, a + depth, [](float value) { return value != 0.0f; });
+                }
+                if (occupied)
+                {
+                    set(row, kt);
+                }
+            }
+        }
+    });
+    ParallelFor(0, mask.tilesN, [&](int tileBegin, int tileEnd) {
+        for (int j = tileBegin; j < tileEnd; j++)
+        {
+            uint32_t* row = bitsB + size_t(j) * mask.wordsK;
+            const int cols = std::min(tileN, N - j * tileN);
+            for (int kt = 0; kt < mask.tilesK; kt++)
+            {
+                bool occupied = !maskB;
+                for (int k = kt * tileK; k < std::min(K, (kt + 1) * tileK) && !occupied; k++)
+                {
+                    const float* b = B + size_t(k) * N + size_t(j) * tileN;
+                    occupied = std::any_of(b, b + cols, [](float value) { return value != 0.0f; });
+                }
+                if (occupied)
+                {
+                    set(row, kt);
+                }
+            }
+        }
+    });
+    return mask;
+}
+
+bool TileMaskOccupied(const TileMask& mask, int tileRow, int tileCol, int kTile)
+{
+    const uint32_t a = mask.bits[size_t(tileRow) * mask.wordsK + kTile / 32];
+    const uint32_t b = mask.bits[size_t(mask.tilesM + tileCol) * mask.wordsK + kTile / 32];
+    return ((a & b) >> (kTile % 32) & 1) != 0;
+}
+
+std::vector<uint32_t> OccupiedTiles(const TileMask& mask)
+{
+    std::vector<uint32_t> tiles;
+    for (int i = 0; i < mask.tilesM; i++)
+    {
+        const uint32_t* a = &mask.bits[size_t(i) * mask.wordsK];
+        for (int j = 0; j < mask.tilesN; j++)
+        {
+            const uint32_t* b = &mask.bits[size_t(mask.tilesM + j) * mask.wordsK];
+            for (int w = 0; w < mask.wordsK; w++)
+            {
+                if (a[w] & b[w])
+                {
+                    tiles.push_back(uint32_t(j) | uint32_t(i) << 16);
+                    break;
+                }
+            }
+        }
+    }
+    return tiles;
+}
+
+long long OccupiedTileSteps(const TileMask& mask)
+{
+    long long steps = 0;
+    for (int i = 0; i < mask.tilesM; i++)
+    {
+        for (int j = 0; j < mask.tilesN; j++)
+        {
+            for (int kt = 0; kt < mask.tilesK; kt++)
+            {
+                steps += TileMaskOccupied(mask, i, j, kt) ? 1 : 0;
+            }
+        }
+    }
+    return steps;
+}
+
+void CpuMatmulBlockSparse(const float* A, const float* B, float* C, int M, int N, int K, const TileMask& mask)
+{
+    ParallelFor(0, M, [=](int rowBegin, int rowEnd) {
+        std::fill(C + size_t(rowBegin) * N, C + size_t(rowEnd) * N, 0.0f);
+    });
+    const std::vector<uint32_t> tiles = OccupiedTiles(mask);
+    const int tileM = mask.tileM;
+    const int tileN = mask.tileN;
+    ParallelFor(0, int(tiles.size()), [&](int tileBegin, int tileEnd) {
+        std::vector<float> acc(size_t(tileM) * tileN);
+        for (int t = tileBegin; t < tileEnd; t++)
+        {
+            const int i = int(tiles[t] >> 16);
+            const int j = int(tiles[t] & 0xffff);
+            const int m0 = i * tileM;
+            const int n0 = j * tileN;
+            const int rows = std::min(tileM, M - m0);
+            const int cols = std::min(tileN, N - n0);
+
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            for (int kt = 0; kt < mask.tilesK; kt++)
+            {
+                if (!TileMaskOccupied(mask, i, j, kt))
+                {
+                    continue;
+                }
+                for (int k = kt * mask.tileK; k < std::min(K, (kt + 1) * mask.tileK); k++)
+                {
+                    const float* b = B + size_t(k) * N + n0;
+                    for (int r = 0; r < rows; r++)
+                    {
+                        MultiplyAddRow(&acc[size_t(r) * tileN], A[size_t(m0 + r) * K + k], b, cols);
+                    }
+                }
+            }
+            for (int r = 0; r < rows; r++)
+            {
+                std::copy(&acc[size_t(r) * tileN], &acc[size_t(r) * tileN] + cols, C + size_t(m0 + r) * N + n0);
+            }
+        }
+    });
+}
+
+std::vector<GroupedGemmProblem> GroupedGemmProblems(const std::vector<int>& rows, int K)
+{
+    std::vector<GroupedGemmProblem> problems;
+    int rowOffset = 0;
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        problems.push_back({ rowOffset, rows[i], int(i) * K, 0 });
+        rowOffset += rows[i];
+    }
+    return problems;
+}
+
+std::vector<int> RandomExpertRows(int tokens, int experts, unsigned seed)
+{
+    std::mt19937 generator(seed);
+    // Exponential weights: a few popular experts and a long tail.
+    std::exponential_distribution<double> popularity(1.0);
+    std::vector<double> weights(experts);
+    for (double& weight : weights)
+    {
+        weight = popularity(generator);
+    }
+    std::discrete_distribution<int> route(weights.begin(), weights.end());
+    std::vector<int> rows(experts);
+    for (int t = 0; t < tokens; t++)
+    {
+        rows[route(generator)]++;
+    }
+    return rows;
+}
+
+std::vector<uint32_t> GroupedGemmTiles(const std::vector<GroupedGemmProblem>& problems, int N, int tileM, int tileN)
+{
+    std::vector<uint32_t> table;
+    const int tilesX = (N + tileN - 1) / tileN;
+    for (size_t i = 0; i < problems.size(); i++)
+    {
+        const int tilesY = (problems[i].rows + tileM - 1) / tileM;
+        for (int y = 0; y < tilesY; y++)
+        {
+            for (int x = 0; x < tilesX; x++)
+            {
+                table.push_back(uint32_t(i));
+                table.push_back(uint32_t(x) | uint32_t(y) << 16);
+            }
+        }
+    }
+    return table;
+}
+
+namespace
+{
+    const int GROUPED_TILE_M = 32;
+    const int GROUPED_TILE_N = 128;
+
+    // The tiles [begin, end) of one thread. The owner takes them from the front
+    // and thieves from the back.
+    struct TileQueue
+    {
+        std::mutex mutex;
+        int begin = 0;
+        int end = 0;
+    };
+}
+
+void CpuMatmulGrouped(const float* A, const float* B, float* C, const std::vector<GroupedGemmProblem>& problems, int N, int K)
+{
+    const std::vector<uint32_t> table = GroupedGemmTiles(problems, N, GROUPED_TILE_M, GROUPED_TILE_N);
+    const int tiles = int(table.size() / 2);
+    if (tiles == 0)
+    {
+        return;
+    }
+    const int workers = std::max(1, std::min(tiles, int(std::thread::hardware_concurrency())));
+    std::vector<TileQueue> queues(workers);
+    for (int w = 0; w < workers; w++)
+    {
+        queues[w].begin = int(int64_t(tiles) * w / workers);
+        queues[w].end = int(int64_t(tiles) * (w + 1) / workers);
+    }
+
+    // Takes the next tile of the worker's queue, stealing when it is empty.
+    // Returns false once every queue is empty; tiles in flight between two
+    // queues belong to the thief, which is still running.
+    auto takeTile = [&](int worker, int& tile) {
+        TileQueue& own = queues[worker];
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (own.begin < own.end)
+            {
+                tile = own.begin++;
+                return true;
+            }
+        }
+        for (int i = 1; i < workers; i++)
+        {
+            TileQueue& victim = queues[(worker + i) % workers];
+            int stolenBegin;
+            int stolenEnd;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                const int left = victim.end - victim.begin;
+                if (left == 0)
+                {
+                    continue;
+                }
+                stolenEnd = victim.end;
+                stolenBegin = victim.end - (left + 1) / 2;
+                victim.end = stolenBegin;
+            }
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.begin = stolenBegin + 1;
+            own.end = stolenEnd;
+            tile = stolenBegin;
+            return true;
+        }
+        return false;
+    };
+
+    std::vector<std::thread> threads;
+    for (int worker = 0; worker < workers; worker++)
+    {
+        threads.emplace_back([&, worker]() {
+            std::vector<float> acc(size_t(GROUPED_TILE_M) * GROUPED_TILE_N);
+            int tile;
+            while (takeTile(worker, tile))
+            {
+                const GroupedGemmProblem& problem = problems[table[2 * size_t(tile)]];
+                const uint32_t xy = table[2 * size_t(tile) + 1];
+                const int m0 = problem.rowOffset + int(xy >> 16) * GROUPED_TILE_M;
+                const int n0 = int(xy & 0xffff) * GROUPED_TILE_N;
+                const int rows = std::min(GROUPED_TILE_M, problem.rowOffset + problem.rows - m0);
+                const int cols = std::min(GROUPED_TILE_N, N - n0);
+
+                std::fill(acc.begin(), acc.end(), 0.0f);
+                for (int k = 0; k < K; k++)
+                {
+                    const float* b = B + size_t(problem.bRowOffset + k) * N + n0;
+                    for (int r = 0; r < rows; r++)
+                    {
+                        MultiplyAddRow(&acc[size_t(r) * GROUPED_TILE_N], A[size_t(m0 + r) * K + k], b, cols);
+                    }
+                }
+                for (int r = 0; r < rows; r++)
+                {
+                    std::copy(&acc[size_t(r) * GROUPED_TILE_N], &acc[size_t(r) * GROUPED_TILE_N] + cols, C + size_t(m0 + r) * N + n0);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void TriangleTile(int index, int& row, int& col)
+{
+    int i = int((std::sqrt(8.0 * index + 1.0) - 1.0) / 2.0);
+    // The root can be rounded either way for large indices.
+    while (i * (i + 1) / 2 > index)
+    {
+        i--;
+    }
+    while ((i + 1) * (i + 2) / 2 <= index)
+    {
+        i++;
+    }
+    row = i;
+    col = index - i * (i + 1) / 2;
+}
+
+void CpuSyrkReference(const float* A, bool transA, double* C, int N, int K, bool upper)
+{
+    auto opA = [=](int row, int k) { return double(transA ? A[size_t(k) * N + row] : A[size_t(row) * K + k]); };
+    ParallelFor(0, N, [=](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; r++)
+        {
+            for (int c = upper ? r : 0; c < (upper ? N : r + 1); c++)
+            {
+                double sum = 0.0;
+                for (int k = 0; k < K; k++)
+                {
+                    sum += opA(r, k) * opA(c, k);
+                }
+                C[size_t(r) * N + c] = sum;
+            }
+        }
+    });
+}
+
+namespace
+{
+    const int TRIANGLE_TILE = 64;
+}
+
+void CpuSyrk(const float* A, bool transA, float* C, int N, int K, bool upper)
+{
+    // op(A) by rows and by columns, so that both sides of a tile stream
+    // contiguously; one of them is A itself.
+    std::vector<float> transposed(size_t(N) * K);
+    TransposeMatrix(A, transA ? K : N, transA ? N : K, transposed.data());
+    const float* rowsA = transA ? transposed.data() : A;
+    const float* colsA = transA ? A : transposed.data();
+
+    const int tiles = (N + TRIANGLE_TILE - 1) / TRIANGLE_TILE;
+    ParallelFor(0, tiles * (tiles + 1) / 2, [&](int tileBegin, int tileEnd) {
+        std::vector<float> acc(size_t(TRIANGLE_TILE) * TRIANGLE_TILE);
+        for (int t = tileBegin; t < tileEnd; t++)
+        {
+            int i, j;
+            TriangleTile(t, i, j);
+            if (upper)
+            {
+                std::swap(i, j);
+            }
+            const int m0 = i * TRIANGLE_TILE;
+            const int n0 = j * TRIANGLE_TILE;
+            const int rows = std::min(TRIANGLE_TILE, N - m0);
+            const int cols = std::min(TRIANGLE_TILE, N - n0);
+
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            for (int k = 0; k < K; k++)
+            {
+                const float* b = colsA + size_t(k) * N + n0;
+                for (int r = 0; r < rows; r++)
+                {
+                    MultiplyAddRow(&acc[size_t(r) * TRIANGLE_TILE], rowsA[size_t(m0 + r) * K + k], b, cols);
+                }
+            }
+            // Tiles on the diagonal are cut along it.
+            for (int r = 0; r < rows; r++)
+            {
+                const int row = m0 + r;
+                const int colBegin = upper ? std::max(n0, row) : n0;
+                const int colEnd = upper ? n0 + cols : std::min(n0 + cols, row + 1);
+                for (int col = colBegin; col < colEnd; col++)
+                {
+                    C[size_t(row) * N + col] = acc[size_t(r) * TRIANGLE_TILE + col - n0];
+                }
+            }
+        }
+    });
+}
+
+void CpuTrmmReference(const float* A, const float* B, double* C, int M, int N, bool upper)
+{
+    ParallelFor(0, M, [=](int rowBegin, int rowEnd) {
+        std::vector<double> row(N);
+        for (int r = rowBegin; r < rowEnd; r++)
+        {
+            std::fill(row.begin(), row.end(), 0.0);
+            for (int k = upper ? r : 0; k < (upper ? M : r + 1); k++)
+            {
+                const double a = A[size_t(r) * M + k];
+                for (int n = 0; n < N; n++)
+                {
+                    row[n] += a * B[size_t(k) * N + n];
+                }
+            }
+            std::copy(row.begin(), row.end(), C + size_t(r) * N);
+        }
+    });
+}
+
+void CpuTrmm(const float* A, const float* B, float* C, int M, int N, bool upper)
+{
+    const int tilesX = (N + CPU_PACK_PANEL_N - 1) / CPU_PACK_PANEL_N;
+    const int tiles = (M + TRIANGLE_TILE - 1) / TRIANGLE_TILE * tilesX;
+    ParallelFor(0, tiles, [&](int tileBegin, int tileEnd) {
+        std::vector<float> acc(size_t(TRIANGLE_TILE) * CPU_PACK_PANEL_N);
+        for (int t = tileBegin; t < tileEnd; t++)
+        {
+            const int m0 = t / tilesX * TRIANGLE_TILE;
+            const int n0 = t % tilesX * CPU_PACK_PANEL_N;
+            const int rows = std::min(TRIANGLE_TILE, M - m0);
+            const int cols = std::min(CPU_PACK_PANEL_N, N - n0);
+
+            // Rows m0 .. m0 + rows of tri(A) are zero outside these columns.
+            const int kBegin = upper ? m0 : 0;
+            const int kEnd = upper ? M : m0 + rows;
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            for (int k = kBegin; k < kEnd; k++)
+            {
+                const float* b = B + size_t(k) * N + n0;
+                const int rBegin = upper ? 0 : std::max(0, k - m0);
+                const int rEnd = upper ? std::min(rows, k - m0 + 1) : rows;
+                for (int r = rBegin; r < rEnd; r++)
+                {
+                    MultiplyAddRow(&acc[size_t(r) * CPU_PACK_PANEL_N], A[size_t(m0 + r) * M + k], b, cols);
+                }
+            }
+            for (int r = 0; r < rows; r++)
+            {
+                std::copy(&acc[size_t(r) * CPU_PACK_PANEL_N], &acc[size_t(r) * CPU_PACK_PANEL_N] + cols, C + size_t(m0 + r) * N + n0);
+            }
+        }
+    });
+}
@@ -0,0 +1,348 @@
+// CpuMatmul.h : Host-side reference and SIMD implementations of the GEMM variants
+// that the compute shaders in this project implement. Nothing here depends on
+// D3D12, so it can be built and verified on any platform.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "SparseMatrix.h"
+
+// Splits [begin, end) into one contiguous chunk per hardware thread and runs
+// func(chunkBegin, chunkEnd) for each of them.
+void ParallelFor(int begin, int end, const std::function<void(int, int)>& func);
+
+// C[M,N] = A[M,K] * B[K,N] accumulated in double precision. Used as the
+// ground truth when checking the GPU and the faster CPU paths.
+void CpuMatmulReference(const float* A, const float* B, double* C, int M, int N, int K);
+
+// Quantization parameters of one row of A or one column of B. The layout is
+// 16 bytes so the shaders can fetch it with a single Load4.
+struct QuantParams
+{
+    float scale;
+    int zeroPoint;
+    int sum;        // Sum of the quantized values of this row/column.
+    int reserved;
+};
+
+// Asymmetric int8 quantization of `rows` vectors of `cols` elements. Element
+// (r, c) is read from src[r * rowStride + c * colStride] and written to
+// dst[r * cols + c]. Quantizing A uses (rowStride = K, colStride = 1); quantizing
+// the columns of B uses (rowStride = 1, colStride = N), which produces B^T.
+void QuantizeInt8(const float* src, int rows, int cols, int rowStride, int colStride,
+                  int8_t* dst, QuantParams* params);
+
+// C[M,N] = dequant(A8[M,K] * B8t[N,K]^T). The int8 products are accumulated in
+// int32 and the per-row/per-column scales and zero points are applied on write.
+void CpuMatmulInt8(const int8_t* A8, const int8_t* B8t, const QuantParams* paramsA,
+                   const QuantParams* paramsB, float* C, int M, int N, int K);
+
+// Symmetric int4 weight-only quantization of B[K,N] with one scale per group of
+// groupSize consecutive K values in each column. Eight columns are packed into
+// one uint32 (column n in bits 4 * (n % 8)), so Bq is K x N/8 words and scales
+// is ceil(K / groupSize) x N floats. N must be a multiple of 8.
+void QuantizeInt4Groupwise(const float* B, int K, int N, int groupSize, uint32_t* Bq, float* scales);
+
+// C[M,N] = A[M,K] * dequant(Bq), the weight-only int4 GEMV/GEMM counterpart of
+// SLM_Matmul_vector_matrix_int4.hlsl.
+void CpuMatmulInt4(const float* A, const uint32_t* Bq, const float* scales, float* C,
+                   int M, int N, int K, int groupSize);
+
+// How the fp32 GEMMs sum over K. The first three values match ACCUMULATE_MODE
+// in the SLM kernels. Apart from NAIVE, each block of ACCUMULATE_BLOCK_K values
+// is summed in fp32 first and the block sums are then combined as named.
+enum AccumulationMode
+{
+    ACCUMULATE_NAIVE = 0,
+    ACCUMULATE_KAHAN = 1,
+    ACCUMULATE_FP64 = 2,
+    ACCUMULATE_PAIRWISE = 3,
+};
+const int ACCUMULATE_BLOCK_K = 64;
+
+const char* AccumulationModeName(AccumulationMode mode);
+
+// C[M,N] = A[M,K] * B[K,N] in fp32, vectorized with AVX2/FMA when available.
+void CpuMatmulFloat(const float* A, const float* B, float* C, int M, int N, int K, AccumulationMode mode);
+
+// C[M,N] = A[M,K] * B[K,N] in fp64, vectorized with AVX2/FMA when available.
+// The CPU counterpart of SLM_DGEMM.hlsl.
+void CpuMatmulDouble(const double* A, const double* B, double* C, int M, int N, int K);
+
+// Writes the transpose of the rows x cols matrix src to dst (cols x rows),
+// one cache-sized block at a time.
+void TransposeMatrix(const float* src, int rows, int cols, float* dst);
+
+// C[M,N] = op(A) * op(B) in fp32, where op(A) is M x K and op(B) is K x N. A
+// transposed operand is stored as the row-major transpose: A as K x M when transA
+// and B as N x K when transB. lda, ldb and ldc are the row strides of the stored
+// matrices in elements, so submatrices and padded rows are read in place. Panels
+// of both operands are packed from either layout into the micro-kernel's order,
+// so no full transpose is needed.
+void CpuMatmulTrans(const float* A, int lda, bool transA, const float* B, int ldb, bool transB,
+                    float* C, int ldc, int M, int N, int K);
+
+// Leading dimension for rows of `cols` elements, stored in groups of `alignment`
+// elements of `alignmentBytes` bytes each (e.g. 4 and 16 for float4 loads).
+// cols is rounded up to whole groups. If the row stride is then a multiple of
+// 512 bytes, it is padded by another 128 bytes. Otherwise rows at power-of-two
+// strides map to the same memory channel and cache sets.
+int PaddedLeadingDimension(int cols, int alignment, int alignmentBytes);
+
+// C[M,N] = A[M,K] * B[K,N] for small M, the CPU counterpart of
+// SLM_Matmul_vector_matrix_chunked.hlsl. Work is split over column blocks so M = 1
+// still uses every core, and each block keeps its sums in registers while B is
+// streamed, so K is unbounded.
+void CpuGemvVectorMatrix(const float* A, const float* B, float* C, int M, int N, int K);
+
+// C[M,N] = A[M,K] * B[K,N] for a handful of rows (M = 2..16), the CPU counterpart
+// of the GEMV_ROWS variants of SLM_Matmul_vector_matrix_chunked.hlsl. Up to 16
+// rows are computed together, so each row segment of B loaded serves all of them.
+void CpuGemmSmallM(const float* A, const float* B, float* C, int M, int N, int K);
+
+// y[M] = A[M,K] * x[K], the CPU counterpart of SLM_Matmul_vector_chunked.hlsl.
+void CpuGemvMatrixVector(const float* A, const float* x, float* y, int M, int K);
+
+// Column panel width of the CPU GEMMs, and the panelN that CpuMatmulPacked expects.
+const int CPU_PACK_PANEL_N = 256;
+
+// Number of floats PackPanels writes for B[K,N]: K and N padded up to whole
+// multiples of panelK and panelN.
+size_t PackedPanelsSize(int K, int N, int panelK, int panelN);
+
+// Rearranges row-major B[K,N] into column panels of panelN columns. Each panel
+// stores its padded K rows back to back, so walking down one column tile reads
+// a single contiguous stream. The padding is zero-filled.
+void PackPanels(const float* B, int K, int N, int panelK, int panelN, float* packed);
+
+// C[M,N] = A[M,K] * B[K,N], with B packed once by
+// PackPanels(B, K, N, 1, CPU_PACK_PANEL_N, packedB) and reused across calls.
+void CpuMatmulPacked(const float* A, const float* packedB, float* C, int M, int N, int K);
+
+// Number of partial tiles when an M x N result is cut into tileM x tileN tiles:
+// the tiles on the N edge above the corner, then the whole row on the M edge.
+int EdgeTileCount(int M, int N, int tileM, int tileN);
+
+// Origin in C of partial tile `index` in the order of EdgeTileCount. Matches
+// the EDGE_TILES group mapping in SLM_8X8_4X16.hlsl.
+void EdgeTileOrigin(int index, int M, int N, int tileM, int tileN, int& row0, int& col0);
+
+// C[M,N] = A[M,K] * B[K,N] with the split the GPU uses for SLM_8X8_4X16: the
+// full tileM x tileN tiles go through a kernel without remainder handling and
+// the partial tiles are enumerated by EdgeTileOrigin. tileN must be a multiple of 8.
+void CpuMatmulSplitEdges(const float* A, const float* B, float* C, int M, int N, int K, int tileM, int tileN);
+
+// C[M,N] = A[M,K] * B[K,N] following the schedule of SLM_8X8_4X16: each
+// tileM x tileN tile of C walks K in steps of tileK, copying the tileM x tileK
+// block of A into a tile buffer and reading B in place. With doubleBuffer, the
+// block of the next step is copied into a second buffer a few rows at a time
+// while the current one is consumed, like the DOUBLE_BUFFER kernels.
+void CpuMatmulPrefetch(const float* A, const float* B, float* C, int M, int N, int K,
+                       int tileM, int tileN, int tileK, bool doubleBuffer);
+
+// C[M,N] = A[M,K] * B[K,N] on `workers` persistent threads, with the
+// decomposition of SLM_Stream_K.hlsl. One iteration is tileK values of K for
+// one tileM x tileN tile of C. With streamK, every worker gets an equal share
+// of all the iterations, crossing tile boundaries, and the tiles shared between
+// workers are summed from per-worker partial tiles afterwards. Without it,
+// workers get whole tiles, so when the tile count isn't a multiple of workers
+// the last round leaves most of them idle.
+void CpuMatmulStreamK(const float* A, const float* B, float* C, int M, int N, int K,
+                      int tileM, int tileN, int tileK, int workers, bool streamK);
+
+// Orders in which the tiles of C are handed out to groups or threads. They
+// match RASTER in SLM_8X8_4X16.hlsl and SLM_4X4_16X16.hlsl. Row-major walks a
+// whole row of tiles, so each tile row reads all of B again. The others keep
+// the tiles that run together close in both directions.
+enum TileRaster
+{
+    RASTER_ROW_MAJOR = 0,
+    RASTER_COLUMN_MAJOR = 1,
+    RASTER_GROUPED_M = 2,   // Bands of groupM tile rows, walked column by column.
+    RASTER_MORTON = 3,
+    RASTER_HILBERT = 4,
+};
+
+const char* TileRasterName(TileRaster raster);
+
+// Number of indices that enumerate a tilesX x tilesY grid: the grid size, or
+// the power-of-two square covering it for Morton and Hilbert.
+int TileRasterCount(TileRaster raster, int tilesX, int tilesY);
+
+// Tile (x, y) of position index in the order. Returns false for the indices
+// of the covering square that fall outside the grid.
+bool TileRasterTile(TileRaster raster, int index, int tilesX, int tilesY, int groupM, int& x, int& y);
+
+// C[M,N] = A[M,K] * B[K,N] with tileM x tileN tiles taken in raster order
+// by all hardware threads from a shared counter, as a GPU schedules groups.
+void CpuMatmulRaster(const float* A, const float* B, float* C, int M, int N, int K,
+                     int tileM, int tileN, TileRaster raster, int groupM);
+
+// A 2D convolution without bias, computed as the implicit GEMM
+// C[M, OC] = A[M, K] * B[K, OC]. Row m of A is output pixel (n, oh, ow) of
+// M = batch * OH * OW, and column k a tap of K = kernelH * kernelW * channels. The
+// taps are ordered so that consecutive k are contiguous in the input:
+// k = (kh * KW + kw) * C + c for NHWC, k = (c * KH + kh) * KW + kw for NCHW.
+// B holds the weights as K x OC in the same order. The output is NHWC or NCHW
+// like the input; NHWC is C itself.
+struct ConvShape
+{
+    int batch;
+    int height;
+    int width;
+    int channels;
+    int outChannels;
+    int kernelH;
+    int kernelW;
+    int stride;
+    int pad;
+    bool nchw;
+};
+
+int ConvOutputHeight(const ConvShape& shape);
+int ConvOutputWidth(const ConvShape& shape);
+// K of the implicit GEMM.
+int ConvGemmK(const ConvShape& shape);
+
+// Writes the explicit im2col matrix A, M x ldk with the columns from K to ldk
+// zero-filled. It takes M * ldk floats, where the input takes batch * H * W * C.
+void Im2Col(const float* input, const ConvShape& shape, int ldk, float* A);
+
+// The convolution of input with weights (K x OC rows), the CPU counterpart of
+// SLM_8X8_4X16.hlsl with CONV. A is never formed: each block of output pixels
+// reads its input taps in place and multiplies them with rows of the weights.
+void CpuConv2D(const float* input, const float* weights, float* output, const ConvShape& shape);
+
+// O[M, headDim] = softmax(Q K^T / sqrt(headDim)) V for one attention head, with
+// Q as M x headDim and K and V as keys x headDim, all row-major. The fp64
+// reference forms each row of scores in full.
+void CpuAttentionReference(const float* Q, const float* K, const float* V, double* O, int M, int keys, int headDim);
+
+// The attention above, the CPU counterpart of SLM_Attention.hlsl. Blocks of query
+// rows walk the keys a block at a time with an online softmax: the running row
+// maximum and sum rescale what was accumulated so far, so the M x keys scores
+// never leave a block buffer.
+void CpuAttention(const float* Q, const float* K, const float* V, float* O, int M, int keys, int headDim);
+
+// The same attention as separate steps: a GEMM writes all M x keys scores, a
+// softmax pass rewrites them as probabilities and a second GEMM multiplies them
+// with V, as running it as two D3D12Sample GEMMs would.
+void CpuAttentionUnfused(const float* Q, const float* K, const float* V, float* O, int M, int keys, int headDim);
+
+// C[M,N] = A[M,K] * B[K,N] with A sparse, accumulated in double precision.
+void CpuSpmmReference(const CsrMatrix& A, const float* B, double* C, int N);
+
+// The CSR SpMM above in fp32, the CPU counterpart of SLM_SpMM.hlsl; N = 1 is
+// SpMV. Pruned rows vary a lot in length, so instead of whole rows every
+// hardware thread gets an equal share of the nonzeros. A row that straddles two
+// shares is split: each thread sums its part into a partial row of its own, and
+// the parts are added up afterwards, as the Stream-K fix-up does for tiles.
+void CpuSpmm(const CsrMatrix& A, const float* B, float* C, int N);
+
+// The blocked ELL SpMM. Every block row holds the same number of blocks, so
+// whole block rows are spread over the threads without any splitting.
+void CpuSpmmBlockedEll(const BlockedEllMatrix& A, const float* B, float* C, int N);
+
+// Which K steps of a tiled GEMM have any work when A and/or B are block-sparse.
+// Bit kt of row i of A's bits is set if the tileM x tileK tile (i, kt) of A
+// holds a nonzero, and bit kt of row j of B's bits if the tileK x tileN tile
+// (kt, j) of B does; an operand that isn't masked has all its bits set. A K
+// step of tile (i, j) of C is needed only if both bits are set. The rows are
+// wordsK 32-bit words long, and bits holds tilesM rows for A and then tilesN
+// rows for B, the layout BLOCK_SPARSE in SLM_8X8_4X16.hlsl reads.
+struct TileMask
+{
+    int tileM;
+    int tileN;
+    int tileK;
+    int tilesM;
+    int tilesN;
+    int tilesK;
+    int wordsK;
+    std::vector<uint32_t> bits;
+};
+
+// The mask of A[M,K] and B[K,N] at the given tile sizes, scanning the values of
+// the operands selected by maskA and maskB.
+TileMask BuildTileMask(const float* A, const float* B, int M, int N, int K, int tileM, int tileN, int tileK,
+                       bool maskA, bool maskB);
+
+// Whether the K step kTile of tile (tileRow, tileCol) of C has any work.
+bool TileMaskOccupied(const TileMask& mask, int tileRow, int tileCol, int kTile);
+
+// The tiles of C with at least one K step of work, row by row, packed as
+// x | y << 16 for the compacted dispatch. The others are all zero.
+std::vector<uint32_t> OccupiedTiles(const TileMask& mask);
+
+// Number of K steps of work over all tiles of C, of tilesM * tilesN * tilesK.
+long long OccupiedTileSteps(const TileMask& mask);
+
+// C[M,N] = A[M,K] * B[K,N] with the tiles and K steps of the mask: the tiles
+// of OccupiedTiles are spread over all hardware threads, each skipping the K
+// steps without work, and the other tiles are zeroed, like the BLOCK_SPARSE
+// SLM_8X8_4X16 dispatch.
+void CpuMatmulBlockSparse(const float* A, const float* B, float* C, int M, int N, int K, const TileMask& mask);
+
+// One problem of a grouped GEMM, C_i[M_i,N] = A_i[M_i,K] * B_i[K,N]. The
+// problems share K and N, as the experts of a mixture-of-experts layer do, and
+// each operand is stacked in one buffer: A_i and C_i are the rows
+// [rowOffset, rowOffset + rows) of A and C, and B_i the rows
+// [bRowOffset, bRowOffset + K) of B. The layout is 16 bytes so the shader can
+// fetch it with a single Load4.
+struct GroupedGemmProblem
+{
+    int rowOffset;
+    int rows;       // M_i, which may be 0.
+    int bRowOffset;
+    int reserved;
+};
+
+// The problems of M_i = rows[i], stacked in order, with B_i the i-th K x N
+// block of B.
+std::vector<GroupedGemmProblem> GroupedGemmProblems(const std::vector<int>& rows, int K);
+
+// M_i of each of `experts` problems when `tokens` rows are routed to one
+// expert each, as top-1 routing does. The experts are drawn with uneven
+// popularity, so some get many rows and some none. The same seed gives the
+// same split.
+std::vector<int> RandomExpertRows(int tokens, int experts, unsigned seed);
+
+// The tile-to-problem table of a grouped dispatch: two words per tileM x tileN
+// tile of every C_i, the problem and the tile x | y << 16 within it, problem
+// by problem. Problems without rows have no tiles.
+std::vector<uint32_t> GroupedGemmTiles(const std::vector<GroupedGemmProblem>& problems, int N, int tileM, int tileN);
+
+// All the problems at once, the CPU counterpart of SLM_Grouped_GEMM.hlsl. The
+// tiles of every problem are dealt to one queue per hardware thread in
+// contiguous runs. A thread works through its queue from the front, and once
+// it is empty steals the back half of another's, so however unevenly the rows
+// are split, no thread idles while tiles are left.
+void CpuMatmulGrouped(const float* A, const float* B, float* C, const std::vector<GroupedGemmProblem>& problems, int N, int K);
+
+// Tile (row, col), row >= col, at position index of the lower triangle of
+// tiles numbered row by row: (0, 0), (1, 0), (1, 1), (2, 0), ... Matches the
+// group mapping of SLM_SYRK.hlsl; the upper triangle takes the transpose.
+void TriangleTile(int index, int& row, int& col);
+
+// C[N,N] = op(A) * op(A)^T, where op(A) is N x K: A itself stored N x K, as for
+// a Gram matrix, or with transA A^T with A stored K x N, as for a covariance.
+// C is symmetric, so like BLAS SYRK only its lower triangle, or with upper its
+// upper triangle, is written, diagonal included. The reference is in fp64.
+void CpuSyrkReference(const float* A, bool transA, double* C, int N, int K, bool upper);
+
+// The SYRK above, the CPU counterpart of SLM_SYRK.hlsl. Only the tiles of the
+// triangle are computed, over all hardware threads, so it takes about half the
+// work of the full GEMM.
+void CpuSyrk(const float* A, bool transA, float* C, int N, int K, bool upper);
+
+// C[M,N] = tri(A) * B with A M x M and B M x N, where tri(A) is the lower
+// triangle of A, or with upper the upper one, diagonal included; the other
+// entries are read as zero. Unlike BLAS TRMM, C is a separate output. The
+// reference is in fp64.
+void CpuTrmmReference(const float* A, const float* B, double* C, int M, int N, bool upper);
+
+// The TRMM above, the CPU counterpart of SLM_SYRK.hlsl with TRMM. Every tile of
+// C walks only the part of K its rows of tri(A) have, about half of it.
+void CpuTrmm(const float* A, const float* B, float* C, int M, int N, bool upper);
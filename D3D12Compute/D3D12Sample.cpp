@@ -12,10 +12,14 @@
 #include "pch.h"
 #include "stdafx.h"
 #include "D3D12Sample.h"
+#include "CacheMissCounter.h"
 #include <chrono>
 #include <iostream>
 #include <cmath>
 #include<string>
+#include <algorithm>
+#include <numeric>
+#include <thread>
 
 #define PRINT_DATA
 
@@ -37,6 +41,150 @@ namespace
 
 		pCmdList->ResourceBarrier(1, &barrierDesc);
 	}
+
+	// Copies a dense rows x cols matrix into rows of ld elements with zero padding.
+	template <typename T>
+	std::vector<T> WithLeadingDimension(const T* src, UINT rows, UINT cols, UINT ld)
+	{
+		std::vector<T> dst(size_t(rows) * ld, T());
+		for (UINT r = 0; r < rows; r++)
+		{
+			std::copy(src + size_t(r) * cols, src + size_t(r + 1) * cols, dst.begin() + size_t(r) * ld);
+		}
+		return dst;
+	}
+
+	// Splits a comma-separated command line value such as "4x8v4k32AB,8x8v4k16B".
+	std::vector<std::string> SplitList(const std::string& list)
+	{
+		std::vector<std::string> items;
+		size_t begin = 0;
+		while (begin <= list.size())
+		{
+			size_t end = list.find(',', begin);
+			if (end == std::string::npos)
+			{
+				end = list.size();
+			}
+			if (end > begin)
+			{
+				items.push_back(list.substr(begin, end - begin));
+			}
+			begin = end + 1;
+		}
+		return items;
+	}
+
+	// K values per Stream-K iteration (STREAM_K_DEPTH).
+	const int kStreamKDepth = 16;
+
+	// Layer shapes of "--conv-bench": batch, H, W, C, OC, KH, KW, stride, pad.
+	struct ConvLayer
+	{
+		const char* name;
+		ConvShape shape;
+	};
+	const ConvLayer kConvBenchmarkLayers[] =
+	{
+		{ "ResNet-50 conv1 7x7/2", { 1, 224, 224, 3, 64, 7, 7, 2, 3, false } },
+		{ "ResNet-50 conv2 1x1", { 1, 56, 56, 256, 64, 1, 1, 1, 0, false } },
+		{ "ResNet-50 conv2 3x3", { 1, 56, 56, 64, 64, 3, 3, 1, 1, false } },
+		{ "ResNet-50 conv3 3x3", { 1, 28, 28, 128, 128, 3, 3, 1, 1, false } },
+		{ "ResNet-50 conv4 3x3", { 1, 14, 14, 256, 256, 3, 3, 1, 1, false } },
+		{ "ResNet-50 conv5 3x3", { 1, 7, 7, 512, 512, 3, 3, 1, 1, false } },
+		{ "UNet 256x256x64 3x3", { 1, 256, 256, 64, 64, 3, 3, 1, 1, false } },
+		{ "UNet 128x128x128 3x3", { 1, 128, 128, 128, 128, 3, 3, 1, 1, false } },
+		{ "UNet 64x64x256 3x3", { 1, 64, 64, 256, 256, 3, 3, 1, 1, false } },
+		{ "UNet 32x32x512 3x3", { 1, 32, 32, 512, 512, 3, 3, 1, 1, false } },
+	};
+
+	// Square GEMM sizes run by "--pad-bench", whose power-of-two strides alias
+	// without padding.
+	const UINT kPadBenchmarkSizes[] = { 4096, 8192 };
+
+	// Sequence lengths and head dimensions swept by "--attention-bench".
+	const UINT kAttentionBenchmarkLengths[] = { 256, 512, 1024, 2048, 4096 };
+	const UINT kAttentionBenchmarkHeadDims[] = { 32, 64, 128 };
+
+	// Sparsities of A swept by "--sparse-bench".
+	const double kSparseBenchmarkSparsities[] = { 0.0, 0.5, 0.7, 0.8, 0.9, 0.95, 0.98, 0.99 };
+
+	// Fractions of the blocks kept by "--block-sparse-bench".
+	const double kBlockSparseBenchmarkDensities[] = { 1.0, 0.75, 0.5, 0.25, 0.1, 0.05 };
+
+	// Directory LoadAssets and --generate write the generated kernels to.
+	const char* const kGeneratedKernelDir = "generated";
+
+	// The general GEMM kernels compared by "--kernel all". The vector kernels
+	// are left out because they only handle specific shapes.
+	const char* const kAccuracyReportKernels[] =
+	{
+		"SLM_8X8_4X16",
+		"SLM_8X8_4X16_packed",
+		"SLM_4x4_16x16_v4",
+		"SLM_4x4_shared_A",
+		"SLM_4x4_16x16_float",
+		"SLM_4x4_16x16_float_coalesced",
+		"SLM_4x4_16x16_4_FLOATS",
+		"MatMul_4x4_16x4_float",
+		"SLM_DGEMM_4x4",
+		"SLM_DGEMM_8x8",
+		"SLM_Stream_K",
+	};
+
+	// The kernels whose shaders implement ACCUMULATE_MODE, with their --kernel
+	// values. The others always sum naively: Start rejects kahan and fp64 for
+	// them, and "--kernel all" runs them with --accumulate naive.
+	struct AccumulateModeKernel
+	{
+		const char* name;
+		D3D12Sample::KERNELTYPE type;
+	};
+	const AccumulateModeKernel kAccumulateModeKernels[] =
+	{
+		{ "SLM_8X8_4X16", D3D12Sample::KERNELTYPE::SLM_8X8_4X16 },
+		{ "SLM_8X8_4X16_packed", D3D12Sample::KERNELTYPE::SLM_8X8_4X16_packed },
+		{ "SLM_4x4_16x16_v4", D3D12Sample::KERNELTYPE::SLM_4x4_16x16_v4 },
+		{ "SLM_4x4_shared_A", D3D12Sample::KERNELTYPE::SLM_4x4_shared_A },
+		{ "SLM_4x4_16x16_float", D3D12Sample::KERNELTYPE::SLM_4x4_16x16_float },
+	};
+
+	// "SLM_8X8_4X16, ... and SLM_4x4_16x16_float" for the messages.
+	std::string AccumulateModeKernelNames()
+	{
+		std::string names;
+		const size_t count = sizeof(kAccumulateModeKernels) / sizeof(kAccumulateModeKernels[0]);
+		for (size_t i = 0; i < count; i++)
+		{
+			names += (i == 0 ? "" : (i + 1 == count ? " and " : ", ")) + std::string(kAccumulateModeKernels[i].name);
+		}
+		return names;
+	}
+
+	// Seed of the inputs of every run of "--kernel all" and of its CPU rows, so
+	// that all the rows compute the same product.
+	const unsigned kAccuracyReportSeed = 1;
+
+	// Error of result against reference, as the largest absolute error over the
+	// largest reference magnitude and as the RMS error over the RMS reference.
+	template <typename T>
+	void RelativeError(const T* result, const double* reference, size_t count, double& maxRelError, double& rmsRelError)
+	{
+		double maxError = 0.0;
+		double maxReference = 0.0;
+		double errorSquares = 0.0;
+		double referenceSquares = 0.0;
+		for (size_t i = 0; i < count; i++)
+		{
+			double error = double(result[i]) - reference[i];
+			maxError = (std::max)(maxError, std::abs(error));
+			maxReference = (std::max)(maxReference, std::abs(reference[i]));
+			errorSquares += error * error;
+			referenceSquares += reference[i] * reference[i];
+		}
+		maxRelError = maxReference > 0.0 ? maxError / maxReference : maxError;
+		rmsRelError = referenceSquares > 0.0 ? std::sqrt(errorSquares / referenceSquares) : std::sqrt(errorSquares);
+	}
 }
 
 D3D12Sample::D3D12Sample() :
@@ -50,6 +198,34 @@ D3D12Sample::D3D12Sample() :
     m_K(512),
     m_tileK(64),
     m_componentSize(4),
+    m_elementSize(sizeof(float)),
+    m_transA(false),
+    m_transB(false),
+    m_lda(0),
+    m_ldb(0),
+    m_ldc(0),
+    m_autoPad(false),
+    m_splitEdges(true),
+    mEdgeDispatchCount(0),
+    m_doubleBuffer(false),
+    m_streamKGroups(64),
+    mFixupDispatchCount(0),
+    m_raster(RASTER_ROW_MAJOR),
+    m_rasterGroupM(8),
+    m_conv(false),
+    m_convShape{},
+    m_gemvRows(1),
+    m_int4GroupSize(128),
+    m_sparsity(0.9),
+    m_sparseBlock(0),
+    m_blockedEll(false),
+    m_blockSparseA(false),
+    m_blockSparseB(false),
+    m_upper(false),
+    m_experts(8),
+    m_shaderCacheDir(SHADER_CACHE_DIR),
+    m_accumulateMode(ACCUMULATE_NAIVE),
+    m_runResult{},
     mWorkPerThreadX(8),
     mWorkPerThreadY(8),
     mLocalGroupSizeX(16),
@@ -58,6 +234,14 @@ D3D12Sample::D3D12Sample() :
 
 void D3D12Sample::Start(int argc, char *argv[])
 {
+    bool runAccuracyReport = false;
+    bool runConvBenchmark = false;
+    bool runAttentionBenchmark = false;
+    bool runPadBenchmark = false;
+    bool runSparseBenchmark = false;
+    bool runBlockSparseBenchmark = false;
+    bool convNchw = false;
+    bool chooseKernel = false;
     for (int i = 0; i < argc; ++i)
     {
         std::string cmd(argv[i]);
@@ -65,13 +249,42 @@ void D3D12Sample::Start(int argc, char *argv[])
         {
             std::cout << "-h, --help     List all the supported command flags." << std::endl;
             std::cout << "--storage-type texture|structured_buffer|byteAddress_buffer     Choose using which storage type to load/store data. The default one is byteAddress_buffer." << std::endl;
-            std::cout << "--kernel SLM_8X8_4X16|SLM_4x4_16x16_v4|SLM_4x4_shared_A|SLM_4x4_16x16_float|SLM_4x4_16x16_float_coalesced|SLM_4x4_16x16_4_FLOATS|MatMul_4x4_16x4_float|MatMul_vector_float Choose which algorithm to run. The default one is SLM_8X8_4X16." << std::endl;
+            std::cout << "--kernel SLM_8X8_4X16|SLM_8X8_4X16_packed|SLM_4x4_16x16_v4|SLM_4x4_shared_A|SLM_4x4_16x16_float|SLM_4x4_16x16_float_coalesced|SLM_4x4_16x16_4_FLOATS|MatMul_4x4_16x4_float|MatMul_vector_float|SLM_INT8_4x4_16x16|SLM_MatMul_vector_matrix_int4|SLM_DGEMM_4x4|SLM_DGEMM_8x8|SLM_4x4_16x16_trans|SLM_MatMul_vector_matrix_chunked|SLM_MatMul_vector_chunked|SLM_MatMul_small_m|SLM_Stream_K|SLM_Attention|SLM_SpMM|SLM_Grouped_GEMM|SLM_SYRK|SLM_TRMM|generated|auto|all Choose which algorithm to run. The SLM_DGEMM kernels compute in fp64. SLM_Stream_K splits the K iterations of all tiles evenly over --groups persistent groups. SLM_Attention computes softmax(Q K^T / sqrt(N)) V for M queries and K keys of head dimension N in one fused kernel. SLM_SpMM multiplies a sparse M x K matrix A with B, or with a vector when N is 1. SLM_Grouped_GEMM runs the M x K by K x N GEMMs of --experts with different M each in one dispatch. SLM_SYRK computes one triangle of the symmetric M x M product A A^T, or A^T A with --trans TN, dispatching only its tiles. SLM_TRMM multiplies the triangle of an M x M matrix A with B. \"generated\" emits a kernel for --shape. \"auto\" picks a GEMV, small-M or tiled GEMM kernel from M and N. \"all\" runs every GEMM kernel and prints a speed versus accuracy table. The default one is SLM_8X8_4X16." << std::endl;
             std::cout << "--num-dispatch int_value     Determines how many command lists will be executed. The default value is 500" << std::endl;
             std::cout << "--M int_value     The rows of the output matrix [M,N]. The default value is 1024" << std::endl;
             std::cout << "--N int_value     The colums of the output matrix [M,N]. The default value is 1024" << std::endl;
             std::cout << "--K int_value     The inner dimension length of matrix multiplication. The default value is 1024" << std::endl;
             std::cout << "--localX int_value     The local work group size X. The default value is 16" << std::endl;
             std::cout << "--localY int_value     The local work group size Y. The default value is 16" << std::endl;
+            std::cout << "--group-size 32|64|128|256     The K group size sharing one scale in the int4 kernels. The default value is 128" << std::endl;
+            std::cout << "--trans NN|NT|TN|TT     Whether A and B are stored transposed (A as K x M, B as N x K) for SLM_4x4_16x16_trans. SLM_SYRK takes NN or TN. The default one is NN." << std::endl;
+            std::cout << "--lda|--ldb|--ldc int_value     Row stride in elements of the stored A, B or C. The default one is the dense row length." << std::endl;
+            std::cout << "--pad none|auto     With auto, strides that aren't given are padded so rows don't alias at power-of-two strides. The default one is none." << std::endl;
+            std::cout << "--pad-bench     Run the kernel at M = K = N = 4096 and 8192 with --pad none and auto, and print the GPU and CPU GFLOPS of the dense and padded strides side by side." << std::endl;
+            std::cout << "--edges split|checked     For SLM_8X8_4X16(_packed), split runs the full tiles without bounds checks and the partial tiles in a second dispatch; checked bounds-checks every tile. The default one is split." << std::endl;
+            std::cout << "--groups int_value     Persistent groups of SLM_Stream_K. Set it to the number of groups the GPU runs at once. The default value is 64" << std::endl;
+            std::cout << "--raster row|column|grouped|morton|hilbert     Order in which SLM_8X8_4X16(_packed) and SLM_4x4_16x16_float walk the tiles of C. grouped walks bands of --raster-group tile rows column by column. The default one is row." << std::endl;
+            std::cout << "--raster-group int_value     Tile rows per band of --raster grouped. The default value is 8" << std::endl;
+            std::cout << "--prefetch single|double     For SLM_8X8_4X16(_packed), SLM_4x4_shared_A, SLM_4x4_16x16_v4 and SLM_4x4_16x16_4_FLOATS, double loads the next A tile (and B tile for the last two) while the current one is used, ping-ponging two groupshared buffers with one barrier per tile. The default one is single." << std::endl;
+            std::cout << "--shape RxCvVkT[A][B]     Register tile of the generated kernel: R rows and C columns per thread in vectors of V (1, 2 or 4) floats, K tiles of T, with A and/or B staged in groupshared memory, e.g. 4x8v4k32AB." << std::endl;
+            std::cout << "--shapes shape[,shape...]     Generated kernels that \"--kernel all\" adds to its table." << std::endl;
+            std::cout << "--generate shape[,shape...]     Write the HLSL kernel and its C++ CPU counterpart for each shape to generated/ and exit." << std::endl;
+            std::cout << "--shader-cache dir|none     Directory of compiled shader blobs, filled by precompile_shaders.py (DXIL) and by earlier runs (DXBC). none always compiles. The default one is shader_cache." << std::endl;
+            std::cout << "--conv batch,H,W,C,OC,KH,KW,stride,pad     Run a 2D convolution as an implicit GEMM in SLM_8X8_4X16, without storing the im2col matrix. OC should be a multiple of 4." << std::endl;
+            std::cout << "--layout nhwc|nchw     Tensor layout of --conv and --conv-bench. nchw needs byteAddress_buffer. The default one is nhwc." << std::endl;
+            std::cout << "--conv-bench     Run --conv over common ResNet-50 and UNet layers and print their GFLOPS and the memory saved against explicit im2col." << std::endl;
+            std::cout << "--attention-bench     Run SLM_Attention over a sweep of sequence lengths and head dimensions and print the memory traffic the fused kernel avoids." << std::endl;
+            std::cout << "--sparsity float_value     Fraction of the blocks of A that SLM_SpMM prunes to zero, or of A and/or B with --block-sparse. The default value is 0.9" << std::endl;
+            std::cout << "--sparse-block int_value     Block size of the pruning and of the blocked-ELL format. The default value is 1 (single weights) for csr, 4 for bell and 32 with --block-sparse." << std::endl;
+            std::cout << "--sparse-format csr|bell     Storage of A for SLM_SpMM: compressed sparse rows, or blocked ELL, which pads every block row to the same number of blocks. bell needs N > 1. The default one is csr." << std::endl;
+            std::cout << "--sparse-matrix file.mtx     Read A from a coordinate Matrix Market file instead; M and K are its size." << std::endl;
+            std::cout << "--sparse-bench     Run SLM_SpMM over a sweep of sparsities and dense SLM_8X8_4X16 on the same shape, and print at what sparsity the sparse path wins on the GPU and the CPU." << std::endl;
+            std::cout << "--block-sparse none|a|b|ab     Prune blocks of A, B or both for SLM_8X8_4X16, which then runs only the tiles of C with work and skips the K steps whose tiles of A or B are all zero. The default one is none." << std::endl;
+            std::cout << "--block-sparse-bench     Run --block-sparse (a unless given) over a sweep of block densities and dense SLM_8X8_4X16 on the same shape, and print the effective GFLOPS on the GPU and the CPU." << std::endl;
+            std::cout << "--uplo lower|upper     Triangle of C that SLM_SYRK computes, or of A that SLM_TRMM reads, diagonal included. The default one is lower." << std::endl;
+            std::cout << "--experts int_value     Problems of SLM_Grouped_GEMM. The M rows are routed to them at random, some getting many and some none. The default value is 8" << std::endl;
+            std::cout << "--expert-m int_list     M of each SLM_Grouped_GEMM problem instead, e.g. 128,0,37; M is their sum." << std::endl;
+            std::cout << "--accumulate naive|kahan|fp64     How the fp32 GEMM kernels sum over K. kahan and fp64 compensate or widen the per-tile sums, and are supported by " << AccumulateModeKernelNames() << ". The default one is naive." << std::endl;
             return;
         }
         else if (cmd == "--storage-type")
@@ -100,6 +313,13 @@ void D3D12Sample::Start(int argc, char *argv[])
                 mWorkPerThreadX = 8;
                 m_componentSize = 4;
             }
+            else if (kernelType == "SLM_8X8_4X16_packed")
+            {
+                mKernelType = KERNELTYPE::SLM_8X8_4X16_packed;
+                mWorkPerThreadY = 8;
+                mWorkPerThreadX = 8;
+                m_componentSize = 4;
+            }
             else if (kernelType == "SLM_4x4_16x16_v4")
             {
                 mKernelType = KERNELTYPE::SLM_4x4_16x16_v4;
@@ -164,6 +384,97 @@ void D3D12Sample::Start(int argc, char *argv[])
                 mWorkPerThreadX = 1;
                 m_componentSize = 1;
             }
+            else if (kernelType == "SLM_MatMul_vector_matrix_chunked") {
+                mKernelType = KERNELTYPE::SLM_MatMul_vector_matrix_chunked;
+                mWorkPerThreadY = 1;
+                mWorkPerThreadX = 4;
+                m_componentSize = 1;
+            }
+            else if (kernelType == "SLM_MatMul_vector_chunked") {
+                mKernelType = KERNELTYPE::SLM_MatMul_vector_chunked;
+                mWorkPerThreadY = 1;
+                mWorkPerThreadX = 1;
+                m_componentSize = 1;
+            }
+            else if (kernelType == "SLM_INT8_4x4_16x16") {
+                mKernelType = KERNELTYPE::SLM_INT8_4x4_16x16;
+                mWorkPerThreadY = 4;
+                mWorkPerThreadX = 4;
+                m_componentSize = 1;
+            }
+            else if (kernelType == "SLM_MatMul_vector_matrix_int4") {
+                mKernelType = KERNELTYPE::SLM_MatMul_vector_matrix_int4;
+                mWorkPerThreadY = 1;
+                mWorkPerThreadX = 8;
+                m_componentSize = 1;
+            }
+            else if (kernelType == "SLM_DGEMM_4x4") {
+                mKernelType = KERNELTYPE::SLM_DGEMM_4x4;
+                mWorkPerThreadY = 4;
+                mWorkPerThreadX = 4;
+                m_componentSize = 1;
+                m_elementSize = sizeof(double);
+            }
+            else if (kernelType == "SLM_DGEMM_8x8") {
+                mKernelType = KERNELTYPE::SLM_DGEMM_8x8;
+                mWorkPerThreadY = 8;
+                mWorkPerThreadX = 8;
+                m_componentSize = 1;
+                m_elementSize = sizeof(double);
+            }
+            else if (kernelType == "SLM_4x4_16x16_trans") {
+                mKernelType = KERNELTYPE::SLM_4x4_16x16_trans;
+                mWorkPerThreadY = 4;
+                mWorkPerThreadX = 4;
+                m_componentSize = 1;
+            }
+            else if (kernelType == "SLM_MatMul_small_m") {
+                mKernelType = KERNELTYPE::SLM_MatMul_small_m;
+                mWorkPerThreadY = 1;
+                mWorkPerThreadX = 4;
+                m_componentSize = 1;
+            }
+            else if (kernelType == "SLM_Stream_K") {
+                mKernelType = KERNELTYPE::SLM_Stream_K;
+                mWorkPerThreadY = 4;
+                mWorkPerThreadX = 4;
+                m_componentSize = 1;
+            }
+            else if (kernelType == "SLM_Attention") {
+                mKernelType = KERNELTYPE::SLM_Attention;
+                mWorkPerThreadY = 4;
+                mWorkPerThreadX = 1;
+                m_componentSize = 1;
+            }
+            else if (kernelType == "SLM_SpMM") {
+                mKernelType = KERNELTYPE::SLM_SpMM;
+                mWorkPerThreadY = 1;
+                mWorkPerThreadX = 8;
+                m_componentSize = 4;
+            }
+            else if (kernelType == "SLM_Grouped_GEMM") {
+                mKernelType = KERNELTYPE::SLM_Grouped_GEMM;
+                mWorkPerThreadY = 4;
+                mWorkPerThreadX = 4;
+                m_componentSize = 1;
+            }
+            else if (kernelType == "SLM_SYRK" || kernelType == "SLM_TRMM") {
+                mKernelType = kernelType == "SLM_SYRK" ? KERNELTYPE::SLM_SYRK : KERNELTYPE::SLM_TRMM;
+                // The rows per thread follow from the local size; see Start.
+                mWorkPerThreadY = 4;
+                mWorkPerThreadX = 4;
+                m_componentSize = 1;
+            }
+            else if (kernelType == "generated") {
+                mKernelType = KERNELTYPE::Generated;
+                m_componentSize = 1;
+            }
+            else if (kernelType == "auto") {
+                chooseKernel = true;
+            }
+            else if (kernelType == "all") {
+                runAccuracyReport = true;
+            }
             else
             {
                 std::cout << "Unsupported kernel type. Please input a valide kernel type." << std::endl;
@@ -173,12 +484,13 @@ void D3D12Sample::Start(int argc, char *argv[])
         else if (cmd == "--num-dispatch")
         {
             char *pNext;
-            m_computeCount = strtol(argv[i++ + 1], &pNext, 10);
-            if (m_computeCount <= 0)
+            int computeCount = strtol(argv[i++ + 1], &pNext, 10);
+            if (computeCount <= 0)
             {
                 std::cerr << "Dispatch count should be larger than 0." << std::endl;
                 return;
             }
+            m_computeCount = computeCount;
         }
         else if (cmd == "--M")
         {
@@ -230,767 +542,3409 @@ void D3D12Sample::Start(int argc, char *argv[])
                 return;
             }
         }
-    }
-
-    if (mKernelType != KERNELTYPE::MatMul_vector_float && mKernelType != SLM_MatMul_vector_float)
-    {
-
-        int tileM = mLocalGroupSizeY * mWorkPerThreadY;
-        int tileN = mLocalGroupSizeX * mWorkPerThreadX;
-        m_tileK = mLocalGroupSizeX * 4; // 4 means to get 4 float data.
-        mDispatchX = ceil(float(m_N) / float(tileN));
-        mDispatchY = ceil(float(m_M) / float(tileM));
-        std::cout << " M = " << m_M << ", K = " << m_K << ", N = " << m_N << ", mDispatchX = " << mDispatchX << ", mDispatchY = " << mDispatchY << std::endl;
-
-    }
-    else {
-        m_tileK = mLocalGroupSizeX * 4; // 4 means to get 4 float data.
-        int tile = mLocalGroupSizeX * mWorkPerThreadX;
-        mDispatchX = ceil(float(m_M * m_N) / float(tile));
-        mDispatchY = 1;
-        std::cout << " M = " << m_M << ", K = " << m_K << ", N = " << m_N << ", mDispatchX = " << mDispatchX << ", mDispatchY = " << mDispatchY << std::endl;
-    }
-
-    LoadPipeline();
-    LoadAssets();
-    RunCompute();
-}
-
-
-// Helper function for acquiring the first available hardware adapter that supports Direct3D 12.
-// If no such adapter can be found, *ppAdapter will be set to nullptr.
-void D3D12Sample::GetHardwareAdapter(IDXGIFactory2* pFactory, IDXGIAdapter1** ppAdapter)
-{
-    ComPtr<IDXGIAdapter1> adapter;
-    *ppAdapter = nullptr;
-
-    for (UINT adapterIndex = 0; DXGI_ERROR_NOT_FOUND != pFactory->EnumAdapters1(adapterIndex, &adapter); ++adapterIndex)
-    {
-        DXGI_ADAPTER_DESC1 desc;
-        ThrowIfFailed(adapter->GetDesc1(&desc));
-
-        if (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE)
+        else if (cmd == "--group-size")
         {
-            // Don't select the Basic Render Driver adapter.
-            // If you want a software adapter, pass in "/warp" on the command line.
-            continue;
+            char *pNext;
+            int groupSize = strtol(argv[i++ + 1], &pNext, 10);
+            if (groupSize != 32 && groupSize != 64 && groupSize != 128 && groupSize != 256)
+            {
+                std::cerr << "The int4 group size should be 32, 64, 128 or 256." << std::endl;
+                return;
+            }
+            m_int4GroupSize = groupSize;
         }
-
-        // Check to see if the adapter supports Direct3D 12, but don't create the
-        // actual device yet.
-        if (SUCCEEDED(D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_11_0, _uuidof(ID3D12Device), nullptr)))
+        else if (cmd == "--groups")
         {
-            break;
+            char *pNext;
+            int groups = strtol(argv[i++ + 1], &pNext, 10);
+            if (groups <= 0 || groups > D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION)
+            {
+                std::cerr << "The number of groups should be between 1 and " << D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION << "." << std::endl;
+                return;
+            }
+            m_streamKGroups = groups;
         }
-    }
-
-    *ppAdapter = adapter.Detach();
-}
-
-void D3D12Sample::CreateDevice(const ComPtr<IDXGIFactory4>& factory)
-{
-    ComPtr<IDXGIAdapter1> hardwareAdapter;
-    GetHardwareAdapter(factory.Get(), &hardwareAdapter);
-
-    ThrowIfFailed(D3D12CreateDevice(
-        hardwareAdapter.Get(),
-        D3D_FEATURE_LEVEL_11_0,
-        IID_PPV_ARGS(&m_d3d12Device)
-    ));
-}
-
-
-// Load the compute pipeline dependencies.
-void D3D12Sample::LoadPipeline()
-{
-    UINT dxgiFactoryFlags = 0;
-
-#if defined(_DEBUG)
-    // Enable the debug layer (requires the Graphics Tools "optional feature").
-    // NOTE: Enabling the debug layer after device creation will invalidate the active device.
-    {
-        ComPtr<ID3D12Debug> debugController;
-        if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController))))
+        else if (cmd == "--trans")
         {
-            debugController->EnableDebugLayer();
-
-            // Enable additional debug layers.
-            dxgiFactoryFlags |= DXGI_CREATE_FACTORY_DEBUG;
+            std::string trans = argv[i++ + 1];
+            if (trans != "NN" && trans != "NT" && trans != "TN" && trans != "TT")
+            {
+                std::cerr << "Unsupported transpose mode. Please input NN, NT, TN or TT." << std::endl;
+                return;
+            }
+            m_transA = trans[0] == 'T';
+            m_transB = trans[1] == 'T';
         }
-    }
-#endif
-
-    // Create DXGIFactory.
-    ComPtr<IDXGIFactory4> factory;
-    ThrowIfFailed(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)));
-
-    // Create device.
-    CreateDevice(factory);   
-    
-    // Describe and create the command queue.
-    D3D12_COMMAND_QUEUE_DESC queueDesc = { D3D12_COMMAND_LIST_TYPE_DIRECT, 0, D3D12_COMMAND_QUEUE_FLAG_NONE };
-
-    ThrowIfFailed(m_d3d12Device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_commandQueue)));
-    ThrowIfFailed(m_commandQueue->GetTimestampFrequency(&m_timestampFrequency));
-    ThrowIfFailed(
-        m_d3d12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_computeAllocator)));
-
-
-    // Create descriptor heaps.
-    {
-        // Describe and create a constant buffer view, shader resource views and unordered access view descriptor heap.
-        // Flags indicate that this descriptor heap can be bound to the pipeline 
-        // and that descriptors contained in it can be referenced by a root table.
-        D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
-        heapDesc.NumDescriptors = 4;  // 1 constant buffer, 2 SRV, 1 UAV.
-        heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-        heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-        ThrowIfFailed(m_d3d12Device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&m_cbSrvHeap)));
-
-        m_cbSrvDescriptorSize = m_d3d12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-    }
-}
-
-// Load the sample assets.
-void D3D12Sample::LoadAssets()
-{
-    // Create root signatures.
-    {
-        D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
-
-        // This is the highest version the sample supports. If CheckFeatureSupport succeeds, the HighestVersion returned will not be greater than this.
-        featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
-
-        CD3DX12_DESCRIPTOR_RANGE1 ranges[3];
-        CD3DX12_ROOT_PARAMETER1 rootParameters[3];
-
-        if (FAILED(m_d3d12Device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &featureData, sizeof(featureData))))
+        else if (cmd == "--shape")
         {
-            featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
+            m_shapeText = argv[i++ + 1];
         }
-        // Root signature for compute pass.
-        ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE);
-        ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE);
-        ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE);
-        rootParameters[0].InitAsDescriptorTable(1, &ranges[0], D3D12_SHADER_VISIBILITY_ALL);
-        rootParameters[1].InitAsDescriptorTable(1, &ranges[1], D3D12_SHADER_VISIBILITY_ALL);
-        rootParameters[2].InitAsDescriptorTable(1, &ranges[2], D3D12_SHADER_VISIBILITY_ALL);
-
-        CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
-        rootSignatureDesc.Init_1_1(_countof(rootParameters), rootParameters, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE);
-
-        ComPtr<ID3DBlob> signature;
-        ComPtr<ID3DBlob> error;
-        ThrowIfFailed(D3DX12SerializeVersionedRootSignature(&rootSignatureDesc, featureData.HighestVersion, &signature, &error));
-        ThrowIfFailed(m_d3d12Device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&m_computeRootSignature)));
-    }
-
-    // Create the compute pipeline state, which includes compiling and loading shaders.
-    D3D12_COMPUTE_PIPELINE_STATE_DESC descComputePSO = {};
-    descComputePSO.pRootSignature = m_computeRootSignature.Get();
-    ComPtr<ID3DBlob> computeShader;
-    UINT compileFlags = 0;
-
-    std::vector<D3D_SHADER_MACRO> defines;
-    static const D3D_SHADER_MACRO useTexture = { "USE_TEXTURE", "1" };
-    static const D3D_SHADER_MACRO useStructuredBuffer = { "USE_STRUCTURED_BUFFERS", "1" };
-    static const D3D_SHADER_MACRO terminator = {};
-    if (mStorageType == STORAGETYPE::TEXTURE)
-    {
-        defines.push_back(useTexture);
-    }
-    else if (mStorageType == STORAGETYPE::STRUCTURED_BUFFER)
-    {
-        defines.push_back(useStructuredBuffer);
-    }
-    // Pass the workgroup size.
-    std::string localXStr = std::to_string(mLocalGroupSizeX);
-    std::string localYStr = std::to_string(mLocalGroupSizeY);
-    std::string workPerThreadXStr = std::to_string(mWorkPerThreadX);
-    std::string workPerThreadYStr = std::to_string(mWorkPerThreadY);
-    defines.push_back({ "LOCAL_GROUP_SIZE_X", localXStr.c_str()});
-    defines.push_back({ "LOCAL_GROUP_SIZE_Y", localYStr.c_str()});
-    defines.push_back({ "WORK_PER_THREAD_X", workPerThreadXStr.c_str()});
-    defines.push_back({ "WORK_PER_THREAD_Y", workPerThreadYStr.c_str()});
-    defines.push_back(terminator);
-
-    if (mKernelType == KERNELTYPE::SLM_8X8_4X16)
+        else if (cmd == "--shapes")
+        {
+            m_reportShapes = SplitList(argv[i++ + 1]);
+        }
+        else if (cmd == "--generate")
+        {
+            for (const std::string& text : SplitList(argv[i++ + 1]))
+            {
+                KernelShape shape;
+                std::string error;
+                if (!ParseKernelShape(text, shape, error))
+                {
+                    std::cerr << text << ": " << error << std::endl;
+                    return;
+                }
+                if (!WriteGeneratedKernel(shape, kGeneratedKernelDir))
+                {
+                    std::cerr << "Can't write " << GeneratedKernelName(shape) << " to " << kGeneratedKernelDir << "." << std::endl;
+                    return;
+                }
+                std::cout << kGeneratedKernelDir << "/" << GeneratedKernelName(shape) << ".hlsl and .h" << std::endl;
+            }
+            return;
+        }
+        else if (cmd == "--lda" || cmd == "--ldb" || cmd == "--ldc")
+        {
+            char *pNext;
+            int ld = strtol(argv[i++ + 1], &pNext, 10);
+            if (ld <= 0)
+            {
+                std::cerr << "The leading dimension should be larger than 0." << std::endl;
+                return;
+            }
+            (cmd == "--lda" ? m_lda : cmd == "--ldb" ? m_ldb : m_ldc) = ld;
+        }
+        else if (cmd == "--pad")
+        {
+            std::string pad = argv[i++ + 1];
+            if (pad != "none" && pad != "auto")
+            {
+                std::cerr << "Unsupported padding policy. Please input none or auto." << std::endl;
+                return;
+            }
+            m_autoPad = pad == "auto";
+        }
+        else if (cmd == "--edges")
+        {
+            std::string edges = argv[i++ + 1];
+            if (edges != "split" && edges != "checked")
+            {
+                std::cerr << "Unsupported edge handling. Please input split or checked." << std::endl;
+                return;
+            }
+            m_splitEdges = edges == "split";
+        }
+        else if (cmd == "--raster")
+        {
+            std::string raster = argv[i++ + 1];
+            if (raster == "row")
+            {
+                m_raster = RASTER_ROW_MAJOR;
+            }
+            else if (raster == "column")
+            {
+                m_raster = RASTER_COLUMN_MAJOR;
+            }
+            else if (raster == "grouped")
+            {
+                m_raster = RASTER_GROUPED_M;
+            }
+            else if (raster == "morton")
+            {
+                m_raster = RASTER_MORTON;
+            }
+            else if (raster == "hilbert")
+            {
+                m_raster = RASTER_HILBERT;
+            }
+            else
+            {
+                std::cerr << "Unsupported raster order. Please input row, column, grouped, morton or hilbert." << std::endl;
+                return;
+            }
+        }
+        else if (cmd == "--raster-group")
+        {
+            char *pNext;
+            int groupM = strtol(argv[i++ + 1], &pNext, 10);
+            if (groupM <= 0)
+            {
+                std::cerr << "The raster group should be larger than 0." << std::endl;
+                return;
+            }
+            m_rasterGroupM = groupM;
+        }
+        else if (cmd == "--conv")
+        {
+            std::vector<std::string> values = SplitList(argv[i++ + 1]);
+            int v[9] = {};
+            for (size_t j = 0; j < values.size() && j < 9; j++)
+            {
+                v[j] = strtol(values[j].c_str(), nullptr, 10);
+            }
+            m_convShape = { v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], false };
+            // The output size truncates towards zero, so a kernel larger than the
+            // padded input would still give one pixel; reject it first.
+            if (values.size() != 9 || v[0] <= 0 || v[1] <= 0 || v[2] <= 0 || v[3] <= 0 || v[4] <= 0 || v[5] <= 0 || v[6] <= 0 ||
+                v[7] <= 0 || v[8] < 0 || v[1] + 2 * v[8] < v[5] || v[2] + 2 * v[8] < v[6] ||
+                ConvOutputHeight(m_convShape) <= 0 || ConvOutputWidth(m_convShape) <= 0)
+            {
+                std::cerr << "Please input the convolution as batch,H,W,C,OC,KH,KW,stride,pad with an output of at least one pixel." << std::endl;
+                return;
+            }
+            m_conv = true;
+        }
+        else if (cmd == "--layout")
+        {
+            std::string layout = argv[i++ + 1];
+            if (layout != "nhwc" && layout != "nchw")
+            {
+                std::cerr << "Unsupported tensor layout. Please input nhwc or nchw." << std::endl;
+                return;
+            }
+            convNchw = layout == "nchw";
+        }
+        else if (cmd == "--conv-bench")
+        {
+            runConvBenchmark = true;
+        }
+        else if (cmd == "--attention-bench")
+        {
+            runAttentionBenchmark = true;
+        }
+        else if (cmd == "--pad-bench")
+        {
+            runPadBenchmark = true;
+        }
+        else if (cmd == "--sparsity")
+        {
+            char *pNext;
+            m_sparsity = strtod(argv[i++ + 1], &pNext);
+            if (m_sparsity < 0.0 || m_sparsity > 1.0)
+            {
+                std::cerr << "The sparsity should be between 0 and 1." << std::endl;
+                return;
+            }
+        }
+        else if (cmd == "--sparse-block")
+        {
+            char *pNext;
+            int blockSize = strtol(argv[i++ + 1], &pNext, 10);
+            if (blockSize <= 0)
+            {
+                std::cerr << "The sparse block size should be larger than 0." << std::endl;
+                return;
+            }
+            m_sparseBlock = blockSize;
+        }
+        else if (cmd == "--sparse-format")
+        {
+            std::string format = argv[i++ + 1];
+            if (format != "csr" && format != "bell")
+            {
+                std::cerr << "Unsupported sparse format. Please input csr or bell." << std::endl;
+                return;
+            }
+            m_blockedEll = format == "bell";
+        }
+        else if (cmd == "--sparse-matrix")
+        {
+            m_sparseMatrixPath = argv[i++ + 1];
+        }
+        else if (cmd == "--sparse-bench")
+        {
+            runSparseBenchmark = true;
+        }
+        else if (cmd == "--block-sparse")
+        {
+            std::string operands = argv[i++ + 1];
+            if (operands != "none" && operands != "a" && operands != "b" && operands != "ab")
+            {
+                std::cerr << "Unsupported block-sparse operands. Please input none, a, b or ab." << std::endl;
+                return;
+            }
+            m_blockSparseA = operands == "a" || operands == "ab";
+            m_blockSparseB = operands == "b" || operands == "ab";
+        }
+        else if (cmd == "--block-sparse-bench")
+        {
+            runBlockSparseBenchmark = true;
+        }
+        else if (cmd == "--uplo")
+        {
+            std::string uplo = argv[i++ + 1];
+            if (uplo != "lower" && uplo != "upper")
+            {
+                std::cerr << "Unsupported triangle. Please input lower or upper." << std::endl;
+                return;
+            }
+            m_upper = uplo == "upper";
+        }
+        else if (cmd == "--experts")
+        {
+            char *pNext;
+            int experts = strtol(argv[i++ + 1], &pNext, 10);
+            if (experts <= 0)
+            {
+                std::cerr << "The number of experts should be larger than 0." << std::endl;
+                return;
+            }
+            m_experts = experts;
+        }
+        else if (cmd == "--expert-m")
+        {
+            m_expertRows.clear();
+            int rows = 0;
+            for (const std::string& value : SplitList(argv[i++ + 1]))
+            {
+                m_expertRows.push_back(strtol(value.c_str(), nullptr, 10));
+                if (m_expertRows.back() < 0)
+                {
+                    std::cerr << "The M of an expert can't be negative." << std::endl;
+                    return;
+                }
+                rows += m_expertRows.back();
+            }
+            if (rows == 0)
+            {
+                std::cerr << "The experts should have at least one row between them." << std::endl;
+                return;
+            }
+        }
+        else if (cmd == "--prefetch")
+        {
+            std::string prefetch = argv[i++ + 1];
+            if (prefetch != "single" && prefetch != "double")
+            {
+                std::cerr << "Unsupported prefetch mode. Please input single or double." << std::endl;
+                return;
+            }
+            m_doubleBuffer = prefetch == "double";
+        }
+        else if (cmd == "--shader-cache")
+        {
+            std::string dir = argv[i++ + 1];
+            m_shaderCacheDir = dir == "none" ? std::string() : dir;
+        }
+        else if (cmd == "--accumulate")
+        {
+            std::string accumulateMode = argv[i++ + 1];
+            if (accumulateMode == "naive")
+            {
+                m_accumulateMode = ACCUMULATE_NAIVE;
+            }
+            else if (accumulateMode == "kahan")
+            {
+                m_accumulateMode = ACCUMULATE_KAHAN;
+            }
+            else if (accumulateMode == "fp64")
+            {
+                m_accumulateMode = ACCUMULATE_FP64;
+            }
+            else
+            {
+                std::cerr << "Unsupported accumulation mode. Please input naive, kahan or fp64." << std::endl;
+                return;
+            }
+        }
+    }
+
+    if (runAccuracyReport)
+    {
+        RunAccuracyReport(argc, argv);
+        return;
+    }
+    if (runConvBenchmark)
+    {
+        RunConvBenchmark(argc, argv);
+        return;
+    }
+    if (runAttentionBenchmark)
+    {
+        RunAttentionBenchmark(argc, argv);
+        return;
+    }
+    if (runPadBenchmark)
+    {
+        if (m_lda || m_ldb || m_ldc)
+        {
+            std::cerr << "--pad-bench compares dense and padded strides, so it can't be combined with --lda, --ldb or --ldc." << std::endl;
+            return;
+        }
+        RunPadBenchmark(argc, argv);
+        return;
+    }
+    const bool blockSparse = m_blockSparseA || m_blockSparseB;
+    if (m_sparseBlock == 0)
+    {
+        m_sparseBlock = blockSparse || runBlockSparseBenchmark ? 32 : (m_blockedEll ? 4 : 1);
+    }
+    if (runSparseBenchmark)
+    {
+        if (!m_sparseMatrixPath.empty())
+        {
+            std::cerr << "--sparse-bench generates its matrices, so it can't be combined with --sparse-matrix." << std::endl;
+            return;
+        }
+        // What SLM_SpMM rejects below, checked here so the sweep doesn't report
+        // runs that never happened.
+        if (mStorageType == STORAGETYPE::TEXTURE || m_lda || m_ldb || m_ldc || m_autoPad)
+        {
+            std::cerr << "SLM_SpMM supports structured_buffer and byteAddress_buffer storage types with dense strides." << std::endl;
+            return;
+        }
+        if (m_N != 1 && m_N % 4 != 0)
+        {
+            std::cerr << "SLM_SpMM reads B and writes C in float4s, so N should be 1 or a multiple of 4." << std::endl;
+            return;
+        }
+        if (m_N == 1 && (m_blockedEll || (mLocalGroupSizeX & (mLocalGroupSizeX - 1)) != 0))
+        {
+            std::cerr << "SpMV (N = 1) uses csr and needs localX to be a power of two." << std::endl;
+            return;
+        }
+        RunSparseBenchmark(argc, argv);
+        return;
+    }
+    if (runBlockSparseBenchmark)
+    {
+        // The block-sparse guard below, checked before the sweep starts.
+        if (mStorageType == STORAGETYPE::TEXTURE || m_conv || m_doubleBuffer || m_raster != RASTER_ROW_MAJOR)
+        {
+            std::cerr << "Block-sparse mode runs on SLM_8X8_4X16 with buffer storage, single prefetch and the row raster order." << std::endl;
+            return;
+        }
+        RunBlockSparseBenchmark(argc, argv);
+        return;
+    }
+    if (m_conv)
+    {
+        m_convShape.nchw = convNchw;
+        if (mKernelType != KERNELTYPE::SLM_8X8_4X16 || mStorageType == STORAGETYPE::TEXTURE ||
+            (convNchw && mStorageType != STORAGETYPE::BYTEADDRESS_BUFFER))
+        {
+            std::cerr << "Convolutions run on SLM_8X8_4X16 with buffer storage, and nchw needs byteAddress_buffer." << std::endl;
+            return;
+        }
+        if (m_convShape.outChannels % 4 != 0 || m_lda || m_ldb || m_ldc || m_autoPad)
+        {
+            std::cerr << "Convolutions write float4s of output channels, so OC should be a multiple of 4, and use dense strides." << std::endl;
+            return;
+        }
+        // The implicit GEMM, with K rounded up to whole float4s.
+        m_M = m_convShape.batch * ConvOutputHeight(m_convShape) * ConvOutputWidth(m_convShape);
+        m_N = m_convShape.outChannels;
+        m_K = (ConvGemmK(m_convShape) + 3) / 4 * 4;
+    }
+    if (chooseKernel)
+    {
+        ChooseKernelForShape();
+    }
+
+    if (mKernelType == KERNELTYPE::SLM_INT8_4x4_16x16 || mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_int4)
+    {
+        if (mStorageType == STORAGETYPE::TEXTURE)
+        {
+            std::cerr << "The quantized kernels only support structured_buffer and byteAddress_buffer storage types." << std::endl;
+            return;
+        }
+    }
+    if (m_elementSize == sizeof(double) && mStorageType == STORAGETYPE::TEXTURE)
+    {
+        std::cerr << "There is no fp64 texture format, so the DGEMM kernels only support structured_buffer and byteAddress_buffer storage types." << std::endl;
+        return;
+    }
+    if ((m_transA || m_transB) && mKernelType != KERNELTYPE::SLM_4x4_16x16_trans &&
+        (mKernelType != KERNELTYPE::SLM_SYRK || m_transB))
+    {
+        std::cerr << "Transposed operands are only supported by SLM_4x4_16x16_trans, and a transposed A by SLM_SYRK." << std::endl;
+        return;
+    }
+    if ((mKernelType == KERNELTYPE::SLM_4x4_16x16_trans || mKernelType == KERNELTYPE::SLM_8X8_4X16_packed) &&
+        mStorageType == STORAGETYPE::TEXTURE)
+    {
+        std::cerr << "SLM_4x4_16x16_trans and SLM_8X8_4X16_packed only support structured_buffer and byteAddress_buffer storage types." << std::endl;
+        return;
+    }
+    if ((mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_chunked || mKernelType == KERNELTYPE::SLM_MatMul_vector_chunked ||
+         mKernelType == KERNELTYPE::SLM_MatMul_small_m || mKernelType == KERNELTYPE::SLM_Stream_K) && mStorageType == STORAGETYPE::TEXTURE)
+    {
+        std::cerr << "The chunked GEMV, small-M and Stream-K kernels only support structured_buffer and byteAddress_buffer storage types." << std::endl;
+        return;
+    }
+    if (m_raster != RASTER_ROW_MAJOR && mKernelType != KERNELTYPE::SLM_8X8_4X16 &&
+        mKernelType != KERNELTYPE::SLM_8X8_4X16_packed && mKernelType != KERNELTYPE::SLM_4x4_16x16_float)
+    {
+        std::cerr << "Tile raster orders are only supported by SLM_8X8_4X16, SLM_8X8_4X16_packed and SLM_4x4_16x16_float." << std::endl;
+        return;
+    }
+    if (m_accumulateMode != ACCUMULATE_NAIVE &&
+        std::none_of(std::begin(kAccumulateModeKernels), std::end(kAccumulateModeKernels),
+                     [this](const AccumulateModeKernel& kernel) { return kernel.type == mKernelType; }))
+    {
+        std::cerr << "kahan and fp64 accumulation are only supported by " << AccumulateModeKernelNames() << "." << std::endl;
+        return;
+    }
+    if (m_doubleBuffer)
+    {
+        if (mKernelType != KERNELTYPE::SLM_8X8_4X16 && mKernelType != KERNELTYPE::SLM_8X8_4X16_packed &&
+            mKernelType != KERNELTYPE::SLM_4x4_shared_A && mKernelType != KERNELTYPE::SLM_4x4_16x16_v4 &&
+            mKernelType != KERNELTYPE::SLM_4x4_16x16_4_FLOATS)
+        {
+            std::cerr << "Double-buffered prefetch is only supported by SLM_8X8_4X16, SLM_8X8_4X16_packed, SLM_4x4_shared_A, SLM_4x4_16x16_v4 and SLM_4x4_16x16_4_FLOATS." << std::endl;
+            return;
+        }
+        // Two tiles of 8 float4 rows of A per thread for SLM_8X8_4X16, of 4 for
+        // SLM_4x4_shared_A, and of 4 of A and 4 of B for SLM_4x4_16x16_v4 and
+        // SLM_4x4_16x16_4_FLOATS.
+        const UINT rowsPerThread = mKernelType == KERNELTYPE::SLM_4x4_shared_A ? 4 : 8;
+        if (2 * mLocalGroupSizeX * mLocalGroupSizeY * rowsPerThread * 16 > D3D12_CS_TGSM_REGISTER_COUNT * 4)
+        {
+            std::cerr << "Two tiles don't fit in 32 KB of groupshared memory with this local group size." << std::endl;
+            return;
+        }
+    }
+    if (mKernelType == KERNELTYPE::Generated)
+    {
+        std::string error;
+        if (!ParseKernelShape(m_shapeText, m_generatedShape, error))
+        {
+            std::cerr << error << std::endl;
+            return;
+        }
+        if (mStorageType == STORAGETYPE::TEXTURE)
+        {
+            std::cerr << "Generated kernels support structured_buffer and byteAddress_buffer storage types." << std::endl;
+            return;
+        }
+        if (m_N % m_generatedShape.vecWidth != 0)
+        {
+            std::cerr << "Generated kernels read and write C in vectors of " << m_generatedShape.vecWidth << ", so N should be a multiple of it." << std::endl;
+            return;
+        }
+        if (KernelSharedMemoryBytes(m_generatedShape, mLocalGroupSizeX, mLocalGroupSizeY) > D3D12_CS_TGSM_REGISTER_COUNT * 4)
+        {
+            std::cerr << "The tiles of " << m_shapeText << " don't fit in 32 KB of groupshared memory with this local group size." << std::endl;
+            return;
+        }
+        mWorkPerThreadX = m_generatedShape.colsPerThread;
+        mWorkPerThreadY = m_generatedShape.rowsPerThread;
+    }
+    if (mKernelType == KERNELTYPE::SLM_Attention)
+    {
+        if (mStorageType == STORAGETYPE::TEXTURE || m_lda || m_ldb || m_ldc || m_autoPad)
+        {
+            std::cerr << "SLM_Attention supports structured_buffer and byteAddress_buffer storage types with dense strides." << std::endl;
+            return;
+        }
+        // Each thread holds N / localX columns of O for 4 rows in registers.
+        if (m_N % mLocalGroupSizeX != 0 || m_N / mLocalGroupSizeX > 8)
+        {
+            std::cerr << "SLM_Attention needs the head dimension N to be a multiple of localX and at most 8 * localX." << std::endl;
+            return;
+        }
+        // Q, K (one float of padding per row), V and the scores of one block.
+        const UINT blockM = mLocalGroupSizeY * 4;
+        const UINT blockN = mLocalGroupSizeX;
+        if ((blockM * m_N + blockN * (m_N + 1) + blockN * m_N + blockM * blockN) * sizeof(float) > D3D12_CS_TGSM_REGISTER_COUNT * 4)
+        {
+            std::cerr << "The SLM_Attention tiles don't fit in 32 KB of groupshared memory with this head dimension and local group size." << std::endl;
+            return;
+        }
+    }
+    if (mKernelType == KERNELTYPE::SLM_SpMM)
+    {
+        if (mStorageType == STORAGETYPE::TEXTURE || m_lda || m_ldb || m_ldc || m_autoPad)
+        {
+            std::cerr << "SLM_SpMM supports structured_buffer and byteAddress_buffer storage types with dense strides." << std::endl;
+            return;
+        }
+        if (m_N == 1)
+        {
+            if (m_blockedEll)
+            {
+                std::cerr << "Blocked ELL is only supported for SpMM. SpMV (N = 1) uses csr." << std::endl;
+                return;
+            }
+            // The threads of a group row sum a row of A in a tree.
+            if ((mLocalGroupSizeX & (mLocalGroupSizeX - 1)) != 0)
+            {
+                std::cerr << "SpMV needs localX to be a power of two." << std::endl;
+                return;
+            }
+            m_componentSize = 1;
+        }
+        else if (m_N % 4 != 0)
+        {
+            std::cerr << "SLM_SpMM reads B and writes C in float4s, so N should be 1 or a multiple of 4." << std::endl;
+            return;
+        }
+        if (!m_sparseMatrixPath.empty())
+        {
+            std::string error;
+            if (!ReadMatrixMarket(m_sparseMatrixPath, m_sparseA, error))
+            {
+                std::cerr << error << std::endl;
+                return;
+            }
+            m_M = m_sparseA.rows;
+            m_K = m_sparseA.cols;
+        }
+        else
+        {
+            // A fixed seed, so --sparse-bench and the CPU see the same matrix.
+            m_sparseA = RandomBlockSparse(m_M, m_K, m_sparseBlock, m_sparsity, 1);
+        }
+        std::cout << " Sparse A: " << m_sparseA.values.size() << " nonzeros, sparsity = " << CsrSparsity(m_sparseA) << std::endl;
+        if (m_blockedEll)
+        {
+            m_sparseEll = BlockedEllFromCsr(m_sparseA, m_sparseBlock);
+            std::cout << " Blocked ELL: " << m_sparseEll.ellCols << " blocks of " << m_sparseBlock << "x" << m_sparseBlock
+                      << " per block row, " << m_sparseEll.values.size() << " values stored" << std::endl;
+        }
+    }
+    if (mKernelType == KERNELTYPE::SLM_SYRK || mKernelType == KERNELTYPE::SLM_TRMM)
+    {
+        if (mStorageType == STORAGETYPE::TEXTURE || m_lda || m_ldb || m_ldc || m_autoPad)
+        {
+            std::cerr << "SLM_SYRK and SLM_TRMM support structured_buffer and byteAddress_buffer storage types with dense strides." << std::endl;
+            return;
+        }
+        // Square tiles of 4 * localX, so that the diagonal runs through whole
+        // tiles: each thread takes 4 columns and the rows that leaves it.
+        if ((4 * mLocalGroupSizeX) % mLocalGroupSizeY != 0)
+        {
+            std::cerr << "SLM_SYRK and SLM_TRMM use square tiles of 4 * localX, so localY should divide 4 * localX." << std::endl;
+            return;
+        }
+        mWorkPerThreadY = 4 * mLocalGroupSizeX / mLocalGroupSizeY;
+        if (mKernelType == KERNELTYPE::SLM_SYRK)
+        {
+            // C = op(A) op(A)^T is M x M.
+            m_N = m_M;
+        }
+        else
+        {
+            // tri(A) is M x M.
+            m_K = m_M;
+        }
+    }
+    if (mKernelType == KERNELTYPE::SLM_Grouped_GEMM)
+    {
+        if (mStorageType == STORAGETYPE::TEXTURE || m_lda || m_ldb || m_ldc || m_autoPad)
+        {
+            std::cerr << "SLM_Grouped_GEMM supports structured_buffer and byteAddress_buffer storage types with dense strides." << std::endl;
+            return;
+        }
+        if (m_expertRows.empty())
+        {
+            // A fixed seed, so the CPU sees the same split.
+            m_expertRows = RandomExpertRows(m_M, m_experts, 1);
+        }
+        m_groupedProblems = GroupedGemmProblems(m_expertRows, m_K);
+        m_M = UINT(std::accumulate(m_expertRows.begin(), m_expertRows.end(), 0));
+        const auto rowRange = std::minmax_element(m_expertRows.begin(), m_expertRows.end());
+        std::cout << " Grouped GEMM: " << m_expertRows.size() << " problems, M_i from " << *rowRange.first << " to " << *rowRange.second << std::endl;
+    }
+    if (blockSparse)
+    {
+        if (mKernelType != KERNELTYPE::SLM_8X8_4X16 || mStorageType == STORAGETYPE::TEXTURE || m_conv || m_doubleBuffer ||
+            m_raster != RASTER_ROW_MAJOR)
+        {
+            std::cerr << "Block-sparse mode runs on SLM_8X8_4X16 with buffer storage, single prefetch and the row raster order." << std::endl;
+            return;
+        }
+        // The tile list covers the partial tiles too, which keep their bounds checks.
+        m_splitEdges = false;
+        buf1Data.resize(size_t(m_M) * m_K);
+        buf2Data.resize(size_t(m_K) * m_N);
+        for (std::vector<float>* data : { &buf1Data, &buf2Data })
+        {
+            for (float& value : *data)
+            {
+                value = (float)rand() / float(RAND_MAX);
+            }
+        }
+        // Fixed seeds, so --block-sparse-bench and the CPU see the same blocks.
+        if (m_blockSparseA)
+        {
+            const int pruned = PruneBlocks(buf1Data.data(), m_M, m_K, m_sparseBlock, m_sparsity, 1);
+            std::cout << " Block-sparse A: " << pruned << " of " << ((m_M + m_sparseBlock - 1) / m_sparseBlock) * ((m_K + m_sparseBlock - 1) / m_sparseBlock)
+                      << " blocks of " << m_sparseBlock << "x" << m_sparseBlock << " pruned" << std::endl;
+        }
+        if (m_blockSparseB)
+        {
+            const int pruned = PruneBlocks(buf2Data.data(), m_K, m_N, m_sparseBlock, m_sparsity, 2);
+            std::cout << " Block-sparse B: " << pruned << " of " << ((m_K + m_sparseBlock - 1) / m_sparseBlock) * ((m_N + m_sparseBlock - 1) / m_sparseBlock)
+                      << " blocks of " << m_sparseBlock << "x" << m_sparseBlock << " pruned" << std::endl;
+        }
+    }
+    if (mKernelType == KERNELTYPE::SLM_MatMul_vector_chunked && m_N != 1)
+    {
+        std::cerr << "SLM_MatMul_vector_chunked multiplies A by a vector, so N should be 1." << std::endl;
+        return;
+    }
+    if (mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_int4 && m_N % 8 != 0)
+    {
+        std::cerr << "The int4 kernels pack eight columns per 32-bit word, so N should be a multiple of 8." << std::endl;
+        return;
+    }
+    if (mKernelType == KERNELTYPE::SLM_INT8_4x4_16x16)
+    {
+        if (m_K % 4 != 0)
+        {
+            std::cerr << "The int8 kernels pack four K values per 32-bit word, so K should be a multiple of 4." << std::endl;
+            return;
+        }
+    }
+
+    if (!ResolveLeadingDimensions())
+    {
+        return;
+    }
+
+    if (mKernelType != KERNELTYPE::MatMul_vector_float && mKernelType != SLM_MatMul_vector_float)
+    {
+
+        int tileM = mLocalGroupSizeY * mWorkPerThreadY;
+        int tileN = mLocalGroupSizeX * mWorkPerThreadX;
+        m_tileK = mLocalGroupSizeX * 4; // 4 means to get 4 float data.
+        mDispatchX = ceil(float(m_N) / float(tileN));
+        mDispatchY = ceil(float(m_M) / float(tileM));
+        // The chunked GEMVs spread K over the threads of a group instead of rows:
+        // m_gemvRows rows of C per group, or LOCAL_GROUP_SIZE_Y rows for A times a vector.
+        if (mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_chunked || mKernelType == KERNELTYPE::SLM_MatMul_small_m)
+        {
+            m_gemvRows = mKernelType == KERNELTYPE::SLM_MatMul_small_m ? (std::min)(m_M, 16u) : 1;
+            mDispatchY = (m_M + m_gemvRows - 1) / m_gemvRows;
+        }
+        else if (mKernelType == KERNELTYPE::SLM_MatMul_vector_chunked)
+        {
+            mDispatchX = (m_M + mLocalGroupSizeY - 1) / mLocalGroupSizeY;
+            mDispatchY = 1;
+        }
+        else if (mKernelType == KERNELTYPE::SLM_Attention)
+        {
+            // One group per block of query rows; the keys are walked inside the group.
+            mDispatchX = mDispatchY;
+            mDispatchY = 1;
+        }
+        else if (mKernelType == KERNELTYPE::SLM_SpMM && m_N == 1)
+        {
+            // SpMV: LOCAL_GROUP_SIZE_Y rows of A per group.
+            mDispatchX = (m_M + mLocalGroupSizeY - 1) / mLocalGroupSizeY;
+            mDispatchY = 1;
+        }
+        else if (mKernelType == KERNELTYPE::SLM_SYRK)
+        {
+            // One group per tile of the triangle, in the order of TriangleTile.
+            const UINT tiles = mDispatchY;
+            std::cout << " SYRK: " << tiles * (tiles + 1) / 2 << " of " << tiles * tiles << " tiles" << std::endl;
+            mDispatchX = tiles * (tiles + 1) / 2;
+            mDispatchY = 1;
+        }
+        else if (mKernelType == KERNELTYPE::SLM_Grouped_GEMM)
+        {
+            // One group per tile of any problem, found through the tile table.
+            m_groupedTiles = GroupedGemmTiles(m_groupedProblems, m_N, tileM, tileN);
+            std::cout << " Grouped GEMM: " << m_groupedTiles.size() / 2 << " tiles in one dispatch, "
+                      << mDispatchX * mDispatchY << " if the problems were one GEMM" << std::endl;
+            mDispatchX = UINT(m_groupedTiles.size() / 2);
+            mDispatchY = 1;
+            if (mDispatchX > D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION)
+            {
+                std::cerr << "Too many tiles for a 1D dispatch." << std::endl;
+                return;
+            }
+        }
+        else if (mKernelType == KERNELTYPE::SLM_Stream_K)
+        {
+            const UINT tiles = mDispatchX * mDispatchY;
+            const UINT iterations = tiles * ((m_K + kStreamKDepth - 1) / kStreamKDepth);
+            std::cout << " Stream-K: " << tiles << " tiles, " << iterations << " iterations, "
+                      << (iterations + m_streamKGroups - 1) / m_streamKGroups << " per group" << std::endl;
+            mFixupDispatchCount = tiles;
+            mDispatchX = m_streamKGroups;
+            mDispatchY = 1;
+        }
+        std::cout << " M = " << m_M << ", K = " << m_K << ", N = " << m_N << ", mDispatchX = " << mDispatchX << ", mDispatchY = " << mDispatchY << std::endl;
+
+        m_splitEdges = m_splitEdges && (mKernelType == KERNELTYPE::SLM_8X8_4X16 || mKernelType == KERNELTYPE::SLM_8X8_4X16_packed);
+        if (m_splitEdges)
+        {
+            mDispatchX = m_N / tileN;
+            mDispatchY = m_M / tileM;
+            mEdgeDispatchCount = EdgeTileCount(m_M, m_N, tileM, tileN);
+            std::cout << " Full tiles = " << mDispatchX << " x " << mDispatchY << ", edge tiles = " << mEdgeDispatchCount << std::endl;
+        }
+        if (m_raster != RASTER_ROW_MAJOR)
+        {
+            // A 1D dispatch that the kernel maps to the tiles in raster order.
+            mDispatchX = TileRasterCount(m_raster, mDispatchX, mDispatchY);
+            mDispatchY = 1;
+            std::cout << " " << TileRasterName(m_raster) << " raster: " << mDispatchX << " groups" << std::endl;
+            if (mDispatchX > D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION)
+            {
+                std::cerr << "Too many tiles for a 1D dispatch. Please use the row raster order." << std::endl;
+                return;
+            }
+        }
+        if (blockSparse)
+        {
+            // A 1D dispatch over the tiles of C with work. The others stay zero.
+            m_tileMask = BuildTileMask(buf1Data.data(), buf2Data.data(), m_M, m_N, m_K, tileM, tileN, m_tileK, m_blockSparseA, m_blockSparseB);
+            m_occupiedTiles = OccupiedTiles(m_tileMask);
+            std::cout << " Block-sparse tiles: " << m_occupiedTiles.size() << " of " << mDispatchX * mDispatchY << " tiles of C, "
+                      << OccupiedTileSteps(m_tileMask) << " of " << (long long)mDispatchX * mDispatchY * m_tileMask.tilesK << " K steps" << std::endl;
+            mDispatchX = UINT(m_occupiedTiles.size());
+            mDispatchY = 1;
+            if (mDispatchX > D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION)
+            {
+                std::cerr << "Too many tiles with work for a 1D dispatch." << std::endl;
+                return;
+            }
+        }
+
+    }
+    else {
+        m_splitEdges = false;
+        m_tileK = mLocalGroupSizeX * 4; // 4 means to get 4 float data.
+        int tile = mLocalGroupSizeX * mWorkPerThreadX;
+        mDispatchX = ceil(float(m_M * m_N) / float(tile));
+        mDispatchY = 1;
+        std::cout << " M = " << m_M << ", K = " << m_K << ", N = " << m_N << ", mDispatchX = " << mDispatchX << ", mDispatchY = " << mDispatchY << std::endl;
+    }
+
+    LoadPipeline();
+    LoadAssets();
+    RunCompute();
+}
+
+
+// Picks the kernel for "--kernel auto" from the shape of the problem. A single
+// column or row of C is a GEMV that is bound by reading the matrix once. Up to 16
+// rows still read B once per group with the small-M kernel, which holds a sum per
+// row in registers. Beyond that the tiled GEMM reuses enough of B to win. Textures
+// are only supported by the tiled kernels.
+void D3D12Sample::ChooseKernelForShape()
+{
+    const char* name;
+    if (mStorageType != STORAGETYPE::TEXTURE && m_N == 1)
+    {
+        mKernelType = KERNELTYPE::SLM_MatMul_vector_chunked;
+        name = "SLM_MatMul_vector_chunked";
+        mWorkPerThreadX = 1;
+        mWorkPerThreadY = 1;
+        m_componentSize = 1;
+    }
+    else if (mStorageType != STORAGETYPE::TEXTURE && m_M == 1)
+    {
+        mKernelType = KERNELTYPE::SLM_MatMul_vector_matrix_chunked;
+        name = "SLM_MatMul_vector_matrix_chunked";
+        mWorkPerThreadX = 4;
+        mWorkPerThreadY = 1;
+        m_componentSize = 1;
+    }
+    else if (mStorageType != STORAGETYPE::TEXTURE && m_M <= 16)
+    {
+        mKernelType = KERNELTYPE::SLM_MatMul_small_m;
+        name = "SLM_MatMul_small_m";
+        mWorkPerThreadX = 4;
+        mWorkPerThreadY = 1;
+        m_componentSize = 1;
+    }
+    else if (m_K % 4 == 0 && m_N % 4 == 0)
+    {
+        mKernelType = KERNELTYPE::SLM_8X8_4X16;
+        name = "SLM_8X8_4X16";
+        mWorkPerThreadX = 8;
+        mWorkPerThreadY = 8;
+        m_componentSize = 4;
+    }
+    else
+    {
+        // The float4 kernels need K and N in whole float4s.
+        mKernelType = KERNELTYPE::SLM_4x4_16x16_float;
+        name = "SLM_4x4_16x16_float";
+        mWorkPerThreadX = 4;
+        mWorkPerThreadY = 4;
+        m_componentSize = 1;
+    }
+    std::cout << " Kernel for M = " << m_M << ", N = " << m_N << ": " << name << std::endl;
+}
+
+// Fills in m_lda, m_ldb and m_ldc in elements of the stored matrices: int8 values
+// for the int8 kernel, int4 columns for the int4 weights, and floats or doubles
+// otherwise. Returns false if a given stride can't be used.
+bool D3D12Sample::ResolveLeadingDimensions()
+{
+    const bool isInt8 = mKernelType == KERNELTYPE::SLM_INT8_4x4_16x16;
+    const bool isInt4 = mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_int4;
+    // Dense row lengths of the stored matrices. The int8 kernel stores B^T.
+    const UINT rowA = m_transA ? m_M : m_K;
+    const UINT rowB = (m_transB || isInt8) ? m_K : m_N;
+    const UINT rowC = m_N;
+    // Strides must keep whole vector loads (and packed words) on row boundaries.
+    const UINT alignA = isInt8 ? 4 : m_componentSize;
+    const UINT alignB = isInt8 ? 4 : (isInt4 ? 8 : m_componentSize);
+    const UINT alignC = m_componentSize;
+    const UINT alignABytes = isInt8 ? 4 : alignA * m_elementSize;
+    const UINT alignBBytes = (isInt8 || isInt4) ? 4 : alignB * m_elementSize;
+    const UINT alignCBytes = alignC * m_elementSize;
+
+    if (mStorageType == STORAGETYPE::TEXTURE && (m_lda || m_ldb || m_ldc || m_autoPad))
+    {
+        std::cerr << "Textures have their own row pitch, so --lda/--ldb/--ldc/--pad need a buffer storage type." << std::endl;
+        return false;
+    }
+    // The vector kernels address B and C linearly and the packed kernel reads B
+    // from its panels, so only the strides below apply to them.
+    if (mKernelType == KERNELTYPE::MatMul_vector_float || mKernelType == KERNELTYPE::SLM_MatMul_vector_float)
+    {
+        m_ldb = rowB;
+        m_ldc = rowC;
+    }
+    if (mKernelType == KERNELTYPE::SLM_8X8_4X16_packed)
+    {
+        m_ldb = rowB;
+    }
+
+    struct Operand { const char* name; UINT& ld; UINT row; UINT align; UINT alignBytes; };
+    Operand operands[] = {
+        { "lda", m_lda, rowA, alignA, alignABytes },
+        { "ldb", m_ldb, rowB, alignB, alignBBytes },
+        { "ldc", m_ldc, rowC, alignC, alignCBytes },
+    };
+    for (Operand& operand : operands)
+    {
+        if (operand.ld == 0)
+        {
+            operand.ld = m_autoPad ? PaddedLeadingDimension(operand.row, operand.align, operand.alignBytes) : operand.row;
+        }
+        else if (operand.ld < operand.row || operand.ld % operand.align != 0)
+        {
+            std::cerr << operand.name << " should be at least " << operand.row << " and a multiple of " << operand.align << "." << std::endl;
+            return false;
+        }
+    }
+    if (m_lda != rowA || m_ldb != rowB || m_ldc != rowC)
+    {
+        std::cout << " lda = " << m_lda << ", ldb = " << m_ldb << ", ldc = " << m_ldc << std::endl;
+    }
+    return true;
+}
+
+// Helper function for acquiring the first available hardware adapter that supports Direct3D 12.
+// If no such adapter can be found, *ppAdapter will be set to nullptr.
+void D3D12Sample::GetHardwareAdapter(IDXGIFactory2* pFactory, IDXGIAdapter1** ppAdapter)
+{
+    ComPtr<IDXGIAdapter1> adapter;
+    *ppAdapter = nullptr;
+
+    for (UINT adapterIndex = 0; DXGI_ERROR_NOT_FOUND != pFactory->EnumAdapters1(adapterIndex, &adapter); ++adapterIndex)
+    {
+        DXGI_ADAPTER_DESC1 desc;
+        ThrowIfFailed(adapter->GetDesc1(&desc));
+
+        if (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE)
+        {
+            // Don't select the Basic Render Driver adapter.
+            // If you want a software adapter, pass in "/warp" on the command line.
+            continue;
+        }
+
+        // Check to see if the adapter supports Direct3D 12, but don't create the
+        // actual device yet.
+        if (SUCCEEDED(D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_11_0, _uuidof(ID3D12Device), nullptr)))
+        {
+            break;
+        }
+    }
+
+    *ppAdapter = adapter.Detach();
+}
+
+void D3D12Sample::CreateDevice(const ComPtr<IDXGIFactory4>& factory)
+{
+    ComPtr<IDXGIAdapter1> hardwareAdapter;
+    GetHardwareAdapter(factory.Get(), &hardwareAdapter);
+
+    ThrowIfFailed(D3D12CreateDevice(
+        hardwareAdapter.Get(),
+        D3D_FEATURE_LEVEL_11_0,
+        IID_PPV_ARGS(&m_d3d12Device)
+    ));
+}
+
+
+// Load the compute pipeline dependencies.
+void D3D12Sample::LoadPipeline()
+{
+    UINT dxgiFactoryFlags = 0;
+
+#if defined(_DEBUG)
+    // Enable the debug layer (requires the Graphics Tools "optional feature").
+    // NOTE: Enabling the debug layer after device creation will invalidate the active device.
+    {
+        ComPtr<ID3D12Debug> debugController;
+        if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController))))
+        {
+            debugController->EnableDebugLayer();
+
+            // Enable additional debug layers.
+            dxgiFactoryFlags |= DXGI_CREATE_FACTORY_DEBUG;
+        }
+    }
+#endif
+
+    // Create DXGIFactory.
+    ComPtr<IDXGIFactory4> factory;
+    ThrowIfFailed(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)));
+
+    // Create device.
+    CreateDevice(factory);   
+    
+    // Describe and create the command queue.
+    D3D12_COMMAND_QUEUE_DESC queueDesc = { D3D12_COMMAND_LIST_TYPE_DIRECT, 0, D3D12_COMMAND_QUEUE_FLAG_NONE };
+
+    ThrowIfFailed(m_d3d12Device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_commandQueue)));
+    ThrowIfFailed(m_commandQueue->GetTimestampFrequency(&m_timestampFrequency));
+    ThrowIfFailed(
+        m_d3d12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_computeAllocator)));
+
+
+    // Create descriptor heaps.
+    {
+        // Describe and create a constant buffer view, shader resource views and unordered access view descriptor heap.
+        // Flags indicate that this descriptor heap can be bound to the pipeline 
+        // and that descriptors contained in it can be referenced by a root table.
+        D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+        heapDesc.NumDescriptors = 6;  // 1 constant buffer, 2 SRV, 1 UAV, 2 extra SRV.
+        heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+        heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+        ThrowIfFailed(m_d3d12Device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&m_cbSrvHeap)));
+
+        m_cbSrvDescriptorSize = m_d3d12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    }
+}
+
+// Creates a compute PSO for sourceFile compiled with the given defines. A DXIL
+// blob from precompile_shaders.py is used when the device supports shader model
+// 6.0, then an FXC blob cached by an earlier run. Otherwise the shader is
+// compiled with FXC and the blob is cached for the next run.
+ComPtr<ID3D12PipelineState> D3D12Sample::CreateComputePipeline(const char* sourceFile, const char* entryPoint, const ShaderDefines& defines)
+{
+    D3D12_COMPUTE_PIPELINE_STATE_DESC descComputePSO = {};
+    descComputePSO.pRootSignature = m_computeRootSignature.Get();
+    ComPtr<ID3D12PipelineState> pipelineState;
+    std::string file(sourceFile);
+    std::wstring sourcePath(file.begin(), file.end());
+
+    ComPtr<ID3DBlob> source;
+    bool useCache = !m_shaderCacheDir.empty() && SUCCEEDED(D3DReadFileToBlob(sourcePath.c_str(), &source));
+    auto cachePath = [&](const char* target)
+    {
+        std::string key = ShaderCacheKey(source->GetBufferPointer(), source->GetBufferSize(), entryPoint, target, defines);
+        std::string path = ShaderCachePath(m_shaderCacheDir, key);
+        return std::wstring(path.begin(), path.end());
+    };
+
+    ComPtr<ID3DBlob> shader;
+    if (useCache)
+    {
+        D3D12_FEATURE_DATA_SHADER_MODEL shaderModel = { D3D_SHADER_MODEL_6_0 };
+        if (SUCCEEDED(m_d3d12Device->CheckFeatureSupport(D3D12_FEATURE_SHADER_MODEL, &shaderModel, sizeof(shaderModel))) &&
+            shaderModel.HighestShaderModel >= D3D_SHADER_MODEL_6_0 &&
+            SUCCEEDED(D3DReadFileToBlob(cachePath("cs_6_0").c_str(), &shader)))
+        {
+            descComputePSO.CS = CD3DX12_SHADER_BYTECODE(shader.Get());
+            if (SUCCEEDED(m_d3d12Device->CreateComputePipelineState(&descComputePSO, IID_PPV_ARGS(&pipelineState))))
+            {
+                std::cout << " " << sourceFile << ": DXIL from " << m_shaderCacheDir << std::endl;
+                return pipelineState;
+            }
+            // DXC without the validator library emits unsigned DXIL, which the runtime rejects.
+            std::cerr << "The device rejected the cached DXIL of " << sourceFile << ", using FXC instead." << std::endl;
+        }
+        shader.Reset();
+        if (SUCCEEDED(D3DReadFileToBlob(cachePath("cs_5_0").c_str(), &shader)))
+        {
+            descComputePSO.CS = CD3DX12_SHADER_BYTECODE(shader.Get());
+            ThrowIfFailed(m_d3d12Device->CreateComputePipelineState(&descComputePSO, IID_PPV_ARGS(&pipelineState)));
+            std::cout << " " << sourceFile << ": DXBC from " << m_shaderCacheDir << std::endl;
+            return pipelineState;
+        }
+    }
+
+    std::vector<D3D_SHADER_MACRO> macros;
+    for (const auto& define : defines)
+    {
+        macros.push_back({ define.first.c_str(), define.second.c_str() });
+    }
+    macros.push_back({ nullptr, nullptr });
+    UINT compileFlags = 0;
+    ComPtr<ID3DBlob> errors;
+    auto compileStart = std::chrono::high_resolution_clock::now();
+    HRESULT hr = D3DCompileFromFile(sourcePath.c_str(), macros.data(), nullptr, entryPoint, "cs_5_0", compileFlags, 0, &shader, &errors);
+    if (FAILED(hr) && errors)
+    {
+        std::cerr << static_cast<const char*>(errors->GetBufferPointer()) << std::endl;
+    }
+    ThrowIfFailed(hr);
+    std::chrono::duration<double, std::milli> compileTime = std::chrono::high_resolution_clock::now() - compileStart;
+    std::cout << " " << sourceFile << ": compiled in " << compileTime.count() << " ms" << std::endl;
+    if (useCache)
+    {
+        // The cache only saves time, so failing to write it isn't an error.
+        std::wstring cacheDir(m_shaderCacheDir.begin(), m_shaderCacheDir.end());
+        CreateDirectoryW(cacheDir.c_str(), nullptr);
+        D3DWriteBlobToFile(shader.Get(), cachePath("cs_5_0").c_str(), TRUE);
+    }
+
+    descComputePSO.CS = CD3DX12_SHADER_BYTECODE(shader.Get());
+    ThrowIfFailed(m_d3d12Device->CreateComputePipelineState(&descComputePSO, IID_PPV_ARGS(&pipelineState)));
+    return pipelineState;
+}
+
+// Load the sample assets.
+void D3D12Sample::LoadAssets()
+{
+    // Create root signatures.
+    {
+        D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
+
+        // This is the highest version the sample supports. If CheckFeatureSupport succeeds, the HighestVersion returned will not be greater than this.
+        featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
+
+        CD3DX12_DESCRIPTOR_RANGE1 ranges[4];
+        CD3DX12_ROOT_PARAMETER1 rootParameters[4];
+
+        if (FAILED(m_d3d12Device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &featureData, sizeof(featureData))))
+        {
+            featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
+        }
+        // Root signature for compute pass.
+        ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE);
+        ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE);
+        ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE);
+        // Extra inputs (t2, t3) such as quantization parameters. Kernels that don't use them get null SRVs.
+        ranges[3].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 2, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE);
+        rootParameters[0].InitAsDescriptorTable(1, &ranges[0], D3D12_SHADER_VISIBILITY_ALL);
+        rootParameters[1].InitAsDescriptorTable(1, &ranges[1], D3D12_SHADER_VISIBILITY_ALL);
+        rootParameters[2].InitAsDescriptorTable(1, &ranges[2], D3D12_SHADER_VISIBILITY_ALL);
+        rootParameters[3].InitAsDescriptorTable(1, &ranges[3], D3D12_SHADER_VISIBILITY_ALL);
+
+        CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
+        rootSignatureDesc.Init_1_1(_countof(rootParameters), rootParameters, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+        ComPtr<ID3DBlob> signature;
+        ComPtr<ID3DBlob> error;
+        ThrowIfFailed(D3DX12SerializeVersionedRootSignature(&rootSignatureDesc, featureData.HighestVersion, &signature, &error));
+        ThrowIfFailed(m_d3d12Device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&m_computeRootSignature)));
+    }
+
+    // Create the compute pipeline state, which includes compiling and loading shaders.
+    D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+    ThrowIfFailed(m_d3d12Device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)));
+    if (m_elementSize == sizeof(double) && !options.DoublePrecisionFloatShaderOps)
+    {
+        throw std::runtime_error("The device doesn't support fp64 shader operations required by the DGEMM kernels.");
+    }
+    if (m_accumulateMode == ACCUMULATE_FP64)
+    {
+        if (!options.DoublePrecisionFloatShaderOps)
+        {
+            std::cerr << "The device doesn't support fp64 shader operations, falling back to kahan accumulation." << std::endl;
+            m_accumulateMode = ACCUMULATE_KAHAN;
+        }
+    }
+
+    // precompile_shaders.py enumerates the same defines to fill the shader cache.
+    ShaderDefines defines;
+    if (mStorageType == STORAGETYPE::TEXTURE)
+    {
+        defines.push_back({ "USE_TEXTURE", "1" });
+    }
+    else if (mStorageType == STORAGETYPE::STRUCTURED_BUFFER)
+    {
+        defines.push_back({ "USE_STRUCTURED_BUFFERS", "1" });
+    }
+    // Pass the workgroup size.
+    defines.push_back({ "LOCAL_GROUP_SIZE_X", std::to_string(mLocalGroupSizeX) });
+    defines.push_back({ "LOCAL_GROUP_SIZE_Y", std::to_string(mLocalGroupSizeY) });
+    defines.push_back({ "WORK_PER_THREAD_X", std::to_string(mWorkPerThreadX) });
+    defines.push_back({ "WORK_PER_THREAD_Y", std::to_string(mWorkPerThreadY) });
+    defines.push_back({ "INT4_GROUP_SIZE", std::to_string(m_int4GroupSize) });
+    defines.push_back({ "ACCUMULATE_MODE", std::to_string(int(m_accumulateMode)) });
+    defines.push_back({ "TRANS_A", m_transA ? "1" : "0" });
+    defines.push_back({ "TRANS_B", m_transB ? "1" : "0" });
+    if (mKernelType == KERNELTYPE::SLM_8X8_4X16_packed)
+    {
+        defines.push_back({ "PACKED_B", "1" });
+    }
+    defines.push_back({ "GEMV_ROWS", std::to_string(m_gemvRows) });
+    if (m_doubleBuffer)
+    {
+        defines.push_back({ "DOUBLE_BUFFER", "1" });
+    }
+    if (mKernelType == KERNELTYPE::SLM_Attention)
+    {
+        defines.push_back({ "ATTENTION_HEAD_DIM", std::to_string(m_N) });
+    }
+    if (mKernelType == KERNELTYPE::SLM_SpMM)
+    {
+        if (m_N == 1)
+        {
+            defines.push_back({ "SPMV", "1" });
+        }
+        if (m_blockedEll)
+        {
+            defines.push_back({ "BLOCKED_ELL", "1" });
+            defines.push_back({ "BELL_BLOCK", std::to_string(m_sparseBlock) });
+            defines.push_back({ "BELL_COLS", std::to_string(m_sparseEll.ellCols) });
+        }
+    }
+    if (m_conv)
+    {
+        defines.push_back({ "CONV", "1" });
+        defines.push_back({ "CONV_NCHW", m_convShape.nchw ? "1" : "0" });
+        defines.push_back({ "CONV_H", std::to_string(m_convShape.height) });
+        defines.push_back({ "CONV_W", std::to_string(m_convShape.width) });
+        defines.push_back({ "CONV_C", std::to_string(m_convShape.channels) });
+        defines.push_back({ "CONV_KH", std::to_string(m_convShape.kernelH) });
+        defines.push_back({ "CONV_KW", std::to_string(m_convShape.kernelW) });
+        defines.push_back({ "CONV_STRIDE", std::to_string(m_convShape.stride) });
+        defines.push_back({ "CONV_PAD", std::to_string(m_convShape.pad) });
+        defines.push_back({ "CONV_OH", std::to_string(ConvOutputHeight(m_convShape)) });
+        defines.push_back({ "CONV_OW", std::to_string(ConvOutputWidth(m_convShape)) });
+        defines.push_back({ "CONV_K", std::to_string(ConvGemmK(m_convShape)) });
+    }
+    ShaderDefines fixupDefines;
+    if (mKernelType == KERNELTYPE::SLM_Stream_K)
+    {
+        defines.push_back({ "STREAM_K_GROUPS", std::to_string(m_streamKGroups) });
+        defines.push_back({ "STREAM_K_DEPTH", std::to_string(kStreamKDepth) });
+        fixupDefines = defines;
+        fixupDefines.push_back({ "FIXUP", "1" });
+    }
+    ShaderDefines edgeDefines;
+    if (m_splitEdges)
+    {
+        edgeDefines = defines;
+        edgeDefines.push_back({ "EDGE_TILES", "1" });
+        defines.push_back({ "BOUNDS_CHECK", "0" });
+    }
+    if (m_raster != RASTER_ROW_MAJOR)
+    {
+        defines.push_back({ "RASTER", std::to_string(int(m_raster)) });
+        defines.push_back({ "RASTER_GROUP_M", std::to_string(m_rasterGroupM) });
+    }
+    if (m_blockSparseA || m_blockSparseB)
+    {
+        defines.push_back({ "BLOCK_SPARSE", "1" });
+    }
+    if (mKernelType == KERNELTYPE::SLM_SYRK || mKernelType == KERNELTYPE::SLM_TRMM)
+    {
+        defines.push_back({ "TRMM", mKernelType == KERNELTYPE::SLM_TRMM ? "1" : "0" });
+        defines.push_back({ "UPPER", m_upper ? "1" : "0" });
+    }
+
+    std::string generatedFile;
+    const char* shaderFile;
+    const char* entryPoint = "main";
+    if (mKernelType == KERNELTYPE::SLM_8X8_4X16 || mKernelType == KERNELTYPE::SLM_8X8_4X16_packed)
+    {
+        shaderFile = "SLM_8X8_4X16.hlsl";
+        entryPoint = "CSMain";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_4x4_16x16_v4)
+    {
+        shaderFile = "SLM_4x4_16x16_vec4.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_4x4_shared_A)
+    {
+        shaderFile = "SLM_4X4_shared_A.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_4x4_16x16_4_FLOATS)
+    {
+        shaderFile = "SLM_4x4_16x16_4_floats.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::MatMul_4x4_16x4_float)
+    {
+        shaderFile = "Matmul_4x4_16x4.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::MatMul_vector_float)
+    {
+        shaderFile = "Matmul_vector.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_MatMul_vector_float)
+    {
+        shaderFile = "SLM_Matmul_vector.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_float)
+    {
+        shaderFile = "SLM_Matmul_vector_matrix.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_one)
+    {
+        shaderFile = "SLM_Matmul_vector_matrix_one.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_4x4_16x16_float_coalesced) {
+        shaderFile = "SLM_4x4_16x16_coalesced.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_chunked || mKernelType == KERNELTYPE::SLM_MatMul_small_m)
+    {
+        shaderFile = "SLM_Matmul_vector_matrix_chunked.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_MatMul_vector_chunked)
+    {
+        shaderFile = "SLM_Matmul_vector_chunked.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_INT8_4x4_16x16)
+    {
+        shaderFile = "SLM_INT8_4X4_16X16.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_int4)
+    {
+        shaderFile = "SLM_Matmul_vector_matrix_int4.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_DGEMM_4x4 || mKernelType == KERNELTYPE::SLM_DGEMM_8x8)
+    {
+        shaderFile = "SLM_DGEMM.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_4x4_16x16_trans)
+    {
+        shaderFile = "SLM_4X4_16X16_trans.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_Stream_K)
+    {
+        shaderFile = "SLM_Stream_K.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_Attention)
+    {
+        shaderFile = "SLM_Attention.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_SpMM)
+    {
+        shaderFile = "SLM_SpMM.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_Grouped_GEMM)
+    {
+        shaderFile = "SLM_Grouped_GEMM.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::SLM_SYRK || mKernelType == KERNELTYPE::SLM_TRMM)
+    {
+        shaderFile = "SLM_SYRK.hlsl";
+    }
+    else if (mKernelType == KERNELTYPE::Generated)
+    {
+        if (!WriteGeneratedKernel(m_generatedShape, kGeneratedKernelDir))
+        {
+            throw std::runtime_error("Can't write the generated kernel to " + std::string(kGeneratedKernelDir) + ".");
+        }
+        generatedFile = std::string(kGeneratedKernelDir) + "/" + GeneratedKernelName(m_generatedShape) + ".hlsl";
+        shaderFile = generatedFile.c_str();
+    }
+    else
+    {
+        assert(mKernelType == KERNELTYPE::SLM_4x4_16x16_float);
+        shaderFile = "SLM_4x4_16x16.hlsl";
+    }
+
+    m_computePSO = CreateComputePipeline(shaderFile, entryPoint, defines);
+    m_computePSO->SetName(L"Compute PSO");
+    if (mEdgeDispatchCount > 0)
+    {
+        m_edgePSO = CreateComputePipeline(shaderFile, entryPoint, edgeDefines);
+        m_edgePSO->SetName(L"Edge tile PSO");
+    }
+    if (mFixupDispatchCount > 0)
+    {
+        m_fixupPSO = CreateComputePipeline(shaderFile, entryPoint, fixupDefines);
+        m_fixupPSO->SetName(L"Stream-K fix-up PSO");
+    }
+
+    // Create the command list.
+    ThrowIfFailed(
+        m_d3d12Device->CreateCommandList(
+            0,
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            m_computeAllocator.Get(),
+            m_computePSO.Get(),
+            IID_PPV_ARGS(&m_commandList)));
+
+    // Create a constant buffer.
+    {
+        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(256),
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(&m_intermediateBuffer)));
+
+        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(256),
+            D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
+            nullptr,
+            IID_PPV_ARGS(&m_constantBuffer)));
+
+        ResourceBarrier(m_commandList.Get(), m_constantBuffer.Get(), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_RESOURCE_STATE_COPY_DEST);
+        m_constantBufferData.M = m_M;
+        m_constantBufferData.N = m_N;
+        m_constantBufferData.K = m_K;
+        m_constantBufferData.TILE_K = m_tileK;
+        m_constantBufferData.LDA = m_lda;
+        m_constantBufferData.LDB = m_ldb;
+        m_constantBufferData.LDC = m_ldc;
+		D3D12_SUBRESOURCE_DATA bufferData = {};
+        bufferData.pData = &m_constantBufferData;
+        bufferData.RowPitch = sizeof(m_constantBufferData);
+        UpdateSubresources(m_commandList.Get(), m_constantBuffer.Get(), m_intermediateBuffer.Get(), 0, 0, 1, &bufferData);
+        ResourceBarrier(m_commandList.Get(), m_constantBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+
+        // Describe and create a constant buffer view.
+        D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
+        cbvDesc.BufferLocation = m_constantBuffer->GetGPUVirtualAddress();
+        cbvDesc.SizeInBytes = (sizeof(SceneConstantBuffer) + 255) & ~255;    // CB size is required to be 256-byte aligned.
+        CD3DX12_CPU_DESCRIPTOR_HANDLE cbHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
+        m_d3d12Device->CreateConstantBufferView(&cbvDesc, cbHandle);
+    }
+
+    // Null descriptors for the extra SRV slots, overwritten by the modes that use them.
+    {
+        D3D12_SHADER_RESOURCE_VIEW_DESC nullSrvDesc = {};
+        nullSrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+        nullSrvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+        nullSrvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+        CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart(), 4, m_cbSrvDescriptorSize);
+        m_d3d12Device->CreateShaderResourceView(nullptr, &nullSrvDesc, srvHandle);
+        srvHandle.Offset(1, m_cbSrvDescriptorSize);
+        m_d3d12Device->CreateShaderResourceView(nullptr, &nullSrvDesc, srvHandle);
+    }
+
+    if (mKernelType == KERNELTYPE::SLM_INT8_4x4_16x16)
+    {
+        LoadInt8Resources();
+    }
+    else if (mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_int4)
+    {
+        LoadInt4Resources();
+    }
+    else if (m_elementSize == sizeof(double))
+    {
+        LoadDoubleResources();
+    }
+    else if (mKernelType == KERNELTYPE::SLM_4x4_16x16_trans)
+    {
+        LoadTransposedResources();
+    }
+    else if (mKernelType == KERNELTYPE::SLM_8X8_4X16_packed)
+    {
+        LoadPackedResources();
+    }
+    else if (m_conv)
+    {
+        LoadConvResources();
+    }
+    else if (mKernelType == KERNELTYPE::SLM_Attention)
+    {
+        LoadAttentionResources();
+    }
+    else if (mKernelType == KERNELTYPE::SLM_SpMM)
+    {
+        LoadSparseResources();
+    }
+    else if (m_blockSparseA || m_blockSparseB)
+    {
+        LoadBlockSparseResources();
+    }
+    else if (mKernelType == KERNELTYPE::SLM_Grouped_GEMM)
+    {
+        LoadGroupedResources();
+    }
+    else if (mKernelType == KERNELTYPE::SLM_SYRK || mKernelType == KERNELTYPE::SLM_TRMM)
+    {
+        LoadTriangularResources();
+    }
+    else if (mStorageType == STORAGETYPE::TEXTURE)
+    {
+        LoadTextureResources();
+    }
+    else
+    {
+        LoadBufferResources();
+    }
+
+    // Close the command list and execute it to begin the buffer copy into
+    // the default heap.
+    ThrowIfFailed(m_commandList->Close());
+    ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
+    m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+
+    // Create synchronization objects and wait until assets have been uploaded to the GPU.
+    {
+        ThrowIfFailed(m_d3d12Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_computeFence)));
+        m_computeFenceValue = 1;
+
+        // Create an event handle to use for frame synchronization.
+        m_computeFenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        if (m_computeFenceEvent == nullptr)
+        {
+            ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+        }
+
+        // Wait for the command list to execute; we are reusing the same command
+        // list in our main loop but for now, we just want to wait for setup to
+        // complete before continuing.
+        WaitForGpu();
+    }
+
+}
+
+void D3D12Sample::LoadTextureResources()
+{
+    {
+        // Create the texture1.
+        const UINT elementCount = m_M * m_K;
+        for (int i = 0; i < elementCount; ++i)
+        {
+            buf1Data.push_back((float)rand() / float(RAND_MAX));
+        }
+        const UINT bufferSize = buf1Data.size() * sizeof(float);
+
+        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(&m_intermediatebuffer1)));
+
+        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32G32B32A32_FLOAT, m_K / m_componentSize, m_M),
+            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+            nullptr,
+            IID_PPV_ARGS(&mTexture1)));
+
+        ResourceBarrier(m_commandList.Get(), mTexture1.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
+        D3D12_SUBRESOURCE_DATA bufferData = {};
+        bufferData.pData = buf1Data.data();
+        bufferData.RowPitch = m_K * sizeof(float);
+        bufferData.SlicePitch = bufferData.RowPitch * m_M;
+        UpdateSubresources(m_commandList.Get(), mTexture1.Get(), m_intermediatebuffer1.Get(), 0, 0, 1, &bufferData);
+        ResourceBarrier(m_commandList.Get(), mTexture1.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+        // Create SRV for the texture1
+        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels = 1;
+        srvDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+        CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
+        srvHandle.Offset(1, m_cbSrvDescriptorSize); // First one is for constant buffer.
+        m_d3d12Device->CreateShaderResourceView(mTexture1.Get(), &srvDesc, srvHandle);
+    }
+
+	{
+		// create the texture2
+		const UINT elementCount = m_K * m_N;
+		for (int i = 0; i < elementCount; ++i)
+		{
+			buf2Data.push_back((float)rand() / float(RAND_MAX));
+		}
+		const UINT bufferSize = buf2Data.size() * sizeof(float);
+
+		ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(&m_intermediatebuffer2)));
+
+		ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32G32B32A32_FLOAT, m_N / m_componentSize, m_K),
+			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+			nullptr,
+			IID_PPV_ARGS(&mTexture2)));
+
+		ResourceBarrier(m_commandList.Get(), mTexture2.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
+		D3D12_SUBRESOURCE_DATA bufferData = {};
+		bufferData.pData = buf2Data.data();
+		bufferData.RowPitch = m_N * sizeof(float);
+		bufferData.SlicePitch = bufferData.RowPitch * m_K;
+		UpdateSubresources(m_commandList.Get(), mTexture2.Get(), m_intermediatebuffer2.Get(), 0, 0, 1, &bufferData);
+		ResourceBarrier(m_commandList.Get(), mTexture2.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+		// Create SRV for texure2
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MipLevels = 1;
+		srvDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+
+		CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
+		srvHandle.Offset(2, m_cbSrvDescriptorSize); // First one is for constant buffer. Senond one is for buffer1
+		m_d3d12Device->CreateShaderResourceView(mTexture2.Get(), &srvDesc, srvHandle);
+	}
+	// Create textureResult and UAV for it.
+	{
+		const UINT elementCount = m_M * m_N;
+		const UINT bufferSize = elementCount * sizeof(float);
+
+		ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32G32B32A32_FLOAT, m_N / m_componentSize, m_M, 1, 0, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+			nullptr,
+			IID_PPV_ARGS(&mTextureResult))
+		);
+
+		// Create UAV for textureResult
+		D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+		uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+		uavDesc.Texture2D.MipSlice = 0;
+		uavDesc.Texture2D.PlaneSlice = 0;
+		uavDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+
+		CD3DX12_CPU_DESCRIPTOR_HANDLE uavHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
+		uavHandle.Offset(3, m_cbSrvDescriptorSize); // First one is for constant buffer. Senond one is for buffer1. Third one is for buffer2.
+		m_d3d12Device->CreateUnorderedAccessView(mTextureResult.Get(), nullptr, &uavDesc, uavHandle);
+	}
+
+	// Create the query result buffer.
+	{
+		// Two timestamps for each frame.
+		const UINT resultCount = 2 * m_computeCount;
+		const UINT resultBufferSize = resultCount * sizeof(UINT64);
+		D3D12_QUERY_HEAP_DESC timestampHeapDesc = {};
+		timestampHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+		timestampHeapDesc.Count = resultCount;
+
+		ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(resultBufferSize),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&m_queryResult)
+		));
+		ThrowIfFailed(m_d3d12Device->CreateQueryHeap(&timestampHeapDesc, IID_PPV_ARGS(&m_queryHeap)));
+	}
+}
+
+// The input tensor goes to the GPU in place of A. The weights are B with their
+// K rows padded by zeros to m_K; buf1Data gets the im2col matrix of the input,
+// so the CPU reference checks the convolution like any other GEMM.
+void D3D12Sample::LoadConvResources()
+{
+    const size_t inputSize = size_t(m_convShape.batch) * m_convShape.height * m_convShape.width * m_convShape.channels;
+    // Padded to whole float4s for the structured buffer view.
+    m_convInput.resize((inputSize + 3) / 4 * 4);
+    for (size_t i = 0; i < inputSize; ++i)
+    {
+        m_convInput[i] = (float)rand() / float(RAND_MAX);
+    }
+    buf2Data.assign(size_t(m_K) * m_N, 0.0f);
+    for (size_t i = 0; i < size_t(ConvGemmK(m_convShape)) * m_N; ++i)
+    {
+        buf2Data[i] = (float)rand() / float(RAND_MAX);
+    }
+    buf1Data.resize(size_t(m_M) * m_K);
+    Im2Col(m_convInput.data(), m_convShape, m_K, buf1Data.data());
+
+    const UINT inputBytes = UINT(m_convInput.size() * sizeof(float));
+    const UINT weightBytes = UINT(buf2Data.size() * sizeof(float));
+    CreateBufferWithData(m_convInput.data(), inputBytes, m_intermediatebuffer1, m_buffer1);
+    CreateBufferWithData(buf2Data.data(), weightBytes, m_intermediatebuffer2, m_buffer2);
+    CreateBufferSRV(m_buffer1.Get(), inputBytes, m_componentSize * sizeof(float), 1);
+    CreateBufferSRV(m_buffer2.Get(), weightBytes, m_componentSize * sizeof(float), 2);
+
+    CreateResultBuffer();
+    CreateQueryResources();
+}
+
+// Q, the keys and the values go to t0, t1 and t2. They are centred on zero so
+// the scores spread out and the softmax is far from uniform.
+void D3D12Sample::LoadAttentionResources()
+{
+    buf1Data.resize(size_t(m_M) * m_N);
+    buf2Data.resize(size_t(m_K) * m_N);
+    m_attentionV.resize(size_t(m_K) * m_N);
+    for (std::vector<float>* data : { &buf1Data, &buf2Data, &m_attentionV })
+    {
+        for (float& value : *data)
+        {
+            value = (float)rand() / float(RAND_MAX) - 0.5f;
+        }
+    }
+
+    const UINT qSize = UINT(buf1Data.size() * sizeof(float));
+    const UINT kvSize = UINT(buf2Data.size() * sizeof(float));
+    CreateBufferWithData(buf1Data.data(), qSize, m_intermediatebuffer1, m_buffer1);
+    CreateBufferWithData(buf2Data.data(), kvSize, m_intermediatebuffer2, m_buffer2);
+    CreateBufferWithData(m_attentionV.data(), kvSize, m_intermediatebuffer3, m_buffer3);
+    CreateBufferSRV(m_buffer1.Get(), qSize, sizeof(float), 1);
+    CreateBufferSRV(m_buffer2.Get(), kvSize, sizeof(float), 2);
+    CreateBufferSRV(m_buffer3.Get(), kvSize, sizeof(float), 4);
+
+    CreateResultBuffer();
+    CreateQueryResources();
+}
+
+// The values of A go to t0 and B to t1. The CSR row offsets and column indices,
+// or the blocked-ELL block columns, go to t2 and t3.
+void D3D12Sample::LoadSparseResources()
+{
+    buf2Data.resize(size_t(m_K) * m_N);
+    for (float& value : buf2Data)
+    {
+        value = (float)rand() / float(RAND_MAX);
+    }
+
+    // Buffers can't be empty, so a matrix without nonzeros still uploads one
+    // unused value. B is padded to whole float4s for the structured SpMV views.
+    std::vector<float> values = m_blockedEll ? m_sparseEll.values : m_sparseA.values;
+    std::vector<int> offsets = m_blockedEll ? m_sparseEll.blockCols : m_sparseA.rowPtr;
+    std::vector<int> columns = m_blockedEll ? std::vector<int>() : m_sparseA.colIdx;
+    std::vector<float> b = buf2Data;
+    values.resize((std::max)(values.size(), size_t(1)));
+    offsets.resize((std::max)(offsets.size(), size_t(1)));
+    columns.resize((std::max)(columns.size(), size_t(1)));
+    b.resize((b.size() + 3) / 4 * 4);
+
+    const UINT valueSize = UINT(values.size() * sizeof(float));
+    const UINT bSize = UINT(b.size() * sizeof(float));
+    const UINT offsetSize = UINT(offsets.size() * sizeof(int));
+    const UINT columnSize = UINT(columns.size() * sizeof(int));
+    CreateBufferWithData(values.data(), valueSize, m_intermediatebuffer1, m_buffer1);
+    CreateBufferWithData(b.data(), bSize, m_intermediatebuffer2, m_buffer2);
+    CreateBufferWithData(offsets.data(), offsetSize, m_intermediatebuffer3, m_buffer3);
+    CreateBufferWithData(columns.data(), columnSize, m_intermediatebuffer4, m_buffer4);
+    CreateBufferSRV(m_buffer1.Get(), valueSize, sizeof(float), 1);
+    CreateBufferSRV(m_buffer2.Get(), bSize, m_componentSize * sizeof(float), 2);
+    CreateBufferSRV(m_buffer3.Get(), offsetSize, sizeof(int), 4);
+    CreateBufferSRV(m_buffer4.Get(), columnSize, sizeof(int), 5);
+
+    CreateResultBuffer();
+    CreateQueryResources();
+}
+
+// A and B are the pruned matrices made in Start. The tile list of the compacted
+// dispatch goes to t2 and the mask of its K steps to t3.
+void D3D12Sample::LoadBlockSparseResources()
+{
+    const std::vector<float> a = WithLeadingDimension(buf1Data.data(), m_M, m_K, m_lda);
+    const std::vector<float> b = WithLeadingDimension(buf2Data.data(), m_K, m_N, m_ldb);
+    // Buffers can't be empty, so a product without work still uploads one unused tile.
+    std::vector<uint32_t> tiles = m_occupiedTiles;
+    tiles.resize((std::max)(tiles.size(), size_t(1)));
+
+    const UINT aSize = UINT(a.size() * sizeof(float));
+    const UINT bSize = UINT(b.size() * sizeof(float));
+    const UINT tileSize = UINT(tiles.size() * sizeof(uint32_t));
+    const UINT maskSize = UINT(m_tileMask.bits.size() * sizeof(uint32_t));
+    CreateBufferWithData(a.data(), aSize, m_intermediatebuffer1, m_buffer1);
+    CreateBufferWithData(b.data(), bSize, m_intermediatebuffer2, m_buffer2);
+    CreateBufferWithData(tiles.data(), tileSize, m_intermediatebuffer3, m_buffer3);
+    CreateBufferWithData(m_tileMask.bits.data(), maskSize, m_intermediatebuffer4, m_buffer4);
+    CreateBufferSRV(m_buffer1.Get(), aSize, m_componentSize * sizeof(float), 1);
+    CreateBufferSRV(m_buffer2.Get(), bSize, m_componentSize * sizeof(float), 2);
+    CreateBufferSRV(m_buffer3.Get(), tileSize, sizeof(uint32_t), 4);
+    CreateBufferSRV(m_buffer4.Get(), maskSize, sizeof(uint32_t), 5);
+
+    CreateResultBuffer();
+    CreateQueryResources();
+}
+
+// The stacked A and B go to t0 and t1, the tile table to t2 and the problems
+// to t3.
+void D3D12Sample::LoadGroupedResources()
+{
+    buf1Data.resize(size_t(m_M) * m_K);
+    buf2Data.resize(m_groupedProblems.size() * m_K * m_N);
+    for (std::vector<float>* data : { &buf1Data, &buf2Data })
+    {
+        for (float& value : *data)
+        {
+            value = (float)rand() / float(RAND_MAX);
+        }
+    }
+
+    const UINT aSize = UINT(buf1Data.size() * sizeof(float));
+    const UINT bSize = UINT(buf2Data.size() * sizeof(float));
+    const UINT tileSize = UINT(m_groupedTiles.size() * sizeof(uint32_t));
+    const UINT problemSize = UINT(m_groupedProblems.size() * sizeof(GroupedGemmProblem));
+    CreateBufferWithData(buf1Data.data(), aSize, m_intermediatebuffer1, m_buffer1);
+    CreateBufferWithData(buf2Data.data(), bSize, m_intermediatebuffer2, m_buffer2);
+    CreateBufferWithData(m_groupedTiles.data(), tileSize, m_intermediatebuffer3, m_buffer3);
+    CreateBufferWithData(m_groupedProblems.data(), problemSize, m_intermediatebuffer4, m_buffer4);
+    CreateBufferSRV(m_buffer1.Get(), aSize, sizeof(float), 1);
+    CreateBufferSRV(m_buffer2.Get(), bSize, sizeof(float), 2);
+    CreateBufferSRV(m_buffer3.Get(), tileSize, 2 * sizeof(uint32_t), 4);
+    CreateBufferSRV(m_buffer4.Get(), problemSize, sizeof(GroupedGemmProblem), 5);
+
+    CreateResultBuffer();
+    CreateQueryResources();
+}
+
+// A (buf1Data) goes to t0, stored as op(A) or, with --trans TN, as its
+// transpose. SLM_SYRK doesn't read B, so A is bound as t1 as well; SLM_TRMM
+// reads B (buf2Data) there. The triangle of A that TRMM ignores holds values
+// too, so that the kernel is checked for skipping them.
+void D3D12Sample::LoadTriangularResources()
+{
+    buf1Data.resize(size_t(m_M) * m_K);
+    if (mKernelType == KERNELTYPE::SLM_TRMM)
+    {
+        buf2Data.resize(size_t(m_K) * m_N);
+    }
+    for (std::vector<float>* data : { &buf1Data, &buf2Data })
+    {
+        for (float& value : *data)
+        {
+            value = (float)rand() / float(RAND_MAX);
+        }
+    }
+
+    const UINT aSize = UINT(buf1Data.size() * sizeof(float));
+    CreateBufferWithData(buf1Data.data(), aSize, m_intermediatebuffer1, m_buffer1);
+    CreateBufferSRV(m_buffer1.Get(), aSize, sizeof(float), 1);
+    if (mKernelType == KERNELTYPE::SLM_TRMM)
+    {
+        const UINT bSize = UINT(buf2Data.size() * sizeof(float));
+        CreateBufferWithData(buf2Data.data(), bSize, m_intermediatebuffer2, m_buffer2);
+        CreateBufferSRV(m_buffer2.Get(), bSize, sizeof(float), 2);
+    }
+    else
+    {
+        CreateBufferSRV(m_buffer1.Get(), aSize, sizeof(float), 2);
+    }
+
+    CreateResultBuffer();
+    CreateQueryResources();
+}
+
+void D3D12Sample::LoadBufferResources()
+{
+    for (UINT i = 0; i < m_M * m_K; ++i)
+    {
+        buf1Data.push_back((float)rand() / float(RAND_MAX));
+    }
+    for (UINT i = 0; i < m_K * m_N; ++i)
+    {
+        buf2Data.push_back((float)rand() / float(RAND_MAX));
+    }
+
+    // buf1Data and buf2Data stay dense for the CPU checks; the GPU copies use the
+    // resolved row strides.
+    const std::vector<float> a = WithLeadingDimension(buf1Data.data(), m_M, m_K, m_lda);
+    const std::vector<float> b = WithLeadingDimension(buf2Data.data(), m_K, m_N, m_ldb);
+    const UINT aSize = UINT(a.size() * sizeof(float));
+    const UINT bSize = UINT(b.size() * sizeof(float));
+    CreateBufferWithData(a.data(), aSize, m_intermediatebuffer1, m_buffer1);
+    CreateBufferWithData(b.data(), bSize, m_intermediatebuffer2, m_buffer2);
+
+    // Descriptor 0 is the constant buffer and 3 is the UAV.
+    CreateBufferSRV(m_buffer1.Get(), aSize, m_componentSize * sizeof(float), 1);
+    CreateBufferSRV(m_buffer2.Get(), bSize, m_componentSize * sizeof(float), 2);
+
+    CreateResultBuffer();
+    CreateQueryResources();
+}
+
+void D3D12Sample::LoadInt8Resources()
+{
+    for (UINT i = 0; i < m_M * m_K; ++i)
+    {
+        buf1Data.push_back((float)rand() / float(RAND_MAX));
+    }
+    for (UINT i = 0; i < m_K * m_N; ++i)
+    {
+        buf2Data.push_back((float)rand() / float(RAND_MAX));
+    }
+
+    // Quantize A per row and B per column. The columns of B are written out
+    // as the rows of B^T.
+    m_int8A.resize(m_M * m_K);
+    m_int8Bt.resize(m_N * m_K);
+    m_quantParamsA.resize(m_M);
+    m_quantParamsB.resize(m_N);
+    QuantizeInt8(buf1Data.data(), m_M, m_K, m_K, 1, m_int8A.data(), m_quantParamsA.data());
+    QuantizeInt8(buf2Data.data(), m_N, m_K, 1, m_N, m_int8Bt.data(), m_quantParamsB.data());
+
+    const std::vector<int8_t> a = WithLeadingDimension(m_int8A.data(), m_M, m_K, m_lda);
+    const std::vector<int8_t> bt = WithLeadingDimension(m_int8Bt.data(), m_N, m_K, m_ldb);
+    const UINT paramsASize = m_M * sizeof(QuantParams);
+    const UINT paramsBSize = m_N * sizeof(QuantParams);
+    CreateBufferWithData(a.data(), UINT(a.size()), m_intermediatebuffer1, m_buffer1);
+    CreateBufferWithData(bt.data(), UINT(bt.size()), m_intermediatebuffer2, m_buffer2);
+    CreateBufferWithData(m_quantParamsA.data(), paramsASize, m_intermediatebuffer3, m_buffer3);
+    CreateBufferWithData(m_quantParamsB.data(), paramsBSize, m_intermediatebuffer4, m_buffer4);
+
+    // Descriptor 0 is the constant buffer and 3 is the UAV.
+    CreateBufferSRV(m_buffer1.Get(), UINT(a.size()), sizeof(UINT), 1);
+    CreateBufferSRV(m_buffer2.Get(), UINT(bt.size()), sizeof(UINT), 2);
+    CreateBufferSRV(m_buffer3.Get(), paramsASize, sizeof(QuantParams), 4);
+    CreateBufferSRV(m_buffer4.Get(), paramsBSize, sizeof(QuantParams), 5);
+
+    CreateResultBuffer();
+    CreateQueryResources();
+}
+
+void D3D12Sample::LoadDoubleResources()
+{
+    // The fp32 inputs of the other kernels, widened, so that the DGEMM is
+    // checked against the same fp64 reference as they are.
+    m_doubleA.resize(m_M * m_K);
+    m_doubleB.resize(m_K * m_N);
+    for (double& value : m_doubleA)
+    {
+        value = (float)rand() / float(RAND_MAX);
+    }
+    for (double& value : m_doubleB)
+    {
+        value = (float)rand() / float(RAND_MAX);
+    }
+
+    const std::vector<double> a = WithLeadingDimension(m_doubleA.data(), m_M, m_K, m_lda);
+    const std::vector<double> b = WithLeadingDimension(m_doubleB.data(), m_K, m_N, m_ldb);
+    const UINT aSize = UINT(a.size() * sizeof(double));
+    const UINT bSize = UINT(b.size() * sizeof(double));
+    CreateBufferWithData(a.data(), aSize, m_intermediatebuffer1, m_buffer1);
+    CreateBufferWithData(b.data(), bSize, m_intermediatebuffer2, m_buffer2);
+
+    // Descriptor 0 is the constant buffer and 3 is the UAV.
+    CreateBufferSRV(m_buffer1.Get(), aSize, sizeof(double), 1);
+    CreateBufferSRV(m_buffer2.Get(), bSize, sizeof(double), 2);
+
+    CreateResultBuffer();
+    CreateQueryResources();
+}
+
+void D3D12Sample::LoadTransposedResources()
+{
+    for (UINT i = 0; i < m_M * m_K; ++i)
+    {
+        buf1Data.push_back((float)rand() / float(RAND_MAX));
+    }
+    for (UINT i = 0; i < m_K * m_N; ++i)
+    {
+        buf2Data.push_back((float)rand() / float(RAND_MAX));
+    }
+
+    // Upload each operand in the layout the kernel was compiled for.
+    const float* pA = buf1Data.data();
+    const float* pB = buf2Data.data();
+    if (m_transA)
+    {
+        m_transposedA.resize(m_M * m_K);
+        TransposeMatrix(buf1Data.data(), m_M, m_K, m_transposedA.data());
+        pA = m_transposedA.data();
+    }
+    if (m_transB)
+    {
+        m_transposedB.resize(m_K * m_N);
+        TransposeMatrix(buf2Data.data(), m_K, m_N, m_transposedB.data());
+        pB = m_transposedB.data();
+    }
+
+    const std::vector<float> a = WithLeadingDimension(pA, m_transA ? m_K : m_M, m_transA ? m_M : m_K, m_lda);
+    const std::vector<float> b = WithLeadingDimension(pB, m_transB ? m_N : m_K, m_transB ? m_K : m_N, m_ldb);
+    const UINT aSize = UINT(a.size() * sizeof(float));
+    const UINT bSize = UINT(b.size() * sizeof(float));
+    CreateBufferWithData(a.data(), aSize, m_intermediatebuffer1, m_buffer1);
+    CreateBufferWithData(b.data(), bSize, m_intermediatebuffer2, m_buffer2);
+
+    // Descriptor 0 is the constant buffer and 3 is the UAV.
+    CreateBufferSRV(m_buffer1.Get(), aSize, sizeof(float), 1);
+    CreateBufferSRV(m_buffer2.Get(), bSize, sizeof(float), 2);
+
+    CreateResultBuffer();
+    CreateQueryResources();
+}
+
+// B is packed once on the CPU into the panel order SLM_8X8_4X16 consumes
+// (TILE_N = 128 columns, K padded to TILE_K0 = 64), as constant weights would be.
+void D3D12Sample::LoadPackedResources()
+{
+    for (UINT i = 0; i < m_M * m_K; ++i)
+    {
+        buf1Data.push_back((float)rand() / float(RAND_MAX));
+    }
+    for (UINT i = 0; i < m_K * m_N; ++i)
+    {
+        buf2Data.push_back((float)rand() / float(RAND_MAX));
+    }
+
+    const int panelK = 64;
+    const int panelN = 128;
+    auto start = std::chrono::steady_clock::now();
+    m_packedB.resize(PackedPanelsSize(m_K, m_N, panelK, panelN));
+    PackPanels(buf2Data.data(), m_K, m_N, panelK, panelN, m_packedB.data());
+    auto end = std::chrono::steady_clock::now();
+    printf("One-time B packing = %lld us\n", (long long)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+    // Only A takes a row stride; the panels have their own layout.
+    const std::vector<float> a = WithLeadingDimension(buf1Data.data(), m_M, m_K, m_lda);
+    const UINT aSize = UINT(a.size() * sizeof(float));
+    const UINT bSize = UINT(m_packedB.size() * sizeof(float));
+    CreateBufferWithData(a.data(), aSize, m_intermediatebuffer1, m_buffer1);
+    CreateBufferWithData(m_packedB.data(), bSize, m_intermediatebuffer2, m_buffer2);
+
+    // Descriptor 0 is the constant buffer and 3 is the UAV.
+    CreateBufferSRV(m_buffer1.Get(), aSize, m_componentSize * sizeof(float), 1);
+    CreateBufferSRV(m_buffer2.Get(), bSize, m_componentSize * sizeof(float), 2);
+
+    CreateResultBuffer();
+    CreateQueryResources();
+}
+
+void D3D12Sample::LoadInt4Resources()
+{
+    for (UINT i = 0; i < m_M * m_K; ++i)
+    {
+        buf1Data.push_back((float)rand() / float(RAND_MAX));
+    }
+    // Signed weights so that the symmetric quantization uses the whole int4 range.
+    for (UINT i = 0; i < m_K * m_N; ++i)
     {
-        ThrowIfFailed(D3DCompileFromFile(L"SLM_8X8_4X16.hlsl", defines.data(), nullptr, "CSMain", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
+        buf2Data.push_back((float)rand() / float(RAND_MAX) - 0.5f);
     }
-    else if (mKernelType == KERNELTYPE::SLM_4x4_16x16_v4)
+
+    const UINT groupCount = (m_K + m_int4GroupSize - 1) / m_int4GroupSize;
+    m_int4B.resize(m_K * m_N / 8);
+    m_int4Scales.resize(groupCount * m_N);
+    QuantizeInt4Groupwise(buf2Data.data(), m_K, m_N, m_int4GroupSize, m_int4B.data(), m_int4Scales.data());
+
+    // m_ldb counts int4 columns, so a row of B is m_ldb / 8 words.
+    const std::vector<float> a = WithLeadingDimension(buf1Data.data(), m_M, m_K, m_lda);
+    const std::vector<uint32_t> b = WithLeadingDimension(m_int4B.data(), m_K, m_N / 8, m_ldb / 8);
+    const UINT aSize = UINT(a.size() * sizeof(float));
+    const UINT bSize = UINT(b.size() * sizeof(uint32_t));
+    const UINT scalesSize = groupCount * m_N * sizeof(float);
+    CreateBufferWithData(a.data(), aSize, m_intermediatebuffer1, m_buffer1);
+    CreateBufferWithData(b.data(), bSize, m_intermediatebuffer2, m_buffer2);
+    CreateBufferWithData(m_int4Scales.data(), scalesSize, m_intermediatebuffer3, m_buffer3);
+
+    // Descriptor 0 is the constant buffer and 3 is the UAV.
+    CreateBufferSRV(m_buffer1.Get(), aSize, sizeof(float), 1);
+    CreateBufferSRV(m_buffer2.Get(), bSize, sizeof(UINT), 2);
+    CreateBufferSRV(m_buffer3.Get(), scalesSize, sizeof(float), 4);
+
+    CreateResultBuffer();
+    CreateQueryResources();
+}
+
+// Creates a default heap buffer and records the upload of pData into it.
+void D3D12Sample::CreateBufferWithData(const void* pData, UINT bufferSize, ComPtr<ID3D12Resource>& intermediate, ComPtr<ID3D12Resource>& buffer)
+{
+    ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&intermediate)));
+
+    ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+        nullptr,
+        IID_PPV_ARGS(&buffer)));
+
+    ResourceBarrier(m_commandList.Get(), buffer.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
+    D3D12_SUBRESOURCE_DATA bufferData = {};
+    bufferData.pData = pData;
+    bufferData.RowPitch = bufferSize;
+    UpdateSubresources(m_commandList.Get(), buffer.Get(), intermediate.Get(), 0, 0, 1, &bufferData);
+    ResourceBarrier(m_commandList.Get(), buffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+}
+
+// Creates a structured or raw SRV for pBuffer at descriptorIndex in the heap,
+// following the current storage type.
+void D3D12Sample::CreateBufferSRV(ID3D12Resource* pBuffer, UINT bufferSize, UINT structureByteStride, UINT descriptorIndex)
+{
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+    srvDesc.Buffer.FirstElement = 0;
+    if (mStorageType == STORAGETYPE::STRUCTURED_BUFFER)
     {
-        ThrowIfFailed(D3DCompileFromFile(L"SLM_4x4_16x16_vec4.hlsl", defines.data(), nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
+        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+        srvDesc.Buffer.NumElements = bufferSize / structureByteStride;
+        srvDesc.Buffer.StructureByteStride = structureByteStride;
+        srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
     }
-    else if (mKernelType == KERNELTYPE::SLM_4x4_shared_A)
+    else
     {
-        ThrowIfFailed(D3DCompileFromFile(L"SLM_4X4_shared_A.hlsl", defines.data(), nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
+        srvDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+        srvDesc.Buffer.NumElements = bufferSize / sizeof(UINT);
+        srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
     }
-    else if (mKernelType == KERNELTYPE::SLM_4x4_16x16_4_FLOATS)
+    CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart(), descriptorIndex, m_cbSrvDescriptorSize);
+    m_d3d12Device->CreateShaderResourceView(pBuffer, &srvDesc, srvHandle);
+}
+
+void D3D12Sample::CreateResultBuffer()
+{
+    // Create bufferResult and UAV for it. Rows are m_ldc elements apart. The
+    // Stream-K workspace, two partial tiles per group, follows C.
+    UINT elementCount = m_M * m_ldc;
+    if (mKernelType == KERNELTYPE::SLM_Stream_K)
     {
-        ThrowIfFailed(D3DCompileFromFile(L"SLM_4x4_16x16_4_floats.hlsl", defines.data(), nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
+        elementCount += 2 * m_streamKGroups * (mLocalGroupSizeY * mWorkPerThreadY) * (mLocalGroupSizeX * mWorkPerThreadX);
     }
-    else if (mKernelType == KERNELTYPE::MatMul_4x4_16x4_float)
+    const UINT bufferSize = elementCount * m_elementSize;
+
+    ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(bufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+        nullptr,
+        IID_PPV_ARGS(&m_bufferResult))
+    );
+
+    // Create UAV for bufferResult
+    D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+    uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+    uavDesc.Buffer.FirstElement = 0;
+    if (mStorageType == STORAGETYPE::STRUCTURED_BUFFER)
     {
-        ThrowIfFailed(D3DCompileFromFile(L"Matmul_4x4_16x4.hlsl", defines.data(), nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
+        uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+        uavDesc.Buffer.NumElements = elementCount / m_componentSize;
+        uavDesc.Buffer.StructureByteStride = m_componentSize * m_elementSize;
+        uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
     }
-    else if (mKernelType == KERNELTYPE::MatMul_vector_float)
+    else {
+        uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+        uavDesc.Buffer.NumElements = bufferSize / sizeof(UINT);
+        uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
+    }
+    CD3DX12_CPU_DESCRIPTOR_HANDLE uavHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
+    uavHandle.Offset(3, m_cbSrvDescriptorSize); // First one is for constant buffer. Senond one is for buffer1. Third one is for buffer2.
+    m_d3d12Device->CreateUnorderedAccessView(m_bufferResult.Get(), nullptr, &uavDesc, uavHandle);
+}
+
+void D3D12Sample::CreateQueryResources()
+{
+    // Create the query result buffer.
+    // Two timestamps for each frame.
+    const UINT resultCount = 2 * m_computeCount;
+    const UINT resultBufferSize = resultCount * sizeof(UINT64);
+    D3D12_QUERY_HEAP_DESC timestampHeapDesc = {};
+    timestampHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+    timestampHeapDesc.Count = resultCount;
+
+    ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(resultBufferSize),
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(&m_queryResult)
+        ));
+    ThrowIfFailed(m_d3d12Device->CreateQueryHeap(&timestampHeapDesc, IID_PPV_ARGS(&m_queryHeap)));
+}
+
+void D3D12Sample::RunCompute()
+{
+    double flops = 2.0 * m_M * m_N * m_K;
+    if (mKernelType == KERNELTYPE::SLM_Attention)
     {
-        ThrowIfFailed(D3DCompileFromFile(L"Matmul_vector.hlsl", defines.data(), nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
+        // Q K^T and P V are both M x K x N.
+        flops *= 2;
     }
-    else if (mKernelType == KERNELTYPE::SLM_MatMul_vector_float)
+    else if (mKernelType == KERNELTYPE::SLM_SpMM)
     {
-        ThrowIfFailed(D3DCompileFromFile(L"SLM_Matmul_vector.hlsl", defines.data(), nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
+        // Only the products with nonzeros of A count, not the padding of blocked ELL.
+        flops = 2.0 * m_sparseA.values.size() * m_N;
     }
-    else if (mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_float)
+    else if (mKernelType == KERNELTYPE::SLM_SYRK)
     {
-        ThrowIfFailed(D3DCompileFromFile(L"SLM_Matmul_vector_matrix.hlsl", defines.data(), nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
+        // The triangle with its diagonal: M (M + 1) / 2 dot products of length K.
+        flops = double(m_M) * (m_M + 1) * m_K;
     }
-    else if (mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_one)
+    else if (mKernelType == KERNELTYPE::SLM_TRMM)
     {
-        ThrowIfFailed(D3DCompileFromFile(L"SLM_Matmul_vector_matrix_one.hlsl", defines.data(), nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
+        // tri(A) has M (M + 1) / 2 nonzeros, each used for N columns.
+        flops = double(m_M) * (m_M + 1) * m_N;
     }
-    else if (mKernelType == KERNELTYPE::SLM_4x4_16x16_float_coalesced) {
-        ThrowIfFailed(D3DCompileFromFile(L"SLM_4x4_16x16_coalesced.hlsl", defines.data(), nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
+    double total = 0.0;
+    for (int it = 0; it < m_computeCount; it++)
+    {
+        // This will restart the command list and start a new record.
+        ThrowIfFailed(m_computeAllocator->Reset());
+        ThrowIfFailed(m_commandList->Reset(m_computeAllocator.Get(), m_computePSO.Get()));
+
+        // Record commands.
+        // Get a timestamp at the beginning and end of the command list.
+        const UINT timestampHeapIndex = 2 * it;
+        m_commandList->EndQuery(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampHeapIndex);
+        ID3D12DescriptorHeap* pHeaps[] = { m_cbSrvHeap.Get() };
+        m_commandList->SetDescriptorHeaps(_countof(pHeaps), pHeaps);
+
+        m_commandList->SetComputeRootSignature(m_computeRootSignature.Get());
+        CD3DX12_GPU_DESCRIPTOR_HANDLE gpuSrvDescriptorHandle(m_cbSrvHeap->GetGPUDescriptorHandleForHeapStart());
+        m_commandList->SetComputeRootDescriptorTable(0, gpuSrvDescriptorHandle);
+        gpuSrvDescriptorHandle.Offset(1, m_cbSrvDescriptorSize);
+        m_commandList->SetComputeRootDescriptorTable(1, gpuSrvDescriptorHandle);
+        gpuSrvDescriptorHandle.Offset(2, m_cbSrvDescriptorSize);
+        m_commandList->SetComputeRootDescriptorTable(2, gpuSrvDescriptorHandle);
+        gpuSrvDescriptorHandle.Offset(1, m_cbSrvDescriptorSize);
+        m_commandList->SetComputeRootDescriptorTable(3, gpuSrvDescriptorHandle);
+
+        m_commandList->SetPipelineState(m_computePSO.Get());
+        m_commandList->Dispatch(mDispatchX, mDispatchY, 1);
+        if (mEdgeDispatchCount > 0)
+        {
+            // Writes a disjoint part of C, so no barrier is needed between the two.
+            m_commandList->SetPipelineState(m_edgePSO.Get());
+            m_commandList->Dispatch(mEdgeDispatchCount, 1, 1);
+        }
+        if (mFixupDispatchCount > 0)
+        {
+            // The fix-up reads the partial tiles the first dispatch wrote.
+            m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(m_bufferResult.Get()));
+            m_commandList->SetPipelineState(m_fixupPSO.Get());
+            m_commandList->Dispatch(mFixupDispatchCount, 1, 1);
+        }
+        m_commandList->EndQuery(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampHeapIndex + 1);
+        m_commandList->ResolveQueryData(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampHeapIndex, 2, m_queryResult.Get(), timestampHeapIndex * sizeof(UINT64));
+
+        ThrowIfFailed(m_commandList->Close());
+        auto start = std::chrono::steady_clock::now();
+        // Execute the command list.
+        ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
+        m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+        WaitForGpu();
+        auto end = std::chrono::steady_clock::now();
+        auto diff = end - start;
+        if (it > 0)
+        {
+            total += std::chrono::duration_cast<std::chrono::microseconds>(diff).count();
+        }
+    }
+    double avg_time = total / (m_computeCount - 1);
+    double total_kernel = 0;
+    double minTime = 1e100;
+
+    // Get the timestamp values from the result buffers.
+    D3D12_RANGE readRange = {};
+    const D3D12_RANGE emptyRange = {};
+    for (UINT i = 0; i < m_computeCount; i++)
+    {
+        readRange.Begin = (2 * i) * sizeof(UINT64);
+        readRange.End = readRange.Begin + 2 * sizeof(UINT64);
+
+        void* pData = nullptr;
+        ThrowIfFailed(m_queryResult->Map(0, &readRange, &pData));
+
+        const UINT64* pTimestamps = reinterpret_cast<UINT64*>(static_cast<UINT8*>(pData) + readRange.Begin);
+        const UINT64 timeStampDelta = pTimestamps[1] - pTimestamps[0];
+
+        // Unmap with an empty range (written range).
+        m_queryResult->Unmap(0, &emptyRange);
+
+        // Calculate the GPU execution time in microseconds.
+        const UINT64 gpuTimeUS =  (timeStampDelta * 1000000) / m_timestampFrequency;
+        // Don't consider the first dispatch time.
+        if (i > 0)
+        {
+            if (gpuTimeUS < minTime)
+                minTime = gpuTimeUS;
+            total_kernel += gpuTimeUS;
+        }
+    }
+    double avg_kernel = 0;
+    avg_kernel = total_kernel / (m_computeCount - 1);
+    m_runResult.gflops = flops / avg_kernel / 1000;
+    m_runResult.kernelTimeUS = avg_kernel;
+    m_runResult.accumulateMode = m_accumulateMode;
+    printf("Avg_time = %f us, Avg_kernel_time = %f us, min_time = %f us\n",
+           avg_time, avg_kernel, minTime);
+    printf("Avg kernel %s = %f, Peak kernel %s = %f\n",
+           mKernelType == KERNELTYPE::SLM_INT8_4x4_16x16 ? "GOPS" : "GFLOPS", flops / avg_kernel / 1000,
+           mKernelType == KERNELTYPE::SLM_INT8_4x4_16x16 ? "GOPS" : "GFLOPS", flops / minTime / 1000);
+    if (mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_int4)
+    {
+        // GEMV is bandwidth bound, so report how fast the compressed weights stream in.
+        const double weightBytes = m_K * m_N / 2.0 + double((m_K + m_int4GroupSize - 1) / m_int4GroupSize) * m_N * sizeof(float);
+        printf("Int4 weights = %f MB (%.1fx smaller than fp32), avg weight bandwidth = %f GB/s, peak = %f GB/s\n",
+               weightBytes / 1e6, m_K * m_N * sizeof(float) / weightBytes, weightBytes / avg_kernel / 1000, weightBytes / minTime / 1000);
+    }
+
+    m_computeAllocator->Reset();
+    m_commandList->Reset(m_computeAllocator.Get(), m_computePSO.Get());
+
+#ifdef PRINT_DATA
+    // Read data back to verify the result
+    UINT64 outputBufferSize = UINT64(m_M) * m_ldc * m_elementSize;
+    ComPtr<ID3D12Resource> readbackBuffer;
+    ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(outputBufferSize),
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(&readbackBuffer)));
+    readbackBuffer->SetName(L"Readback buffer Map");
+    if (mStorageType == STORAGETYPE::TEXTURE)
+    {
+        ResourceBarrier(m_commandList.Get(), mTextureResult.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+        D3D12_TEXTURE_COPY_LOCATION copyDest;
+        copyDest.pResource = readbackBuffer.Get();
+        copyDest.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+        UINT64 transferToToalBytes;
+        const UINT64 baseOffset = 0;
+        D3D12_RESOURCE_DESC desc = mTextureResult.Get()->GetDesc();
+        m_d3d12Device->GetCopyableFootprints(&desc, 0, 1, baseOffset, &copyDest.PlacedFootprint, nullptr, nullptr, &transferToToalBytes);
+
+        D3D12_TEXTURE_COPY_LOCATION copySrc;
+        copySrc.pResource = mTextureResult.Get();
+        copySrc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+        copySrc.SubresourceIndex = 0;
+        CD3DX12_BOX box(0, 0, m_N / m_componentSize, m_M);
+        m_commandList->CopyTextureRegion(&copyDest, 0, 0, 0, &copySrc, &box);
     }
     else
     {
-        assert(mKernelType == KERNELTYPE::SLM_4x4_16x16_float);
-        ThrowIfFailed(D3DCompileFromFile(L"SLM_4x4_16x16.hlsl", defines.data(), nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
+        ResourceBarrier(m_commandList.Get(), m_bufferResult.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+        // Only C is read back; the Stream-K workspace behind it is left out.
+        m_commandList->CopyBufferRegion(readbackBuffer.Get(), 0, m_bufferResult.Get(), 0, outputBufferSize);
     }
 
-    descComputePSO.CS = CD3DX12_SHADER_BYTECODE(computeShader.Get());
-    ThrowIfFailed(m_d3d12Device->CreateComputePipelineState(&descComputePSO, IID_PPV_ARGS(&m_computePSO)));
-    m_computePSO->SetName(L"Compute PSO");
+    m_commandList->Close();
+    ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
+    m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+    WaitForGpu();
 
-    // Create the command list.
-    ThrowIfFailed(
-        m_d3d12Device->CreateCommandList(
-            0,
-            D3D12_COMMAND_LIST_TYPE_DIRECT,
-            m_computeAllocator.Get(),
-            m_computePSO.Get(),
-            IID_PPV_ARGS(&m_commandList)));
+    float result = 0.0;
+    int m = rand() % m_M;
+    int n = rand() % m_N;
+    D3D12_RANGE readbackBufferRange{ 0, outputBufferSize };
+    FLOAT * pReadbackBufferData{};
+    ThrowIfFailed(readbackBuffer->Map(
+        0,
+        &readbackBufferRange,
+        reinterpret_cast<void**>(&pReadbackBufferData)));
 
-    // Create a constant buffer.
+    // Drop the row padding so the checks below see a dense M x N result.
+    const size_t rowBytes = size_t(m_N) * m_elementSize;
+    std::vector<double> gpuResult((size_t(m_M) * rowBytes + sizeof(double) - 1) / sizeof(double));
+    for (UINT row = 0; row < m_M; row++)
     {
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(256),
-            D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(&m_intermediateBuffer)));
+        memcpy(reinterpret_cast<char*>(gpuResult.data()) + row * rowBytes,
+               reinterpret_cast<const char*>(pReadbackBufferData) + size_t(row) * m_ldc * m_elementSize, rowBytes);
+    }
+    readbackBuffer->Unmap(0, &emptyRange);
+    if (m_conv && m_convShape.nchw)
+    {
+        // Back from NCHW to the M x OC order of the implicit GEMM for the checks.
+        const UINT plane = m_M / m_convShape.batch;
+        std::vector<double> rowMajor(gpuResult.size());
+        const float* pNchw = reinterpret_cast<const float*>(gpuResult.data());
+        float* pRowMajor = reinterpret_cast<float*>(rowMajor.data());
+        for (UINT row = 0; row < m_M; row++)
+        {
+            for (UINT oc = 0; oc < m_N; oc++)
+            {
+                pRowMajor[size_t(row) * m_N + oc] = pNchw[(size_t(row / plane) * m_N + oc) * plane + row % plane];
+            }
+        }
+        gpuResult.swap(rowMajor);
+    }
+    const float* pGpuResult = reinterpret_cast<const float*>(gpuResult.data());
 
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(256),
-            D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
-            nullptr,
-            IID_PPV_ARGS(&m_constantBuffer)));
+    result = pGpuResult[m*m_N + n];
+    if (mKernelType == KERNELTYPE::SLM_INT8_4x4_16x16)
+    {
+        ReportInt8(pGpuResult);
+    }
+    else if (mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_int4)
+    {
+        ReportInt4(pGpuResult);
+    }
+    else if (m_elementSize == sizeof(double))
+    {
+        ReportDouble(gpuResult.data());
+    }
+    else if (mKernelType == KERNELTYPE::SLM_Attention)
+    {
+        ReportAttention(pGpuResult);
+    }
+    else if (mKernelType == KERNELTYPE::SLM_SpMM)
+    {
+        ReportSparse(pGpuResult);
+    }
+    else if (mKernelType == KERNELTYPE::SLM_Grouped_GEMM)
+    {
+        ReportGrouped(pGpuResult);
+    }
+    else if (mKernelType == KERNELTYPE::SLM_SYRK || mKernelType == KERNELTYPE::SLM_TRMM)
+    {
+        ReportTriangular(pGpuResult);
+    }
+    else
+    {
+        ReportAccuracy(pGpuResult);
+    }
 
-        ResourceBarrier(m_commandList.Get(), m_constantBuffer.Get(), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_RESOURCE_STATE_COPY_DEST);
-        m_constantBufferData.M = m_M;
-        m_constantBufferData.N = m_N;
-        m_constantBufferData.K = m_K;
-        m_constantBufferData.TILE_K = m_tileK;
-		D3D12_SUBRESOURCE_DATA bufferData = {};
-        bufferData.pData = &m_constantBufferData;
-        bufferData.RowPitch = sizeof(m_constantBufferData);
-        UpdateSubresources(m_commandList.Get(), m_constantBuffer.Get(), m_intermediateBuffer.Get(), 0, 0, 1, &bufferData);
-        ResourceBarrier(m_commandList.Get(), m_constantBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+    // The Report functions of the kernels that aren't plain GEMMs check their results themselves.
+    if (m_elementSize == sizeof(float) && mKernelType != KERNELTYPE::SLM_Attention && mKernelType != KERNELTYPE::SLM_SpMM &&
+        mKernelType != KERNELTYPE::SLM_Grouped_GEMM && mKernelType != KERNELTYPE::SLM_SYRK && mKernelType != KERNELTYPE::SLM_TRMM)
+    {
+        float acc = 0.0;
+        for (unsigned int k = 0; k < m_K; k++)
+        {
+            acc += buf1Data[m*m_K + k] * buf2Data[k*m_N + n];
+        }
+        printf("The result is GPU: %f, CPU: %f\n", result, acc);
+    }
+#endif // PRINT_DATA
+}
 
-        // Describe and create a constant buffer view.
-        D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-        cbvDesc.BufferLocation = m_constantBuffer->GetGPUVirtualAddress();
-        cbvDesc.SizeInBytes = (sizeof(SceneConstantBuffer) + 255) & ~255;    // CB size is required to be 256-byte aligned.
-        CD3DX12_CPU_DESCRIPTOR_HANDLE cbHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
-        m_d3d12Device->CreateConstantBufferView(&cbvDesc, cbHandle);
+// Checks the int8 kernel against the CPU int8 GEMM and reports the error that
+// quantization introduces relative to the fp32 inputs.
+void D3D12Sample::ReportInt8(const float* pGpuResult)
+{
+    std::vector<float> cpuResult(m_M * m_N);
+    auto start = std::chrono::steady_clock::now();
+    CpuMatmulInt8(m_int8A.data(), m_int8Bt.data(), m_quantParamsA.data(), m_quantParamsB.data(), cpuResult.data(), m_M, m_N, m_K);
+    auto end = std::chrono::steady_clock::now();
+    double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+    std::vector<double> reference(m_M * m_N);
+    CpuMatmulReference(buf1Data.data(), buf2Data.data(), reference.data(), m_M, m_N, m_K);
+
+    double maxGpuDiff = 0.0;
+    double maxQuantError = 0.0;
+    double errorSquares = 0.0;
+    double referenceSquares = 0.0;
+    for (UINT i = 0; i < m_M * m_N; i++)
+    {
+        maxGpuDiff = (std::max)(maxGpuDiff, double(std::abs(pGpuResult[i] - cpuResult[i])));
+        double error = double(cpuResult[i]) - reference[i];
+        maxQuantError = (std::max)(maxQuantError, std::abs(error));
+        errorSquares += error * error;
+        referenceSquares += reference[i] * reference[i];
     }
+    printf("Int8 CPU time = %f us, CPU GOPS = %f\n", cpuTimeUS, 2.0 * m_M * m_N * m_K / cpuTimeUS / 1000);
+    printf("Int8 max |GPU - CPU| = %f\n", maxGpuDiff);
+    printf("Quantization error vs fp32 inputs: max abs = %f, relative RMS = %e\n",
+           maxQuantError, std::sqrt(errorSquares / referenceSquares));
+}
+
+// Checks the DGEMM kernels against the CPU DGEMM on the same fp64 inputs.
+void D3D12Sample::ReportDouble(const double* pGpuResult)
+{
+    // The inputs hold fp32 values, so they narrow exactly.
+    std::vector<float> a(m_doubleA.size());
+    std::vector<float> b(m_doubleB.size());
+    std::transform(m_doubleA.begin(), m_doubleA.end(), a.begin(), [](double value) { return float(value); });
+    std::transform(m_doubleB.begin(), m_doubleB.end(), b.begin(), [](double value) { return float(value); });
+    std::vector<double> reference(m_M * m_N);
+    CpuMatmulReference(a.data(), b.data(), reference.data(), m_M, m_N, m_K);
+    RelativeError(pGpuResult, reference.data(), reference.size(), m_runResult.maxRelError, m_runResult.rmsRelError);
+    printf("Error vs fp64 reference: max rel = %e, RMS rel = %e\n", m_runResult.maxRelError, m_runResult.rmsRelError);
+
+    std::vector<double> cpuResult(m_M * m_N);
+    auto start = std::chrono::steady_clock::now();
+    CpuMatmulDouble(m_doubleA.data(), m_doubleB.data(), cpuResult.data(), m_M, m_N, m_K);
+    auto end = std::chrono::steady_clock::now();
+    double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    double maxCpuRelError;
+    double rmsCpuRelError;
+    RelativeError(cpuResult.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
+    printf("DGEMM CPU time = %f us, CPU GFLOPS = %f, max rel error = %e\n", cpuTimeUS, 2.0 * m_M * m_N * m_K / cpuTimeUS / 1000,
+           maxCpuRelError);
+}
+
+// Checks the fused attention against the fp64 reference, times the fused and
+// unfused CPU versions, and reports the score traffic the fusion avoids.
+void D3D12Sample::ReportAttention(const float* pGpuResult)
+{
+    std::vector<double> reference(size_t(m_M) * m_N);
+    CpuAttentionReference(buf1Data.data(), buf2Data.data(), m_attentionV.data(), reference.data(), m_M, m_K, m_N);
+    RelativeError(pGpuResult, reference.data(), reference.size(), m_runResult.maxRelError, m_runResult.rmsRelError);
+    printf("Error vs fp64 attention: max rel = %e, RMS rel = %e\n", m_runResult.maxRelError, m_runResult.rmsRelError);
+
+    std::vector<float> fusedResult(size_t(m_M) * m_N);
+    std::vector<float> unfusedResult(size_t(m_M) * m_N);
+    const double flops = 4.0 * m_M * m_N * m_K;
+    auto start = std::chrono::steady_clock::now();
+    CpuAttention(buf1Data.data(), buf2Data.data(), m_attentionV.data(), fusedResult.data(), m_M, m_K, m_N);
+    auto end = std::chrono::steady_clock::now();
+    double fusedUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    start = std::chrono::steady_clock::now();
+    CpuAttentionUnfused(buf1Data.data(), buf2Data.data(), m_attentionV.data(), unfusedResult.data(), m_M, m_K, m_N);
+    end = std::chrono::steady_clock::now();
+    double unfusedUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    double maxFusedRelError;
+    double rmsFusedRelError;
+    RelativeError(fusedResult.data(), reference.data(), reference.size(), maxFusedRelError, rmsFusedRelError);
+    double maxUnfusedRelError;
+    double rmsUnfusedRelError;
+    RelativeError(unfusedResult.data(), reference.data(), reference.size(), maxUnfusedRelError, rmsUnfusedRelError);
+    printf("CPU fused = %f us, GFLOPS = %f, max rel error = %e; CPU unfused = %f us, GFLOPS = %f, max rel error = %e\n",
+           fusedUS, flops / fusedUS / 1000, maxFusedRelError, unfusedUS, flops / unfusedUS / 1000, maxUnfusedRelError);
+
+    // Unfused, the scores are written by Q K^T, read and written by the softmax
+    // and read by P V.
+    const double scoreMB = double(m_M) * m_K * sizeof(float) / 1e6;
+    printf("Scores = %f MB, score traffic avoided = %f MB\n", scoreMB, 4 * scoreMB);
+}
 
-    if (mStorageType == STORAGETYPE::TEXTURE)
+// Checks SLM_SpMM against the fp64 reference and times the CPU SpMM in the same
+// format.
+void D3D12Sample::ReportSparse(const float* pGpuResult)
+{
+    std::vector<double> reference(size_t(m_M) * m_N);
+    CpuSpmmReference(m_sparseA, buf2Data.data(), reference.data(), m_N);
+    RelativeError(pGpuResult, reference.data(), reference.size(), m_runResult.maxRelError, m_runResult.rmsRelError);
+    printf("Error vs fp64 SpMM: max rel = %e, RMS rel = %e\n", m_runResult.maxRelError, m_runResult.rmsRelError);
+
+    std::vector<float> cpuResult(size_t(m_M) * m_N);
+    auto start = std::chrono::steady_clock::now();
+    if (m_blockedEll)
     {
-        LoadTextureResources();
+        CpuSpmmBlockedEll(m_sparseEll, buf2Data.data(), cpuResult.data(), m_N);
     }
     else
     {
-        LoadBufferResources();
+        CpuSpmm(m_sparseA, buf2Data.data(), cpuResult.data(), m_N);
     }
+    auto end = std::chrono::steady_clock::now();
+    double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    double maxCpuRelError;
+    double rmsCpuRelError;
+    RelativeError(cpuResult.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
+    printf("CPU %s time = %f us, CPU GFLOPS = %f, max rel error = %e\n", m_blockedEll ? "blocked-ELL SpMM" : (m_N == 1 ? "CSR SpMV" : "CSR SpMM"),
+           cpuTimeUS, 2.0 * m_sparseA.values.size() * m_N / cpuTimeUS / 1000, maxCpuRelError);
+}
 
-    // Close the command list and execute it to begin the buffer copy into
-    // the default heap.
-    ThrowIfFailed(m_commandList->Close());
-    ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
-    m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+// Checks SLM_Grouped_GEMM against an fp64 GEMM per problem, and times the CPU
+// grouped GEMM against the same problems run one after another, as separate
+// GEMM calls would.
+void D3D12Sample::ReportGrouped(const float* pGpuResult)
+{
+    std::vector<double> reference(size_t(m_M) * m_N);
+    for (const GroupedGemmProblem& problem : m_groupedProblems)
+    {
+        CpuMatmulReference(buf1Data.data() + size_t(problem.rowOffset) * m_K, buf2Data.data() + size_t(problem.bRowOffset) * m_N,
+                           reference.data() + size_t(problem.rowOffset) * m_N, problem.rows, m_N, m_K);
+    }
+    RelativeError(pGpuResult, reference.data(), reference.size(), m_runResult.maxRelError, m_runResult.rmsRelError);
+    printf("Error vs fp64 per-problem GEMMs: max rel = %e, RMS rel = %e\n", m_runResult.maxRelError, m_runResult.rmsRelError);
+
+    std::vector<float> cpuResult(size_t(m_M) * m_N);
+    auto start = std::chrono::steady_clock::now();
+    CpuMatmulGrouped(buf1Data.data(), buf2Data.data(), cpuResult.data(), m_groupedProblems, m_N, m_K);
+    auto end = std::chrono::steady_clock::now();
+    const double groupedTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    double maxCpuRelError;
+    double rmsCpuRelError;
+    RelativeError(cpuResult.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
+    start = std::chrono::steady_clock::now();
+    for (const GroupedGemmProblem& problem : m_groupedProblems)
+    {
+        CpuMatmulFloat(buf1Data.data() + size_t(problem.rowOffset) * m_K, buf2Data.data() + size_t(problem.bRowOffset) * m_N,
+                       cpuResult.data() + size_t(problem.rowOffset) * m_N, problem.rows, m_N, m_K, ACCUMULATE_NAIVE);
+    }
+    end = std::chrono::steady_clock::now();
+    const double loopTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    const double flops = 2.0 * m_M * m_N * m_K;
+    printf("CPU grouped time = %f us, CPU GFLOPS = %f, max rel error = %e; one problem at a time = %f us, CPU GFLOPS = %f\n",
+           groupedTimeUS, flops / groupedTimeUS / 1000, maxCpuRelError, loopTimeUS, flops / loopTimeUS / 1000);
+}
 
-    // Create synchronization objects and wait until assets have been uploaded to the GPU.
+// Checks SLM_SYRK or SLM_TRMM against its fp64 reference, and times the CPU
+// version against the CPU GEMM of the same product that ignores its structure.
+void D3D12Sample::ReportTriangular(const float* pGpuResult)
+{
+    const bool syrk = mKernelType == KERNELTYPE::SLM_SYRK;
+    std::vector<double> reference(size_t(m_M) * m_N);
+    if (syrk)
     {
-        ThrowIfFailed(m_d3d12Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_computeFence)));
-        m_computeFenceValue = 1;
+        CpuSyrkReference(buf1Data.data(), m_transA, reference.data(), m_M, m_K, m_upper);
+    }
+    else
+    {
+        CpuTrmmReference(buf1Data.data(), buf2Data.data(), reference.data(), m_M, m_N, m_upper);
+    }
+    RelativeError(pGpuResult, reference.data(), reference.size(), m_runResult.maxRelError, m_runResult.rmsRelError);
+    printf("Error vs fp64 %s (%s): max rel = %e, RMS rel = %e\n", syrk ? "SYRK" : "TRMM", m_upper ? "upper" : "lower",
+           m_runResult.maxRelError, m_runResult.rmsRelError);
 
-        // Create an event handle to use for frame synchronization.
-        m_computeFenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-        if (m_computeFenceEvent == nullptr)
+    std::vector<float> cpuResult(size_t(m_M) * m_N);
+    auto start = std::chrono::steady_clock::now();
+    if (syrk)
+    {
+        CpuSyrk(buf1Data.data(), m_transA, cpuResult.data(), m_M, m_K, m_upper);
+    }
+    else
+    {
+        CpuTrmm(buf1Data.data(), buf2Data.data(), cpuResult.data(), m_M, m_N, m_upper);
+    }
+    auto end = std::chrono::steady_clock::now();
+    const double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    double maxCpuRelError;
+    double rmsCpuRelError;
+    if (syrk)
+    {
+        // CpuSyrk only promises the stored triangle, so only that is compared.
+        std::vector<float> cpuTriangle;
+        std::vector<double> referenceTriangle;
+        for (UINT r = 0; r < m_M; r++)
         {
-            ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+            for (UINT c = m_upper ? r : 0; c < (m_upper ? m_M : r + 1); c++)
+            {
+                cpuTriangle.push_back(cpuResult[size_t(r) * m_N + c]);
+                referenceTriangle.push_back(reference[size_t(r) * m_N + c]);
+            }
         }
-
-        // Wait for the command list to execute; we are reusing the same command
-        // list in our main loop but for now, we just want to wait for setup to
-        // complete before continuing.
-        WaitForGpu();
+        RelativeError(cpuTriangle.data(), referenceTriangle.data(), referenceTriangle.size(), maxCpuRelError, rmsCpuRelError);
+    }
+    else
+    {
+        RelativeError(cpuResult.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
     }
 
-}
-
-void D3D12Sample::LoadTextureResources()
-{
+    // The same product as a plain GEMM: op(A) times its transpose, or tri(A)
+    // with its zeros written out times B.
+    std::vector<float> left = buf1Data;
+    std::vector<float> right = buf2Data;
+    if (syrk)
     {
-        // Create the texture1.
-        const UINT elementCount = m_M * m_K;
-        for (int i = 0; i < elementCount; ++i)
+        std::vector<float> transposed(size_t(m_M) * m_K);
+        TransposeMatrix(buf1Data.data(), m_transA ? m_K : m_M, m_transA ? m_M : m_K, transposed.data());
+        (m_transA ? left : right) = transposed;
+    }
+    else
+    {
+        for (UINT r = 0; r < m_M; r++)
         {
-            buf1Data.push_back((float)rand() / float(RAND_MAX));
+            float* row = &left[size_t(r) * m_M];
+            std::fill(m_upper ? row : row + r + 1, m_upper ? row + r : row + m_M, 0.0f);
         }
-        const UINT bufferSize = buf1Data.size() * sizeof(float);
-
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
-            D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(&m_intermediatebuffer1)));
-
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32G32B32A32_FLOAT, m_K / m_componentSize, m_M),
-            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
-            nullptr,
-            IID_PPV_ARGS(&mTexture1)));
-
-        ResourceBarrier(m_commandList.Get(), mTexture1.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
-        D3D12_SUBRESOURCE_DATA bufferData = {};
-        bufferData.pData = buf1Data.data();
-        bufferData.RowPitch = m_K * sizeof(float);
-        bufferData.SlicePitch = bufferData.RowPitch * m_M;
-        UpdateSubresources(m_commandList.Get(), mTexture1.Get(), m_intermediatebuffer1.Get(), 0, 0, 1, &bufferData);
-        ResourceBarrier(m_commandList.Get(), mTexture1.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-
-        // Create SRV for the texture1
-        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-        srvDesc.Texture2D.MipLevels = 1;
-        srvDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-        CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
-        srvHandle.Offset(1, m_cbSrvDescriptorSize); // First one is for constant buffer.
-        m_d3d12Device->CreateShaderResourceView(mTexture1.Get(), &srvDesc, srvHandle);
     }
+    start = std::chrono::steady_clock::now();
+    CpuMatmulFloat(left.data(), right.data(), cpuResult.data(), m_M, m_N, m_K, ACCUMULATE_NAIVE);
+    end = std::chrono::steady_clock::now();
+    const double gemmTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    printf("CPU %s time = %f us (max rel error = %e), the full GEMM = %f us\n", syrk ? "SYRK" : "TRMM", cpuTimeUS,
+           maxCpuRelError, gemmTimeUS);
+}
 
-	{
-		// create the texture2
-		const UINT elementCount = m_K * m_N;
-		for (int i = 0; i < elementCount; ++i)
-		{
-			buf2Data.push_back((float)rand() / float(RAND_MAX));
-		}
-		const UINT bufferSize = buf2Data.size() * sizeof(float);
+// Compares the whole fp32 result with the fp64 reference.
+void D3D12Sample::ReportAccuracy(const float* pGpuResult)
+{
+    std::vector<double> reference(m_M * m_N);
+    CpuMatmulReference(buf1Data.data(), buf2Data.data(), reference.data(), m_M, m_N, m_K);
+    RelativeError(pGpuResult, reference.data(), reference.size(), m_runResult.maxRelError, m_runResult.rmsRelError);
+    printf("Error vs fp64 reference (%s accumulation): max rel = %e, RMS rel = %e\n",
+           AccumulationModeName(m_accumulateMode), m_runResult.maxRelError, m_runResult.rmsRelError);
 
-		ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&m_intermediatebuffer2)));
+    if (mKernelType == KERNELTYPE::SLM_4x4_16x16_trans)
+    {
+        // The CPU GEMM reads the same stored layouts as the kernel.
+        std::vector<float> cpuResult(m_M * m_N);
+        auto start = std::chrono::steady_clock::now();
+        CpuMatmulTrans(m_transA ? m_transposedA.data() : buf1Data.data(), m_transA ? m_M : m_K, m_transA,
+                       m_transB ? m_transposedB.data() : buf2Data.data(), m_transB ? m_K : m_N, m_transB,
+                       cpuResult.data(), m_N, m_M, m_N, m_K);
+        auto end = std::chrono::steady_clock::now();
+        double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        double maxCpuRelError;
+        double rmsCpuRelError;
+        RelativeError(cpuResult.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
+        printf("%c%c CPU time = %f us, CPU GFLOPS = %f, CPU max rel error = %e\n", m_transA ? 'T' : 'N', m_transB ? 'T' : 'N',
+               cpuTimeUS, 2.0 * m_M * m_N * m_K / cpuTimeUS / 1000, maxCpuRelError);
+    }
+    else if (mKernelType == KERNELTYPE::SLM_8X8_4X16_packed)
+    {
+        // Compare the CPU GEMM on row-major B with the one on pre-packed panels.
+        std::vector<float> cpuResult(m_M * m_N);
+        auto start = std::chrono::steady_clock::now();
+        CpuMatmulFloat(buf1Data.data(), buf2Data.data(), cpuResult.data(), m_M, m_N, m_K, ACCUMULATE_NAIVE);
+        auto end = std::chrono::steady_clock::now();
+        double rowMajorTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+        std::vector<float> packedB(PackedPanelsSize(m_K, m_N, 1, CPU_PACK_PANEL_N));
+        start = std::chrono::steady_clock::now();
+        PackPanels(buf2Data.data(), m_K, m_N, 1, CPU_PACK_PANEL_N, packedB.data());
+        end = std::chrono::steady_clock::now();
+        double packTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+        start = std::chrono::steady_clock::now();
+        CpuMatmulPacked(buf1Data.data(), packedB.data(), cpuResult.data(), m_M, m_N, m_K);
+        end = std::chrono::steady_clock::now();
+        double packedTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        double maxCpuRelError;
+        double rmsCpuRelError;
+        RelativeError(cpuResult.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
+        printf("CPU row-major B = %f us, packed B = %f us (+ %f us one-time packing), packed max rel error = %e\n",
+               rowMajorTimeUS, packedTimeUS, packTimeUS, maxCpuRelError);
+    }
 
-		ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32G32B32A32_FLOAT, m_N / m_componentSize, m_K),
-			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
-			nullptr,
-			IID_PPV_ARGS(&mTexture2)));
+    if (mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_chunked || mKernelType == KERNELTYPE::SLM_MatMul_vector_chunked)
+    {
+        std::vector<float> cpuResult(m_M * m_N);
+        auto start = std::chrono::steady_clock::now();
+        if (mKernelType == KERNELTYPE::SLM_MatMul_vector_matrix_chunked)
+        {
+            CpuGemvVectorMatrix(buf1Data.data(), buf2Data.data(), cpuResult.data(), m_M, m_N, m_K);
+        }
+        else
+        {
+            CpuGemvMatrixVector(buf1Data.data(), buf2Data.data(), cpuResult.data(), m_M, m_K);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        double maxCpuRelError;
+        double rmsCpuRelError;
+        RelativeError(cpuResult.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
+        // A GEMV reads every element of the matrix once, so bandwidth is the limit.
+        const double matrixBytes = double(m_K) * (mKernelType == KERNELTYPE::SLM_MatMul_vector_chunked ? m_M : m_N) * sizeof(float);
+        printf("GEMV CPU time = %f us, CPU GB/s = %f, CPU max rel error = %e\n", cpuTimeUS, matrixBytes / cpuTimeUS / 1000, maxCpuRelError);
+    }
 
-		ResourceBarrier(m_commandList.Get(), mTexture2.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
-		D3D12_SUBRESOURCE_DATA bufferData = {};
-		bufferData.pData = buf2Data.data();
-		bufferData.RowPitch = m_N * sizeof(float);
-		bufferData.SlicePitch = bufferData.RowPitch * m_K;
-		UpdateSubresources(m_commandList.Get(), mTexture2.Get(), m_intermediatebuffer2.Get(), 0, 0, 1, &bufferData);
-		ResourceBarrier(m_commandList.Get(), mTexture2.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    if (mKernelType == KERNELTYPE::SLM_MatMul_small_m)
+    {
+        // The CPU small-M kernel next to the general CPU GEMM as the baseline.
+        std::vector<float> cpuResult(m_M * m_N);
+        auto start = std::chrono::steady_clock::now();
+        CpuGemmSmallM(buf1Data.data(), buf2Data.data(), cpuResult.data(), m_M, m_N, m_K);
+        auto end = std::chrono::steady_clock::now();
+        double smallMTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        double maxCpuRelError;
+        double rmsCpuRelError;
+        RelativeError(cpuResult.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
+        start = std::chrono::steady_clock::now();
+        CpuMatmulFloat(buf1Data.data(), buf2Data.data(), cpuResult.data(), m_M, m_N, m_K, ACCUMULATE_NAIVE);
+        end = std::chrono::steady_clock::now();
+        double gemmTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        printf("CPU small-M = %f us (max rel error = %e), CPU GEMM = %f us\n", smallMTimeUS, maxCpuRelError, gemmTimeUS);
+    }
 
-		// Create SRV for texure2
-		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MipLevels = 1;
-		srvDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+    if (m_splitEdges && mEdgeDispatchCount > 0)
+    {
+        // Run the same interior/edge split on the CPU to check the tile mapping.
+        const int tileM = mLocalGroupSizeY * mWorkPerThreadY;
+        const int tileN = mLocalGroupSizeX * mWorkPerThreadX;
+        std::vector<float> cpuResult(m_M * m_N);
+        CpuMatmulSplitEdges(buf1Data.data(), buf2Data.data(), cpuResult.data(), m_M, m_N, m_K, tileM, tileN);
+        double maxCpuRelError;
+        double rmsCpuRelError;
+        RelativeError(cpuResult.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
+        printf("CPU split over %u edge tiles: max rel error = %e\n", mEdgeDispatchCount, maxCpuRelError);
+    }
 
-		CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
-		srvHandle.Offset(2, m_cbSrvDescriptorSize); // First one is for constant buffer. Senond one is for buffer1
-		m_d3d12Device->CreateShaderResourceView(mTexture2.Get(), &srvDesc, srvHandle);
-	}
-	// Create textureResult and UAV for it.
-	{
-		const UINT elementCount = m_M * m_N;
-		const UINT bufferSize = elementCount * sizeof(float);
+    if (mKernelType == KERNELTYPE::SLM_Stream_K)
+    {
+        // The CPU decomposition with one worker per hardware thread, against whole
+        // tiles per worker, to show the tail of the data-parallel split.
+        const int tileM = mLocalGroupSizeY * mWorkPerThreadY;
+        const int tileN = mLocalGroupSizeX * mWorkPerThreadX;
+        const int workers = (std::max)(1, int(std::thread::hardware_concurrency()));
+        std::vector<float> cpuResult(m_M * m_N);
+        auto start = std::chrono::steady_clock::now();
+        CpuMatmulStreamK(buf1Data.data(), buf2Data.data(), cpuResult.data(), m_M, m_N, m_K, tileM, tileN, kStreamKDepth, workers, false);
+        auto end = std::chrono::steady_clock::now();
+        double tiledTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        start = std::chrono::steady_clock::now();
+        CpuMatmulStreamK(buf1Data.data(), buf2Data.data(), cpuResult.data(), m_M, m_N, m_K, tileM, tileN, kStreamKDepth, workers, true);
+        end = std::chrono::steady_clock::now();
+        double streamKTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        double maxCpuRelError;
+        double rmsCpuRelError;
+        RelativeError(cpuResult.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
+        printf("CPU %d workers: whole tiles GFLOPS = %f, Stream-K GFLOPS = %f (max rel error = %e)\n", workers,
+               2.0 * m_M * m_N * m_K / tiledTimeUS / 1000, 2.0 * m_M * m_N * m_K / streamKTimeUS / 1000, maxCpuRelError);
+    }
 
-		ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32G32B32A32_FLOAT, m_N / m_componentSize, m_M, 1, 0, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
-			D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-			nullptr,
-			IID_PPV_ARGS(&mTextureResult))
-		);
+    if (m_conv)
+    {
+        // The CPU implicit GEMM, and what the explicit im2col matrix would cost.
+        std::vector<float> cpuResult(size_t(m_M) * m_N);
+        auto start = std::chrono::steady_clock::now();
+        CpuConv2D(m_convInput.data(), buf2Data.data(), cpuResult.data(), m_convShape);
+        auto end = std::chrono::steady_clock::now();
+        double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        if (m_convShape.nchw)
+        {
+            // Back to the M x OC order of the reference, as for the GPU result.
+            const UINT plane = m_M / m_convShape.batch;
+            std::vector<float> rowMajor(cpuResult.size());
+            for (UINT row = 0; row < m_M; row++)
+            {
+                for (UINT oc = 0; oc < m_N; oc++)
+                {
+                    rowMajor[size_t(row) * m_N + oc] = cpuResult[(size_t(row / plane) * m_N + oc) * plane + row % plane];
+                }
+            }
+            cpuResult.swap(rowMajor);
+        }
+        // The reference is the explicit im2col matrix times the weights.
+        double maxCpuRelError;
+        double rmsCpuRelError;
+        RelativeError(cpuResult.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
+        const size_t inputSize = size_t(m_convShape.batch) * m_convShape.height * m_convShape.width * m_convShape.channels;
+        const double im2colMB = double(m_M) * ConvGemmK(m_convShape) * sizeof(float) / 1e6;
+        printf("CPU implicit GEMM conv = %f us, GFLOPS = %f, max rel error = %e; im2col = %f MB vs input = %f MB\n", cpuTimeUS,
+               2.0 * m_M * m_N * ConvGemmK(m_convShape) / cpuTimeUS / 1000, maxCpuRelError, im2colMB, inputSize * sizeof(float) / 1e6);
+    }
 
-		// Create UAV for textureResult
-		D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
-		uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
-		uavDesc.Texture2D.MipSlice = 0;
-		uavDesc.Texture2D.PlaneSlice = 0;
-		uavDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+    if (m_raster != RASTER_ROW_MAJOR)
+    {
+        // Every tile order on the CPU with the tiles of the kernel. Cache misses
+        // are only counted where perf_event_open is available.
+        const int tileM = mLocalGroupSizeY * mWorkPerThreadY;
+        const int tileN = mLocalGroupSizeX * mWorkPerThreadX;
+        std::vector<float> cpuResult(m_M * m_N);
+        CacheMissCounter counter;
+        for (int raster = RASTER_ROW_MAJOR; raster <= RASTER_HILBERT; raster++)
+        {
+            // Only the tiles an order visits are written, so a tile it misses
+            // shows up as zeros instead of the result of the order before.
+            std::fill(cpuResult.begin(), cpuResult.end(), 0.0f);
+            counter.Start();
+            auto start = std::chrono::steady_clock::now();
+            CpuMatmulRaster(buf1Data.data(), buf2Data.data(), cpuResult.data(), m_M, m_N, m_K, tileM, tileN, TileRaster(raster), m_rasterGroupM);
+            auto end = std::chrono::steady_clock::now();
+            const unsigned long long misses = counter.Stop();
+            double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+            double maxCpuRelError;
+            double rmsCpuRelError;
+            RelativeError(cpuResult.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
+            printf("CPU %s raster = %f us, GFLOPS = %f, max rel error = %e", TileRasterName(TileRaster(raster)), cpuTimeUS,
+                   2.0 * m_M * m_N * m_K / cpuTimeUS / 1000, maxCpuRelError);
+            if (counter.Available())
+            {
+                printf(", cache misses = %llu", misses);
+            }
+            printf("\n");
+        }
+    }
 
-		CD3DX12_CPU_DESCRIPTOR_HANDLE uavHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
-		uavHandle.Offset(3, m_cbSrvDescriptorSize); // First one is for constant buffer. Senond one is for buffer1. Third one is for buffer2.
-		m_d3d12Device->CreateUnorderedAccessView(mTextureResult.Get(), nullptr, &uavDesc, uavHandle);
-	}
+    if (m_doubleBuffer)
+    {
+        // The CPU port of both prefetch schedules, on the tiles of the kernel.
+        const int tileM = mLocalGroupSizeY * mWorkPerThreadY;
+        const int tileN = mLocalGroupSizeX * mWorkPerThreadX;
+        std::vector<float> cpuResult(m_M * m_N);
+        auto start = std::chrono::steady_clock::now();
+        CpuMatmulPrefetch(buf1Data.data(), buf2Data.data(), cpuResult.data(), m_M, m_N, m_K, tileM, tileN, m_tileK, false);
+        auto end = std::chrono::steady_clock::now();
+        double singleTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        start = std::chrono::steady_clock::now();
+        CpuMatmulPrefetch(buf1Data.data(), buf2Data.data(), cpuResult.data(), m_M, m_N, m_K, tileM, tileN, m_tileK, true);
+        end = std::chrono::steady_clock::now();
+        double doubleTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        double maxCpuRelError;
+        double rmsCpuRelError;
+        RelativeError(cpuResult.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
+        printf("CPU single-buffered GFLOPS = %f, double-buffered GFLOPS = %f (max rel error = %e)\n",
+               2.0 * m_M * m_N * m_K / singleTimeUS / 1000, 2.0 * m_M * m_N * m_K / doubleTimeUS / 1000, maxCpuRelError);
+    }
 
-	// Create the query result buffer.
-	{
-		// Two timestamps for each frame.
-		const UINT resultCount = 2 * m_computeCount;
-		const UINT resultBufferSize = resultCount * sizeof(UINT64);
-		D3D12_QUERY_HEAP_DESC timestampHeapDesc = {};
-		timestampHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
-		timestampHeapDesc.Count = resultCount;
+    const UINT rowA = m_transA ? m_M : m_K;
+    const UINT rowB = m_transB ? m_K : m_N;
+    if (m_lda != rowA || m_ldb != rowB || m_ldc != m_N)
+    {
+        // Time the CPU GEMM on the same strides as the GPU and on dense rows.
+        const UINT storedRowsA = m_transA ? m_K : m_M;
+        const UINT storedRowsB = m_transB ? m_N : m_K;
+        const float* pA = m_transA ? m_transposedA.data() : buf1Data.data();
+        const float* pB = m_transB ? m_transposedB.data() : buf2Data.data();
+        const std::vector<float> paddedA = WithLeadingDimension(pA, storedRowsA, rowA, m_lda);
+        const std::vector<float> paddedB = WithLeadingDimension(pB, storedRowsB, rowB, m_ldb);
+        std::vector<float> paddedC(size_t(m_M) * m_ldc);
+        std::vector<float> denseC(size_t(m_M) * m_N);
 
-		ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(resultBufferSize),
-			D3D12_RESOURCE_STATE_COPY_DEST,
-			nullptr,
-			IID_PPV_ARGS(&m_queryResult)
-		));
-		ThrowIfFailed(m_d3d12Device->CreateQueryHeap(&timestampHeapDesc, IID_PPV_ARGS(&m_queryHeap)));
-	}
+        auto start = std::chrono::steady_clock::now();
+        CpuMatmulTrans(pA, rowA, m_transA, pB, rowB, m_transB, denseC.data(), m_N, m_M, m_N, m_K);
+        auto end = std::chrono::steady_clock::now();
+        double denseTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        start = std::chrono::steady_clock::now();
+        CpuMatmulTrans(paddedA.data(), m_lda, m_transA, paddedB.data(), m_ldb, m_transB, paddedC.data(), m_ldc, m_M, m_N, m_K);
+        end = std::chrono::steady_clock::now();
+        double paddedTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        printf("CPU dense strides = %f us, lda = %u, ldb = %u, ldc = %u: %f us\n", denseTimeUS, m_lda, m_ldb, m_ldc, paddedTimeUS);
+    }
 }
 
-void D3D12Sample::LoadBufferResources()
+// Runs every kernel in kAccuracyReportKernels with the remaining flags unchanged,
+// then prints their GFLOPS next to their error, followed by the CPU GEMM in
+// each accumulation mode, so the fastest kernel within an error budget can be picked.
+void D3D12Sample::RunAccuracyReport(int argc, char *argv[])
 {
+    // One row of the table: its label, the --kernel value and the flags added for it.
+    struct ReportRun
     {
-        // Create the buffer1.
-        const UINT elementCount = m_M * m_K;
-        for ( int i = 0; i < elementCount; ++i )
+        std::string label;
+        std::string kernel;
+        std::vector<std::string> extraArgs;
+    };
+    std::vector<ReportRun> runs;
+    for (const char* kernel : kAccuracyReportKernels)
+    {
+        runs.push_back({ kernel, kernel, {} });
+    }
+    // The double-buffered variants and the generated kernels from --shapes
+    // follow the hand-written ones.
+    runs.push_back({ "SLM_8X8_4X16 double", "SLM_8X8_4X16", { "--prefetch", "double" } });
+    runs.push_back({ "SLM_8X8_4X16_packed double", "SLM_8X8_4X16_packed", { "--prefetch", "double" } });
+    runs.push_back({ "SLM_4x4_16x16_v4 double", "SLM_4x4_16x16_v4", { "--prefetch", "double" } });
+    runs.push_back({ "SLM_4x4_shared_A double", "SLM_4x4_shared_A", { "--prefetch", "double" } });
+    runs.push_back({ "SLM_4x4_16x16_4_FLOATS double", "SLM_4x4_16x16_4_FLOATS", { "--prefetch", "double" } });
+    for (const std::string& shape : m_reportShapes)
+    {
+        runs.push_back({ "GEN_" + shape, "generated", { "--shape", shape } });
+    }
+
+    std::vector<RunResult> results;
+    for (ReportRun& run : runs)
+    {
+        // The kernels without ACCUMULATE_MODE reject kahan and fp64; their rows
+        // show the naive error they really have.
+        if (std::none_of(std::begin(kAccumulateModeKernels), std::end(kAccumulateModeKernels),
+                         [&run](const AccumulateModeKernel& kernel) { return run.kernel == kernel.name; }))
         {
-            buf1Data.push_back((float) rand() / float(RAND_MAX));
+            run.extraArgs.push_back("--accumulate");
+            run.extraArgs.push_back("naive");
+        }
+        std::vector<std::string> args(argv, argv + argc);
+        for (size_t i = 0; i + 1 < args.size(); i++)
+        {
+            if (args[i] == "--kernel")
+            {
+                args[i + 1] = run.kernel;
+            }
+        }
+        args.insert(args.end(), run.extraArgs.begin(), run.extraArgs.end());
+        std::vector<char*> kernelArgv;
+        for (std::string& arg : args)
+        {
+            kernelArgv.push_back(&arg[0]);
         }
-        const UINT bufferSize = buf1Data.size() * sizeof(float);
 
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
-            D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(&m_intermediatebuffer1)));
+        std::cout << "=== " << run.label << " ===" << std::endl;
+        srand(kAccuracyReportSeed);
+        D3D12Sample sample;
+        sample.Start(int(kernelArgv.size()), kernelArgv.data());
+        results.push_back(sample.GetRunResult());
+    }
+
+    // The inputs the runs drew from the same seed, A first.
+    srand(kAccuracyReportSeed);
+    std::vector<float> a(m_M * m_K);
+    std::vector<float> b(m_K * m_N);
+    for (float& value : a)
+    {
+        value = (float)rand() / float(RAND_MAX);
+    }
+    for (float& value : b)
+    {
+        value = (float)rand() / float(RAND_MAX);
+    }
+    std::vector<double> reference(m_M * m_N);
+    CpuMatmulReference(a.data(), b.data(), reference.data(), m_M, m_N, m_K);
+
+    printf("\nM = %u, K = %u, N = %u\n", m_M, m_K, m_N);
+    printf("%-32s %12s %12s %16s %16s\n", "Kernel", "Accumulation", "GFLOPS", "Max rel error", "RMS rel error");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        printf("%-32s %12s %12.2f %16e %16e\n", runs[i].label.c_str(), AccumulationModeName(results[i].accumulateMode),
+               results[i].gflops, results[i].maxRelError, results[i].rmsRelError);
+    }
+
+    static const AccumulationMode cpuModes[] = { ACCUMULATE_NAIVE, ACCUMULATE_KAHAN, ACCUMULATE_PAIRWISE, ACCUMULATE_FP64 };
+    std::vector<float> c(m_M * m_N);
+    for (AccumulationMode mode : cpuModes)
+    {
+        auto start = std::chrono::steady_clock::now();
+        CpuMatmulFloat(a.data(), b.data(), c.data(), m_M, m_N, m_K, mode);
+        auto end = std::chrono::steady_clock::now();
+        double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
 
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
-            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
-            nullptr,
-            IID_PPV_ARGS(&m_buffer1)));
+        double maxRelError;
+        double rmsRelError;
+        RelativeError(c.data(), reference.data(), reference.size(), maxRelError, rmsRelError);
+        printf("%-32s %12s %12.2f %16e %16e\n", "CPU", AccumulationModeName(mode), 2.0 * m_M * m_N * m_K / cpuTimeUS / 1000,
+               maxRelError, rmsRelError);
+    }
 
-        ResourceBarrier(m_commandList.Get(), m_buffer1.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
-        D3D12_SUBRESOURCE_DATA bufferData = {};
-        bufferData.pData = buf1Data.data();
-        bufferData.RowPitch = bufferSize;
-        UpdateSubresources(m_commandList.Get(), m_buffer1.Get(), m_intermediatebuffer1.Get(), 0, 0, 1, &bufferData);
-        ResourceBarrier(m_commandList.Get(), m_buffer1.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    // The same inputs widened to fp64, to show what full double precision costs on the CPU.
+    std::vector<double> a64(a.begin(), a.end());
+    std::vector<double> b64(b.begin(), b.end());
+    std::vector<double> c64(m_M * m_N);
+    auto start = std::chrono::steady_clock::now();
+    CpuMatmulDouble(a64.data(), b64.data(), c64.data(), m_M, m_N, m_K);
+    auto end = std::chrono::steady_clock::now();
+    double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    double maxRelError;
+    double rmsRelError;
+    RelativeError(c64.data(), reference.data(), reference.size(), maxRelError, rmsRelError);
+    printf("%-32s %12s %12.2f %16e %16e\n", "CPU DGEMM", "fp64", 2.0 * m_M * m_N * m_K / cpuTimeUS / 1000, maxRelError, rmsRelError);
+
+    // The CPU port of the single- and double-buffered SLM_8X8_4X16 schedules.
+    for (int doubleBuffer = 0; doubleBuffer < 2; doubleBuffer++)
+    {
+        start = std::chrono::steady_clock::now();
+        CpuMatmulPrefetch(a.data(), b.data(), c.data(), m_M, m_N, m_K, 32, 128, 64, doubleBuffer != 0);
+        end = std::chrono::steady_clock::now();
+        cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        RelativeError(c.data(), reference.data(), reference.size(), maxRelError, rmsRelError);
+        printf("%-32s %12s %12.2f %16e %16e\n", doubleBuffer ? "CPU prefetch double" : "CPU prefetch single", "naive",
+               2.0 * m_M * m_N * m_K / cpuTimeUS / 1000, maxRelError, rmsRelError);
+    }
+}
 
-        // Create SRV for the buffer1
-        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-        srvDesc.Buffer.FirstElement = 0;
-        if (mStorageType == STORAGETYPE::STRUCTURED_BUFFER)
+// Runs --conv for every layer in kConvBenchmarkLayers with the remaining flags
+// unchanged, then prints the GPU and CPU GFLOPS of each layer next to the size
+// of the im2col matrix an explicit lowering would have stored.
+void D3D12Sample::RunConvBenchmark(int argc, char *argv[])
+{
+    std::vector<RunResult> results;
+    std::vector<double> cpuGflops;
+    bool nchw = false;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        nchw = nchw || (std::string(argv[i]) == "--layout" && std::string(argv[i + 1]) == "nchw");
+    }
+    for (const ConvLayer& layer : kConvBenchmarkLayers)
+    {
+        const ConvShape& shape = layer.shape;
+        std::vector<std::string> args;
+        for (int i = 0; i < argc; i++)
         {
-            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
-            srvDesc.Buffer.NumElements = elementCount / m_componentSize;
-            srvDesc.Buffer.StructureByteStride = m_componentSize * sizeof(float);
-            srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+            if (std::string(argv[i]) != "--conv-bench")
+            {
+                args.push_back(argv[i]);
+            }
         }
-        else
+        args.push_back("--conv");
+        args.push_back(std::to_string(shape.batch) + "," + std::to_string(shape.height) + "," + std::to_string(shape.width) + "," +
+                       std::to_string(shape.channels) + "," + std::to_string(shape.outChannels) + "," + std::to_string(shape.kernelH) + "," +
+                       std::to_string(shape.kernelW) + "," + std::to_string(shape.stride) + "," + std::to_string(shape.pad));
+        std::vector<char*> layerArgv;
+        for (std::string& arg : args)
         {
-            srvDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-            srvDesc.Buffer.NumElements = elementCount;
-            srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
+            layerArgv.push_back(&arg[0]);
         }
-        CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
-        srvHandle.Offset(1, m_cbSrvDescriptorSize); // First one is for constant buffer.
-        m_d3d12Device->CreateShaderResourceView(m_buffer1.Get(), &srvDesc, srvHandle);
-    }
 
-    {
-        // create the buffer2
-        const UINT elementCount = m_K * m_N;
-        for (int i = 0; i < elementCount; ++i)
+        std::cout << "=== " << layer.name << " ===" << std::endl;
+        D3D12Sample sample;
+        sample.Start(int(layerArgv.size()), layerArgv.data());
+        results.push_back(sample.GetRunResult());
+
+        ConvShape cpuShape = shape;
+        cpuShape.nchw = nchw;
+        const int M = shape.batch * ConvOutputHeight(shape) * ConvOutputWidth(shape);
+        std::vector<float> input(size_t(shape.batch) * shape.height * shape.width * shape.channels);
+        std::vector<float> weights(size_t(ConvGemmK(shape)) * shape.outChannels);
+        std::vector<float> output(size_t(M) * shape.outChannels);
+        for (float& value : input)
         {
-            buf2Data.push_back((float)rand() / float(RAND_MAX));
+            value = (float)rand() / float(RAND_MAX);
         }
-        const UINT bufferSize = buf2Data.size() * sizeof(float);
-
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
-            D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(&m_intermediatebuffer2)));
-
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
-            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
-            nullptr,
-            IID_PPV_ARGS(&m_buffer2)));
+        for (float& value : weights)
+        {
+            value = (float)rand() / float(RAND_MAX);
+        }
+        auto start = std::chrono::steady_clock::now();
+        CpuConv2D(input.data(), weights.data(), output.data(), cpuShape);
+        auto end = std::chrono::steady_clock::now();
+        double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        cpuGflops.push_back(2.0 * M * shape.outChannels * ConvGemmK(shape) / cpuTimeUS / 1000);
+    }
 
-        ResourceBarrier(m_commandList.Get(), m_buffer2.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
-        D3D12_SUBRESOURCE_DATA bufferData = {};
-        bufferData.pData = buf2Data.data();
-        bufferData.RowPitch = bufferSize;
-        UpdateSubresources(m_commandList.Get(), m_buffer2.Get(), m_intermediatebuffer2.Get(), 0, 0, 1, &bufferData);
-        ResourceBarrier(m_commandList.Get(), m_buffer2.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    printf("\n%-24s %10s %10s %12s %12s %12s\n", "Layer", "GPU GFLOPS", "CPU GFLOPS", "Input MB", "im2col MB", "Saved MB");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const ConvShape& shape = kConvBenchmarkLayers[i].shape;
+        const double inputMB = double(shape.batch) * shape.height * shape.width * shape.channels * sizeof(float) / 1e6;
+        const double im2colMB = double(shape.batch) * ConvOutputHeight(shape) * ConvOutputWidth(shape) * ConvGemmK(shape) * sizeof(float) / 1e6;
+        printf("%-24s %10.2f %10.2f %12.2f %12.2f %12.2f\n", kConvBenchmarkLayers[i].name, results[i].gflops, cpuGflops[i],
+               inputMB, im2colMB, im2colMB - inputMB);
+    }
+}
 
-        // Create SRV for buffer2
-        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-        srvDesc.Buffer.FirstElement = 0;
-        if (mStorageType == STORAGETYPE::STRUCTURED_BUFFER)
+// Runs the kernel at M = K = N = each size of kPadBenchmarkSizes with --pad none
+// and auto, with the remaining flags unchanged, and the CPU GEMM on the same
+// dense and padded strides, then prints their GFLOPS side by side.
+void D3D12Sample::RunPadBenchmark(int argc, char *argv[])
+{
+    auto runSample = [&](std::initializer_list<std::string> extraArgs) {
+        std::vector<std::string> args;
+        for (int i = 0; i < argc; i++)
         {
-            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
-            srvDesc.Buffer.NumElements = elementCount / m_componentSize;
-            srvDesc.Buffer.StructureByteStride = m_componentSize * sizeof(float);
-            srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+            if (std::string(argv[i]) != "--pad-bench")
+            {
+                args.push_back(argv[i]);
+            }
         }
-        else
+        args.insert(args.end(), extraArgs);
+        std::vector<char*> runArgv;
+        for (std::string& arg : args)
         {
-            srvDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-            srvDesc.Buffer.NumElements = elementCount;
-            srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
+            runArgv.push_back(&arg[0]);
         }
-        CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
-        srvHandle.Offset(2, m_cbSrvDescriptorSize); // First one is for constant buffer. Senond one is for buffer1
-        m_d3d12Device->CreateShaderResourceView(m_buffer2.Get(), &srvDesc, srvHandle);
-	}
-        // Create bufferResult and UAV for it.
-    {
-        const UINT elementCount = m_M * m_N;
-        const UINT bufferSize = elementCount * sizeof(float);
-
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(bufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
-            D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-            nullptr,
-            IID_PPV_ARGS(&m_bufferResult))
-        );
+        D3D12Sample sample;
+        sample.Start(int(runArgv.size()), runArgv.data());
+        return sample.GetRunResult();
+    };
 
-        // Create UAV for bufferResult
-        D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
-        uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
-        uavDesc.Buffer.FirstElement = 0;
-        if (mStorageType == STORAGETYPE::STRUCTURED_BUFFER)
+    struct PadRun
+    {
+        UINT size;
+        int ld;     // Of the CPU rows, padded as for float4 loads.
+        RunResult dense;
+        RunResult padded;
+        double cpuDenseGflops;
+        double cpuPaddedGflops;
+    };
+    std::vector<PadRun> runs;
+    for (UINT size : kPadBenchmarkSizes)
+    {
+        const std::string n = std::to_string(size);
+        PadRun run = {};
+        run.size = size;
+        run.ld = PaddedLeadingDimension(int(size), 4, 16);
+        std::cout << "=== M = K = N = " << size << ", --pad none ===" << std::endl;
+        run.dense = runSample({ "--M", n, "--K", n, "--N", n, "--pad", "none" });
+        std::cout << "=== M = K = N = " << size << ", --pad auto ===" << std::endl;
+        run.padded = runSample({ "--M", n, "--K", n, "--N", n, "--pad", "auto" });
+
+        std::vector<float> a(size_t(size) * size);
+        std::vector<float> b(size_t(size) * size);
+        for (std::vector<float>* data : { &a, &b })
         {
-            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
-            uavDesc.Buffer.NumElements = elementCount / m_componentSize;
-            uavDesc.Buffer.StructureByteStride = m_componentSize * sizeof(float);
-            uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
-        }
-        else {
-            uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-            uavDesc.Buffer.NumElements = elementCount;
-            uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
+            for (float& value : *data)
+            {
+                value = (float)rand() / float(RAND_MAX);
+            }
         }
-            CD3DX12_CPU_DESCRIPTOR_HANDLE uavHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
-            uavHandle.Offset(3, m_cbSrvDescriptorSize); // First one is for constant buffer. Senond one is for buffer1. Third one is for buffer2.
-            m_d3d12Device->CreateUnorderedAccessView(m_bufferResult.Get(), nullptr, &uavDesc, uavHandle);
+        const double flops = 2.0 * size * size * size;
+        {
+            std::vector<float> c(size_t(size) * size);
+            auto start = std::chrono::steady_clock::now();
+            CpuMatmulTrans(a.data(), size, false, b.data(), size, false, c.data(), size, size, size, size);
+            auto end = std::chrono::steady_clock::now();
+            run.cpuDenseGflops = flops / double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()) / 1000;
         }
+        a = WithLeadingDimension(a.data(), size, size, UINT(run.ld));
+        b = WithLeadingDimension(b.data(), size, size, UINT(run.ld));
+        std::vector<float> c(size_t(size) * run.ld);
+        auto start = std::chrono::steady_clock::now();
+        CpuMatmulTrans(a.data(), run.ld, false, b.data(), run.ld, false, c.data(), run.ld, size, size, size);
+        auto end = std::chrono::steady_clock::now();
+        run.cpuPaddedGflops = flops / double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()) / 1000;
+        runs.push_back(run);
+    }
 
-    // Create the query result buffer.
+    printf("\n%8s %8s %12s %12s %12s %12s\n", "Size", "CPU ld", "GPU dense", "GPU padded", "CPU dense", "CPU padded");
+    for (const PadRun& run : runs)
     {
-        // Two timestamps for each frame.
-        const UINT resultCount = 2 * m_computeCount;
-        const UINT resultBufferSize = resultCount * sizeof(UINT64);
-        D3D12_QUERY_HEAP_DESC timestampHeapDesc = {};
-        timestampHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
-        timestampHeapDesc.Count = resultCount;
-
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(resultBufferSize),
-            D3D12_RESOURCE_STATE_COPY_DEST,
-            nullptr,
-            IID_PPV_ARGS(&m_queryResult)
-            ));
-        ThrowIfFailed(m_d3d12Device->CreateQueryHeap(&timestampHeapDesc, IID_PPV_ARGS(&m_queryHeap)));
+        printf("%8u %8d %12.2f %12.2f %12.2f %12.2f\n", run.size, run.ld, run.dense.gflops, run.padded.gflops,
+               run.cpuDenseGflops, run.cpuPaddedGflops);
     }
 }
 
-void D3D12Sample::RunCompute()
+// Runs SLM_Attention with M = K = each length of kAttentionBenchmarkLengths and
+// N = each of kAttentionBenchmarkHeadDims, with the remaining flags unchanged,
+// then prints the GPU GFLOPS next to the score traffic that running attention
+// as two GEMMs and a softmax pass would add.
+void D3D12Sample::RunAttentionBenchmark(int argc, char *argv[])
 {
-    double flops = 2 * m_M * m_N * m_K;
-    double total = 0.0;
-    for (int it = 0; it < m_computeCount; it++)
+    struct AttentionRun
     {
-        // This will restart the command list and start a new record.
-        ThrowIfFailed(m_computeAllocator->Reset());
-        ThrowIfFailed(m_commandList->Reset(m_computeAllocator.Get(), m_computePSO.Get()));
-
-        // Record commands.
-        // Get a timestamp at the beginning and end of the command list.
-        const UINT timestampHeapIndex = 2 * it;
-        m_commandList->EndQuery(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampHeapIndex);
-        ID3D12DescriptorHeap* pHeaps[] = { m_cbSrvHeap.Get() };
-        m_commandList->SetDescriptorHeaps(_countof(pHeaps), pHeaps);
+        UINT length;
+        UINT headDim;
+        RunResult result;
+    };
+    std::vector<AttentionRun> runs;
+    for (UINT length : kAttentionBenchmarkLengths)
+    {
+        for (UINT headDim : kAttentionBenchmarkHeadDims)
+        {
+            std::vector<std::string> args;
+            for (int i = 0; i < argc; i++)
+            {
+                if (std::string(argv[i]) != "--attention-bench")
+                {
+                    args.push_back(argv[i]);
+                }
+            }
+            args.insert(args.end(), { "--kernel", "SLM_Attention", "--M", std::to_string(length), "--K", std::to_string(length),
+                                      "--N", std::to_string(headDim) });
+            std::vector<char*> runArgv;
+            for (std::string& arg : args)
+            {
+                runArgv.push_back(&arg[0]);
+            }
 
-        m_commandList->SetComputeRootSignature(m_computeRootSignature.Get());
-        CD3DX12_GPU_DESCRIPTOR_HANDLE gpuSrvDescriptorHandle(m_cbSrvHeap->GetGPUDescriptorHandleForHeapStart());
-        m_commandList->SetComputeRootDescriptorTable(0, gpuSrvDescriptorHandle);
-        gpuSrvDescriptorHandle.Offset(1, m_cbSrvDescriptorSize);
-        m_commandList->SetComputeRootDescriptorTable(1, gpuSrvDescriptorHandle);
-        gpuSrvDescriptorHandle.Offset(2, m_cbSrvDescriptorSize);
-        m_commandList->SetComputeRootDescriptorTable(2, gpuSrvDescriptorHandle);
+            std::cout << "=== Attention, sequence length " << length << ", head dimension " << headDim << " ===" << std::endl;
+            D3D12Sample sample;
+            sample.Start(int(runArgv.size()), runArgv.data());
+            runs.push_back({ length, headDim, sample.GetRunResult() });
+        }
+    }
 
-        m_commandList->SetPipelineState(m_computePSO.Get());
-        m_commandList->Dispatch(mDispatchX, mDispatchY, 1);
-        m_commandList->EndQuery(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampHeapIndex + 1);
-        m_commandList->ResolveQueryData(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampHeapIndex, 2, m_queryResult.Get(), timestampHeapIndex * sizeof(UINT64));
+    printf("\n%8s %8s %10s %14s %12s %14s %16s\n", "Length", "HeadDim", "GFLOPS", "Max rel error", "Scores MB", "Avoided MB", "Q+K+V+O MB");
+    for (const AttentionRun& run : runs)
+    {
+        const double scoreMB = double(run.length) * run.length * sizeof(float) / 1e6;
+        const double operandMB = 4.0 * run.length * run.headDim * sizeof(float) / 1e6;
+        printf("%8u %8u %10.2f %14e %12.2f %14.2f %16.2f\n", run.length, run.headDim, run.result.gflops,
+               run.result.maxRelError, scoreMB, 4 * scoreMB, operandMB);
+    }
+}
 
-        ThrowIfFailed(m_commandList->Close());
-        auto start = std::chrono::steady_clock::now();
-        // Execute the command list.
-        ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
-        m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
-        WaitForGpu();
-        auto end = std::chrono::steady_clock::now();
-        auto diff = end - start;
-        if (it > 0)
+// Runs SLM_SpMM on A pruned to each sparsity of kSparseBenchmarkSparsities and
+// the dense kernel once on the same shape, with the remaining flags unchanged:
+// SLM_8X8_4X16, or SLM_MatMul_vector_chunked for N = 1. Then prints the GPU
+// and CPU times of the sparse and dense paths side by side and the sparsity
+// from which the sparse path stays faster.
+void D3D12Sample::RunSparseBenchmark(int argc, char *argv[])
+{
+    auto runSample = [&](std::initializer_list<std::string> extraArgs) {
+        std::vector<std::string> args;
+        for (int i = 0; i < argc; i++)
         {
-            total += std::chrono::duration_cast<std::chrono::microseconds>(diff).count();
+            if (std::string(argv[i]) != "--sparse-bench")
+            {
+                args.push_back(argv[i]);
+            }
+        }
+        args.insert(args.end(), extraArgs);
+        std::vector<char*> runArgv;
+        for (std::string& arg : args)
+        {
+            runArgv.push_back(&arg[0]);
+        }
+        D3D12Sample sample;
+        sample.Start(int(runArgv.size()), runArgv.data());
+        return sample.GetRunResult();
+    };
+
+    std::cout << "=== Dense, M = " << m_M << ", K = " << m_K << ", N = " << m_N << " ===" << std::endl;
+    const RunResult dense = runSample({ "--kernel", m_N == 1 ? "SLM_MatMul_vector_chunked" : "SLM_8X8_4X16" });
+
+    std::vector<float> denseA(size_t(m_M) * m_K);
+    std::vector<float> b(size_t(m_K) * m_N);
+    std::vector<float> c(size_t(m_M) * m_N);
+    for (std::vector<float>* data : { &denseA, &b })
+    {
+        for (float& value : *data)
+        {
+            value = (float)rand() / float(RAND_MAX);
         }
     }
-    double avg_time = total / (m_computeCount - 1);
-    double total_kernel = 0;
-    double minTime = 1e100;
-
-    // Get the timestamp values from the result buffers.
-    D3D12_RANGE readRange = {};
-    const D3D12_RANGE emptyRange = {};
-    for (UINT i = 0; i < m_computeCount; i++)
+    auto start = std::chrono::steady_clock::now();
+    if (m_N == 1)
     {
-        readRange.Begin = (2 * i) * sizeof(UINT64);
-        readRange.End = readRange.Begin + 2 * sizeof(UINT64);
-
-        void* pData = nullptr;
-        ThrowIfFailed(m_queryResult->Map(0, &readRange, &pData));
-
-        const UINT64* pTimestamps = reinterpret_cast<UINT64*>(static_cast<UINT8*>(pData) + readRange.Begin);
-        const UINT64 timeStampDelta = pTimestamps[1] - pTimestamps[0];
+        CpuGemvMatrixVector(denseA.data(), b.data(), c.data(), m_M, m_K);
+    }
+    else
+    {
+        CpuMatmulFloat(denseA.data(), b.data(), c.data(), m_M, m_N, m_K, ACCUMULATE_NAIVE);
+    }
+    auto end = std::chrono::steady_clock::now();
+    const double cpuDenseUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
 
-        // Unmap with an empty range (written range).
-        m_queryResult->Unmap(0, &emptyRange);
+    struct SparseRun
+    {
+        double sparsity;    // Of the generated A, which differs a little from the one asked for.
+        size_t nonZeros;
+        RunResult result;
+        double cpuTimeUS;
+    };
+    std::vector<SparseRun> runs;
+    for (double sparsity : kSparseBenchmarkSparsities)
+    {
+        std::cout << "=== Sparse, sparsity " << sparsity << " ===" << std::endl;
+        const RunResult result = runSample({ "--kernel", "SLM_SpMM", "--sparsity", std::to_string(sparsity) });
 
-        // Calculate the GPU execution time in microseconds.
-        const UINT64 gpuTimeUS =  (timeStampDelta * 1000000) / m_timestampFrequency;
-        // Don't consider the first dispatch time.
-        if (i > 0)
+        // The matrix the sample generated, from the same seed.
+        const CsrMatrix A = RandomBlockSparse(m_M, m_K, m_sparseBlock, sparsity, 1);
+        BlockedEllMatrix ell;
+        if (m_blockedEll)
         {
-            if (gpuTimeUS < minTime)
-                minTime = gpuTimeUS;
-            total_kernel += gpuTimeUS;
+            ell = BlockedEllFromCsr(A, m_sparseBlock);
+        }
+        start = std::chrono::steady_clock::now();
+        if (m_blockedEll)
+        {
+            CpuSpmmBlockedEll(ell, b.data(), c.data(), m_N);
+        }
+        else
+        {
+            CpuSpmm(A, b.data(), c.data(), m_N);
         }
+        end = std::chrono::steady_clock::now();
+        runs.push_back({ CsrSparsity(A), A.values.size(), result,
+                         double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()) });
     }
-    double avg_kernel = 0;
-    avg_kernel = total_kernel / (m_computeCount - 1);
-    printf("Avg_time = %f us, Avg_kernel_time = %f us, min_time = %f us\n",
-           avg_time, avg_kernel, minTime);
-
-    m_computeAllocator->Reset();
-    m_commandList->Reset(m_computeAllocator.Get(), m_computePSO.Get());
 
-#ifdef PRINT_DATA
-    // Read data back to verify the result
-    UINT64 outputBufferSize = m_M * m_N * sizeof(float);
-    ComPtr<ID3D12Resource> readbackBuffer;
-    ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
-        D3D12_HEAP_FLAG_NONE,
-        &CD3DX12_RESOURCE_DESC::Buffer(outputBufferSize),
-        D3D12_RESOURCE_STATE_COPY_DEST,
-        nullptr,
-        IID_PPV_ARGS(&readbackBuffer)));
-    readbackBuffer->SetName(L"Readback buffer Map");
-    if (mStorageType == STORAGETYPE::TEXTURE)
+    printf("\n%s with %ux%u blocks, M = %u, K = %u, N = %u\n", m_blockedEll ? "Blocked ELL" : "CSR", m_sparseBlock, m_sparseBlock, m_M, m_K, m_N);
+    printf("%10s %12s %14s %14s %10s %14s %14s %10s\n", "Sparsity", "Nonzeros", "GPU sparse us", "GPU dense us", "Speedup",
+           "CPU sparse us", "CPU dense us", "Speedup");
+    // The lowest sparsity from which the sparse path is faster at every higher one.
+    double gpuCrossover = -1.0;
+    double cpuCrossover = -1.0;
+    for (const SparseRun& run : runs)
     {
-        ResourceBarrier(m_commandList.Get(), mTextureResult.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
-        D3D12_TEXTURE_COPY_LOCATION copyDest;
-        copyDest.pResource = readbackBuffer.Get();
-        copyDest.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-        UINT64 transferToToalBytes;
-        const UINT64 baseOffset = 0;
-        D3D12_RESOURCE_DESC desc = mTextureResult.Get()->GetDesc();
-        m_d3d12Device->GetCopyableFootprints(&desc, 0, 1, baseOffset, &copyDest.PlacedFootprint, nullptr, nullptr, &transferToToalBytes);
-
-        D3D12_TEXTURE_COPY_LOCATION copySrc;
-        copySrc.pResource = mTextureResult.Get();
-        copySrc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-        copySrc.SubresourceIndex = 0;
-        CD3DX12_BOX box(0, 0, m_N / m_componentSize, m_M);
-        m_commandList->CopyTextureRegion(&copyDest, 0, 0, 0, &copySrc, &box);
+        if (run.result.kernelTimeUS == 0.0 || dense.kernelTimeUS == 0.0)
+        {
+            // The run failed or was too fast to time, so it can't count as a win.
+            printf("%10.4f %12zu %14s\n", run.sparsity, run.nonZeros, "not timed");
+            gpuCrossover = -1.0;
+            cpuCrossover = -1.0;
+            continue;
+        }
+        const double gpuSpeedup = dense.kernelTimeUS / run.result.kernelTimeUS;
+        const double cpuSpeedup = cpuDenseUS / run.cpuTimeUS;
+        gpuCrossover = gpuSpeedup > 1.0 ? (gpuCrossover < 0.0 ? run.sparsity : gpuCrossover) : -1.0;
+        cpuCrossover = cpuSpeedup > 1.0 ? (cpuCrossover < 0.0 ? run.sparsity : cpuCrossover) : -1.0;
+        printf("%10.4f %12zu %14.2f %14.2f %10.2f %14.2f %14.2f %10.2f\n", run.sparsity, run.nonZeros, run.result.kernelTimeUS,
+               dense.kernelTimeUS, gpuSpeedup, run.cpuTimeUS, cpuDenseUS, cpuSpeedup);
     }
-    else
+    for (int cpu = 0; cpu < 2; cpu++)
     {
-        ResourceBarrier(m_commandList.Get(), m_bufferResult.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
-        m_commandList->CopyResource(readbackBuffer.Get(), m_bufferResult.Get());
+        const double crossover = cpu ? cpuCrossover : gpuCrossover;
+        if (crossover < 0.0)
+        {
+            printf("%s: the sparse path doesn't beat dense at the highest sparsity measured.\n", cpu ? "CPU" : "GPU");
+        }
+        else
+        {
+            printf("%s: the sparse path is faster than dense from a sparsity of %.4f.\n", cpu ? "CPU" : "GPU", crossover);
+        }
     }
+}
 
-    m_commandList->Close();
-    ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
-    m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
-    WaitForGpu();
+// Runs --block-sparse on A and/or B with each density of
+// kBlockSparseBenchmarkDensities and dense SLM_8X8_4X16 once on the same shape,
+// with the remaining flags unchanged. The GFLOPS are effective ones, 2MNK over
+// the time, so they grow past the dense rate as more K steps are skipped.
+void D3D12Sample::RunBlockSparseBenchmark(int argc, char *argv[])
+{
+    auto runSample = [&](std::initializer_list<std::string> extraArgs) {
+        std::vector<std::string> args;
+        for (int i = 0; i < argc; i++)
+        {
+            if (std::string(argv[i]) != "--block-sparse-bench")
+            {
+                args.push_back(argv[i]);
+            }
+        }
+        args.insert(args.end(), extraArgs);
+        std::vector<char*> runArgv;
+        for (std::string& arg : args)
+        {
+            runArgv.push_back(&arg[0]);
+        }
+        D3D12Sample sample;
+        sample.Start(int(runArgv.size()), runArgv.data());
+        return sample.GetRunResult();
+    };
+    if (!m_blockSparseA && !m_blockSparseB)
+    {
+        m_blockSparseA = true;
+    }
+    const std::string operands = std::string(m_blockSparseA ? "a" : "") + (m_blockSparseB ? "b" : "");
 
-    float result = 0.0;
-    int m = rand() % m_M;
-    int n = rand() % m_N;
-    D3D12_RANGE readbackBufferRange{ 0, outputBufferSize };
-    FLOAT * pReadbackBufferData{};
-    ThrowIfFailed(readbackBuffer->Map(
-        0,
-        &readbackBufferRange,
-        reinterpret_cast<void**>(&pReadbackBufferData)));
+    std::cout << "=== Dense, M = " << m_M << ", K = " << m_K << ", N = " << m_N << " ===" << std::endl;
+    const RunResult dense = runSample({ "--kernel", "SLM_8X8_4X16", "--block-sparse", "none" });
 
-    result = pReadbackBufferData[m*m_N + n];
-    readbackBuffer->Unmap(0, &emptyRange);
+    std::vector<float> a(size_t(m_M) * m_K);
+    std::vector<float> b(size_t(m_K) * m_N);
+    std::vector<float> c(size_t(m_M) * m_N);
+    for (std::vector<float>* data : { &a, &b })
+    {
+        for (float& value : *data)
+        {
+            value = (float)rand() / float(RAND_MAX);
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    CpuMatmulFloat(a.data(), b.data(), c.data(), m_M, m_N, m_K, ACCUMULATE_NAIVE);
+    auto end = std::chrono::steady_clock::now();
+    const double cpuDenseUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+    struct BlockSparseRun
+    {
+        double density;
+        double stepFraction;    // Of the K steps of all tiles of C, run on both the GPU and the CPU.
+        RunResult result;
+        double cpuTimeUS;
+        double cpuMaxRelError;    // Against the dense product of the pruned matrices.
+    };
+    std::vector<BlockSparseRun> runs;
+    // The tiles of SLM_8X8_4X16.
+    const int tileM = int(mLocalGroupSizeY) * 8;
+    const int tileN = int(mLocalGroupSizeX) * 8;
+    const int tileK = int(mLocalGroupSizeX) * 4;
+    for (double density : kBlockSparseBenchmarkDensities)
+    {
+        std::cout << "=== Block-sparse " << operands << ", density " << density << " ===" << std::endl;
+        const RunResult result = runSample({ "--kernel", "SLM_8X8_4X16", "--block-sparse", operands, "--sparsity", std::to_string(1.0 - density) });
+
+        // The blocks the sample pruned, from the same seeds.
+        std::vector<float> prunedA = a;
+        std::vector<float> prunedB = b;
+        if (m_blockSparseA)
+        {
+            PruneBlocks(prunedA.data(), m_M, m_K, m_sparseBlock, 1.0 - density, 1);
+        }
+        if (m_blockSparseB)
+        {
+            PruneBlocks(prunedB.data(), m_K, m_N, m_sparseBlock, 1.0 - density, 2);
+        }
+        const TileMask mask = BuildTileMask(prunedA.data(), prunedB.data(), m_M, m_N, m_K, tileM, tileN, tileK, m_blockSparseA, m_blockSparseB);
+        start = std::chrono::steady_clock::now();
+        CpuMatmulBlockSparse(prunedA.data(), prunedB.data(), c.data(), m_M, m_N, m_K, mask);
+        end = std::chrono::steady_clock::now();
+        std::vector<double> reference(size_t(m_M) * m_N);
+        CpuMatmulReference(prunedA.data(), prunedB.data(), reference.data(), m_M, m_N, m_K);
+        double maxCpuRelError;
+        double rmsCpuRelError;
+        RelativeError(c.data(), reference.data(), reference.size(), maxCpuRelError, rmsCpuRelError);
+        const double steps = double(mask.tilesM) * mask.tilesN * mask.tilesK;
+        runs.push_back({ density, steps > 0.0 ? OccupiedTileSteps(mask) / steps : 0.0, result,
+                         double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()), maxCpuRelError });
+    }
 
-    float acc = 0.0;
-    for (unsigned int k = 0; k < m_K; k++)
+    const double flops = 2.0 * m_M * m_N * m_K;
+    printf("\nBlock-sparse %s with %ux%u blocks, M = %u, K = %u, N = %u, dense GPU %.2f us (%.2f GFLOPS), dense CPU %.2f us\n",
+           operands.c_str(), m_sparseBlock, m_sparseBlock, m_M, m_K, m_N, dense.kernelTimeUS, dense.gflops, cpuDenseUS);
+    printf("%10s %12s %12s %14s %10s %12s %14s %10s %14s\n", "Density", "K steps run", "GPU us", "GPU eff GFLOPS", "Speedup",
+           "CPU us", "CPU eff GFLOPS", "Speedup", "CPU rel error");
+    for (const BlockSparseRun& run : runs)
     {
-        acc += buf1Data[m*m_K + k] * buf2Data[k*m_N + n];
+        if (run.result.kernelTimeUS == 0.0 || dense.kernelTimeUS == 0.0)
+        {
+            // The run failed or was too fast to time.
+            printf("%10.4f %11.1f%% %12s\n", run.density, 100.0 * run.stepFraction, "not timed");
+            continue;
+        }
+        printf("%10.4f %11.1f%% %12.2f %14.2f %10.2f %12.2f %14.2f %10.2f %14e\n", run.density, 100.0 * run.stepFraction,
+               run.result.kernelTimeUS, flops / run.result.kernelTimeUS / 1000, dense.kernelTimeUS / run.result.kernelTimeUS,
+               run.cpuTimeUS, flops / run.cpuTimeUS / 1000, cpuDenseUS / run.cpuTimeUS, run.cpuMaxRelError);
     }
-    printf("The result is GPU: %f, CPU: %f\n", result, acc);
-#endif // PRINT_DATA
 }
 
 // Wait for pending GPU work to complete.
@@ -1006,3 +3960,35 @@ void D3D12Sample::WaitForGpu()
     // Increment the fence value for the current frame.
     m_computeFenceValue++;
 }
+
+// Checks the int4 GEMV against the CPU kernel and reports the CPU weight
+// bandwidth and the error of the int4 weights relative to fp32.
+void D3D12Sample::ReportInt4(const float* pGpuResult)
+{
+    std::vector<float> cpuResult(m_M * m_N);
+    auto start = std::chrono::steady_clock::now();
+    CpuMatmulInt4(buf1Data.data(), m_int4B.data(), m_int4Scales.data(), cpuResult.data(), m_M, m_N, m_K, m_int4GroupSize);
+    auto end = std::chrono::steady_clock::now();
+    double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+    std::vector<double> reference(m_M * m_N);
+    CpuMatmulReference(buf1Data.data(), buf2Data.data(), reference.data(), m_M, m_N, m_K);
+
+    double maxGpuDiff = 0.0;
+    double maxQuantError = 0.0;
+    double errorSquares = 0.0;
+    double referenceSquares = 0.0;
+    for (UINT i = 0; i < m_M * m_N; i++)
+    {
+        maxGpuDiff = (std::max)(maxGpuDiff, double(std::abs(pGpuResult[i] - cpuResult[i])));
+        double error = double(cpuResult[i]) - reference[i];
+        maxQuantError = (std::max)(maxQuantError, std::abs(error));
+        errorSquares += error * error;
+        referenceSquares += reference[i] * reference[i];
+    }
+    const double weightBytes = double(m_int4B.size()) * sizeof(uint32_t) + double(m_int4Scales.size()) * sizeof(float);
+    printf("Int4 CPU time = %f us, CPU weight bandwidth = %f GB/s\n", cpuTimeUS, weightBytes / cpuTimeUS / 1000);
+    printf("Int4 max |GPU - CPU| = %f\n", maxGpuDiff);
+    printf("Quantization error vs fp32 weights: max abs = %f, relative RMS = %e\n",
+           maxQuantError, std::sqrt(errorSquares / referenceSquares));
+}
@@ -11,6 +11,9 @@
 
 #pragma once
 #include <stdexcept>
+#include "CpuMatmul.h"
+#include "KernelGenerator.h"
+#include "ShaderCache.h"
 using namespace DirectX;
 
 // Note that while ComPtr is used to manage the lifetime of resources on the CPU,
@@ -51,6 +54,50 @@ public:
 }
     void Start(int argc, char *argv[]);
 
+    // Speed and accuracy of the last run. The errors compare the GPU result with
+    // an fp64 CPU reference and are only filled in when PRINT_DATA is defined.
+    struct RunResult
+    {
+        double gflops;
+        double maxRelError;     // max |C - ref| / max |ref|
+        double rmsRelError;     // ||C - ref|| / ||ref||
+        double kernelTimeUS;    // Average GPU time of one dispatch.
+        AccumulationMode accumulateMode;    // As run, after any fp64 fallback.
+    };
+    inline const RunResult& GetRunResult() const { return m_runResult; }
+
+    // The kernels --kernel selects.
+    enum KERNELTYPE : short
+    {
+        SLM_8X8_4X16,
+        SLM_4x4_16x16_v4,
+        SLM_4x4_shared_A,
+        SLM_4x4_16x16_float,
+        SLM_4x4_16x16_float_coalesced,
+        SLM_4x4_16x16_4_FLOATS,
+        MatMul_4x4_16x4_float,
+        MatMul_vector_float,
+        SLM_MatMul_vector_float,
+        SLM_MatMul_vector_matrix_float,
+        SLM_MatMul_vector_matrix_one,
+        SLM_INT8_4x4_16x16,
+        SLM_MatMul_vector_matrix_int4,
+        SLM_DGEMM_4x4,
+        SLM_DGEMM_8x8,
+        SLM_4x4_16x16_trans,
+        SLM_8X8_4X16_packed,
+        SLM_MatMul_vector_matrix_chunked,
+        SLM_MatMul_vector_chunked,
+        SLM_MatMul_small_m,
+        Generated,
+        SLM_Stream_K,
+        SLM_Attention,
+        SLM_SpMM,
+        SLM_Grouped_GEMM,
+        SLM_SYRK,
+        SLM_TRMM,
+    };
+
 private:
     struct SceneConstantBuffer
     {
@@ -58,6 +105,10 @@ private:
         int K;
         int N;
         int TILE_K;
+        int LDA;
+        int LDB;
+        int LDC;
+        int LD_PAD;     // Keeps the constants a whole number of 16-byte registers.
     };
 
     // Pipeline objects.
@@ -68,6 +119,8 @@ private:
     ComPtr<ID3D12DescriptorHeap> m_cbSrvHeap;
     ComPtr<ID3D12QueryHeap> m_queryHeap;
     ComPtr<ID3D12PipelineState> m_computePSO;
+    ComPtr<ID3D12PipelineState> m_edgePSO;
+    ComPtr<ID3D12PipelineState> m_fixupPSO;
     ComPtr<ID3D12GraphicsCommandList> m_commandList;
     UINT m_cbSrvDescriptorSize;
 
@@ -76,8 +129,12 @@ private:
     ComPtr<ID3D12Resource> m_constantBuffer;
     ComPtr<ID3D12Resource> m_intermediatebuffer1;
     ComPtr<ID3D12Resource> m_intermediatebuffer2;
+    ComPtr<ID3D12Resource> m_intermediatebuffer3;
+    ComPtr<ID3D12Resource> m_intermediatebuffer4;
     ComPtr<ID3D12Resource> m_buffer1;
     ComPtr<ID3D12Resource> m_buffer2;
+    ComPtr<ID3D12Resource> m_buffer3;
+    ComPtr<ID3D12Resource> m_buffer4;
     ComPtr<ID3D12Resource> m_bufferResult;
     ComPtr<ID3D12Resource> mTexture1;
     ComPtr<ID3D12Resource> mTexture2;
@@ -102,20 +159,6 @@ private:
     };
     STORAGETYPE mStorageType;
 
-    enum KERNELTYPE : short
-    {
-        SLM_8X8_4X16,
-        SLM_4x4_16x16_v4,
-        SLM_4x4_shared_A,
-        SLM_4x4_16x16_float,
-        SLM_4x4_16x16_float_coalesced,
-        SLM_4x4_16x16_4_FLOATS,
-        MatMul_4x4_16x4_float,
-        MatMul_vector_float,
-        SLM_MatMul_vector_float,
-        SLM_MatMul_vector_matrix_float,
-        SLM_MatMul_vector_matrix_one,
-    };
     KERNELTYPE mKernelType;
 
 	UINT m_M;
@@ -126,19 +169,156 @@ private:
     UINT mWorkPerThreadY;
     UINT mDispatchX;
     UINT mDispatchY;
+    // With m_splitEdges, mDispatchX x mDispatchY covers only the full tiles with
+    // an unchecked m_computePSO, and m_edgePSO runs mEdgeDispatchCount groups
+    // over the partial tiles.
+    bool m_splitEdges;
+    UINT mEdgeDispatchCount;
+    // Ping-pongs two groupshared tiles in the kernels that take DOUBLE_BUFFER.
+    bool m_doubleBuffer;
+    // SLM_Stream_K runs m_streamKGroups persistent groups, then m_fixupPSO over
+    // mFixupDispatchCount tiles to add up the tiles that were split between them.
+    UINT m_streamKGroups;
+    UINT mFixupDispatchCount;
+    // Order of the tiles of C (RASTER). Other than row-major, the dispatch is 1D.
+    TileRaster m_raster;
+    UINT m_rasterGroupM;
+    // Rows of A per group (GEMV_ROWS) of SLM_Matmul_vector_matrix_chunked.hlsl.
+    UINT m_gemvRows;
     UINT mLocalGroupSizeX;
     UINT mLocalGroupSizeY;
 	UINT m_componentSize;
+    UINT m_elementSize;     // Bytes per scalar of A, B and C: 4, or 8 for the DGEMM kernels.
 	UINT m_computeCount = 500;
+    AccumulationMode m_accumulateMode;
+
+    // Row strides in elements of the stored A, B and C. Zero until Start()
+    // resolves them, either from --lda/--ldb/--ldc or from the padding policy.
+    UINT m_lda;
+    UINT m_ldb;
+    UINT m_ldc;
+    bool m_autoPad;
+    RunResult m_runResult;
 	std::vector<float> buf1Data;
 	std::vector<float> buf2Data;
 
+    // Stored layouts of A (K x M) and B (N x K) for SLM_4x4_16x16_trans when
+    // m_transA/m_transB are set. buf1Data/buf2Data keep the logical row-major A and B.
+    bool m_transA;
+    bool m_transB;
+    std::vector<float> m_transposedA;
+    std::vector<float> m_transposedB;
+
+    // B rearranged by PackPanels into the column panels SLM_8X8_4X16_packed reads.
+    std::vector<float> m_packedB;
+
+    // fp64 operands for the DGEMM kernels.
+    std::vector<double> m_doubleA;
+    std::vector<double> m_doubleB;
+
+    // Quantized operands for the int8 kernels. B is stored transposed (N x K)
+    // so that four consecutive K values pack into one 32-bit word.
+    std::vector<int8_t> m_int8A;
+    std::vector<int8_t> m_int8Bt;
+    std::vector<QuantParams> m_quantParamsA;
+    std::vector<QuantParams> m_quantParamsB;
+
+    // Group-wise int4 weights (K x N/8 packed words) and their scales.
+    UINT m_int4GroupSize;
+    std::vector<uint32_t> m_int4B;
+    std::vector<float> m_int4Scales;
+
+    // Register tile of the Generated kernel (--shape), and the shapes "--kernel all"
+    // adds to its table (--shapes).
+    std::string m_shapeText;
+    KernelShape m_generatedShape;
+    std::vector<std::string> m_reportShapes;
+
+    // With m_conv, SLM_8X8_4X16 runs the convolution m_convShape as an implicit
+    // GEMM: src0 is m_convInput, B (buf2Data) the weights padded to m_K rows, and
+    // buf1Data the explicit im2col matrix, built only for the CPU checks.
+    bool m_conv;
+    ConvShape m_convShape;
+    std::vector<float> m_convInput;
+
+    // SLM_Attention reads Q (M x N) from buf1Data, the keys (K x N) from buf2Data
+    // and the values (K x N) from m_attentionV. N is the head dimension.
+    std::vector<float> m_attentionV;
+
+    // SLM_SpMM multiplies the sparse M x K matrix m_sparseA with B (buf2Data).
+    // A is read from m_sparseMatrixPath, or generated with m_sparsity of its
+    // m_sparseBlock x m_sparseBlock blocks pruned, and goes to the GPU as CSR
+    // or, with m_blockedEll, as m_sparseEll with blocks of m_sparseBlock.
+    double m_sparsity;
+    UINT m_sparseBlock;
+    bool m_blockedEll;
+    std::string m_sparseMatrixPath;
+    CsrMatrix m_sparseA;
+    BlockedEllMatrix m_sparseEll;
+
+    // With --block-sparse, SLM_8X8_4X16 multiplies buf1Data and buf2Data with
+    // m_sparsity of the m_sparseBlock x m_sparseBlock blocks of A and/or B
+    // pruned. m_tileMask marks the K steps of each tile with work and the
+    // dispatch covers m_occupiedTiles only.
+    bool m_blockSparseA;
+    bool m_blockSparseB;
+    TileMask m_tileMask;
+    std::vector<uint32_t> m_occupiedTiles;
+
+    // SLM_SYRK writes the lower triangle of C, and SLM_TRMM reads the lower
+    // triangle of A, or with m_upper the upper ones.
+    bool m_upper;
+
+    // SLM_Grouped_GEMM runs m_groupedProblems, one per expert, in a single
+    // dispatch over m_groupedTiles. A (buf1Data) stacks the rows of all of them
+    // and B (buf2Data) one K x N matrix each. Their M_i are m_expertRows, given
+    // with --expert-m or drawn for m_experts experts.
+    UINT m_experts;
+    std::vector<int> m_expertRows;
+    std::vector<GroupedGemmProblem> m_groupedProblems;
+    std::vector<uint32_t> m_groupedTiles;
+
+    // Directory of the compiled shader cache; empty when --shader-cache none.
+    std::string m_shaderCacheDir;
+
 	void GetHardwareAdapter(IDXGIFactory2* pFactory, IDXGIAdapter1** ppAdapter);
     void CreateDevice(const ComPtr<IDXGIFactory4>& factory);
+    void ChooseKernelForShape();
+    bool ResolveLeadingDimensions();
     void LoadPipeline();
     void LoadAssets();
+    ComPtr<ID3D12PipelineState> CreateComputePipeline(const char* sourceFile, const char* entryPoint, const ShaderDefines& defines);
     void LoadBufferResources();
     void LoadTextureResources();
+    void LoadInt8Resources();
+    void LoadInt4Resources();
+    void LoadDoubleResources();
+    void LoadTransposedResources();
+    void LoadPackedResources();
+    void LoadConvResources();
+    void LoadAttentionResources();
+    void LoadSparseResources();
+    void LoadBlockSparseResources();
+    void LoadGroupedResources();
+    void LoadTriangularResources();
+    void CreateBufferWithData(const void* pData, UINT bufferSize, ComPtr<ID3D12Resource>& intermediate, ComPtr<ID3D12Resource>& buffer);
+    void CreateBufferSRV(ID3D12Resource* pBuffer, UINT bufferSize, UINT structureByteStride, UINT descriptorIndex);
+    void CreateResultBuffer();
+    void CreateQueryResources();
+    void ReportInt8(const float* pGpuResult);
+    void ReportInt4(const float* pGpuResult);
+    void ReportAccuracy(const float* pGpuResult);
+    void ReportDouble(const double* pGpuResult);
+    void ReportAttention(const float* pGpuResult);
+    void ReportSparse(const float* pGpuResult);
+    void ReportGrouped(const float* pGpuResult);
+    void ReportTriangular(const float* pGpuResult);
+    void RunAccuracyReport(int argc, char *argv[]);
+    void RunConvBenchmark(int argc, char *argv[]);
+    void RunAttentionBenchmark(int argc, char *argv[]);
+    void RunPadBenchmark(int argc, char *argv[]);
+    void RunSparseBenchmark(int argc, char *argv[]);
+    void RunBlockSparseBenchmark(int argc, char *argv[]);
     void WaitForGpu();
     void RunCompute();
 };
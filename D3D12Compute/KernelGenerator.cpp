@@ -0,0 +1,605 @@
+// KernelGenerator.cpp : Emits register-tiled GEMM kernels for any tile shape.
+//
+// Both outputs start from a fixed template with $NAME$ placeholders. The parts
+// that depend on the register block (accumulators, loads, FMAs and stores) are
+// unrolled here and substituted in.
+
+#include "pch.h"
+#include "KernelGenerator.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    const char kHlslTemplate[] = R"HLSL(// Generated by KernelGenerator for shape $SHAPE$. Regenerate it with
+// "D3D12Compute --generate $SHAPE$" instead of editing it.
+//
+// C[M,N] = A[M,K] * B[K,N]. Each thread computes $ROWS$ rows and $COLS$ columns of C as
+// $VEC_GROUPS$ $VEC_TYPE$ column groups, LOCAL_GROUP_SIZE_X * $VEC$ columns apart so that
+// neighbouring threads touch neighbouring vectors. K is walked $TILE_K$ values at a
+// time; $STAGING$.
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;
+    int K;
+    int N;
+    int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
+}
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+};
+
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<float> src0 : register(t0);
+StructuredBuffer<float> src1 : register(t1);
+RWStructuredBuffer<float> dst : register(u0);
+
+float mm_readA(int row, int col) {
+    if (row < M && col < K)
+    {
+        return src0[row * LDA + col];
+    }
+    else {
+        return 0.0;
+    }
+}
+
+$VEC_TYPE$ mm_readB(int row, int col) {
+    if (row < K && col < N)
+    {
+        int index = row * LDB + col;
+        return $STRUCTURED_LOAD$;
+    }
+    else {
+        return ($VEC_TYPE$)0;
+    }
+}
+
+void mm_write(int row, int col, $VEC_TYPE$ value) {
+    if (row < M && col < N)
+    {
+        int index = row * LDC + col;
+$STRUCTURED_STORE$    }
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+ByteAddressBuffer src1 : register(t1);
+RWByteAddressBuffer dst : register(u0);
+
+float mm_readA(int row, int col) {
+    if (row < M && col < K)
+    {
+        return asfloat(src0.Load(4 * (row * LDA + col)));
+    }
+    else {
+        return 0.0;
+    }
+}
+
+$VEC_TYPE$ mm_readB(int row, int col) {
+    if (row < K && col < N)
+    {
+        return asfloat(src1.$LOAD$(4 * (row * LDB + col)));
+    }
+    else {
+        return ($VEC_TYPE$)0;
+    }
+}
+
+void mm_write(int row, int col, $VEC_TYPE$ value) {
+    if (row < M && col < N)
+    {
+        dst.$STORE$(4 * (row * LDC + col), asuint(value));
+    }
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+static const int RowsPerThread = $ROWS$;
+static const int VecGroups = $VEC_GROUPS$;
+static const int TileK = $TILE_K$;
+static const int TileM = LOCAL_GROUP_SIZE_Y * RowsPerThread;
+static const int TileNVec = LOCAL_GROUP_SIZE_X * VecGroups;     // Tile width in vectors.
+static const int GroupSize = LOCAL_GROUP_SIZE_X * LOCAL_GROUP_SIZE_Y;
+$SHARED$
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    int localX = int(input.dx_LocalInvocationID.x);
+    int localY = int(input.dx_LocalInvocationID.y);
+    int localIndex = localY * LOCAL_GROUP_SIZE_X + localX;
+    int groupRow = int(input.dx_WorkGroupID.y) * TileM;
+    int groupCol = int(input.dx_WorkGroupID.x) * TileNVec * $VEC$;
+    int tileRow = localY * RowsPerThread;
+    int globalRow = groupRow + tileRow;
+    int globalCol = groupCol + localX * $VEC$;
+
+$ACCUMULATORS$
+    int numTiles = (K + TileK - 1) / TileK;
+    for (int t = 0; t < numTiles; t++) {
+        int kBase = t * TileK;
+$TILE_LOAD$
+        for (int k = 0; k < TileK; k++) {
+$INNER$        }
+$TILE_END$    }
+
+$WRITES$}
+)HLSL";
+
+    const char kCpuTemplate[] = R"CPP(// Generated by KernelGenerator for shape $SHAPE$. Regenerate it with
+// "D3D12Compute --generate $SHAPE$" instead of editing it.
+//
+// The CPU counterpart of $NAME$.hlsl with the same blocking. A tile of
+// groupRows * $ROWS$ rows and groupCols * $COLS$ columns of C (groupRows and groupCols
+// play LOCAL_GROUP_SIZE_Y and LOCAL_GROUP_SIZE_X) is built up $TILE_K$ values of K at a
+// time; $STAGING$. Each $ROWS$ x $COLS$ block of the tile keeps its sums in
+// $VEC$-wide vectors while it walks one step of K. Unlike the shader, a block's
+// columns are contiguous, so its vectors map onto SIMD lanes.
+
+#pragma once
+#include "CpuMatmul.h"
+#include <algorithm>
+#include <vector>
+
+inline void CpuMatmul_$NAME$(const float* A, int lda, const float* B, int ldb, float* C, int ldc,
+    int M, int N, int K, int groupRows, int groupCols)
+{
+    const int tileM = groupRows * $ROWS$;
+    const int tileN = groupCols * $COLS$;
+    const int tileK = $TILE_K$;
+    const int tilesN = (N + tileN - 1) / tileN;
+    const int tileCount = (M + tileM - 1) / tileM * tilesN;
+    ParallelFor(0, tileCount, [&](int begin, int end)
+    {
+$BUFFERS$        for (int tile = begin; tile < end; tile++)
+        {
+            const int groupRow = tile / tilesN * tileM;
+            const int groupCol = tile % tilesN * tileN;
+            const int rows = (std::min)(tileM, M - groupRow);
+            const int cols = (std::min)(tileN, N - groupCol);
+            for (int r = 0; r < rows; r++)
+            {
+                float* c = C + size_t(groupRow + r) * ldc + groupCol;
+                std::fill(c, c + cols, 0.0f);
+            }
+            for (int kBase = 0; kBase < K; kBase += tileK)
+            {
+                const int kCount = (std::min)(tileK, K - kBase);
+$PACK$                for (int blockRow = 0; blockRow < rows; blockRow += $ROWS$)
+                {
+                    for (int blockCol = 0; blockCol < cols; blockCol += $COLS$)
+                    {
+                        if (blockRow + $ROWS$ > rows || blockCol + $COLS$ > cols)
+                        {
+                            // A partial block on the edge of C.
+                            for (int r = blockRow; r < (std::min)(blockRow + $ROWS$, rows); r++)
+                            {
+                                for (int c = blockCol; c < (std::min)(blockCol + $COLS$, cols); c++)
+                                {
+                                    float sum = C[size_t(groupRow + r) * ldc + groupCol + c];
+                                    for (int k = 0; k < kCount; k++)
+                                    {
+                                        sum += $A_AT$ * $B_AT$;
+                                    }
+                                    C[size_t(groupRow + r) * ldc + groupCol + c] = sum;
+                                }
+                            }
+                            continue;
+                        }
+
+$BLOCK$                    }
+                }
+            }
+        }
+    });
+}
+)CPP";
+
+    // Replaces every $KEY$ in text by values[KEY].
+    std::string Substitute(const char* text, const std::map<std::string, std::string>& values)
+    {
+        std::string result;
+        for (const char* p = text; *p; )
+        {
+            const char* close = p[0] == '$' ? std::strchr(p + 1, '$') : nullptr;
+            auto it = close ? values.find(std::string(p + 1, close)) : values.end();
+            if (it != values.end())
+            {
+                result += it->second;
+                p = close + 1;
+            }
+            else
+            {
+                result += *p++;
+            }
+        }
+        return result;
+    }
+
+    std::string VecType(int vecWidth)
+    {
+        return vecWidth == 1 ? "float" : "float" + std::to_string(vecWidth);
+    }
+
+    // "base", "base + 1", ... for offset 0, 1, ...
+    std::string Plus(const std::string& base, int offset)
+    {
+        return offset == 0 ? base : base + " + " + std::to_string(offset);
+    }
+
+    // Column of vector group j of a thread: groups are LOCAL_GROUP_SIZE_X vectors apart.
+    std::string GroupOffset(const std::string& base, int j, int vecWidth)
+    {
+        if (j == 0)
+        {
+            return base;
+        }
+        std::string scale = j * vecWidth == 1 ? "" : " * " + std::to_string(j * vecWidth);
+        return base + " + LOCAL_GROUP_SIZE_X" + scale;
+    }
+
+    std::string Staging(const KernelShape& shape)
+    {
+        if (shape.slmA && shape.slmB)
+        {
+            return "the A and B tiles are staged in groupshared memory";
+        }
+        if (shape.slmA)
+        {
+            return "the A tile is staged in groupshared memory and B is read from memory";
+        }
+        if (shape.slmB)
+        {
+            return "the B tile is staged in groupshared memory and A is read from memory";
+        }
+        return "A and B are read from memory";
+    }
+
+    std::map<std::string, std::string> CommonValues(const KernelShape& shape)
+    {
+        std::map<std::string, std::string> values;
+        values["SHAPE"] = KernelShapeName(shape);
+        values["NAME"] = GeneratedKernelName(shape);
+        values["ROWS"] = std::to_string(shape.rowsPerThread);
+        values["COLS"] = std::to_string(shape.colsPerThread);
+        values["VEC"] = std::to_string(shape.vecWidth);
+        values["VEC_GROUPS"] = std::to_string(shape.colsPerThread / shape.vecWidth);
+        values["TILE_K"] = std::to_string(shape.tileK);
+        values["STAGING"] = Staging(shape);
+        return values;
+    }
+
+    bool MakeDirectory(const std::string& dir)
+    {
+#ifdef _WIN32
+        return _mkdir(dir.c_str()) == 0 || errno == EEXIST;
+#else
+        return mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+    }
+}
+
+bool ParseKernelShape(const std::string& text, KernelShape& shape, std::string& error)
+{
+    int consumed = 0;
+    if (sscanf(text.c_str(), "%dx%dv%dk%d%n", &shape.rowsPerThread, &shape.colsPerThread,
+               &shape.vecWidth, &shape.tileK, &consumed) != 4)
+    {
+        error = "Kernel shapes are written <rows>x<cols>v<vecWidth>k<tileK>[A][B], e.g. 4x8v4k32AB.";
+        return false;
+    }
+    std::string staging = text.substr(consumed);
+    if (staging != "" && staging != "A" && staging != "B" && staging != "AB")
+    {
+        error = "A kernel shape ends with the operands staged in groupshared memory: A, B, AB or nothing.";
+        return false;
+    }
+    shape.slmA = staging.find('A') != std::string::npos;
+    shape.slmB = staging.find('B') != std::string::npos;
+
+    if (shape.vecWidth != 1 && shape.vecWidth != 2 && shape.vecWidth != 4)
+    {
+        error = "The vector width of a kernel shape should be 1, 2 or 4.";
+        return false;
+    }
+    if (shape.rowsPerThread < 1 || shape.rowsPerThread > 16 || shape.colsPerThread < 1 || shape.colsPerThread > 16 ||
+        shape.colsPerThread % shape.vecWidth != 0)
+    {
+        error = "Rows and columns per thread should be 1..16, and the columns a multiple of the vector width.";
+        return false;
+    }
+    if (shape.rowsPerThread * shape.colsPerThread > 128)
+    {
+        error = "A thread can hold at most 128 accumulators.";
+        return false;
+    }
+    if (shape.tileK < 1 || shape.tileK > 256)
+    {
+        error = "The K tile of a kernel shape should be 1..256.";
+        return false;
+    }
+    return true;
+}
+
+std::string KernelShapeName(const KernelShape& shape)
+{
+    std::ostringstream name;
+    name << shape.rowsPerThread << "x" << shape.colsPerThread << "v" << shape.vecWidth << "k" << shape.tileK
+         << (shape.slmA ? "A" : "") << (shape.slmB ? "B" : "");
+    return name.str();
+}
+
+std::string GeneratedKernelName(const KernelShape& shape)
+{
+    return "GEN_" + KernelShapeName(shape);
+}
+
+int KernelSharedMemoryBytes(const KernelShape& shape, int localX, int localY)
+{
+    int floats = 0;
+    if (shape.slmA)
+    {
+        floats += localY * shape.rowsPerThread * shape.tileK;
+    }
+    if (shape.slmB)
+    {
+        floats += shape.tileK * localX * shape.colsPerThread;
+    }
+    return floats * int(sizeof(float));
+}
+
+std::string GenerateHlslKernel(const KernelShape& shape)
+{
+    static const char components[] = "xyzw";
+    const int vec = shape.vecWidth;
+    const int groups = shape.colsPerThread / vec;
+    const std::string vecType = VecType(vec);
+    auto values = CommonValues(shape);
+    values["VEC_TYPE"] = vecType;
+    values["LOAD"] = vec == 1 ? "Load" : "Load" + std::to_string(vec);
+    values["STORE"] = vec == 1 ? "Store" : "Store" + std::to_string(vec);
+
+    std::string load = vecType + "(";
+    std::string store;
+    for (int e = 0; e < vec; e++)
+    {
+        load += (e ? ", " : "") + std::string("src1[") + Plus("index", e) + "]";
+        store += "        dst[" + Plus("index", e) + "] = value" + (vec == 1 ? "" : std::string(".") + components[e]) + ";\n";
+    }
+    values["STRUCTURED_LOAD"] = vec == 1 ? "src1[index]" : load + ")";
+    values["STRUCTURED_STORE"] = store;
+
+    std::string shared;
+    if (shape.slmA)
+    {
+        shared += "\ngroupshared float mm_Asub[TileM][TileK];\n";
+    }
+    if (shape.slmB)
+    {
+        shared += (shape.slmA ? "" : "\n") + std::string("groupshared ") + vecType + " mm_Bsub[TileK][TileNVec];\n";
+    }
+    values["SHARED"] = shared;
+
+    std::string accumulators;
+    for (int r = 0; r < shape.rowsPerThread; r++)
+    {
+        for (int j = 0; j < groups; j++)
+        {
+            accumulators += "    " + vecType + " acc" + std::to_string(r) + "_" + std::to_string(j) + " = (" + vecType + ")0;\n";
+        }
+    }
+    values["ACCUMULATORS"] = accumulators;
+
+    std::string tileLoad;
+    if (shape.slmA)
+    {
+        tileLoad +=
+            "        for (int i = localIndex; i < TileM * TileK; i += GroupSize) {\n"
+            "            mm_Asub[i / TileK][i % TileK] = mm_readA(groupRow + i / TileK, kBase + i % TileK);\n"
+            "        }\n";
+    }
+    if (shape.slmB)
+    {
+        tileLoad +=
+            "        for (int i = localIndex; i < TileK * TileNVec; i += GroupSize) {\n"
+            "            mm_Bsub[i / TileNVec][i % TileNVec] = mm_readB(kBase + i / TileNVec, groupCol + (i % TileNVec) * " +
+            std::to_string(vec) + ");\n"
+            "        }\n";
+    }
+    if (shape.slmA || shape.slmB)
+    {
+        tileLoad += "        GroupMemoryBarrierWithGroupSync();\n";
+        values["TILE_END"] =
+            "        // The next tile overwrites groupshared memory.\n"
+            "        GroupMemoryBarrierWithGroupSync();\n";
+    }
+    else
+    {
+        values["TILE_END"] = "";
+    }
+    values["TILE_LOAD"] = tileLoad;
+
+    std::string inner;
+    for (int j = 0; j < groups; j++)
+    {
+        std::string b = shape.slmB ? "mm_Bsub[k][" + GroupOffset("localX", j, 1) + "]"
+                                   : "mm_readB(kBase + k, " + GroupOffset("globalCol", j, vec) + ")";
+        inner += "            " + vecType + " b" + std::to_string(j) + " = " + b + ";\n";
+    }
+    for (int r = 0; r < shape.rowsPerThread; r++)
+    {
+        std::string row = std::to_string(r);
+        std::string a = shape.slmA ? "mm_Asub[" + Plus("tileRow", r) + "][k]" : "mm_readA(" + Plus("globalRow", r) + ", kBase + k)";
+        inner += "            float a" + row + " = " + a + ";\n";
+        for (int j = 0; j < groups; j++)
+        {
+            std::string col = std::to_string(j);
+            inner += "            acc" + row + "_" + col + " += a" + row + " * b" + col + ";\n";
+        }
+    }
+    values["INNER"] = inner;
+
+    std::string writes;
+    for (int r = 0; r < shape.rowsPerThread; r++)
+    {
+        for (int j = 0; j < groups; j++)
+        {
+            writes += "    mm_write(" + Plus("globalRow", r) + ", " + GroupOffset("globalCol", j, vec) + ", acc" +
+                      std::to_string(r) + "_" + std::to_string(j) + ");\n";
+        }
+    }
+    values["WRITES"] = writes;
+
+    return Substitute(kHlslTemplate, values);
+}
+
+std::string GenerateCpuKernel(const KernelShape& shape)
+{
+    const int vec = shape.vecWidth;
+    const int groups = shape.colsPerThread / vec;
+    auto values = CommonValues(shape);
+    values["A_AT"] = shape.slmA ? "Asub[r * tileK + k]" : "A[size_t(groupRow + r) * lda + kBase + k]";
+    values["B_AT"] = shape.slmB ? "Bsub[k * tileN + c]" : "B[size_t(kBase + k) * ldb + groupCol + c]";
+
+    std::string buffers;
+    std::string pack;
+    if (shape.slmA)
+    {
+        buffers += "        std::vector<float> Asub(tileM * tileK);\n";
+        pack +=
+            "                for (int r = 0; r < rows; r++)\n"
+            "                {\n"
+            "                    const float* a = A + size_t(groupRow + r) * lda + kBase;\n"
+            "                    std::copy(a, a + kCount, Asub.begin() + r * tileK);\n"
+            "                }\n";
+    }
+    if (shape.slmB)
+    {
+        buffers += "        std::vector<float> Bsub(tileK * tileN);\n";
+        pack +=
+            "                for (int k = 0; k < kCount; k++)\n"
+            "                {\n"
+            "                    const float* b = B + size_t(kBase + k) * ldb + groupCol;\n"
+            "                    std::copy(b, b + cols, Bsub.begin() + k * tileN);\n"
+            "                }\n";
+    }
+    values["BUFFERS"] = buffers;
+    values["PACK"] = pack;
+
+    const std::string indent = "                        ";
+    const std::string vecText = std::to_string(vec);
+    std::string block;
+    for (int r = 0; r < shape.rowsPerThread; r++)
+    {
+        std::string row = std::to_string(r);
+        std::string a = shape.slmA ? "&Asub[" + (r ? "(" + Plus("blockRow", r) + ")" : std::string("blockRow")) + " * tileK]"
+                                   : "A + size_t(groupRow + " + Plus("blockRow", r) + ") * lda + kBase";
+        block += indent + "const float* a" + row + " = " + a + ";\n";
+        block += indent + "float* c" + row + " = C + size_t(groupRow + " + Plus("blockRow", r) + ") * ldc + groupCol + blockCol;\n";
+    }
+    for (int r = 0; r < shape.rowsPerThread; r++)
+    {
+        block += indent + "float ";
+        for (int j = 0; j < groups; j++)
+        {
+            block += (j ? ", acc" : "acc") + std::to_string(r) + "_" + std::to_string(j) + "[" + vecText + "]";
+        }
+        block += ";\n";
+    }
+    block += indent + "for (int e = 0; e < " + vecText + "; e++)\n" + indent + "{\n";
+    for (int r = 0; r < shape.rowsPerThread; r++)
+    {
+        for (int j = 0; j < groups; j++)
+        {
+            block += indent + "    acc" + std::to_string(r) + "_" + std::to_string(j) + "[e] = c" + std::to_string(r) +
+                     "[" + Plus("e", j * vec) + "];\n";
+        }
+    }
+    block += indent + "}\n";
+    block += indent + "for (int k = 0; k < kCount; k++)\n" + indent + "{\n";
+    block += indent + "    const float* b = " +
+             (shape.slmB ? std::string("&Bsub[k * tileN + blockCol]") : std::string("B + size_t(kBase + k) * ldb + groupCol + blockCol")) + ";\n";
+    block += indent + "    for (int e = 0; e < " + vecText + "; e++)\n" + indent + "    {\n";
+    for (int r = 0; r < shape.rowsPerThread; r++)
+    {
+        for (int j = 0; j < groups; j++)
+        {
+            block += indent + "        acc" + std::to_string(r) + "_" + std::to_string(j) + "[e] += a" + std::to_string(r) +
+                     "[k] * b[" + Plus("e", j * vec) + "];\n";
+        }
+    }
+    block += indent + "    }\n" + indent + "}\n";
+    block += indent + "for (int e = 0; e < " + vecText + "; e++)\n" + indent + "{\n";
+    for (int r = 0; r < shape.rowsPerThread; r++)
+    {
+        for (int j = 0; j < groups; j++)
+        {
+            block += indent + "    c" + std::to_string(r) + "[" + Plus("e", j * vec) + "] = acc" + std::to_string(r) + "_" +
+                     std::to_string(j) + "[e];\n";
+        }
+    }
+    block += indent + "}\n";
+    values["BLOCK"] = block;
+
+    return Substitute(kCpuTemplate, values);
+}
+
+bool WriteGeneratedKernel(const KernelShape& shape, const std::string& dir)
+{
+    if (!MakeDirectory(dir))
+    {
+        return false;
+    }
+    std::string stem = dir + "/" + GeneratedKernelName(shape);
+    std::ofstream hlsl(stem + ".hlsl", std::ios::binary);
+    hlsl << GenerateHlslKernel(shape);
+    std::ofstream cpu(stem + ".h", std::ios::binary);
+    cpu << GenerateCpuKernel(shape);
+    return bool(hlsl) && bool(cpu);
+}
+
+#ifdef KERNEL_GENERATOR_MAIN
+// Standalone build for hosts without D3D12:
+//     g++ -std=c++14 -DKERNEL_GENERATOR_MAIN KernelGenerator.cpp -o kernel_generator
+//     ./kernel_generator generated 4x8v4k32AB 8x8v4k16B
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <output dir> <shape>...\n", argv[0]);
+        return 1;
+    }
+    for (int i = 2; i < argc; i++)
+    {
+        KernelShape shape;
+        std::string error;
+        if (!ParseKernelShape(argv[i], shape, error))
+        {
+            fprintf(stderr, "%s: %s\n", argv[i], error.c_str());
+            return 1;
+        }
+        if (!WriteGeneratedKernel(shape, argv[1]))
+        {
+            fprintf(stderr, "Can't write %s to %s.\n", GeneratedKernelName(shape).c_str(), argv[1]);
+            return 1;
+        }
+        printf("%s/%s.hlsl, .h\n", argv[1], GeneratedKernelName(shape).c_str());
+    }
+    return 0;
+}
+#endif
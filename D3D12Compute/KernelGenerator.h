@@ -0,0 +1,47 @@
+// KernelGenerator.h : Emits register-tiled GEMM kernels for any tile shape, as an
+// HLSL compute shader and as a C++ CPU counterpart with the same blocking, both
+// from one KernelShape. Nothing here depends on D3D12, so kernels can be
+// generated on any platform.
+
+#pragma once
+#include <string>
+
+// C[M,N] = A[M,K] * B[K,N] where each thread owns a rowsPerThread x
+// colsPerThread block of C, held in registers as vectors of vecWidth columns.
+// A group of LOCAL_GROUP_SIZE_X x LOCAL_GROUP_SIZE_Y threads walks K tileK
+// values at a time, optionally staging its A and B tiles in groupshared memory.
+struct KernelShape
+{
+    int rowsPerThread;
+    int colsPerThread;  // A multiple of vecWidth.
+    int vecWidth;       // Columns per load and store of B and C: 1, 2 or 4.
+    int tileK;
+    bool slmA;
+    bool slmB;
+};
+
+// Parses "<rows>x<cols>v<vecWidth>k<tileK>" followed by A and/or B for the
+// operands staged in groupshared memory, e.g. "4x8v4k32AB" or "8x4v4k16B".
+// Returns false with a message in error if the text or the shape is invalid.
+bool ParseKernelShape(const std::string& text, KernelShape& shape, std::string& error);
+
+// The text form ParseKernelShape reads.
+std::string KernelShapeName(const KernelShape& shape);
+
+// Stem of the generated files and suffix of the CPU function, e.g. "GEN_4x8v4k32AB".
+std::string GeneratedKernelName(const KernelShape& shape);
+
+// Bytes of groupshared memory the HLSL kernel declares for a localX x localY group.
+int KernelSharedMemoryBytes(const KernelShape& shape, int localX, int localY);
+
+// Source of the compute shader, entry point "main". It takes the defines and
+// bindings of the hand-written kernels (byteAddress or structured buffers).
+std::string GenerateHlslKernel(const KernelShape& shape);
+
+// Source of a header defining CpuMatmul_<GeneratedKernelName>(), which blocks
+// the CPU loops exactly as the shader blocks its groups and threads.
+std::string GenerateCpuKernel(const KernelShape& shape);
+
+// Writes <dir>/<GeneratedKernelName>.hlsl and .h, creating dir if needed.
+// Returns false if a file can't be written.
+bool WriteGeneratedKernel(const KernelShape& shape, const std::string& dir);
@@ -4,6 +4,10 @@ cbuffer SceneConstantBuffer : register( b0 )
     int K;
     int N;
     int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
 }
 
 static uint3 gl_WorkGroupID = uint3(0, 0, 0);
@@ -58,7 +62,7 @@ RWStructuredBuffer<float> dst : register(u0);
 float4 mm_readA(int row, int col) {
     if (row < M)
     {
-        int index = row * K + col;
+        int index = row * LDA + col;
         float4 result = float4(src0[index],
             src0[index + 1],
             src0[index + 2],
@@ -71,7 +75,7 @@ float4 mm_readA(int row, int col) {
 }
 
 float4 mm_readB(int row, int col) {
-    int index = row * N + col;
+    int index = row * LDB + col;
     float4 result = float4(src1[index],
         src1[index + 1],
         src1[index + 2],
@@ -82,7 +86,7 @@ float4 mm_readB(int row, int col) {
 void mm_write(int row, int col, float4 value) {
     if (row < M && col < N)
     {
-        int index = row * N + col;
+        int index = row * LDC + col;
         if (col < (N - 3)) {
             dst[index] = value.x;
             dst[index + 1] = value.y;
@@ -114,7 +118,7 @@ RWByteAddressBuffer dst : register(u0);
 float4 mm_readA(int row, int col) {
     if (row < M)
     {
-        int index = row * K + col;
+        int index = row * LDA + col;
         float4 result = float4(asfloat(src0.Load(4 * index)),
             asfloat(src0.Load(4 * (index + 1))),
             asfloat(src0.Load(4 * (index + 2))),
@@ -129,7 +133,7 @@ float4 mm_readA(int row, int col) {
 float3 mm_readA(int row, int col, float3 value) {
     if (row < M)
     {
-        int index = row * K + col;
+        int index = row * LDA + col;
         float3 value = float3(asfloat(src0.Load(4 * index)),
             asfloat(src0.Load(4 * (index + 1))),
             asfloat(src0.Load(4 * (index + 2))));
@@ -141,7 +145,7 @@ float3 mm_readA(int row, int col, float3 value) {
 float2 mm_readA(int row, int col, float2 value) {
     if (row < M)
     {
-        int index = row * K + col;
+        int index = row * LDA + col;
         float2 value = float2(asfloat(src0.Load(4 * index)),
             asfloat(src0.Load(4 * (index + 1))));
         return value;
@@ -152,14 +156,14 @@ float2 mm_readA(int row, int col, float2 value) {
 float mm_readA(int row, int col, float value) {
     if (row < M)
     {
-        int index = row * K + col;
+        int index = row * LDA + col;
         return asfloat(src0.Load(4 * index));
     }
     else { return 0; }
 }
 
 float4 mm_readB(int row, int col) {
-    int index = row * N + col;
+    int index = row * LDB + col;
     float4 result = float4(asfloat(src1.Load(4 * index)),
         asfloat(src1.Load(4 * (index + 1))),
         asfloat(src1.Load(4 * (index + 2))),
@@ -170,7 +174,7 @@ float4 mm_readB(int row, int col) {
 void mm_write(int row, int col, float4 value) {
     if (row < M && col < N)
     {
-        int index = row * N + col;
+        int index = row * LDC + col;
         if (col < (N - 3)) {
             dst.Store(4 * (index), asuint(value.x));
             dst.Store(4 * (index + 1), asuint(value.y));
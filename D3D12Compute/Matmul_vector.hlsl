@@ -4,6 +4,10 @@ cbuffer SceneConstantBuffer : register( b0 )
     int K;
     int N;
     int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
 }
 
 static uint3 gl_WorkGroupID = uint3(0, 0, 0);
@@ -58,7 +62,7 @@ RWStructuredBuffer<float> dst : register(u0);
 float4 mm_readA(int row, int col) {
     if (row < M)
     {
-        int index = row * K + col;
+        int index = row * LDA + col;
         float4 result = float4(src0[index],
             src0[index + 1],
             src0[index + 2],
@@ -92,7 +96,7 @@ RWByteAddressBuffer dst : register(u0);
 float4 mm_readA(int row, int col) {
     if (row < M)
     {
-        int index = row * K + col;
+        int index = row * LDA + col;
         float4 result = float4(asfloat(src0.Load(4 * index)),
             asfloat(src0.Load(4 * (index + 1))),
             asfloat(src0.Load(4 * (index + 2))),
@@ -4,21 +4,25 @@ cbuffer SceneConstantBuffer : register( b0 )
     int K;
     int N;
     int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
 }
 
+static uint3 gl_WorkGroupID = uint3(0, 0, 0);
 static uint3 gl_LocalInvocationID = uint3(0, 0, 0);
-static uint3 gl_GlobalInvocationID = uint3(0, 0, 0);
 
 struct CS_INPUT
 {
+    uint3 dx_WorkGroupID : SV_GroupID;
     uint3 dx_LocalInvocationID : SV_GroupThreadID;
-    uint3 dx_GlobalInvocationID : SV_DispatchThreadID;
 };
 
 void initGLBuiltins(CS_INPUT input)
 {
+    gl_WorkGroupID = input.dx_WorkGroupID;
     gl_LocalInvocationID = input.dx_LocalInvocationID;
-    gl_GlobalInvocationID = input.dx_GlobalInvocationID;
 };
 
 #ifdef USE_STRUCTURED_BUFFERS
@@ -29,7 +33,7 @@ RWStructuredBuffer<float> dst : register(u0);
   float mm_readA(int row, int col) {
       if (row < M && col < K)
       {
-          float result = src0[row * K + col];
+          float result = src0[row * LDA + col];
           return result;
       }
       else {
@@ -39,14 +43,14 @@ RWStructuredBuffer<float> dst : register(u0);
   }
 
   float mm_readB(int row, int col) {
-    float result = src1[row * N + col];
+    float result = src1[row * LDB + col];
     return result;
   }
 
   void mm_write(int row, int col, float value) {
       if (row < M && col < N)
       {
-          dst[row * N + col] = value;
+          dst[row * LDC + col] = value;
       }
   }
 #else
@@ -57,7 +61,7 @@ RWByteAddressBuffer dst : register(u0);
 float mm_readA(int row, int col) {
     if (row < M && col < K)
     {
-        float result = asfloat(src0.Load(4 * (row * K + col)));
+        float result = asfloat(src0.Load(4 * (row * LDA + col)));
         return result;
     }
     else {
@@ -66,14 +70,14 @@ float mm_readA(int row, int col) {
 }
 
 float mm_readB(int row, int col) {
-    float result = asfloat(src1.Load(4 * (row * N + col)));
+    float result = asfloat(src1.Load(4 * (row * LDB + col)));
     return result;
 }
 
 void mm_write(int row, int col, float value) {
     if (row < M && col < N)
     {
-        dst.Store(4 * (row * N + col), asuint(value));
+        dst.Store(4 * (row * LDC + col), asuint(value));
     }
 }
 #endif  // USE_STRUCTURED_BUFFERS
@@ -82,6 +86,85 @@ static int RowPerThread = 4;
 static int ColPerThread = 4;
 static int TileInner = LOCAL_GROUP_SIZE_X * 4;
 
+#ifndef ACCUMULATE_MODE
+#define ACCUMULATE_MODE 0
+#endif
+
+// Same accumulation modes as SLM_8X8_4X16.hlsl.
+#if ACCUMULATE_MODE == 2
+typedef double acc_total;
+#else
+typedef float acc_total;
+#endif
+
+void accumulate_tile(inout acc_total total, inout float comp, float partial) {
+#if ACCUMULATE_MODE == 1
+    precise float y = partial - comp;
+    precise float t = total + y;
+    comp = (t - total) - y;
+    total = t;
+#else
+    total += partial;
+#endif
+}
+
+// Same tile orders as SLM_8X8_4X16.hlsl.
+#ifndef RASTER
+#define RASTER 0
+#endif
+#ifndef RASTER_GROUP_M
+#define RASTER_GROUP_M 8
+#endif
+int compact_bits(uint v) {
+    v &= 0x55555555;
+    v = (v | (v >> 1)) & 0x33333333;
+    v = (v | (v >> 2)) & 0x0f0f0f0f;
+    v = (v | (v >> 4)) & 0x00ff00ff;
+    v = (v | (v >> 8)) & 0x0000ffff;
+    return int(v);
+}
+
+bool raster_tile(int index, int tilesX, int tilesY, out int x, out int y) {
+#if RASTER == 1
+    x = index / tilesY;
+    y = index % tilesY;
+#elif RASTER == 2
+    int band = index / (RASTER_GROUP_M * tilesX);
+    int rows = min(RASTER_GROUP_M, tilesY - band * RASTER_GROUP_M);
+    int inBand = index - band * RASTER_GROUP_M * tilesX;
+    x = inBand / rows;
+    y = band * RASTER_GROUP_M + inBand % rows;
+#elif RASTER == 3
+    x = compact_bits(uint(index));
+    y = compact_bits(uint(index) >> 1);
+#else
+    int side = 1;
+    while (side < tilesX || side < tilesY) {
+        side *= 2;
+    }
+    int t = index;
+    x = 0;
+    y = 0;
+    for (int s = 1; s < side; s *= 2) {
+        int rx = 1 & (t / 2);
+        int ry = 1 & (t ^ rx);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            int swap = x;
+            x = y;
+            y = swap;
+        }
+        x += s * rx;
+        y += s * ry;
+        t /= 4;
+    }
+#endif
+    return x < tilesX && y < tilesY;
+}
+
 groupshared float mm_Asub[LOCAL_GROUP_SIZE_Y * 4][LOCAL_GROUP_SIZE_X * 4];
 groupshared float mm_Bsub[LOCAL_GROUP_SIZE_X * 4][LOCAL_GROUP_SIZE_X * 4];
 
@@ -95,8 +178,16 @@ void main(CS_INPUT input)
     int tileRow = int(gl_LocalInvocationID.y) * RowPerThread;
     int tileCol = int(gl_LocalInvocationID.x) * ColPerThread;
 
-    int globalRow = int(gl_GlobalInvocationID.y) * RowPerThread;
-    int globalCol = int(gl_GlobalInvocationID.x) * ColPerThread;
+    int group_x = int(gl_WorkGroupID.x);
+    int group_y = int(gl_WorkGroupID.y);
+#if RASTER != 0
+    int index = group_x;
+    if (!raster_tile(index, (dimBOuter - 1) / TileInner + 1, (dimAOuter - 1) / (LOCAL_GROUP_SIZE_Y * 4) + 1, group_x, group_y)) {
+        return;
+    }
+#endif
+    int globalRow = (group_y * LOCAL_GROUP_SIZE_Y + int(gl_LocalInvocationID.y)) * RowPerThread;
+    int globalCol = (group_x * LOCAL_GROUP_SIZE_X + int(gl_LocalInvocationID.x)) * ColPerThread;
 
     int numTiles = (dimInner - 1) / TileInner + 1;
 
@@ -110,6 +201,16 @@ void main(CS_INPUT input)
         acc[innerRow][innerCol] = 0.0;
       }
     }
+#if ACCUMULATE_MODE != 0
+    acc_total accTotal[4][4];
+    float accComp[4][4];
+    for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
+      for (int innerCol = 0; innerCol < ColPerThread; innerCol++) {
+        accTotal[innerRow][innerCol] = 0.0;
+        accComp[innerRow][innerCol] = 0.0;
+      }
+    }
+#endif
 
     int tileColA = int(gl_LocalInvocationID.x) * 4;
     int tileRowB = int(gl_LocalInvocationID.y) * 4;
@@ -156,7 +257,22 @@ void main(CS_INPUT input)
       }
 
       GroupMemoryBarrierWithGroupSync();
+#if ACCUMULATE_MODE != 0
+      for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
+        for (int innerCol = 0; innerCol < ColPerThread; innerCol++) {
+          accumulate_tile(accTotal[innerRow][innerCol], accComp[innerRow][innerCol], acc[innerRow][innerCol]);
+          acc[innerRow][innerCol] = 0.0;
+        }
+      }
+#endif
+    }
+#if ACCUMULATE_MODE != 0
+    for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
+      for (int innerCol = 0; innerCol < ColPerThread; innerCol++) {
+        acc[innerRow][innerCol] = float(accTotal[innerRow][innerCol]);
+      }
     }
+#endif
 
     for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
       for (int innerCol = 0; innerCol < ColPerThread; innerCol++) {
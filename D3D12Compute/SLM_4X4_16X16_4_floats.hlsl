@@ -4,6 +4,10 @@ cbuffer SceneConstantBuffer : register( b0 )
     int K;
     int N;
     int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
 }
 
 static uint3 gl_LocalInvocationID = uint3(0, 0, 0);
@@ -29,7 +33,7 @@ RWStructuredBuffer<float> dst : register(u0);
 float4 mm_readA(int row, int col) {
     if (row < M && col < K)
     {
-        int index = row * K + col;
+        int index = row * LDA + col;
         float4 result = float4(src0[index],
             src0[index + 1], src0[index + 2], src0[index + 3]);
         return result;
@@ -40,7 +44,7 @@ float4 mm_readA(int row, int col) {
 }
 
 float4 mm_readB(int row, int col) {
-    int index = row * N + col;
+    int index = row * LDB + col;
     float4 result = float4(src1[index],
         src1[index + 1], src1[index + 2], src1[index + 3]);
     return result;
@@ -49,7 +53,7 @@ float4 mm_readB(int row, int col) {
 void mm_write(int row, int col, float4 value) {
     if (row < M && col < N)
     {
-        int index = row * N + col;
+        int index = row * LDC + col;
         dst[index] = value.x;
         dst[index + 1] = value.y;
         dst[index + 2] = value.z;
@@ -64,7 +68,7 @@ RWByteAddressBuffer dst : register(u0);
 float4 mm_readA(int row, int col) {
     if (row < M && col < K)
     {
-        int index = row * K + col;
+        int index = row * LDA + col;
         float4 result = float4(asfloat(src0.Load(4 * index)),
             asfloat(src0.Load(4 * (index + 1))),
             asfloat(src0.Load(4 * (index + 2))),
@@ -77,7 +81,7 @@ float4 mm_readA(int row, int col) {
 }
 
 float4 mm_readB(int row, int col) {
-    int index = row * N + col;
+    int index = row * LDB + col;
     float4 result = float4(asfloat(src1.Load(4 * index)),
         asfloat(src1.Load(4 * (index + 1))),
         asfloat(src1.Load(4 * (index + 2))),
@@ -88,7 +92,7 @@ float4 mm_readB(int row, int col) {
 void mm_write(int row, int col, float4 value) {
     if (row < M && col < N)
     {
-        int index = row * N + col;
+        int index = row * LDC + col;
         dst.Store(4 * (index), asuint(value.x));
         dst.Store(4 * (index + 1), asuint(value.y));
         dst.Store(4 * (index + 2), asuint(value.z));
@@ -102,8 +106,28 @@ static int ColPerThread = 4;
 static int TileInner = LOCAL_GROUP_SIZE_X * 4;
 static int VEC_SIZE = 4;
 
-groupshared float mm_Asub[LOCAL_GROUP_SIZE_Y * 4][LOCAL_GROUP_SIZE_X * 4];
-groupshared float mm_Bsub[LOCAL_GROUP_SIZE_Y * 4][LOCAL_GROUP_SIZE_X * 4]; // LOCAL_GROUP_SIZE_X and LOCAL_GROUP_SIZE_Y must be same.
+// With DOUBLE_BUFFER, mm_Asub and mm_Bsub each hold two tiles, ping-ponged as
+// in SLM_4X4_16X16_vec4.hlsl.
+#ifndef DOUBLE_BUFFER
+#define DOUBLE_BUFFER 0
+#endif
+#define SUB_ROWS (LOCAL_GROUP_SIZE_Y * 4)
+
+groupshared float mm_Asub[(DOUBLE_BUFFER + 1) * SUB_ROWS][LOCAL_GROUP_SIZE_X * 4];
+groupshared float mm_Bsub[(DOUBLE_BUFFER + 1) * SUB_ROWS][LOCAL_GROUP_SIZE_X * 4]; // LOCAL_GROUP_SIZE_X and LOCAL_GROUP_SIZE_Y must be same.
+
+#if DOUBLE_BUFFER
+void store_sub(int aRow, int bRow, int col, float4 a, float4 b) {
+    mm_Asub[aRow][col] = a.x;
+    mm_Asub[aRow][col + 1] = a.y;
+    mm_Asub[aRow][col + 2] = a.z;
+    mm_Asub[aRow][col + 3] = a.w;
+    mm_Bsub[bRow][col] = b.x;
+    mm_Bsub[bRow][col + 1] = b.y;
+    mm_Bsub[bRow][col + 2] = b.z;
+    mm_Bsub[bRow][col + 3] = b.w;
+}
+#endif
 
 [numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
 void main(CS_INPUT input)
@@ -132,9 +156,34 @@ void main(CS_INPUT input)
     }
 
     int tileRowB = int(gl_LocalInvocationID.y) * 4;
+    // First row of the halves of mm_Asub and mm_Bsub that hold the current tiles.
+    int slm = 0;
+
+#if DOUBLE_BUFFER
+    // The first tiles go into the first halves before the loop.
+    for (int innerRow = 0; innerRow < 4; innerRow++) {
+        store_sub(tileRow + innerRow, tileRowB + innerRow, tileCol,
+                  mm_readA(globalRow + innerRow, tileCol),
+                  mm_readB(tileRowB + innerRow, globalCol));
+    }
+    GroupMemoryBarrierWithGroupSync();
+#endif
 
     // Loop over shared dimension.
     for (int t = 0; t < numTiles; t++) {
+#if DOUBLE_BUFFER
+      bool hasNext = t + 1 < numTiles;
+      float4 anext[4];
+      float4 bnext[4];
+      for (int innerRow = 0; innerRow < 4; innerRow++) {
+          anext[innerRow] = float4(0, 0, 0, 0);
+          bnext[innerRow] = float4(0, 0, 0, 0);
+          if (hasNext) {
+              anext[innerRow] = mm_readA(globalRow + innerRow, (t + 1) * TileInner + tileCol);
+              bnext[innerRow] = mm_readB((t + 1) * TileInner + tileRowB + innerRow, globalCol);
+          }
+      }
+#else
       // Load one tile of A into local memory.
       for (int innerRow = 0; innerRow < 4; innerRow++) {
           int inputRow = tileRow + innerRow;
@@ -164,21 +213,32 @@ void main(CS_INPUT input)
       }
 
       GroupMemoryBarrierWithGroupSync();
+#endif
 
       // Compute acc values for a single thread.
       for (int k = 0; k < TileInner; k++) {
           for (int inner = 0; inner < ColPerThread; inner++) {
-              BCached[inner] = mm_Bsub[k][tileCol + inner];
+              BCached[inner] = mm_Bsub[slm + k][tileCol + inner];
           }
 
           for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
-              ACached = mm_Asub[tileRow + innerRow][k];
+              ACached = mm_Asub[slm + tileRow + innerRow][k];
               for (int innerCol = 0; innerCol < ColPerThread; innerCol++) {
                   acc[innerRow][innerCol] += ACached * BCached[innerCol];
               }
           }
       }
 
+#if DOUBLE_BUFFER
+      // Store the next tiles to the other halves. The barrier below publishes
+      // them and frees these halves for the tiles after.
+      slm = SUB_ROWS - slm;
+      if (hasNext) {
+          for (int innerRow = 0; innerRow < 4; innerRow++) {
+              store_sub(slm + tileRow + innerRow, slm + tileRowB + innerRow, tileCol, anext[innerRow], bnext[innerRow]);
+          }
+      }
+#endif
       GroupMemoryBarrierWithGroupSync();
     }
 
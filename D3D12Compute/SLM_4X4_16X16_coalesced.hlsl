@@ -4,6 +4,10 @@ cbuffer SceneConstantBuffer : register( b0 )
     int K;
     int N;
     int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
 }
 
 static uint3 gl_WorkGroupID = uint3(0, 0, 0);
@@ -32,7 +36,7 @@ RWStructuredBuffer<float> dst : register(u0);
   float mm_readA(int row, int col) {
       if (row < M && col < K)
       {
-          float result = src0[row * K + col];
+          float result = src0[row * LDA + col];
           return result;
       }
       else {
@@ -42,14 +46,14 @@ RWStructuredBuffer<float> dst : register(u0);
   }
 
   float mm_readB(int row, int col) {
-    float result = src1[row * N + col];
+    float result = src1[row * LDB + col];
     return result;
   }
 
   void mm_write(int row, int col, float value) {
       if (row < M && col < N)
       {
-          dst[row * N + col] = value;
+          dst[row * LDC + col] = value;
       }
   }
 #else
@@ -60,7 +64,7 @@ RWByteAddressBuffer dst : register(u0);
 float mm_readA(int row, int col) {
     if (row < M && col < K)
     {
-        float result = asfloat(src0.Load(4 * (row * K + col)));
+        float result = asfloat(src0.Load(4 * (row * LDA + col)));
         return result;
     }
     else {
@@ -69,14 +73,14 @@ float mm_readA(int row, int col) {
 }
 
 float mm_readB(int row, int col) {
-    float result = asfloat(src1.Load(4 * (row * N + col)));
+    float result = asfloat(src1.Load(4 * (row * LDB + col)));
     return result;
 }
 
 void mm_write(int row, int col, float value) {
     if (row < M && col < N)
     {
-        dst.Store(4 * (row * N + col), asuint(value));
+        dst.Store(4 * (row * LDC + col), asuint(value));
     }
 }
 #endif  // USE_STRUCTURED_BUFFERS
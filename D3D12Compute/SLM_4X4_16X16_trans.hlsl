@@ -0,0 +1,196 @@
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;
+    int K;
+    int N;
+    int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
+}
+
+static uint3 gl_WorkGroupID = uint3(0, 0, 0);
+static uint3 gl_LocalInvocationID = uint3(0, 0, 0);
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+};
+
+void initGLBuiltins(CS_INPUT input)
+{
+    gl_WorkGroupID = input.dx_WorkGroupID;
+    gl_LocalInvocationID = input.dx_LocalInvocationID;
+};
+
+// C = op(A) * op(B). With TRANS_A, A is stored as K x M; with TRANS_B, B is
+// stored as N x K. mm_readA/mm_readB always take logical (row, col) of op(A)/op(B).
+#ifndef TRANS_A
+#define TRANS_A 0
+#endif
+#ifndef TRANS_B
+#define TRANS_B 0
+#endif
+
+#if TRANS_A
+#define A_INDEX(row, col) ((col) * LDA + (row))
+#else
+#define A_INDEX(row, col) ((row) * LDA + (col))
+#endif
+#if TRANS_B
+#define B_INDEX(row, col) ((col) * LDB + (row))
+#else
+#define B_INDEX(row, col) ((row) * LDB + (col))
+#endif
+
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<float> src0 : register(t0);
+StructuredBuffer<float> src1 : register(t1);
+RWStructuredBuffer<float> dst : register(u0);
+
+float mm_readA(int row, int col) {
+    if (row < M && col < K)
+    {
+        return src0[A_INDEX(row, col)];
+    }
+    else {
+        return 0.0;
+    }
+}
+
+float mm_readB(int row, int col) {
+    if (row < K && col < N)
+    {
+        return src1[B_INDEX(row, col)];
+    }
+    else {
+        return 0.0;
+    }
+}
+
+void mm_write(int row, int col, float value) {
+    if (row < M && col < N)
+    {
+        dst[row * LDC + col] = value;
+    }
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+ByteAddressBuffer src1 : register(t1);
+RWByteAddressBuffer dst : register(u0);
+
+float mm_readA(int row, int col) {
+    if (row < M && col < K)
+    {
+        return asfloat(src0.Load(4 * A_INDEX(row, col)));
+    }
+    else {
+        return 0.0;
+    }
+}
+
+float mm_readB(int row, int col) {
+    if (row < K && col < N)
+    {
+        return asfloat(src1.Load(4 * B_INDEX(row, col)));
+    }
+    else {
+        return 0.0;
+    }
+}
+
+void mm_write(int row, int col, float value) {
+    if (row < M && col < N)
+    {
+        dst.Store(4 * (row * LDC + col), asuint(value));
+    }
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+static const int RowPerThread = 4;
+static const int ColPerThread = 4;
+static const int TileM = LOCAL_GROUP_SIZE_Y * 4;
+static const int TileN = LOCAL_GROUP_SIZE_X * 4;
+static const int GroupSize = LOCAL_GROUP_SIZE_X * LOCAL_GROUP_SIZE_Y;
+#define TILE_K_T 32
+
+// Both tiles are padded by one element: the transposed loads write down a
+// column of the tile, which would otherwise hit a single bank.
+groupshared float mm_Asub[TileM][TILE_K_T + 1];
+groupshared float mm_Bsub[TILE_K_T][TileN + 1];
+
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    initGLBuiltins(input);
+    int localX = int(gl_LocalInvocationID.x);
+    int localY = int(gl_LocalInvocationID.y);
+    int localIndex = localY * LOCAL_GROUP_SIZE_X + localX;
+    int tileRowStart = int(gl_WorkGroupID.y) * TileM;
+    int tileColStart = int(gl_WorkGroupID.x) * TileN;
+
+    // Each thread owns rows localY + i * LOCAL_GROUP_SIZE_Y and columns
+    // localX + j * LOCAL_GROUP_SIZE_X of the tile so that writes stay coalesced.
+    float acc[4][4];
+    for (int i = 0; i < RowPerThread; i++) {
+        for (int j = 0; j < ColPerThread; j++) {
+            acc[i][j] = 0.0;
+        }
+    }
+
+    int numTiles = (K + TILE_K_T - 1) / TILE_K_T;
+    for (int t = 0; t < numTiles; t++) {
+        // Consecutive threads walk the dimension that is contiguous in memory,
+        // so every layout loads with coalesced reads.
+        for (int index = localIndex; index < TileM * TILE_K_T; index += GroupSize) {
+#if TRANS_A
+            int row = index % TileM;
+            int col = index / TileM;
+#else
+            int row = index / TILE_K_T;
+            int col = index % TILE_K_T;
+#endif
+            mm_Asub[row][col] = mm_readA(tileRowStart + row, t * TILE_K_T + col);
+        }
+        for (int index = localIndex; index < TILE_K_T * TileN; index += GroupSize) {
+#if TRANS_B
+            int row = index % TILE_K_T;
+            int col = index / TILE_K_T;
+#else
+            int row = index / TileN;
+            int col = index % TileN;
+#endif
+            mm_Bsub[row][col] = mm_readB(t * TILE_K_T + row, tileColStart + col);
+        }
+
+        GroupMemoryBarrierWithGroupSync();
+
+        for (int k = 0; k < TILE_K_T; k++) {
+            float ACached[4];
+            float BCached[4];
+            for (int i = 0; i < RowPerThread; i++) {
+                ACached[i] = mm_Asub[localY + i * LOCAL_GROUP_SIZE_Y][k];
+            }
+            for (int j = 0; j < ColPerThread; j++) {
+                BCached[j] = mm_Bsub[k][localX + j * LOCAL_GROUP_SIZE_X];
+            }
+            for (int i = 0; i < RowPerThread; i++) {
+                for (int j = 0; j < ColPerThread; j++) {
+                    acc[i][j] += ACached[i] * BCached[j];
+                }
+            }
+        }
+
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    for (int i = 0; i < RowPerThread; i++) {
+        for (int j = 0; j < ColPerThread; j++) {
+            mm_write(tileRowStart + localY + i * LOCAL_GROUP_SIZE_Y,
+                     tileColStart + localX + j * LOCAL_GROUP_SIZE_X,
+                     acc[i][j]);
+        }
+    }
+}
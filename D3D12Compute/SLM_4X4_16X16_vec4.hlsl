@@ -4,6 +4,10 @@ cbuffer SceneConstantBuffer : register( b0 )
     int K;
     int N;
     int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
 }
 
 static uint3 gl_LocalInvocationID = uint3(0, 0, 0);
@@ -46,7 +50,7 @@ RWStructuredBuffer<float4> dst : register(u0);
 float4 mm_readA(int row, int col) {
     if (row < M && col < K / 4)
     {
-        return src0[row * (K / 4) + col];
+        return src0[row * (LDA / 4) + col];
     }
     else {
         return float4(0, 0, 0, 0);
@@ -54,13 +58,13 @@ float4 mm_readA(int row, int col) {
 }
 
 float4 mm_readB(int row, int col) {
-    return src1[row * (N / 4) + col];
+    return src1[row * (LDB / 4) + col];
 }
 
 void mm_write(int row, int col, float4 value) {
     if (row < M && col < N / 4)
     {
-        dst[row * (N / 4) + col] = value;
+        dst[row * (LDC / 4) + col] = value;
     }
 }
 #else
@@ -71,7 +75,7 @@ RWByteAddressBuffer dst : register(u0);
 float4 mm_readA(int row, int col) {
     if (row < M && col < K / 4)
     {
-        float4 result = asfloat(src0.Load4(16 * (row * (K / 4) + col)));
+        float4 result = asfloat(src0.Load4(16 * (row * (LDA / 4) + col)));
         return result;
     }
     else {
@@ -80,14 +84,14 @@ float4 mm_readA(int row, int col) {
 }
 
 float4 mm_readB(int row, int col) {
-    float4 result = asfloat(src1.Load4(16 * (row * (N / 4) + col)));
+    float4 result = asfloat(src1.Load4(16 * (row * (LDB / 4) + col)));
     return result;
 }
 
 void mm_write(int row, int col, float4 value) {
     if (row < M && col < N / 4)
     {
-        dst.Store4(16 * (row * (N / 4) + col), asuint(value));
+        dst.Store4(16 * (row * (LDC / 4) + col), asuint(value));
     }
 }
 #endif  // USE_STRUCTURED_BUFFERS
@@ -98,8 +102,38 @@ static int ColPerThread = 4;
 static int TileInner = LOCAL_GROUP_SIZE_X * 4;
 static int VEC_SIZE = 4;
 
-groupshared float4 mm_Asub[LOCAL_GROUP_SIZE_Y * 4][LOCAL_GROUP_SIZE_X];
-groupshared float4 mm_Bsub[LOCAL_GROUP_SIZE_Y * 4][LOCAL_GROUP_SIZE_X]; // LOCAL_GROUP_SIZE_X and LOCAL_GROUP_SIZE_Y must be same.
+#ifndef ACCUMULATE_MODE
+#define ACCUMULATE_MODE 0
+#endif
+
+// Same accumulation modes as SLM_8X8_4X16.hlsl.
+#if ACCUMULATE_MODE == 2
+typedef double4 acc_total4;
+#else
+typedef float4 acc_total4;
+#endif
+
+void accumulate_tile(inout acc_total4 total, inout float4 comp, float4 partial) {
+#if ACCUMULATE_MODE == 1
+    precise float4 y = partial - comp;
+    precise float4 t = total + y;
+    comp = (t - total) - y;
+    total = t;
+#else
+    total += partial;
+#endif
+}
+
+// With DOUBLE_BUFFER, mm_Asub and mm_Bsub each hold two tiles, ping-ponged as
+// in SLM_8X8_4X16.hlsl: tile t + 1 is read into registers before tile t is
+// consumed and stored to the other halves afterwards, with one barrier per tile.
+#ifndef DOUBLE_BUFFER
+#define DOUBLE_BUFFER 0
+#endif
+#define SUB_ROWS (LOCAL_GROUP_SIZE_Y * 4)
+
+groupshared float4 mm_Asub[(DOUBLE_BUFFER + 1) * SUB_ROWS][LOCAL_GROUP_SIZE_X];
+groupshared float4 mm_Bsub[(DOUBLE_BUFFER + 1) * SUB_ROWS][LOCAL_GROUP_SIZE_X]; // LOCAL_GROUP_SIZE_X and LOCAL_GROUP_SIZE_Y must be same.
 
 [numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
 void main(CS_INPUT input)
@@ -124,12 +158,46 @@ void main(CS_INPUT input)
     for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
         acc[innerRow] = (float4)(0.f);
     }
+#if ACCUMULATE_MODE != 0
+    acc_total4 accTotal[4];
+    float4 accComp[4];
+    for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
+        accTotal[innerRow] = (acc_total4)0;
+        accComp[innerRow] = (float4)(0.f);
+    }
+#endif
 
     int globalColA = tileCol;
     int tileRowB = int(gl_LocalInvocationID.y) * 4;
+    // First row of the halves of mm_Asub and mm_Bsub that hold the current tiles.
+    int slm = 0;
+
+#if DOUBLE_BUFFER
+    // The first tiles go into the first halves before the loop.
+    for (int innerRow = 0; innerRow < 4; innerRow++) {
+        mm_Asub[tileRow + innerRow][tileCol] = mm_readA(globalRow + innerRow, globalColA);
+        mm_Bsub[tileRowB + innerRow][tileCol] = mm_readB(tileRowB + innerRow, globalCol);
+    }
+    globalColA += TileInner / VEC_SIZE;
+    GroupMemoryBarrierWithGroupSync();
+#endif
 
     // Loop over shared dimension.
     for (int t = 0; t < numTiles; t++) {
+#if DOUBLE_BUFFER
+      bool hasNext = t + 1 < numTiles;
+      float4 anext[4];
+      float4 bnext[4];
+      for (int innerRow = 0; innerRow < 4; innerRow++) {
+          anext[innerRow] = float4(0, 0, 0, 0);
+          bnext[innerRow] = float4(0, 0, 0, 0);
+          if (hasNext) {
+              anext[innerRow] = mm_readA(globalRow + innerRow, globalColA);
+              bnext[innerRow] = mm_readB((t + 1) * TileInner + tileRowB + innerRow, globalCol);
+          }
+      }
+      globalColA += TileInner / VEC_SIZE;
+#else
       // Load one tile of A into local memory.
       for (int innerRow = 0; innerRow < 4; innerRow++) {
           int inputRow = tileRow + innerRow;
@@ -152,41 +220,64 @@ void main(CS_INPUT input)
       }
 
       GroupMemoryBarrierWithGroupSync();
+#endif
 
       // Compute acc values for a single thread.
       for (int k = 0; k < TileInner / VEC_SIZE; k++) {
-        BCached[0] = mm_Bsub[k * VEC_SIZE][tileCol];
-        BCached[1] = mm_Bsub[k * VEC_SIZE + 1][tileCol];
-        BCached[2] = mm_Bsub[k * VEC_SIZE + 2][tileCol];
-        BCached[3] = mm_Bsub[k * VEC_SIZE + 3][tileCol];
+        BCached[0] = mm_Bsub[slm + k * VEC_SIZE][tileCol];
+        BCached[1] = mm_Bsub[slm + k * VEC_SIZE + 1][tileCol];
+        BCached[2] = mm_Bsub[slm + k * VEC_SIZE + 2][tileCol];
+        BCached[3] = mm_Bsub[slm + k * VEC_SIZE + 3][tileCol];
 
-        ACached = mm_Asub[tileRow][k];
+        ACached = mm_Asub[slm + tileRow][k];
         acc[0] = BCached[0] * ACached.x + acc[0];
         acc[0] = BCached[1] * ACached.y + acc[0];
         acc[0] = BCached[2] * ACached.z + acc[0];
         acc[0] = BCached[3] * ACached.w + acc[0];
 
-        ACached = mm_Asub[tileRow + 1][k];
+        ACached = mm_Asub[slm + tileRow + 1][k];
         acc[1] = BCached[0] * ACached.x + acc[1];
         acc[1] = BCached[1] * ACached.y + acc[1];
         acc[1] = BCached[2] * ACached.z + acc[1];
         acc[1] = BCached[3] * ACached.w + acc[1];
 
-        ACached = mm_Asub[tileRow + 2][k];
+        ACached = mm_Asub[slm + tileRow + 2][k];
         acc[2] = BCached[0] * ACached.x + acc[2];
         acc[2] = BCached[1] * ACached.y + acc[2];
         acc[2] = BCached[2] * ACached.z + acc[2];
         acc[2] = BCached[3] * ACached.w + acc[2];
 
-        ACached = mm_Asub[tileRow + 3][k];
+        ACached = mm_Asub[slm + tileRow + 3][k];
         acc[3] = BCached[0] * ACached.x + acc[3];
         acc[3] = BCached[1] * ACached.y + acc[3];
         acc[3] = BCached[2] * ACached.z + acc[3];
         acc[3] = BCached[3] * ACached.w + acc[3];
       }
 
+#if DOUBLE_BUFFER
+      // Store the next tiles to the other halves. The barrier below publishes
+      // them and frees these halves for the tiles after.
+      slm = SUB_ROWS - slm;
+      if (hasNext) {
+          for (int innerRow = 0; innerRow < 4; innerRow++) {
+              mm_Asub[slm + tileRow + innerRow][tileCol] = anext[innerRow];
+              mm_Bsub[slm + tileRowB + innerRow][tileCol] = bnext[innerRow];
+          }
+      }
+#endif
       GroupMemoryBarrierWithGroupSync();
+#if ACCUMULATE_MODE != 0
+      for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
+          accumulate_tile(accTotal[innerRow], accComp[innerRow], acc[innerRow]);
+          acc[innerRow] = (float4)(0.f);
+      }
+#endif
+    }
+#if ACCUMULATE_MODE != 0
+    for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
+        acc[innerRow] = float4(accTotal[innerRow]);
     }
+#endif
 
     for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
           mm_write(globalRow + innerRow,
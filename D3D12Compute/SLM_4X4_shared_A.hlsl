@@ -4,6 +4,10 @@ cbuffer SceneConstantBuffer : register( b0 )
     int K;
     int N;
     int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
 }
 
 static uint3 gl_LocalInvocationID = uint3(0, 0, 0);
@@ -46,7 +50,7 @@ RWStructuredBuffer<float4> dst : register(u0);
 float4 mm_readA(int row, int col) {
     if (row < M && col < K / 4)
     {
-        return src0[row * (K / 4) + col];
+        return src0[row * (LDA / 4) + col];
     }
     else {
         return float4(0, 0, 0, 0);
@@ -54,13 +58,13 @@ float4 mm_readA(int row, int col) {
 }
 
 float4 mm_readB(int row, int col) {
-    return src1[row * (N / 4) + col];
+    return src1[row * (LDB / 4) + col];
 }
 
 void mm_write(int row, int col, float4 value) {
     if (row < M && col < N / 4)
     {
-        dst[row * (N / 4) + col] = value;
+        dst[row * (LDC / 4) + col] = value;
     }
 }
 #else
@@ -71,7 +75,7 @@ RWByteAddressBuffer dst : register(u0);
 float4 mm_readA(int row, int col) {
     if (row < M && col < K / 4)
     {
-        float4 result = asfloat(src0.Load4(16 * (row * (K / 4) + col)));
+        float4 result = asfloat(src0.Load4(16 * (row * (LDA / 4) + col)));
         return result;
     }
     else {
@@ -80,14 +84,14 @@ float4 mm_readA(int row, int col) {
 }
 
 float4 mm_readB(int row, int col) {
-    float4 result = asfloat(src1.Load4(16 * (row * (N / 4) + col)));
+    float4 result = asfloat(src1.Load4(16 * (row * (LDB / 4) + col)));
     return result;
 }
 
 void mm_write(int row, int col, float4 value) {
     if (row < M && col < N / 4)
     {
-        dst.Store4(16 * (row * (N / 4) + col), asuint(value));
+        dst.Store4(16 * (row * (LDC / 4) + col), asuint(value));
     }
 }
 #endif  // USE_STRUCTURED_BUFFERS
@@ -98,7 +102,37 @@ static int ColPerThread = 4;
 static int TileInner = LOCAL_GROUP_SIZE_X * 4;
 static int VEC_SIZE = 4;
 
-groupshared float4 mm_Asub[LOCAL_GROUP_SIZE_Y * 4][LOCAL_GROUP_SIZE_X];
+#ifndef ACCUMULATE_MODE
+#define ACCUMULATE_MODE 0
+#endif
+
+// Same accumulation modes as SLM_8X8_4X16.hlsl.
+#if ACCUMULATE_MODE == 2
+typedef double4 acc_total4;
+#else
+typedef float4 acc_total4;
+#endif
+
+void accumulate_tile(inout acc_total4 total, inout float4 comp, float4 partial) {
+#if ACCUMULATE_MODE == 1
+    precise float4 y = partial - comp;
+    precise float4 t = total + y;
+    comp = (t - total) - y;
+    total = t;
+#else
+    total += partial;
+#endif
+}
+
+// With DOUBLE_BUFFER, mm_Asub holds two A tiles, ping-ponged as in
+// SLM_8X8_4X16.hlsl: tile t + 1 is read into registers before tile t is
+// consumed and stored to the other half afterwards, with one barrier per tile.
+#ifndef DOUBLE_BUFFER
+#define DOUBLE_BUFFER 0
+#endif
+#define ASUB_ROWS (LOCAL_GROUP_SIZE_Y * 4)
+
+groupshared float4 mm_Asub[(DOUBLE_BUFFER + 1) * ASUB_ROWS][LOCAL_GROUP_SIZE_X];
 
 [numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
 void main(CS_INPUT input)
@@ -123,12 +157,42 @@ void main(CS_INPUT input)
     for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
         acc[innerRow] = (float4)(0.f);
     }
+#if ACCUMULATE_MODE != 0
+    acc_total4 accTotal[4];
+    float4 accComp[4];
+    for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
+        accTotal[innerRow] = (acc_total4)0;
+        accComp[innerRow] = (float4)(0.f);
+    }
+#endif
 
     int rowB0 = 0;
     int globalColA = tileCol;
+    // First row of the half of mm_Asub that holds the current tile.
+    int slm = 0;
+
+#if DOUBLE_BUFFER
+    // The first tile goes into the first half before the loop.
+    for (int innerRow = 0; innerRow < 4; innerRow++) {
+        mm_Asub[tileRow + innerRow][tileCol] = mm_readA(globalRow + innerRow, globalColA);
+    }
+    globalColA += TileInner / VEC_SIZE;
+    GroupMemoryBarrierWithGroupSync();
+#endif
 
     // Loop over shared dimension.
     for (int t = 0; t < numTiles; t++) {
+#if DOUBLE_BUFFER
+      bool hasNext = t + 1 < numTiles;
+      float4 anext[4];
+      for (int innerRow = 0; innerRow < 4; innerRow++) {
+          anext[innerRow] = float4(0, 0, 0, 0);
+          if (hasNext) {
+              anext[innerRow] = mm_readA(globalRow + innerRow, globalColA);
+          }
+      }
+      globalColA += TileInner / VEC_SIZE;
+#else
       // Load one tile of A into local memory.
       for (int innerRow = 0; innerRow < 4; innerRow++) {
           int inputRow = tileRow + innerRow;
@@ -141,6 +205,7 @@ void main(CS_INPUT input)
       globalColA += TileInner / VEC_SIZE;
 
       GroupMemoryBarrierWithGroupSync();
+#endif
 
       // Compute acc values for a single thread.
       for (int k = 0; k < TileInner / VEC_SIZE; k++) {
@@ -149,33 +214,54 @@ void main(CS_INPUT input)
         BCached[2] = mm_readB(rowB0, globalCol); rowB0++;
         BCached[3] = mm_readB(rowB0, globalCol); rowB0++;
 
-        ACached = mm_Asub[tileRow][k];
+        ACached = mm_Asub[slm + tileRow][k];
         acc[0] = BCached[0] * ACached.x + acc[0];
         acc[0] = BCached[1] * ACached.y + acc[0];
         acc[0] = BCached[2] * ACached.z + acc[0];
         acc[0] = BCached[3] * ACached.w + acc[0];
 
-        ACached = mm_Asub[tileRow + 1][k];
+        ACached = mm_Asub[slm + tileRow + 1][k];
         acc[1] = BCached[0] * ACached.x + acc[1];
         acc[1] = BCached[1] * ACached.y + acc[1];
         acc[1] = BCached[2] * ACached.z + acc[1];
         acc[1] = BCached[3] * ACached.w + acc[1];
 
-        ACached = mm_Asub[tileRow + 2][k];
+        ACached = mm_Asub[slm + tileRow + 2][k];
         acc[2] = BCached[0] * ACached.x + acc[2];
         acc[2] = BCached[1] * ACached.y + acc[2];
         acc[2] = BCached[2] * ACached.z + acc[2];
         acc[2] = BCached[3] * ACached.w + acc[2];
 
-        ACached = mm_Asub[tileRow + 3][k];
+        ACached = mm_Asub[slm + tileRow + 3][k];
         acc[3] = BCached[0] * ACached.x + acc[3];
         acc[3] = BCached[1] * ACached.y + acc[3];
         acc[3] = BCached[2] * ACached.z + acc[3];
         acc[3] = BCached[3] * ACached.w + acc[3];
       }
 
+#if DOUBLE_BUFFER
+      // Store the next tile to the other half. The barrier below publishes it
+      // and frees this half for the tile after.
+      slm = ASUB_ROWS - slm;
+      if (hasNext) {
+          for (int innerRow = 0; innerRow < 4; innerRow++) {
+              mm_Asub[slm + tileRow + innerRow][tileCol] = anext[innerRow];
+          }
+      }
+#endif
       GroupMemoryBarrierWithGroupSync();
+#if ACCUMULATE_MODE != 0
+      for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
+          accumulate_tile(accTotal[innerRow], accComp[innerRow], acc[innerRow]);
+          acc[innerRow] = (float4)(0.f);
+      }
+#endif
+    }
+#if ACCUMULATE_MODE != 0
+    for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
+        acc[innerRow] = float4(accTotal[innerRow]);
     }
+#endif
 
     for (int innerRow = 0; innerRow < RowPerThread; innerRow++) {
           mm_write(globalRow + innerRow,
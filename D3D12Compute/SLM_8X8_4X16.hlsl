@@ -4,6 +4,10 @@ cbuffer SceneConstantBuffer : register( b0 )
     int K;
     int N;
     int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
 }
 
 static uint3 gl_WorkGroupID = uint3(0, 0, 0);
@@ -27,13 +31,50 @@ static int TILE_N = 128;
 static int ROWS_PER_WI = 8;
 static int TILE_K0 = 64;
 
+#ifdef PACKED_B
+// With PACKED_B, B has been rearranged by PackPanels into TILE_N wide column
+// panels whose rows are stored back to back, with K padded to TILE_K0. A work
+// group then reads B as one contiguous stream, and the zero padding makes the
+// reads past K safe. row and col are still in logical B coordinates (col in float4s).
+int packedBIndex(int row, int col) {
+    int panelWidth = TILE_N / VEC_SIZE;
+    int paddedK = (K + TILE_K0 - 1) / TILE_K0 * TILE_K0;
+    return ((col / panelWidth) * paddedK + row) * panelWidth + col % panelWidth;
+}
+#endif
+
+// With BOUNDS_CHECK 0 the M and N checks are compiled out. The host only does
+// that for the interior tiles of a split dispatch, which lie wholly inside C; a
+// second dispatch with EDGE_TILES covers the partial tiles with the checks on.
+// The K check on A stays in both: reads of B past K fall outside the buffer,
+// which D3D12 defines to return zero, and meet the zeros read from A.
+#ifndef BOUNDS_CHECK
+#define BOUNDS_CHECK 1
+#endif
+#ifndef EDGE_TILES
+#define EDGE_TILES 0
+#endif
+// With DOUBLE_BUFFER, atile holds two A tiles. Tile t + 1 is read into registers
+// before tile t is consumed and stored to the other half afterwards, so its load
+// latency hides behind the FMAs and one barrier per tile is enough.
+#ifndef DOUBLE_BUFFER
+#define DOUBLE_BUFFER 0
+#endif
+#if BOUNDS_CHECK
+#define IN_M(row) ((row) < M)
+#define IN_N4(col) ((col) < N / 4)
+#else
+#define IN_M(row) true
+#define IN_N4(col) true
+#endif
+
 #ifdef USE_TEXTURE
 Texture2D<float4> src0 : register(t0);
 Texture2D<float4> src1 : register(t1);
 RWTexture2D<float4> dst : register(u0);
 
 float4 mm_readA(int row, int col) {
-    if (row < M && col < K / 4)
+    if (IN_M(row) && col < K / 4)
     {
         return src0.Load(int3(col, row, 0));
     }
@@ -43,11 +84,17 @@ float4 mm_readA(int row, int col) {
 }
 
 float4 mm_readB(int row, int col) {
-    return src1.Load(int3(col, row, 0));
+    if (IN_N4(col))
+    {
+        return src1.Load(int3(col, row, 0));
+    }
+    else {
+        return float4(0, 0, 0, 0);
+    }
 }
 
 void mm_write(int row, int col, float4 value) {
-    if (row < M && col < N / 4)
+    if (IN_M(row) && IN_N4(col))
     {
         dst[uint2(col, row)] = value;
     }
@@ -59,9 +106,9 @@ StructuredBuffer<float4> src1 : register(t1);
 RWStructuredBuffer<float4> dst : register(u0);
 
 float4 mm_readA(int row, int col) {
-    if (row < M && col < K / 4)
+    if (IN_M(row) && col < K / 4)
     {
-       return src0[row * (K / 4) + col];
+       return src0[row * (LDA / 4) + col];
     }
     else {
         return float4(0, 0, 0, 0);
@@ -69,13 +116,23 @@ float4 mm_readA(int row, int col) {
 }
 
 float4 mm_readB(int row, int col) {
-    return src1[row * (N / 4) + col];
+    if (IN_N4(col))
+    {
+#ifdef PACKED_B
+        return src1[packedBIndex(row, col)];
+#else
+        return src1[row * (LDB / 4) + col];
+#endif
+    }
+    else {
+        return float4(0, 0, 0, 0);
+    }
 }
 
 void mm_write(int row, int col, float4 value) {
-    if (row < M && col < N / 4)
+    if (IN_M(row) && IN_N4(col))
     {
-        dst[row * (N / 4) + col] = value;
+        dst[row * (LDC / 4) + col] = value;
     }
 }
 #else
@@ -84,9 +141,9 @@ ByteAddressBuffer src1 : register(t1);
 RWByteAddressBuffer dst : register(u0);
 
 float4 mm_readA(int row, int col) {
-    if (row < M && col < K / 4)
+    if (IN_M(row) && col < K / 4)
     {
-        float4 result = asfloat(src0.Load4(16 * (row * (K / 4) + col)));
+        float4 result = asfloat(src0.Load4(16 * (row * (LDA / 4) + col)));
         return result;
     }
     else {
@@ -95,20 +152,253 @@ float4 mm_readA(int row, int col) {
 }
 
 float4 mm_readB(int row, int col) {
-    float4 result = asfloat(src1.Load4(16 * (row * (N / 4) + col)));
-    return result;
+    if (IN_N4(col))
+    {
+#ifdef PACKED_B
+        float4 result = asfloat(src1.Load4(16 * packedBIndex(row, col)));
+#else
+        float4 result = asfloat(src1.Load4(16 * (row * (LDB / 4) + col)));
+#endif
+        return result;
+    }
+    else {
+        return float4(0, 0, 0, 0);
+    }
 }
 
 void mm_write(int row, int col, float4 value) {
-    if (row < M && col < N / 4)
+    if (IN_M(row) && IN_N4(col))
     {
-        dst.Store4(16 * (row * (N / 4) + col), asuint(value));
+        dst.Store4(16 * (row * (LDC / 4) + col), asuint(value));
     }
 }
 #endif  // USE_STRUCTURED_BUFFERS
 #endif  // USE_TEXTURE
 
-groupshared float4 atile[LOCAL_GROUP_SIZE_Y * 8 * LOCAL_GROUP_SIZE_X];
+#ifndef BLOCK_SPARSE
+#define BLOCK_SPARSE 0
+#endif
+#if BLOCK_SPARSE
+// Block-sparse A and/or B. The dispatch is 1D over the tiles of C that have
+// any work, listed in tileList as x | y << 16; the host leaves the others at
+// zero. tileMask holds one row of bits per tile row of A, then one per tile
+// column of B, each (K + TILE_K0 - 1) / TILE_K0 bits long in whole words: bit
+// kt is set if the K tile kt of that row or column holds a nonzero. A K tile
+// contributes to a tile of C only if both of its bits are set.
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<uint> tileList : register(t2);
+StructuredBuffer<uint> tileMask : register(t3);
+
+uint mm_readTile(int index) {
+    return tileList[index];
+}
+
+uint mm_readMask(int index) {
+    return tileMask[index];
+}
+#else
+ByteAddressBuffer tileList : register(t2);
+ByteAddressBuffer tileMask : register(t3);
+
+uint mm_readTile(int index) {
+    return tileList.Load(4 * index);
+}
+
+uint mm_readMask(int index) {
+    return tileMask.Load(4 * index);
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+bool k_tile_occupied(int tileRow, int tileCol, int kTile) {
+    int wordsK = ((K + TILE_K0 - 1) / TILE_K0 + 31) / 32;
+    int tilesM = (M + TILE_M - 1) / TILE_M;
+    uint a = mm_readMask(tileRow * wordsK + kTile / 32);
+    uint b = mm_readMask((tilesM + tileCol) * wordsK + kTile / 32);
+    return ((a & b) >> (kTile % 32) & 1) != 0;
+}
+#endif  // BLOCK_SPARSE
+
+#ifdef CONV
+// Implicit-GEMM 2D convolution. src0 holds the input tensor instead of A, and A
+// is its im2col matrix: row m is output pixel (n, oh, ow) of M = batch * OH * OW,
+// column k a (c, kh, kw) tap of the CONV_K = KH * KW * C real ones. K itself is
+// rounded up to whole float4s; B holds the weights as K x OC with zero padding
+// rows. Each element of A is computed from the input as it's loaded, so the
+// im2col matrix is never stored. In NHWC, k = (kh * KW + kw) * C + c and C is the
+// contiguous dimension; in NCHW (CONV_NCHW), k = (c * KH + kh) * KW + kw and the
+// output is also written as NCHW.
+float conv_load(int index) {
+#ifdef USE_STRUCTURED_BUFFERS
+    return src0[index / 4][index % 4];
+#else
+    return asfloat(src0.Load(4 * index));
+#endif
+}
+
+// Input index of tap k of output pixel row, or -1 where it falls in the padding.
+int conv_index(int row, int k) {
+    int n = row / (CONV_OH * CONV_OW);
+    int oh = row / CONV_OW % CONV_OH;
+    int ow = row % CONV_OW;
+#if CONV_NCHW
+    int c = k / (CONV_KH * CONV_KW);
+    int kh = k / CONV_KW % CONV_KH;
+    int kw = k % CONV_KW;
+#else
+    int c = k % CONV_C;
+    int kh = k / CONV_C / CONV_KW;
+    int kw = k / CONV_C % CONV_KW;
+#endif
+    int ih = oh * CONV_STRIDE - CONV_PAD + kh;
+    int iw = ow * CONV_STRIDE - CONV_PAD + kw;
+    if (ih < 0 || ih >= CONV_H || iw < 0 || iw >= CONV_W) {
+        return -1;
+    }
+#if CONV_NCHW
+    return ((n * CONV_C + c) * CONV_H + ih) * CONV_W + iw;
+#else
+    return ((n * CONV_H + ih) * CONV_W + iw) * CONV_C + c;
+#endif
+}
+
+float conv_readA_scalar(int row, int k) {
+    int index = k < CONV_K ? conv_index(row, k) : -1;
+    return index >= 0 ? conv_load(index) : 0.0;
+}
+
+float4 conv_readA(int row, int col) {
+    if (!IN_M(row) || col >= K / 4) {
+        return float4(0, 0, 0, 0);
+    }
+#if !CONV_NCHW && CONV_C % 4 == 0
+    // The four taps are four consecutive channels of one input pixel.
+    int index = conv_index(row, col * 4);
+    if (index < 0) {
+        return float4(0, 0, 0, 0);
+    }
+#ifdef USE_STRUCTURED_BUFFERS
+    return src0[index / 4];
+#else
+    return asfloat(src0.Load4(4 * index));
+#endif
+#else
+    return float4(conv_readA_scalar(row, col * 4), conv_readA_scalar(row, col * 4 + 1),
+                  conv_readA_scalar(row, col * 4 + 2), conv_readA_scalar(row, col * 4 + 3));
+#endif
+}
+#define mm_readA conv_readA
+
+#if CONV_NCHW
+#ifdef USE_STRUCTURED_BUFFERS
+#error NCHW output scatters single floats, so it needs byteAddress_buffer storage.
+#endif
+// The four output channels of a float4 lie a whole OH x OW plane apart.
+void conv_write(int row, int col, float4 value) {
+    if (IN_M(row) && IN_N4(col))
+    {
+        int plane = CONV_OH * CONV_OW;
+        int base = (row / plane * N + col * 4) * plane + row % plane;
+        dst.Store(4 * base, asuint(value.x));
+        dst.Store(4 * (base + plane), asuint(value.y));
+        dst.Store(4 * (base + 2 * plane), asuint(value.z));
+        dst.Store(4 * (base + 3 * plane), asuint(value.w));
+    }
+}
+#define mm_write conv_write
+#endif  // CONV_NCHW
+#endif  // CONV
+
+#ifndef ACCUMULATE_MODE
+#define ACCUMULATE_MODE 0
+#endif
+
+// ACCUMULATE_MODE 0 chains every product into one fp32 accumulator. Mode 1 sums
+// each K tile in fp32 and folds the tile sum into the total with Kahan
+// compensation, mode 2 accumulates the tile sums in fp64.
+#if ACCUMULATE_MODE == 2
+typedef double4 acc_total4;
+#else
+typedef float4 acc_total4;
+#endif
+
+void accumulate_tile(inout acc_total4 total, inout float4 comp, float4 partial) {
+#if ACCUMULATE_MODE == 1
+    // precise keeps the compiler from folding the compensation term away.
+    precise float4 y = partial - comp;
+    precise float4 t = total + y;
+    comp = (t - total) - y;
+    total = t;
+#else
+    total += partial;
+#endif
+}
+
+// Folds the tile sum of one accumulator into its total and restarts it.
+#define FOLD_TILE(i, d) accumulate_tile(accTotal[i], accComp[i], d); d = float4(0, 0, 0, 0)
+
+// Maps the 1D group index of a RASTER dispatch to the (x, y) tile of C in a
+// tilesX x tilesY grid, in the orders of TileRasterTile() in CpuMatmul.cpp:
+// 1 column-major, 2 bands of RASTER_GROUP_M tile rows walked column by column,
+// 3 Morton, 4 Hilbert. The last two are dispatched over the power-of-two square
+// covering the grid; false marks the groups that fall outside it.
+#ifndef RASTER
+#define RASTER 0
+#endif
+#ifndef RASTER_GROUP_M
+#define RASTER_GROUP_M 8
+#endif
+int compact_bits(uint v) {
+    v &= 0x55555555;
+    v = (v | (v >> 1)) & 0x33333333;
+    v = (v | (v >> 2)) & 0x0f0f0f0f;
+    v = (v | (v >> 4)) & 0x00ff00ff;
+    v = (v | (v >> 8)) & 0x0000ffff;
+    return int(v);
+}
+
+bool raster_tile(int index, int tilesX, int tilesY, out int x, out int y) {
+#if RASTER == 1
+    x = index / tilesY;
+    y = index % tilesY;
+#elif RASTER == 2
+    int band = index / (RASTER_GROUP_M * tilesX);
+    int rows = min(RASTER_GROUP_M, tilesY - band * RASTER_GROUP_M);
+    int inBand = index - band * RASTER_GROUP_M * tilesX;
+    x = inBand / rows;
+    y = band * RASTER_GROUP_M + inBand % rows;
+#elif RASTER == 3
+    x = compact_bits(uint(index));
+    y = compact_bits(uint(index) >> 1);
+#else
+    int side = 1;
+    while (side < tilesX || side < tilesY) {
+        side *= 2;
+    }
+    int t = index;
+    x = 0;
+    y = 0;
+    for (int s = 1; s < side; s *= 2) {
+        int rx = 1 & (t / 2);
+        int ry = 1 & (t ^ rx);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            int swap = x;
+            x = y;
+            y = swap;
+        }
+        x += s * rx;
+        y += s * ry;
+        t /= 4;
+    }
+#endif
+    return x < tilesX && y < tilesY;
+}
+
+#define ATILE_SIZE (LOCAL_GROUP_SIZE_Y * 8 * LOCAL_GROUP_SIZE_X)
+groupshared float4 atile[(DOUBLE_BUFFER + 1) * ATILE_SIZE];
 [numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
 void CSMain(CS_INPUT input)
 {
@@ -118,6 +408,33 @@ void CSMain(CS_INPUT input)
 
     int group_x = int(gl_WorkGroupID.x);
     int group_y = int(gl_WorkGroupID.y);
+#if EDGE_TILES
+    // A 1D dispatch over the partial tiles, in the order of EdgeTileOrigin() in
+    // CpuMatmul.cpp: the tiles on the N edge above the corner, then the M edge.
+    int fullTilesX = N / TILE_N;
+    int fullTilesY = M / TILE_M;
+    int nEdgeTiles = (N % TILE_N != 0) ? fullTilesY : 0;
+    if (group_x < nEdgeTiles) {
+        group_y = group_x;
+        group_x = fullTilesX;
+    }
+    else {
+        group_x -= nEdgeTiles;
+        group_y = fullTilesY;
+    }
+#elif BLOCK_SPARSE
+    uint tile = mm_readTile(group_x);
+    group_x = int(tile & 0xffff);
+    group_y = int(tile >> 16);
+#elif RASTER != 0
+    // The grid is the full tiles only when the edges run in their own dispatch.
+    int tilesX = BOUNDS_CHECK ? (N + TILE_N - 1) / TILE_N : N / TILE_N;
+    int tilesY = BOUNDS_CHECK ? (M + TILE_M - 1) / TILE_M : M / TILE_M;
+    int index = group_x;
+    if (!raster_tile(index, tilesX, tilesY, group_x, group_y)) {
+        return;
+    }
+#endif
     int local_x = int(gl_LocalInvocationID.x);
     int local_y = int(gl_LocalInvocationID.y);
 
@@ -141,6 +458,14 @@ void CSMain(CS_INPUT input)
     float4 dot15 = {0, 0, 0, 0};
     float4 dot16 = {0, 0, 0, 0};
     float4 dot17 = {0, 0, 0, 0};
+#if ACCUMULATE_MODE != 0
+    acc_total4 accTotal[16];
+    float4 accComp[16];
+    for (int a = 0; a < 16; a++) {
+        accTotal[a] = (acc_total4)0;
+        accComp[a] = float4(0, 0, 0, 0);
+    }
+#endif
 
     // Src0 is used to load atile.
     // It starts at the left side of src0 and walks across.
@@ -159,9 +484,56 @@ void CSMain(CS_INPUT input)
 
     int slm = local_y * ( ROWS_PER_WI * TILE_K0 / VEC_SIZE );
 
+#if DOUBLE_BUFFER
+    // The first tile goes into the first half before the loop.
+    atile[slm + local_x + 0 * TILE_K0 / VEC_SIZE] = mm_readA(globalRow, globalColA);
+    atile[slm + local_x + 1 * TILE_K0 / VEC_SIZE] = mm_readA(globalRow + 1, globalColA);
+    atile[slm + local_x + 2 * TILE_K0 / VEC_SIZE] = mm_readA(globalRow + 2, globalColA);
+    atile[slm + local_x + 3 * TILE_K0 / VEC_SIZE] = mm_readA(globalRow + 3, globalColA);
+    atile[slm + local_x + 4 * TILE_K0 / VEC_SIZE] = mm_readA(globalRow + 4, globalColA);
+    atile[slm + local_x + 5 * TILE_K0 / VEC_SIZE] = mm_readA(globalRow + 5, globalColA);
+    atile[slm + local_x + 6 * TILE_K0 / VEC_SIZE] = mm_readA(globalRow + 6, globalColA);
+    atile[slm + local_x + 7 * TILE_K0 / VEC_SIZE] = mm_readA(globalRow + 7, globalColA);
+    globalColA += TILE_K / VEC_SIZE;
+    GroupMemoryBarrierWithGroupSync();
+#endif
+
     // Walk ACROSS src0 and DOWN src1:
     int w = 0;
     do{
+#if BLOCK_SPARSE
+      // The bits are the same for the whole group, so the barriers below stay
+      // in uniform control flow.
+      if (!k_tile_occupied(group_y, group_x, w / (TILE_K0 / VEC_SIZE))) {
+          globalColA += TILE_K / VEC_SIZE;
+          rowB0 += TILE_K0;
+          rowB1 += TILE_K0;
+          w += TILE_K0 / VEC_SIZE;
+          continue;
+      }
+#endif
+#if DOUBLE_BUFFER
+      bool hasNext = w + TILE_K0 / VEC_SIZE < width0;
+      float4 anext0 = float4(0, 0, 0, 0);
+      float4 anext1 = float4(0, 0, 0, 0);
+      float4 anext2 = float4(0, 0, 0, 0);
+      float4 anext3 = float4(0, 0, 0, 0);
+      float4 anext4 = float4(0, 0, 0, 0);
+      float4 anext5 = float4(0, 0, 0, 0);
+      float4 anext6 = float4(0, 0, 0, 0);
+      float4 anext7 = float4(0, 0, 0, 0);
+      if (hasNext) {
+          anext0 = mm_readA(globalRow, globalColA);
+          anext1 = mm_readA(globalRow + 1, globalColA);
+          anext2 = mm_readA(globalRow + 2, globalColA);
+          anext3 = mm_readA(globalRow + 3, globalColA);
+          anext4 = mm_readA(globalRow + 4, globalColA);
+          anext5 = mm_readA(globalRow + 5, globalColA);
+          anext6 = mm_readA(globalRow + 6, globalColA);
+          anext7 = mm_readA(globalRow + 7, globalColA);
+      }
+      globalColA += TILE_K / VEC_SIZE;
+#else
       // We want to load atile, which is M rows x K columns
       // M = 32, and we have 4 rows of work-items, so each work-item must load 32/4 = 8 rows.
       // K = 64, and we have 16 columns of work-items, so each work-item must load 64/16 = 4 columns = 1 float4.
@@ -177,6 +549,7 @@ void CSMain(CS_INPUT input)
       globalColA += TILE_K / VEC_SIZE;
 
       GroupMemoryBarrierWithGroupSync();
+#endif
 
       int i = 0;
       do{
@@ -274,11 +647,62 @@ void CSMain(CS_INPUT input)
       }
       while( i < TILE_K0 / VEC_SIZE );
 
+#if DOUBLE_BUFFER
+      // Store the next tile to the other half. The barrier below publishes it
+      // and, as every thread is then done with this half, frees it for the tile after.
+      slm = slm < ATILE_SIZE ? slm + ATILE_SIZE : slm - ATILE_SIZE;
+      if (hasNext) {
+          atile[slm + local_x + 0 * TILE_K0 / VEC_SIZE] = anext0;
+          atile[slm + local_x + 1 * TILE_K0 / VEC_SIZE] = anext1;
+          atile[slm + local_x + 2 * TILE_K0 / VEC_SIZE] = anext2;
+          atile[slm + local_x + 3 * TILE_K0 / VEC_SIZE] = anext3;
+          atile[slm + local_x + 4 * TILE_K0 / VEC_SIZE] = anext4;
+          atile[slm + local_x + 5 * TILE_K0 / VEC_SIZE] = anext5;
+          atile[slm + local_x + 6 * TILE_K0 / VEC_SIZE] = anext6;
+          atile[slm + local_x + 7 * TILE_K0 / VEC_SIZE] = anext7;
+      }
+#endif
       GroupMemoryBarrierWithGroupSync();
+#if ACCUMULATE_MODE != 0
+      FOLD_TILE(0, dot00);
+      FOLD_TILE(1, dot01);
+      FOLD_TILE(2, dot02);
+      FOLD_TILE(3, dot03);
+      FOLD_TILE(4, dot04);
+      FOLD_TILE(5, dot05);
+      FOLD_TILE(6, dot06);
+      FOLD_TILE(7, dot07);
+      FOLD_TILE(8, dot10);
+      FOLD_TILE(9, dot11);
+      FOLD_TILE(10, dot12);
+      FOLD_TILE(11, dot13);
+      FOLD_TILE(12, dot14);
+      FOLD_TILE(13, dot15);
+      FOLD_TILE(14, dot16);
+      FOLD_TILE(15, dot17);
+#endif
 
       w += TILE_K0 / VEC_SIZE;
     }
     while( w < width0 );
+#if ACCUMULATE_MODE != 0
+    dot00 = float4(accTotal[0]);
+    dot01 = float4(accTotal[1]);
+    dot02 = float4(accTotal[2]);
+    dot03 = float4(accTotal[3]);
+    dot04 = float4(accTotal[4]);
+    dot05 = float4(accTotal[5]);
+    dot06 = float4(accTotal[6]);
+    dot07 = float4(accTotal[7]);
+    dot10 = float4(accTotal[8]);
+    dot11 = float4(accTotal[9]);
+    dot12 = float4(accTotal[10]);
+    dot13 = float4(accTotal[11]);
+    dot14 = float4(accTotal[12]);
+    dot15 = float4(accTotal[13]);
+    dot16 = float4(accTotal[14]);
+    dot17 = float4(accTotal[15]);
+#endif
 
     mm_write(globalRow, globalCol0, dot00);
     mm_write(globalRow + 1, globalCol0, dot01);
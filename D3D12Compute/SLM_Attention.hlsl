@@ -0,0 +1,167 @@
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;
+    int K;
+    int N;
+    int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
+}
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+};
+
+// Q is M x N in src0, the keys and values are K x N in src1 and src2, and O is
+// M x N in dst. N is the head dimension and K the number of keys.
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<float> src0 : register(t0);
+StructuredBuffer<float> src1 : register(t1);
+StructuredBuffer<float> src2 : register(t2);
+RWStructuredBuffer<float> dst : register(u0);
+
+float mm_readA(int row, int col) {
+    return row < M ? src0[row * N + col] : 0.0;
+}
+
+float mm_readB(int row, int col) {
+    return row < K ? src1[row * N + col] : 0.0;
+}
+
+float mm_readV(int row, int col) {
+    return row < K ? src2[row * N + col] : 0.0;
+}
+
+void mm_write(int row, int col, float value) {
+    if (row < M) {
+        dst[row * LDC + col] = value;
+    }
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+ByteAddressBuffer src1 : register(t1);
+ByteAddressBuffer src2 : register(t2);
+RWByteAddressBuffer dst : register(u0);
+
+float mm_readA(int row, int col) {
+    return row < M ? asfloat(src0.Load(4 * (row * N + col))) : 0.0;
+}
+
+float mm_readB(int row, int col) {
+    return row < K ? asfloat(src1.Load(4 * (row * N + col))) : 0.0;
+}
+
+float mm_readV(int row, int col) {
+    return row < K ? asfloat(src2.Load(4 * (row * N + col))) : 0.0;
+}
+
+void mm_write(int row, int col, float value) {
+    if (row < M) {
+        dst.Store(4 * (row * LDC + col), asuint(value));
+    }
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+// Fused attention O = softmax(Q K^T / sqrt(N)) V for one head. A group owns
+// BLOCK_M query rows and walks the keys BLOCK_N at a time: the block of scores
+// lives in groupshared memory only, and an online softmax keeps a running
+// maximum and sum per row, rescaling what was accumulated into O whenever the
+// maximum grows. So the M x K score matrix that two separate GEMMs would write
+// out, and a softmax pass would read and write again, never reaches memory.
+// Each thread owns 4 query rows at a stride of LOCAL_GROUP_SIZE_Y and
+// HEAD_DIM / LOCAL_GROUP_SIZE_X columns of O at a stride of LOCAL_GROUP_SIZE_X.
+#define HEAD_DIM ATTENTION_HEAD_DIM
+#define BLOCK_M (LOCAL_GROUP_SIZE_Y * 4)
+#define BLOCK_N LOCAL_GROUP_SIZE_X
+#define COLS_PER_THREAD (HEAD_DIM / LOCAL_GROUP_SIZE_X)
+#define GROUP_THREADS (LOCAL_GROUP_SIZE_X * LOCAL_GROUP_SIZE_Y)
+// Score of a key past K. exp() of it minus any real maximum is 0, without the
+// NaN that -inf - -inf would give.
+#define MASKED_SCORE -1e30
+
+groupshared float mm_Qsub[BLOCK_M][HEAD_DIM];
+// The threads of a row read different keys, so the key rows are padded by one
+// float to fall in different banks.
+groupshared float mm_Ksub[BLOCK_N][HEAD_DIM + 1];
+groupshared float mm_Vsub[BLOCK_N][HEAD_DIM];
+groupshared float mm_Ssub[BLOCK_M][BLOCK_N];
+
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    int row0 = int(input.dx_WorkGroupID.x) * BLOCK_M;
+    int localRow = int(input.dx_LocalInvocationID.y);
+    int localCol = int(input.dx_LocalInvocationID.x);
+    int localIndex = localRow * LOCAL_GROUP_SIZE_X + localCol;
+
+    // Q is loaded once, with the 1 / sqrt(N) of the scores folded in.
+    float scale = rsqrt(float(HEAD_DIM));
+    for (int i = localIndex; i < BLOCK_M * HEAD_DIM; i += GROUP_THREADS) {
+      mm_Qsub[i / HEAD_DIM][i % HEAD_DIM] = mm_readA(row0 + i / HEAD_DIM, i % HEAD_DIM) * scale;
+    }
+
+    float acc[4][COLS_PER_THREAD];
+    float rowMax[4];
+    float rowSum[4];
+    for (int r = 0; r < 4; r++) {
+      rowMax[r] = MASKED_SCORE;
+      rowSum[r] = 0.0;
+      for (int c = 0; c < COLS_PER_THREAD; c++) {
+        acc[r][c] = 0.0;
+      }
+    }
+
+    for (int key0 = 0; key0 < K; key0 += BLOCK_N) {
+      for (int i = localIndex; i < BLOCK_N * HEAD_DIM; i += GROUP_THREADS) {
+        mm_Ksub[i / HEAD_DIM][i % HEAD_DIM] = mm_readB(key0 + i / HEAD_DIM, i % HEAD_DIM);
+        mm_Vsub[i / HEAD_DIM][i % HEAD_DIM] = mm_readV(key0 + i / HEAD_DIM, i % HEAD_DIM);
+      }
+      GroupMemoryBarrierWithGroupSync();
+
+      // Scores of this thread's rows against key localCol of the block.
+      for (int r = 0; r < 4; r++) {
+        int tileRow = localRow + r * LOCAL_GROUP_SIZE_Y;
+        float s = 0.0;
+        for (int d = 0; d < HEAD_DIM; d++) {
+          s += mm_Qsub[tileRow][d] * mm_Ksub[localCol][d];
+        }
+        mm_Ssub[tileRow][localCol] = key0 + localCol < K ? s : MASKED_SCORE;
+      }
+      GroupMemoryBarrierWithGroupSync();
+
+      // Every thread of a row works out the row's maximum and probabilities
+      // itself, which costs BLOCK_N exps per row but no further barrier.
+      for (int r = 0; r < 4; r++) {
+        int tileRow = localRow + r * LOCAL_GROUP_SIZE_Y;
+        float blockMax = rowMax[r];
+        for (int j = 0; j < BLOCK_N; j++) {
+          blockMax = max(blockMax, mm_Ssub[tileRow][j]);
+        }
+        float correction = exp(rowMax[r] - blockMax);
+        rowSum[r] *= correction;
+        for (int c = 0; c < COLS_PER_THREAD; c++) {
+          acc[r][c] *= correction;
+        }
+        for (int j = 0; j < BLOCK_N; j++) {
+          float p = exp(mm_Ssub[tileRow][j] - blockMax);
+          rowSum[r] += p;
+          for (int c = 0; c < COLS_PER_THREAD; c++) {
+            acc[r][c] += p * mm_Vsub[j][localCol + c * LOCAL_GROUP_SIZE_X];
+          }
+        }
+        rowMax[r] = blockMax;
+      }
+      GroupMemoryBarrierWithGroupSync();
+    }
+
+    for (int r = 0; r < 4; r++) {
+      int tileRow = localRow + r * LOCAL_GROUP_SIZE_Y;
+      for (int c = 0; c < COLS_PER_THREAD; c++) {
+        mm_write(row0 + tileRow, localCol + c * LOCAL_GROUP_SIZE_X, acc[r][c] / rowSum[r]);
+      }
+    }
+}
@@ -0,0 +1,170 @@
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;
+    int K;
+    int N;
+    int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
+}
+
+static uint3 gl_WorkGroupID = uint3(0, 0, 0);
+static uint3 gl_LocalInvocationID = uint3(0, 0, 0);
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+};
+
+void initGLBuiltins(CS_INPUT input)
+{
+    gl_WorkGroupID = input.dx_WorkGroupID;
+    gl_LocalInvocationID = input.dx_LocalInvocationID;
+};
+
+// A, B and C hold doubles. Raw buffers address them as two uints each.
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<double> src0 : register(t0);
+StructuredBuffer<double> src1 : register(t1);
+RWStructuredBuffer<double> dst : register(u0);
+
+double mm_readA(int row, int col) {
+    if (row < M && col < K)
+    {
+        return src0[row * LDA + col];
+    }
+    else {
+        return 0.0;
+    }
+}
+
+double mm_readB(int row, int col) {
+    if (row < K && col < N)
+    {
+        return src1[row * LDB + col];
+    }
+    else {
+        return 0.0;
+    }
+}
+
+void mm_write(int row, int col, double value) {
+    if (row < M && col < N)
+    {
+        dst[row * LDC + col] = value;
+    }
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+ByteAddressBuffer src1 : register(t1);
+RWByteAddressBuffer dst : register(u0);
+
+double mm_readA(int row, int col) {
+    if (row < M && col < K)
+    {
+        uint2 bits = src0.Load2(8 * (row * LDA + col));
+        return asdouble(bits.x, bits.y);
+    }
+    else {
+        return 0.0;
+    }
+}
+
+double mm_readB(int row, int col) {
+    if (row < K && col < N)
+    {
+        uint2 bits = src1.Load2(8 * (row * LDB + col));
+        return asdouble(bits.x, bits.y);
+    }
+    else {
+        return 0.0;
+    }
+}
+
+void mm_write(int row, int col, double value) {
+    if (row < M && col < N)
+    {
+        uint2 bits;
+        asuint(value, bits.x, bits.y);
+        dst.Store2(8 * (row * LDC + col), bits);
+    }
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+static const int RowPerThread = WORK_PER_THREAD_Y;
+static const int ColPerThread = WORK_PER_THREAD_X;
+static const int TileM = LOCAL_GROUP_SIZE_Y * WORK_PER_THREAD_Y;
+static const int TileN = LOCAL_GROUP_SIZE_X * WORK_PER_THREAD_X;
+// Doubles take twice the shared memory of floats, so the K tile is shorter
+// than in the fp32 kernels to stay within 32 KB at 8x8 work per thread.
+#define DTILE_K 16
+
+// A rows are padded by one element so the threads of a column hit different banks.
+groupshared double mm_Asub[TileM][DTILE_K + 1];
+groupshared double mm_Bsub[DTILE_K][TileN];
+
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    initGLBuiltins(input);
+    int localX = int(gl_LocalInvocationID.x);
+    int localY = int(gl_LocalInvocationID.y);
+    int localIndex = localY * LOCAL_GROUP_SIZE_X + localX;
+    int tileRowStart = int(gl_WorkGroupID.y) * TileM;
+    int tileColStart = int(gl_WorkGroupID.x) * TileN;
+
+    // Each thread owns rows localY + i * LOCAL_GROUP_SIZE_Y and columns
+    // localX + j * LOCAL_GROUP_SIZE_X of the tile so that writes stay coalesced.
+    double acc[WORK_PER_THREAD_Y][WORK_PER_THREAD_X];
+    for (int i = 0; i < RowPerThread; i++) {
+        for (int j = 0; j < ColPerThread; j++) {
+            acc[i][j] = 0.0;
+        }
+    }
+
+    int numTiles = (K + DTILE_K - 1) / DTILE_K;
+    for (int t = 0; t < numTiles; t++) {
+        for (int index = localIndex; index < TileM * DTILE_K; index += LOCAL_GROUP_SIZE_X * LOCAL_GROUP_SIZE_Y) {
+            int row = index / DTILE_K;
+            int col = index % DTILE_K;
+            mm_Asub[row][col] = mm_readA(tileRowStart + row, t * DTILE_K + col);
+        }
+        for (int index = localIndex; index < DTILE_K * TileN; index += LOCAL_GROUP_SIZE_X * LOCAL_GROUP_SIZE_Y) {
+            int row = index / TileN;
+            int col = index % TileN;
+            mm_Bsub[row][col] = mm_readB(t * DTILE_K + row, tileColStart + col);
+        }
+
+        GroupMemoryBarrierWithGroupSync();
+
+        for (int k = 0; k < DTILE_K; k++) {
+            double ACached[WORK_PER_THREAD_Y];
+            double BCached[WORK_PER_THREAD_X];
+            for (int i = 0; i < RowPerThread; i++) {
+                ACached[i] = mm_Asub[localY + i * LOCAL_GROUP_SIZE_Y][k];
+            }
+            for (int j = 0; j < ColPerThread; j++) {
+                BCached[j] = mm_Bsub[k][localX + j * LOCAL_GROUP_SIZE_X];
+            }
+            for (int i = 0; i < RowPerThread; i++) {
+                for (int j = 0; j < ColPerThread; j++) {
+                    // fma() needs the separate fp64 fused multiply-add cap, so use mul + add.
+                    acc[i][j] += ACached[i] * BCached[j];
+                }
+            }
+        }
+
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    for (int i = 0; i < RowPerThread; i++) {
+        for (int j = 0; j < ColPerThread; j++) {
+            mm_write(tileRowStart + localY + i * LOCAL_GROUP_SIZE_Y,
+                     tileColStart + localX + j * LOCAL_GROUP_SIZE_X,
+                     acc[i][j]);
+        }
+    }
+}
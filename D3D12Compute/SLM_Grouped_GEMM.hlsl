@@ -0,0 +1,145 @@
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;
+    int K;
+    int N;
+    int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
+}
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+};
+
+// Grouped GEMM: C_i[M_i,N] = A_i[M_i,K] * B_i[K,N] for every problem i in one
+// dispatch. src0 holds the A_i stacked (M rows in all), src1 the B_i stacked
+// (K rows each) and dst the C_i stacked like A. Problem i is
+// (first row of A_i and C_i, M_i, first row of B_i, 0) in problems, and group g
+// computes the tile tiles[g] = (problem, x | y << 16), so the host only
+// launches the tiles that the problems have, however uneven their M_i.
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<float> src0 : register(t0);
+StructuredBuffer<float> src1 : register(t1);
+StructuredBuffer<uint2> tiles : register(t2);
+StructuredBuffer<int4> problems : register(t3);
+RWStructuredBuffer<float> dst : register(u0);
+
+float mm_readA(int row, int rowEnd, int col) {
+    return row < rowEnd && col < K ? src0[row * LDA + col] : 0.0;
+}
+
+float mm_readB(int row, int col) {
+    return col < N ? src1[row * LDB + col] : 0.0;
+}
+
+uint2 mm_readTile(int index) {
+    return tiles[index];
+}
+
+int4 mm_readProblem(int index) {
+    return problems[index];
+}
+
+void mm_write(int row, int col, float value) {
+    dst[row * LDC + col] = value;
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+ByteAddressBuffer src1 : register(t1);
+ByteAddressBuffer tiles : register(t2);
+ByteAddressBuffer problems : register(t3);
+RWByteAddressBuffer dst : register(u0);
+
+float mm_readA(int row, int rowEnd, int col) {
+    return row < rowEnd && col < K ? asfloat(src0.Load(4 * (row * LDA + col))) : 0.0;
+}
+
+float mm_readB(int row, int col) {
+    return col < N ? asfloat(src1.Load(4 * (row * LDB + col))) : 0.0;
+}
+
+uint2 mm_readTile(int index) {
+    return tiles.Load2(8 * index);
+}
+
+int4 mm_readProblem(int index) {
+    return asint(problems.Load4(16 * index));
+}
+
+void mm_write(int row, int col, float value) {
+    dst.Store(4 * (row * LDC + col), asuint(value));
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+// The tiles are those of SLM_Stream_K.hlsl: each thread owns a 4x4 block of
+// the TILE_M x TILE_N tile at a stride of the group size, and K is walked
+// GROUPED_DEPTH values at a time through groupshared memory.
+#define TILE_M (LOCAL_GROUP_SIZE_Y * 4)
+#define TILE_N (LOCAL_GROUP_SIZE_X * 4)
+#define GROUP_THREADS (LOCAL_GROUP_SIZE_X * LOCAL_GROUP_SIZE_Y)
+#define GROUPED_DEPTH 16
+
+groupshared float mm_Asub[TILE_M][GROUPED_DEPTH];
+groupshared float mm_Bsub[GROUPED_DEPTH][TILE_N];
+
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    int localRow = int(input.dx_LocalInvocationID.y);
+    int localCol = int(input.dx_LocalInvocationID.x);
+    int localIndex = localRow * LOCAL_GROUP_SIZE_X + localCol;
+
+    uint2 tile = mm_readTile(int(input.dx_WorkGroupID.x));
+    int4 problem = mm_readProblem(int(tile.x));
+    int row0 = problem.x + int(tile.y >> 16) * TILE_M;
+    int rowEnd = problem.x + problem.y;
+    int col0 = int(tile.y & 0xffff) * TILE_N;
+    int bRow0 = problem.z;
+
+    float acc[4][4];
+    for (int r = 0; r < 4; r++) {
+      for (int c = 0; c < 4; c++) {
+        acc[r][c] = 0.0;
+      }
+    }
+
+    for (int k0 = 0; k0 < K; k0 += GROUPED_DEPTH) {
+      for (int i = localIndex; i < TILE_M * GROUPED_DEPTH; i += GROUP_THREADS) {
+        mm_Asub[i / GROUPED_DEPTH][i % GROUPED_DEPTH] = mm_readA(row0 + i / GROUPED_DEPTH, rowEnd, k0 + i % GROUPED_DEPTH);
+      }
+      for (int i = localIndex; i < GROUPED_DEPTH * TILE_N; i += GROUP_THREADS) {
+        int k = k0 + i / TILE_N;
+        mm_Bsub[i / TILE_N][i % TILE_N] = k < K ? mm_readB(bRow0 + k, col0 + i % TILE_N) : 0.0;
+      }
+      GroupMemoryBarrierWithGroupSync();
+
+      for (int kk = 0; kk < GROUPED_DEPTH; kk++) {
+        float b[4];
+        for (int c = 0; c < 4; c++) {
+          b[c] = mm_Bsub[kk][localCol + c * LOCAL_GROUP_SIZE_X];
+        }
+        for (int r = 0; r < 4; r++) {
+          float a = mm_Asub[localRow + r * LOCAL_GROUP_SIZE_Y][kk];
+          for (int c = 0; c < 4; c++) {
+            acc[r][c] += a * b[c];
+          }
+        }
+      }
+      GroupMemoryBarrierWithGroupSync();
+    }
+
+    for (int r = 0; r < 4; r++) {
+      for (int c = 0; c < 4; c++) {
+        int row = row0 + localRow + r * LOCAL_GROUP_SIZE_Y;
+        int col = col0 + localCol + c * LOCAL_GROUP_SIZE_X;
+        if (row < rowEnd && col < N) {
+          mm_write(row, col, acc[r][c]);
+        }
+      }
+    }
+}
@@ -0,0 +1,227 @@
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;
+    int K;
+    int N;
+    int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
+}
+
+static uint3 gl_WorkGroupID = uint3(0, 0, 0);
+static uint3 gl_LocalInvocationID = uint3(0, 0, 0);
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+};
+
+void initGLBuiltins(CS_INPUT input)
+{
+    gl_WorkGroupID = input.dx_WorkGroupID;
+    gl_LocalInvocationID = input.dx_LocalInvocationID;
+};
+
+// Per-row (A) / per-column (B) quantization parameters, see QuantParams in CpuMatmul.h.
+struct QuantParams
+{
+    float scale;
+    int zeroPoint;
+    int sum;
+    int reserved;
+};
+
+// A is M x K int8 and B is stored transposed as N x K int8, so both operands
+// pack four consecutive K values into one uint. mm_readA/mm_readB index in uints.
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<uint> src0 : register(t0);
+StructuredBuffer<uint> src1 : register(t1);
+StructuredBuffer<QuantParams> srcParamsA : register(t2);
+StructuredBuffer<QuantParams> srcParamsB : register(t3);
+RWStructuredBuffer<float> dst : register(u0);
+
+uint mm_readA(int row, int col) {
+    if (row < M && col < K / 4)
+    {
+        return src0[row * (LDA / 4) + col];
+    }
+    else {
+        return 0;
+    }
+}
+
+uint mm_readB(int row, int col) {
+    if (row < N && col < K / 4)
+    {
+        return src1[row * (LDB / 4) + col];
+    }
+    else {
+        return 0;
+    }
+}
+
+QuantParams mm_readParamsA(int row) {
+    return srcParamsA[min(row, M - 1)];
+}
+
+QuantParams mm_readParamsB(int col) {
+    return srcParamsB[min(col, N - 1)];
+}
+
+void mm_write(int row, int col, float value) {
+    if (row < M && col < N)
+    {
+        dst[row * LDC + col] = value;
+    }
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+ByteAddressBuffer src1 : register(t1);
+ByteAddressBuffer srcParamsA : register(t2);
+ByteAddressBuffer srcParamsB : register(t3);
+RWByteAddressBuffer dst : register(u0);
+
+uint mm_readA(int row, int col) {
+    if (row < M && col < K / 4)
+    {
+        return src0.Load(4 * (row * (LDA / 4) + col));
+    }
+    else {
+        return 0;
+    }
+}
+
+uint mm_readB(int row, int col) {
+    if (row < N && col < K / 4)
+    {
+        return src1.Load(4 * (row * (LDB / 4) + col));
+    }
+    else {
+        return 0;
+    }
+}
+
+QuantParams LoadParams(uint4 raw) {
+    QuantParams params;
+    params.scale = asfloat(raw.x);
+    params.zeroPoint = asint(raw.y);
+    params.sum = asint(raw.z);
+    params.reserved = 0;
+    return params;
+}
+
+QuantParams mm_readParamsA(int row) {
+    return LoadParams(srcParamsA.Load4(16 * min(row, M - 1)));
+}
+
+QuantParams mm_readParamsB(int col) {
+    return LoadParams(srcParamsB.Load4(16 * min(col, N - 1)));
+}
+
+void mm_write(int row, int col, float value) {
+    if (row < M && col < N)
+    {
+        dst.Store(4 * (row * LDC + col), asuint(value));
+    }
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+// Dot product of four packed signed bytes.
+int dot4(uint a, uint b) {
+#ifdef USE_DOT4ADD
+    // Shader model 6.4 exposes the packed instruction directly.
+    return dot4add_i8packed(a, b, 0);
+#else
+    int4 va = int4(int(a << 24), int(a << 16), int(a << 8), int(a)) >> 24;
+    int4 vb = int4(int(b << 24), int(b << 16), int(b << 8), int(b)) >> 24;
+    return dot(va, vb);
+#endif
+}
+
+// sum((a - za) * (b - zb)) = sum(a * b) - zb * sum(a) - za * sum(b) + K * za * zb,
+// then scaled back to fp32.
+float dequantize(QuantParams pa, QuantParams pb, int acc) {
+    int value = acc - pb.zeroPoint * pa.sum - pa.zeroPoint * pb.sum + K * pa.zeroPoint * pb.zeroPoint;
+    return pa.scale * pb.scale * float(value);
+}
+
+static const int RowPerThread = 4;
+static const int ColPerThread = 4;
+static const int TileM = LOCAL_GROUP_SIZE_Y * 4;
+static const int TileN = LOCAL_GROUP_SIZE_X * 4;
+// 64 int8 values of K per tile, 4 per uint.
+#define TILE_K4 16
+
+// Rows are padded by one uint so the threads of a row hit different banks.
+groupshared uint mm_Asub[LOCAL_GROUP_SIZE_Y * 4][TILE_K4 + 1];
+groupshared uint mm_Bsub[LOCAL_GROUP_SIZE_X * 4][TILE_K4 + 1];
+
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    initGLBuiltins(input);
+    int localX = int(gl_LocalInvocationID.x);
+    int localY = int(gl_LocalInvocationID.y);
+    int localIndex = localY * LOCAL_GROUP_SIZE_X + localX;
+    int tileRowStart = int(gl_WorkGroupID.y) * TileM;
+    int tileColStart = int(gl_WorkGroupID.x) * TileN;
+
+    // Each thread owns rows localY + i * LOCAL_GROUP_SIZE_Y and columns
+    // localX + j * LOCAL_GROUP_SIZE_X of the tile so that writes stay coalesced.
+    int acc[4][4];
+    for (int i = 0; i < RowPerThread; i++) {
+        for (int j = 0; j < ColPerThread; j++) {
+            acc[i][j] = 0;
+        }
+    }
+
+    int numTiles = (K / 4 + TILE_K4 - 1) / TILE_K4;
+    for (int t = 0; t < numTiles; t++) {
+        for (int index = localIndex; index < TileM * TILE_K4; index += LOCAL_GROUP_SIZE_X * LOCAL_GROUP_SIZE_Y) {
+            int row = index / TILE_K4;
+            int col = index % TILE_K4;
+            mm_Asub[row][col] = mm_readA(tileRowStart + row, t * TILE_K4 + col);
+        }
+        for (int index = localIndex; index < TileN * TILE_K4; index += LOCAL_GROUP_SIZE_X * LOCAL_GROUP_SIZE_Y) {
+            int row = index / TILE_K4;
+            int col = index % TILE_K4;
+            mm_Bsub[row][col] = mm_readB(tileColStart + row, t * TILE_K4 + col);
+        }
+
+        GroupMemoryBarrierWithGroupSync();
+
+        for (int k = 0; k < TILE_K4; k++) {
+            uint ACached[4];
+            uint BCached[4];
+            for (int i = 0; i < RowPerThread; i++) {
+                ACached[i] = mm_Asub[localY + i * LOCAL_GROUP_SIZE_Y][k];
+            }
+            for (int j = 0; j < ColPerThread; j++) {
+                BCached[j] = mm_Bsub[localX + j * LOCAL_GROUP_SIZE_X][k];
+            }
+            for (int i = 0; i < RowPerThread; i++) {
+                for (int j = 0; j < ColPerThread; j++) {
+                    acc[i][j] += dot4(ACached[i], BCached[j]);
+                }
+            }
+        }
+
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    QuantParams paramsB[4];
+    for (int j = 0; j < ColPerThread; j++) {
+        paramsB[j] = mm_readParamsB(tileColStart + localX + j * LOCAL_GROUP_SIZE_X);
+    }
+    for (int i = 0; i < RowPerThread; i++) {
+        int row = tileRowStart + localY + i * LOCAL_GROUP_SIZE_Y;
+        QuantParams paramsA = mm_readParamsA(row);
+        for (int j = 0; j < ColPerThread; j++) {
+            int col = tileColStart + localX + j * LOCAL_GROUP_SIZE_X;
+            mm_write(row, col, dequantize(paramsA, paramsB[j], acc[i][j]));
+        }
+    }
+}
@@ -0,0 +1,145 @@
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;
+    int K;
+    int N;
+    int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
+}
+
+static uint3 gl_WorkGroupID = uint3(0, 0, 0);
+static uint3 gl_LocalInvocationID = uint3(0, 0, 0);
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+};
+
+void initGLBuiltins(CS_INPUT input)
+{
+    gl_WorkGroupID = input.dx_WorkGroupID;
+    gl_LocalInvocationID = input.dx_LocalInvocationID;
+};
+
+// B is the K x 1 vector, so its row stride LDB is the distance between elements.
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<float> src0 : register(t0);
+StructuredBuffer<float> src1 : register(t1);
+RWStructuredBuffer<float> dst : register(u0);
+
+float mm_readA(int row, int col) {
+    return src0[row * LDA + col];
+}
+
+float mm_readB(int row) {
+    if (row < K)
+    {
+        return src1[row * LDB];
+    }
+    else {
+        return 0.0;
+    }
+}
+
+void mm_write(int row, float value) {
+    dst[row * LDC] = value;
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+ByteAddressBuffer src1 : register(t1);
+RWByteAddressBuffer dst : register(u0);
+
+float mm_readA(int row, int col) {
+    return asfloat(src0.Load(4 * (row * LDA + col)));
+}
+
+float mm_readB(int row) {
+    if (row < K)
+    {
+        return asfloat(src1.Load(4 * (row * LDB)));
+    }
+    else {
+        return 0.0;
+    }
+}
+
+void mm_write(int row, float value) {
+    dst.Store(4 * (row * LDC), asuint(value));
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+// C[M, 1] = A[M, K] * B[K, 1]. A group computes LOCAL_GROUP_SIZE_Y rows, and the
+// LOCAL_GROUP_SIZE_X threads of a row walk it together so the reads of A coalesce.
+//
+// B is staged through groupshared memory GEMV_CHUNK_K values at a time, double
+// buffered as in SLM_Matmul_vector_matrix_chunked.hlsl, so K is unbounded.
+#define GEMV_CHUNK_K 1024
+static const int GroupSize = LOCAL_GROUP_SIZE_X * LOCAL_GROUP_SIZE_Y;
+static const int PrefetchPerThread = (GEMV_CHUNK_K + GroupSize - 1) / GroupSize;
+
+groupshared float mm_Bsub[2][GEMV_CHUNK_K];
+groupshared float mm_partial[LOCAL_GROUP_SIZE_Y][LOCAL_GROUP_SIZE_X];
+
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    initGLBuiltins(input);
+
+    int localX = int(gl_LocalInvocationID.x);
+    int localY = int(gl_LocalInvocationID.y);
+    int localIndex = localY * LOCAL_GROUP_SIZE_X + localX;
+    int globalRow = int(gl_WorkGroupID.x) * LOCAL_GROUP_SIZE_Y + localY;
+    bool active = globalRow < M;
+
+    for (int p = 0; p < PrefetchPerThread; p++) {
+        int index = localIndex + p * GroupSize;
+        if (index < GEMV_CHUNK_K) {
+            mm_Bsub[0][index] = mm_readB(index);
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    float acc = 0.0;
+    float prefetch[PrefetchPerThread];
+    int numChunks = (K + GEMV_CHUNK_K - 1) / GEMV_CHUNK_K;
+    for (int t = 0; t < numChunks; t++) {
+        int current = t & 1;
+        bool hasNext = t + 1 < numChunks;
+        if (hasNext) {
+            for (int p = 0; p < PrefetchPerThread; p++) {
+                prefetch[p] = mm_readB((t + 1) * GEMV_CHUNK_K + localIndex + p * GroupSize);
+            }
+        }
+
+        if (active) {
+            int kBase = t * GEMV_CHUNK_K;
+            int kCount = min(GEMV_CHUNK_K, K - kBase);
+            for (int k = localX; k < kCount; k += LOCAL_GROUP_SIZE_X) {
+                acc = mm_readA(globalRow, kBase + k) * mm_Bsub[current][k] + acc;
+            }
+        }
+
+        if (hasNext) {
+            for (int p = 0; p < PrefetchPerThread; p++) {
+                int index = localIndex + p * GroupSize;
+                if (index < GEMV_CHUNK_K) {
+                    mm_Bsub[1 - current][index] = prefetch[p];
+                }
+            }
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    mm_partial[localY][localX] = acc;
+    GroupMemoryBarrierWithGroupSync();
+    if (localX == 0 && active) {
+        for (int x = 1; x < LOCAL_GROUP_SIZE_X; x++) {
+            acc += mm_partial[localY][x];
+        }
+        mm_write(globalRow, acc);
+    }
+}
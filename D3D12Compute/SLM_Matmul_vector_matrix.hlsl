@@ -4,6 +4,10 @@ cbuffer SceneConstantBuffer : register( b0 )
     int K;
     int N;
     int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
 }
 
 static uint3 gl_WorkGroupID = uint3(0, 0, 0);
@@ -58,7 +62,7 @@ RWStructuredBuffer<float> dst : register(u0);
 float4 mm_readA(int row, int col) {
     if (row < M)
     {
-        int index = row * K + col;
+        int index = row * LDA + col;
         float4 result = float4(src0[index],
             src0[index + 1],
             src0[index + 2],
@@ -71,7 +75,7 @@ float4 mm_readA(int row, int col) {
 }
 
 float4 mm_readB(int row, int col) {
-    int index = row * N + col;
+    int index = row * LDB + col;
     float4 result = float4(src1[index],
         src1[index + 1],
         src1[index + 2],
@@ -82,7 +86,7 @@ float4 mm_readB(int row, int col) {
 void mm_write(int row, int col, float value) {
     if (row < M && col < N)
     {
-        int index = row * N + col;
+        int index = row * LDC + col;
         dst[index] = value;
     }
 }
@@ -94,7 +98,7 @@ RWByteAddressBuffer dst : register(u0);
 float4 mm_readA(int row, int col) {
     if (row < M)
     {
-        int index = row * K + col;
+        int index = row * LDA + col;
         float4 result = float4(asfloat(src0.Load(4 * index)),
             asfloat(src0.Load(4 * (index + 1))),
             asfloat(src0.Load(4 * (index + 2))),
@@ -107,7 +111,7 @@ float4 mm_readA(int row, int col) {
 }
 
 float4 mm_readB(int row, int col) {
-    int index = row * N + col;
+    int index = row * LDB + col;
     float4 result = float4(asfloat(src1.Load(4 * index)),
         asfloat(src1.Load(4 * (index + 1))),
         asfloat(src1.Load(4 * (index + 2))),
@@ -118,7 +122,7 @@ float4 mm_readB(int row, int col) {
 void mm_write(int row, int col, float value) {
     if (row < M && col < N)
     {
-        int index = row * N + col;
+        int index = row * LDC + col;
         dst.Store(4 * (index), asuint(value));
     }
 }
@@ -0,0 +1,184 @@
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;
+    int K;
+    int N;
+    int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
+}
+
+static uint3 gl_WorkGroupID = uint3(0, 0, 0);
+static uint3 gl_LocalInvocationID = uint3(0, 0, 0);
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+};
+
+void initGLBuiltins(CS_INPUT input)
+{
+    gl_WorkGroupID = input.dx_WorkGroupID;
+    gl_LocalInvocationID = input.dx_LocalInvocationID;
+};
+
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<float> src0 : register(t0);
+StructuredBuffer<float> src1 : register(t1);
+RWStructuredBuffer<float> dst : register(u0);
+
+float mm_readA(int row, int col) {
+    if (row < M && col < K)
+    {
+        return src0[row * LDA + col];
+    }
+    else {
+        return 0.0;
+    }
+}
+
+float4 mm_readB(int row, int col) {
+    int index = row * LDB + col;
+    return float4(src1[index], src1[index + 1], src1[index + 2], src1[index + 3]);
+}
+
+void mm_write(int row, int col, float value) {
+    if (row < M && col < N)
+    {
+        dst[row * LDC + col] = value;
+    }
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+ByteAddressBuffer src1 : register(t1);
+RWByteAddressBuffer dst : register(u0);
+
+float mm_readA(int row, int col) {
+    if (row < M && col < K)
+    {
+        return asfloat(src0.Load(4 * (row * LDA + col)));
+    }
+    else {
+        return 0.0;
+    }
+}
+
+float4 mm_readB(int row, int col) {
+    return asfloat(src1.Load4(4 * (row * LDB + col)));
+}
+
+void mm_write(int row, int col, float value) {
+    if (row < M && col < N)
+    {
+        dst.Store(4 * (row * LDC + col), asuint(value));
+    }
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+// C[rows, :] = A[rows, :] * B for the GEMV_ROWS rows starting at the group's y
+// times GEMV_ROWS. Each thread owns four columns and keeps a float4 sum for every
+// row, so each element of B is read once per group whatever the number of rows.
+// The LOCAL_GROUP_SIZE_Y threads of a column split every chunk of K between
+// them so that a single row (M = 1) still fills the GPU.
+//
+// The rows of A are staged through groupshared memory GEMV_CHUNK_K values at a
+// time, so K is unbounded. The two halves of mm_Asub are double buffered: the
+// next chunk is loaded into registers before the current one is consumed and
+// stored to the other half afterwards, leaving one barrier per chunk.
+#ifndef GEMV_ROWS
+#define GEMV_ROWS 1
+#endif
+// One chunk of all the rows takes 4 KB of groupshared memory per half.
+#define GEMV_CHUNK_K (1024 / GEMV_ROWS)
+static const int GroupSize = LOCAL_GROUP_SIZE_X * LOCAL_GROUP_SIZE_Y;
+static const int ChunkSize = GEMV_ROWS * GEMV_CHUNK_K;
+static const int PrefetchPerThread = (ChunkSize + GroupSize - 1) / GroupSize;
+
+groupshared float mm_Asub[2][GEMV_ROWS][GEMV_CHUNK_K];
+groupshared float4 mm_partial[LOCAL_GROUP_SIZE_Y][LOCAL_GROUP_SIZE_X];
+
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    initGLBuiltins(input);
+
+    int localX = int(gl_LocalInvocationID.x);
+    int localY = int(gl_LocalInvocationID.y);
+    int localIndex = localY * LOCAL_GROUP_SIZE_X + localX;
+    int rowStart = int(gl_WorkGroupID.y) * GEMV_ROWS;
+    int globalCol = (int(gl_WorkGroupID.x) * LOCAL_GROUP_SIZE_X + localX) * 4;
+    bool active = globalCol < N;
+
+    for (int p = 0; p < PrefetchPerThread; p++) {
+        int index = localIndex + p * GroupSize;
+        if (index < ChunkSize) {
+            mm_Asub[0][index / GEMV_CHUNK_K][index % GEMV_CHUNK_K] =
+                mm_readA(rowStart + index / GEMV_CHUNK_K, index % GEMV_CHUNK_K);
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    float4 acc[GEMV_ROWS];
+    for (int r = 0; r < GEMV_ROWS; r++) {
+        acc[r] = float4(0.0, 0.0, 0.0, 0.0);
+    }
+    float prefetch[PrefetchPerThread];
+    int numChunks = (K + GEMV_CHUNK_K - 1) / GEMV_CHUNK_K;
+    for (int t = 0; t < numChunks; t++) {
+        int current = t & 1;
+        bool hasNext = t + 1 < numChunks;
+        if (hasNext) {
+            for (int p = 0; p < PrefetchPerThread; p++) {
+                int index = localIndex + p * GroupSize;
+                prefetch[p] = mm_readA(rowStart + index / GEMV_CHUNK_K, (t + 1) * GEMV_CHUNK_K + index % GEMV_CHUNK_K);
+            }
+        }
+
+        if (active) {
+            int kBase = t * GEMV_CHUNK_K;
+            int kCount = min(GEMV_CHUNK_K, K - kBase);
+            for (int k = localY; k < kCount; k += LOCAL_GROUP_SIZE_Y) {
+                float4 b = mm_readB(kBase + k, globalCol);
+                for (int r = 0; r < GEMV_ROWS; r++) {
+                    acc[r] = b * mm_Asub[current][r][k] + acc[r];
+                }
+            }
+        }
+
+        if (hasNext) {
+            for (int p = 0; p < PrefetchPerThread; p++) {
+                int index = localIndex + p * GroupSize;
+                if (index < ChunkSize) {
+                    mm_Asub[1 - current][index / GEMV_CHUNK_K][index % GEMV_CHUNK_K] = prefetch[p];
+                }
+            }
+        }
+        // Chunk t + 1 is visible and every thread is done with chunk t, whose
+        // half is overwritten by chunk t + 2 in the next iteration.
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    for (int r = 0; r < GEMV_ROWS; r++) {
+        float4 sum = acc[r];
+#if LOCAL_GROUP_SIZE_Y > 1
+        mm_partial[localY][localX] = sum;
+        GroupMemoryBarrierWithGroupSync();
+        if (localY == 0) {
+            for (int y = 1; y < LOCAL_GROUP_SIZE_Y; y++) {
+                sum += mm_partial[y][localX];
+            }
+        }
+        // mm_partial is reused by the next row.
+        GroupMemoryBarrierWithGroupSync();
+#endif
+        if (localY == 0 && active) {
+            mm_write(rowStart + r, globalCol, sum.x);
+            mm_write(rowStart + r, globalCol + 1, sum.y);
+            mm_write(rowStart + r, globalCol + 2, sum.z);
+            mm_write(rowStart + r, globalCol + 3, sum.w);
+        }
+    }
+}
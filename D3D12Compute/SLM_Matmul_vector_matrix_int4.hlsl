@@ -0,0 +1,177 @@
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;
+    int K;
+    int N;
+    int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
+}
+
+static uint3 gl_WorkGroupID = uint3(0, 0, 0);
+static uint3 gl_LocalInvocationID = uint3(0, 0, 0);
+static uint3 gl_GlobalInvocationID = uint3(0, 0, 0);
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+    uint3 dx_GlobalInvocationID : SV_DispatchThreadID;
+};
+
+void initGLBuiltins(CS_INPUT input)
+{
+    gl_WorkGroupID = input.dx_WorkGroupID;
+    gl_LocalInvocationID = input.dx_LocalInvocationID;
+    gl_GlobalInvocationID = input.dx_GlobalInvocationID;
+};
+
+// Weight-only int4: B[K,N] packs eight columns per uint (column n in bits
+// 4 * (n % 8)) and has one fp32 scale per INT4_GROUP_SIZE values of K in each
+// column. mm_readB takes a word column, mm_readScales a group row and word column.
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<float> src0 : register(t0);
+StructuredBuffer<uint> src1 : register(t1);
+StructuredBuffer<float> srcScales : register(t2);
+RWStructuredBuffer<float> dst : register(u0);
+
+float mm_readA(int row, int col) {
+    if (row < M && col < K)
+    {
+        return src0[row * LDA + col];
+    }
+    else {
+        return 0.0;
+    }
+}
+
+uint mm_readB(int row, int col) {
+    if (row < K)
+    {
+        return src1[row * (LDB / 8) + col];
+    }
+    else {
+        return 0;
+    }
+}
+
+void mm_readScales(int group, int col, out float4 lo, out float4 hi) {
+    int index = group * N + col * 8;
+    lo = float4(srcScales[index], srcScales[index + 1], srcScales[index + 2], srcScales[index + 3]);
+    hi = float4(srcScales[index + 4], srcScales[index + 5], srcScales[index + 6], srcScales[index + 7]);
+}
+
+void mm_write(int row, int col, float value) {
+    if (row < M && col < N)
+    {
+        dst[row * LDC + col] = value;
+    }
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+ByteAddressBuffer src1 : register(t1);
+ByteAddressBuffer srcScales : register(t2);
+RWByteAddressBuffer dst : register(u0);
+
+float mm_readA(int row, int col) {
+    if (row < M && col < K)
+    {
+        return asfloat(src0.Load(4 * (row * LDA + col)));
+    }
+    else {
+        return 0.0;
+    }
+}
+
+uint mm_readB(int row, int col) {
+    if (row < K)
+    {
+        return src1.Load(4 * (row * (LDB / 8) + col));
+    }
+    else {
+        return 0;
+    }
+}
+
+void mm_readScales(int group, int col, out float4 lo, out float4 hi) {
+    int index = group * N + col * 8;
+    lo = asfloat(srcScales.Load4(4 * index));
+    hi = asfloat(srcScales.Load4(4 * (index + 4)));
+}
+
+void mm_write(int row, int col, float value) {
+    if (row < M && col < N)
+    {
+        dst.Store(4 * (row * LDC + col), asuint(value));
+    }
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+// A is staged through groupshared memory in chunks, so K is not limited by its size.
+// INT4_GROUP_SIZE must divide A_CHUNK.
+#define A_CHUNK 256
+groupshared float mm_Asub[LOCAL_GROUP_SIZE_Y][A_CHUNK];
+
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    initGLBuiltins(input);
+
+    int localX = int(gl_LocalInvocationID.x);
+    int localY = int(gl_LocalInvocationID.y);
+    int globalRow = int(gl_GlobalInvocationID.y);
+    // Each thread produces the eight columns of one packed word.
+    int globalWord = int(gl_GlobalInvocationID.x);
+    bool active = globalWord < N / 8;
+
+    float4 accLo = float4(0.0, 0.0, 0.0, 0.0);
+    float4 accHi = float4(0.0, 0.0, 0.0, 0.0);
+
+    int numChunks = (K + A_CHUNK - 1) / A_CHUNK;
+    for (int t = 0; t < numChunks; t++) {
+        for (int index = localX; index < A_CHUNK; index += LOCAL_GROUP_SIZE_X) {
+            mm_Asub[localY][index] = mm_readA(globalRow, t * A_CHUNK + index);
+        }
+        GroupMemoryBarrierWithGroupSync();
+
+        if (active) {
+            for (int g = 0; g < A_CHUNK / INT4_GROUP_SIZE; g++) {
+                int kBase = t * A_CHUNK + g * INT4_GROUP_SIZE;
+                if (kBase >= K) {
+                    break;
+                }
+                float4 groupLo = float4(0.0, 0.0, 0.0, 0.0);
+                float4 groupHi = float4(0.0, 0.0, 0.0, 0.0);
+                for (int k = 0; k < INT4_GROUP_SIZE; k++) {
+                    uint w = mm_readB(kBase + k, globalWord);
+                    // Move each nibble to the top bits, then shift back arithmetically to sign extend.
+                    float4 lo = float4(asint(uint4(w << 28, w << 24, w << 20, w << 16)) >> 28);
+                    float4 hi = float4(asint(uint4(w << 12, w << 8, w << 4, w)) >> 28);
+                    float a = mm_Asub[localY][g * INT4_GROUP_SIZE + k];
+                    groupLo = lo * a + groupLo;
+                    groupHi = hi * a + groupHi;
+                }
+                float4 scaleLo;
+                float4 scaleHi;
+                mm_readScales(kBase / INT4_GROUP_SIZE, globalWord, scaleLo, scaleHi);
+                accLo = groupLo * scaleLo + accLo;
+                accHi = groupHi * scaleHi + accHi;
+            }
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    if (active) {
+        int col = globalWord * 8;
+        mm_write(globalRow, col, accLo.x);
+        mm_write(globalRow, col + 1, accLo.y);
+        mm_write(globalRow, col + 2, accLo.z);
+        mm_write(globalRow, col + 3, accLo.w);
+        mm_write(globalRow, col + 4, accHi.x);
+        mm_write(globalRow, col + 5, accHi.y);
+        mm_write(globalRow, col + 6, accHi.z);
+        mm_write(globalRow, col + 7, accHi.w);
+    }
+}
@@ -4,6 +4,10 @@ cbuffer SceneConstantBuffer : register( b0 )
     int K;
     int N;
     int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
 }
 
 static uint3 gl_WorkGroupID = uint3(0, 0, 0);
@@ -58,7 +62,7 @@ RWStructuredBuffer<float> dst : register(u0);
 float mm_readA(int row, int col) {
     if (row < M)
     {
-        int index = row * K + col;
+        int index = row * LDA + col;
         float result = src0[index];
         return result;
     }
@@ -68,7 +72,7 @@ float mm_readA(int row, int col) {
 }
 
 float mm_readB(int row, int col) {
-    int index = row * N + col;
+    int index = row * LDB + col;
     float result = src1[index];
     return result;
 }
@@ -76,7 +80,7 @@ float mm_readB(int row, int col) {
 void mm_write(int row, int col, float value) {
     if (row < M && col < N)
     {
-        int index = row * N + col;
+        int index = row * LDC + col;
         dst[index] = value;
     }
 }
@@ -88,7 +92,7 @@ RWByteAddressBuffer dst : register(u0);
 float mm_readA(int row, int col) {
     if (row < M)
     {
-        int index = row * K + col;
+        int index = row * LDA + col;
         float result = asfloat(src0.Load(4 * index));
         return result;
     }
@@ -98,7 +102,7 @@ float mm_readA(int row, int col) {
 }
 
 float mm_readB(int row, int col) {
-    int index = row * N + col;
+    int index = row * LDB + col;
     float result = asfloat(src1.Load(4 * index));
     return result;
 }
@@ -106,7 +110,7 @@ float mm_readB(int row, int col) {
 void mm_write(int row, int col, float value) {
     if (row < M && col < N)
     {
-        int index = row * N + col;
+        int index = row * LDC + col;
         dst.Store(4 * (index), asuint(value));
     }
 }
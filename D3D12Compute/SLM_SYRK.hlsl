@@ -0,0 +1,201 @@
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;
+    int K;
+    int N;
+    int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
+}
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+};
+
+// Products with a triangular side, lower or with UPPER upper, diagonal
+// included.
+//
+// SYRK: C[M,M] = op(A) * op(A)^T with op(A) M x K, A itself (M x K) or with
+// TRANS_A its transpose (A stored K x M). C is symmetric, so only the tiles of
+// its triangle are dispatched, T * (T + 1) / 2 of the T x T, and only the
+// triangle is written; the rest of C is left as it is. B isn't read.
+//
+// TRMM: C[M,N] = tri(A) * B with A M x M (K = M) and B M x N, where the other
+// triangle of A is read as zero. Every tile of C is dispatched, but a tile row
+// walks only the part of K its rows of tri(A) have.
+#ifndef TRMM
+#define TRMM 0
+#endif
+#ifndef UPPER
+#define UPPER 0
+#endif
+
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<float> src0 : register(t0);
+StructuredBuffer<float> src1 : register(t1);
+RWStructuredBuffer<float> dst : register(u0);
+
+float mm_readA(int index) {
+    return src0[index];
+}
+
+float mm_readB(int row, int col) {
+    return row < K && col < N ? src1[row * LDB + col] : 0.0;
+}
+
+void mm_write(int row, int col, float value) {
+    dst[row * LDC + col] = value;
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+ByteAddressBuffer src1 : register(t1);
+RWByteAddressBuffer dst : register(u0);
+
+float mm_readA(int index) {
+    return asfloat(src0.Load(4 * index));
+}
+
+float mm_readB(int row, int col) {
+    return row < K && col < N ? asfloat(src1.Load(4 * (row * LDB + col))) : 0.0;
+}
+
+void mm_write(int row, int col, float value) {
+    dst.Store(4 * (row * LDC + col), asuint(value));
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+// Element (row, k) of op(A), or of tri(A) for TRMM, and zero outside M x K.
+float op_a(int row, int k) {
+    if (row >= M || k >= K) {
+        return 0.0;
+    }
+#if TRMM
+    if (UPPER ? k < row : k > row) {
+        return 0.0;
+    }
+#endif
+#if TRANS_A
+    return mm_readA(k * LDA + row);
+#else
+    return mm_readA(row * LDA + k);
+#endif
+}
+
+// Square TILE x TILE tiles, so that the diagonal runs through whole tiles.
+// Each thread owns ROWS_PER_THREAD x 4 values of a tile at a stride of the
+// group size, and K is walked TRIANGLE_DEPTH values at a time through
+// groupshared memory.
+#define TILE (LOCAL_GROUP_SIZE_X * 4)
+#define ROWS_PER_THREAD (TILE / LOCAL_GROUP_SIZE_Y)
+#define GROUP_THREADS (LOCAL_GROUP_SIZE_X * LOCAL_GROUP_SIZE_Y)
+#define TRIANGLE_DEPTH 16
+
+// Tile (row, col), row >= col, of the lower triangle of tiles numbered row by
+// row: 0 is (0, 0), 1 is (1, 0), 2 is (1, 1), 3 is (2, 0) and so on.
+void triangle_tile(int index, out int row, out int col) {
+    int i = int((sqrt(8.0 * float(index) + 1.0) - 1.0) * 0.5);
+    // The float root can be one off either way for large indices.
+    if (i * (i + 1) / 2 > index) {
+        i--;
+    }
+    if ((i + 1) * (i + 2) / 2 <= index) {
+        i++;
+    }
+    row = i;
+    col = index - i * (i + 1) / 2;
+}
+
+groupshared float mm_Asub[TILE][TRIANGLE_DEPTH];
+groupshared float mm_Bsub[TRIANGLE_DEPTH][TILE];
+
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    int localRow = int(input.dx_LocalInvocationID.y);
+    int localCol = int(input.dx_LocalInvocationID.x);
+    int localIndex = localRow * LOCAL_GROUP_SIZE_X + localCol;
+
+    int tileRow;
+    int tileCol;
+#if TRMM
+    tileRow = int(input.dx_WorkGroupID.y);
+    tileCol = int(input.dx_WorkGroupID.x);
+#if UPPER
+    int kBegin = tileRow * TILE;
+    int kEnd = K;
+#else
+    int kBegin = 0;
+    int kEnd = min(K, (tileRow + 1) * TILE);
+#endif
+#else
+    // The upper triangle is the transpose of the lower one.
+#if UPPER
+    triangle_tile(int(input.dx_WorkGroupID.x), tileCol, tileRow);
+#else
+    triangle_tile(int(input.dx_WorkGroupID.x), tileRow, tileCol);
+#endif
+    int kBegin = 0;
+    int kEnd = K;
+#endif
+    int row0 = tileRow * TILE;
+    int col0 = tileCol * TILE;
+
+    float acc[ROWS_PER_THREAD][4];
+    for (int r = 0; r < ROWS_PER_THREAD; r++) {
+      for (int c = 0; c < 4; c++) {
+        acc[r][c] = 0.0;
+      }
+    }
+
+    for (int k0 = kBegin; k0 < kEnd; k0 += TRIANGLE_DEPTH) {
+      for (int i = localIndex; i < TILE * TRIANGLE_DEPTH; i += GROUP_THREADS) {
+        mm_Asub[i / TRIANGLE_DEPTH][i % TRIANGLE_DEPTH] = op_a(row0 + i / TRIANGLE_DEPTH, k0 + i % TRIANGLE_DEPTH);
+      }
+      for (int i = localIndex; i < TRIANGLE_DEPTH * TILE; i += GROUP_THREADS) {
+#if TRMM
+        mm_Bsub[i / TILE][i % TILE] = mm_readB(k0 + i / TILE, col0 + i % TILE);
+#elif TRANS_A
+        // The columns of op(A)^T are rows of the stored A.
+        mm_Bsub[i / TILE][i % TILE] = op_a(col0 + i % TILE, k0 + i / TILE);
+#else
+        // Neighbouring threads read along the rows of A.
+        mm_Bsub[i % TRIANGLE_DEPTH][i / TRIANGLE_DEPTH] = op_a(col0 + i / TRIANGLE_DEPTH, k0 + i % TRIANGLE_DEPTH);
+#endif
+      }
+      GroupMemoryBarrierWithGroupSync();
+
+      for (int kk = 0; kk < TRIANGLE_DEPTH; kk++) {
+        float b[4];
+        for (int c = 0; c < 4; c++) {
+          b[c] = mm_Bsub[kk][localCol + c * LOCAL_GROUP_SIZE_X];
+        }
+        for (int r = 0; r < ROWS_PER_THREAD; r++) {
+          float a = mm_Asub[localRow + r * LOCAL_GROUP_SIZE_Y][kk];
+          for (int c = 0; c < 4; c++) {
+            acc[r][c] += a * b[c];
+          }
+        }
+      }
+      GroupMemoryBarrierWithGroupSync();
+    }
+
+    for (int r = 0; r < ROWS_PER_THREAD; r++) {
+      for (int c = 0; c < 4; c++) {
+        int row = row0 + localRow + r * LOCAL_GROUP_SIZE_Y;
+        int col = col0 + localCol + c * LOCAL_GROUP_SIZE_X;
+#if TRMM
+        bool inside = row < M && col < N;
+#else
+        // Tiles on the diagonal are cut along it.
+        bool inside = row < M && col < M && (UPPER ? col >= row : col <= row);
+#endif
+        if (inside) {
+          mm_write(row, col, acc[r][c]);
+        }
+      }
+    }
+}
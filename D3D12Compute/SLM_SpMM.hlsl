@@ -0,0 +1,233 @@
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;
+    int K;
+    int N;
+    int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
+}
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+};
+
+// C[M,N] = A[M,K] * B[K,N] with A sparse. src0 holds the values of A, index0
+// the row offsets of CSR or the block columns of blocked ELL (BLOCKED_ELL) and
+// index1 the column indices of CSR. B is K x N in src1 and C is M x N in dst,
+// both read and written as float4s, or as floats for SpMV (SPMV, N = 1).
+#if SPMV
+#define VEC_WIDTH 1
+#define VEC_TYPE float
+#else
+#define VEC_WIDTH 4
+#define VEC_TYPE float4
+#endif
+
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<float> src0 : register(t0);
+StructuredBuffer<VEC_TYPE> src1 : register(t1);
+StructuredBuffer<int> index0 : register(t2);
+StructuredBuffer<int> index1 : register(t3);
+RWStructuredBuffer<VEC_TYPE> dst : register(u0);
+
+float mm_readA(int index) {
+    return src0[index];
+}
+
+int mm_readIndex0(int index) {
+    return index0[index];
+}
+
+int mm_readIndex1(int index) {
+    return index1[index];
+}
+
+// col counts vectors of VEC_WIDTH floats.
+VEC_TYPE mm_readB(int row, int col) {
+    return row < K && col * VEC_WIDTH < N ? src1[row * (N / VEC_WIDTH) + col] : (VEC_TYPE)0.0;
+}
+
+void mm_write(int row, int col, VEC_TYPE value) {
+    if (row < M && col * VEC_WIDTH < N) {
+        dst[row * (LDC / VEC_WIDTH) + col] = value;
+    }
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+ByteAddressBuffer src1 : register(t1);
+ByteAddressBuffer index0 : register(t2);
+ByteAddressBuffer index1 : register(t3);
+RWByteAddressBuffer dst : register(u0);
+
+float mm_readA(int index) {
+    return asfloat(src0.Load(4 * index));
+}
+
+int mm_readIndex0(int index) {
+    return asint(index0.Load(4 * index));
+}
+
+int mm_readIndex1(int index) {
+    return asint(index1.Load(4 * index));
+}
+
+VEC_TYPE mm_readB(int row, int col) {
+    if (row >= K || col * VEC_WIDTH >= N) {
+        return (VEC_TYPE)0.0;
+    }
+#if SPMV
+    return asfloat(src1.Load(4 * (row * N + col)));
+#else
+    return asfloat(src1.Load4(4 * (row * N + col * 4)));
+#endif
+}
+
+void mm_write(int row, int col, VEC_TYPE value) {
+    if (row < M && col * VEC_WIDTH < N) {
+#if SPMV
+        dst.Store(4 * (row * LDC + col), asuint(value));
+#else
+        dst.Store4(4 * (row * LDC + col * 4), asuint(value));
+#endif
+    }
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+#if SPMV
+// y = A x in CSR-vector form: the LOCAL_GROUP_SIZE_X threads of one group row
+// stride over the nonzeros of one row of A, so neighbouring threads read
+// neighbouring values and column indices however short the rows are, and sum
+// their parts in a groupshared tree. LOCAL_GROUP_SIZE_X is a power of two.
+groupshared float partialSums[LOCAL_GROUP_SIZE_Y][LOCAL_GROUP_SIZE_X];
+
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    int tx = int(input.dx_LocalInvocationID.x);
+    int ty = int(input.dx_LocalInvocationID.y);
+    int row = int(input.dx_WorkGroupID.x) * LOCAL_GROUP_SIZE_Y + ty;
+    int begin = row < M ? mm_readIndex0(row) : 0;
+    int end = row < M ? mm_readIndex0(row + 1) : 0;
+
+    float sum = 0.0;
+    for (int p = begin + tx; p < end; p += LOCAL_GROUP_SIZE_X) {
+        sum += mm_readA(p) * mm_readB(mm_readIndex1(p), 0);
+    }
+    partialSums[ty][tx] = sum;
+    GroupMemoryBarrierWithGroupSync();
+    for (int stride = LOCAL_GROUP_SIZE_X / 2; stride > 0; stride >>= 1) {
+        if (tx < stride) {
+            partialSums[ty][tx] += partialSums[ty][tx + stride];
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+    if (tx == 0) {
+        mm_write(row, 0, partialSums[ty][0]);
+    }
+}
+#else
+// Each thread computes VECS_PER_THREAD float4s of one row of C, LOCAL_GROUP_SIZE_X
+// float4s apart so that neighbouring threads read neighbouring parts of a row
+// of B. A group covers LOCAL_GROUP_SIZE_Y rows and LOCAL_GROUP_SIZE_X *
+// WORK_PER_THREAD_X columns, and every nonzero a(r, k) of its rows adds a times
+// row k of B, so only the rows of B that A has nonzeros in are read.
+#define VECS_PER_THREAD (WORK_PER_THREAD_X / 4)
+
+#if BLOCKED_ELL
+// Blocked ELL with BELL_BLOCK x BELL_BLOCK blocks and BELL_COLS of them per
+// block row. The threads of a row walk the same block slots, so the block
+// columns and values are broadcast loads, and a block's BELL_BLOCK columns are
+// unrolled. Padding slots are at the end of a block row and stop the walk.
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    int tx = int(input.dx_LocalInvocationID.x);
+    int row = int(input.dx_WorkGroupID.y) * LOCAL_GROUP_SIZE_Y + int(input.dx_LocalInvocationID.y);
+    int col = int(input.dx_WorkGroupID.x) * LOCAL_GROUP_SIZE_X * VECS_PER_THREAD + tx;
+    float4 acc[VECS_PER_THREAD];
+    for (int j = 0; j < VECS_PER_THREAD; j++) {
+        acc[j] = float4(0.0, 0.0, 0.0, 0.0);
+    }
+
+    if (row < M) {
+        int blockRow = row / BELL_BLOCK;
+        for (int slot = 0; slot < BELL_COLS; slot++) {
+            int block = blockRow * BELL_COLS + slot;
+            int k0 = mm_readIndex0(block) * BELL_BLOCK;
+            if (k0 < 0) {
+                break;
+            }
+            int valueBase = (block * BELL_BLOCK + row % BELL_BLOCK) * BELL_BLOCK;
+            [unroll]
+            for (int kk = 0; kk < BELL_BLOCK; kk++) {
+                float a = mm_readA(valueBase + kk);
+                for (int j = 0; j < VECS_PER_THREAD; j++) {
+                    acc[j] += a * mm_readB(k0 + kk, col + j * LOCAL_GROUP_SIZE_X);
+                }
+            }
+        }
+    }
+
+    for (int j = 0; j < VECS_PER_THREAD; j++) {
+        mm_write(row, col + j * LOCAL_GROUP_SIZE_X, acc[j]);
+    }
+}
+#else
+// CSR. Each group row stages LOCAL_GROUP_SIZE_X nonzeros of its row of A at a
+// time in groupshared memory, one per thread, and then every thread of the row
+// uses all of them. The rows of a group differ in length, so the group runs
+// as many steps as its longest row needs; every thread finds that length from
+// the same row offsets, which keeps the barriers in uniform control flow.
+groupshared float tileValues[LOCAL_GROUP_SIZE_Y][LOCAL_GROUP_SIZE_X];
+groupshared int tileColumns[LOCAL_GROUP_SIZE_Y][LOCAL_GROUP_SIZE_X];
+
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    int tx = int(input.dx_LocalInvocationID.x);
+    int ty = int(input.dx_LocalInvocationID.y);
+    int firstRow = int(input.dx_WorkGroupID.y) * LOCAL_GROUP_SIZE_Y;
+    int row = firstRow + ty;
+    int col = int(input.dx_WorkGroupID.x) * LOCAL_GROUP_SIZE_X * VECS_PER_THREAD + tx;
+    float4 acc[VECS_PER_THREAD];
+    for (int j = 0; j < VECS_PER_THREAD; j++) {
+        acc[j] = float4(0.0, 0.0, 0.0, 0.0);
+    }
+
+    int longestRow = 0;
+    for (int r = 0; r < LOCAL_GROUP_SIZE_Y; r++) {
+        if (firstRow + r < M) {
+            longestRow = max(longestRow, mm_readIndex0(firstRow + r + 1) - mm_readIndex0(firstRow + r));
+        }
+    }
+    int begin = row < M ? mm_readIndex0(row) : 0;
+    int length = row < M ? mm_readIndex0(row + 1) - begin : 0;
+
+    for (int base = 0; base < longestRow; base += LOCAL_GROUP_SIZE_X) {
+        int p = base + tx;
+        tileValues[ty][tx] = p < length ? mm_readA(begin + p) : 0.0;
+        tileColumns[ty][tx] = p < length ? mm_readIndex1(begin + p) : 0;
+        GroupMemoryBarrierWithGroupSync();
+
+        int count = min(LOCAL_GROUP_SIZE_X, length - base);
+        for (int i = 0; i < count; i++) {
+            float a = tileValues[ty][i];
+            int k = tileColumns[ty][i];
+            for (int j = 0; j < VECS_PER_THREAD; j++) {
+                acc[j] += a * mm_readB(k, col + j * LOCAL_GROUP_SIZE_X);
+            }
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    for (int j = 0; j < VECS_PER_THREAD; j++) {
+        mm_write(row, col + j * LOCAL_GROUP_SIZE_X, acc[j]);
+    }
+}
+#endif  // BLOCKED_ELL
+#endif  // SPMV
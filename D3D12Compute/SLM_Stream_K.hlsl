@@ -0,0 +1,204 @@
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;
+    int K;
+    int N;
+    int TILE_K;
+    int LDA;     // Leading dimensions (row strides) of A, B and C in elements.
+    int LDB;
+    int LDC;
+    int LD_PAD;
+}
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+};
+
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<float> src0 : register(t0);
+StructuredBuffer<float> src1 : register(t1);
+RWStructuredBuffer<float> dst : register(u0);
+
+float mm_readA(int row, int col) {
+    return row < M && col < K ? src0[row * LDA + col] : 0.0;
+}
+
+float mm_readB(int row, int col) {
+    return row < K && col < N ? src1[row * LDB + col] : 0.0;
+}
+
+float dst_load(int index) {
+    return dst[index];
+}
+
+void dst_store(int index, float value) {
+    dst[index] = value;
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+ByteAddressBuffer src1 : register(t1);
+RWByteAddressBuffer dst : register(u0);
+
+float mm_readA(int row, int col) {
+    return row < M && col < K ? asfloat(src0.Load(4 * (row * LDA + col))) : 0.0;
+}
+
+float mm_readB(int row, int col) {
+    return row < K && col < N ? asfloat(src1.Load(4 * (row * LDB + col))) : 0.0;
+}
+
+float dst_load(int index) {
+    return asfloat(dst.Load(4 * index));
+}
+
+void dst_store(int index, float value) {
+    dst.Store(4 * index, asuint(value));
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+// Stream-K GEMM. Instead of one group per tile of C, STREAM_K_GROUPS persistent
+// groups split the MAC iterations of all tiles evenly between them, where one
+// iteration is STREAM_K_DEPTH values of K for one TILE_M x TILE_N tile. So the
+// last wave is never left mostly empty when the tile count isn't a multiple of
+// the groups the GPU runs at once.
+//
+// A group walks its range of iterations across tile boundaries. Tiles it covers
+// entirely are written to C. Only the first and last tile of a range can be
+// shared with other groups, and their partial sums go to workspace slots 2g and
+// 2g + 1 behind C. A second dispatch with FIXUP, one group per tile, adds up the
+// partial sums of the shared tiles. Each thread owns a 4x4 block of the tile at
+// a stride of the group size, so neighbouring threads touch neighbouring columns.
+#ifndef FIXUP
+#define FIXUP 0
+#endif
+#define TILE_M (LOCAL_GROUP_SIZE_Y * 4)
+#define TILE_N (LOCAL_GROUP_SIZE_X * 4)
+#define GROUP_THREADS (LOCAL_GROUP_SIZE_X * LOCAL_GROUP_SIZE_Y)
+
+int tiles_x() {
+    return (N + TILE_N - 1) / TILE_N;
+}
+
+int iters_per_tile() {
+    return (K + STREAM_K_DEPTH - 1) / STREAM_K_DEPTH;
+}
+
+int total_iters() {
+    return tiles_x() * ((M + TILE_M - 1) / TILE_M) * iters_per_tile();
+}
+
+int iters_per_group() {
+    return (total_iters() + STREAM_K_GROUPS - 1) / STREAM_K_GROUPS;
+}
+
+// Offset in dst of the partial tile that group g computed for tile t.
+int workspace_offset(int g, int t) {
+    int firstTile = g * iters_per_group() / iters_per_tile();
+    int slot = 2 * g + (t == firstTile ? 0 : 1);
+    return M * LDC + slot * TILE_M * TILE_N;
+}
+
+#if FIXUP
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    int tile = int(input.dx_WorkGroupID.x);
+    int firstGroup = tile * iters_per_tile() / iters_per_group();
+    int lastGroup = ((tile + 1) * iters_per_tile() - 1) / iters_per_group();
+    if (firstGroup == lastGroup) {
+        // A single group covered the tile and wrote it to C.
+        return;
+    }
+
+    int row0 = tile / tiles_x() * TILE_M;
+    int col0 = tile % tiles_x() * TILE_N;
+    int localRow = int(input.dx_LocalInvocationID.y);
+    int localCol = int(input.dx_LocalInvocationID.x);
+    for (int r = 0; r < 4; r++) {
+      for (int c = 0; c < 4; c++) {
+        int tileRow = localRow + r * LOCAL_GROUP_SIZE_Y;
+        int tileCol = localCol + c * LOCAL_GROUP_SIZE_X;
+        float sum = 0.0;
+        for (int g = firstGroup; g <= lastGroup; g++) {
+          sum += dst_load(workspace_offset(g, tile) + tileRow * TILE_N + tileCol);
+        }
+        if (row0 + tileRow < M && col0 + tileCol < N) {
+          dst_store((row0 + tileRow) * LDC + col0 + tileCol, sum);
+        }
+      }
+    }
+}
+#else
+groupshared float mm_Asub[TILE_M][STREAM_K_DEPTH];
+groupshared float mm_Bsub[STREAM_K_DEPTH][TILE_N];
+
+[numthreads(LOCAL_GROUP_SIZE_X, LOCAL_GROUP_SIZE_Y, 1)]
+void main(CS_INPUT input)
+{
+    int group = int(input.dx_WorkGroupID.x);
+    int localRow = int(input.dx_LocalInvocationID.y);
+    int localCol = int(input.dx_LocalInvocationID.x);
+    int localIndex = localRow * LOCAL_GROUP_SIZE_X + localCol;
+    int itersPerTile = iters_per_tile();
+
+    int iter = group * iters_per_group();
+    int iterEnd = min(iter + iters_per_group(), total_iters());
+    while (iter < iterEnd) {
+      int tile = iter / itersPerTile;
+      int kBegin = iter - tile * itersPerTile;
+      int kEnd = min(itersPerTile, kBegin + iterEnd - iter);
+      int row0 = tile / tiles_x() * TILE_M;
+      int col0 = tile % tiles_x() * TILE_N;
+
+      float acc[4][4];
+      for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+          acc[r][c] = 0.0;
+        }
+      }
+
+      for (int k = kBegin; k < kEnd; k++) {
+        int k0 = k * STREAM_K_DEPTH;
+        for (int i = localIndex; i < TILE_M * STREAM_K_DEPTH; i += GROUP_THREADS) {
+          mm_Asub[i / STREAM_K_DEPTH][i % STREAM_K_DEPTH] = mm_readA(row0 + i / STREAM_K_DEPTH, k0 + i % STREAM_K_DEPTH);
+        }
+        for (int i = localIndex; i < STREAM_K_DEPTH * TILE_N; i += GROUP_THREADS) {
+          mm_Bsub[i / TILE_N][i % TILE_N] = mm_readB(k0 + i / TILE_N, col0 + i % TILE_N);
+        }
+        GroupMemoryBarrierWithGroupSync();
+
+        for (int kk = 0; kk < STREAM_K_DEPTH; kk++) {
+          float b[4];
+          for (int c = 0; c < 4; c++) {
+            b[c] = mm_Bsub[kk][localCol + c * LOCAL_GROUP_SIZE_X];
+          }
+          for (int r = 0; r < 4; r++) {
+            float a = mm_Asub[localRow + r * LOCAL_GROUP_SIZE_Y][kk];
+            for (int c = 0; c < 4; c++) {
+              acc[r][c] += a * b[c];
+            }
+          }
+        }
+        GroupMemoryBarrierWithGroupSync();
+      }
+
+      bool wholeTile = kBegin == 0 && kEnd == itersPerTile;
+      int partial = workspace_offset(group, tile);
+      for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+          int tileRow = localRow + r * LOCAL_GROUP_SIZE_Y;
+          int tileCol = localCol + c * LOCAL_GROUP_SIZE_X;
+          if (!wholeTile) {
+            dst_store(partial + tileRow * TILE_N + tileCol, acc[r][c]);
+          }
+          else if (row0 + tileRow < M && col0 + tileCol < N) {
+            dst_store((row0 + tileRow) * LDC + col0 + tileCol, acc[r][c]);
+          }
+        }
+      }
+      iter += kEnd - kBegin;
+    }
+}
+#endif  // FIXUP
@@ -0,0 +1,67 @@
+// ShaderCache.cpp : Keys of the content-addressed cache of compiled compute shaders.
+//
+
+#include "pch.h"
+#include "ShaderCache.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace
+{
+    const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+    const uint64_t FNV_PRIME = 1099511628211ull;
+
+    void HashBytes(uint64_t& hash, const char* data, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= uint8_t(data[i]);
+            hash *= FNV_PRIME;
+        }
+    }
+
+    void HashString(uint64_t& hash, const std::string& s)
+    {
+        HashBytes(hash, s.data(), s.size());
+        HashBytes(hash, "\n", 1);
+    }
+}
+
+std::string ShaderCacheKey(const void* source, size_t sourceSize, const std::string& entryPoint,
+                           const std::string& target, const ShaderDefines& defines)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    HashString(hash, target);
+    HashString(hash, entryPoint);
+
+    ShaderDefines sorted = defines;
+    std::sort(sorted.begin(), sorted.end());
+    for (const auto& define : sorted)
+    {
+        HashString(hash, define.first + "=" + define.second);
+    }
+    HashBytes(hash, "\n", 1);
+
+    const char* text = static_cast<const char*>(source);
+    for (size_t i = 0; i < sourceSize; ++i)
+    {
+        if (text[i] != '\r')
+        {
+            HashBytes(hash, text + i, 1);
+        }
+    }
+
+    static const char digits[] = "0123456789abcdef";
+    std::string key(16, '0');
+    for (int i = 15; i >= 0; --i)
+    {
+        key[i] = digits[hash & 0xf];
+        hash >>= 4;
+    }
+    return key;
+}
+
+std::string ShaderCachePath(const std::string& cacheDir, const std::string& key)
+{
+    return cacheDir + "/" + key + ".cso";
+}
@@ -0,0 +1,27 @@
+// ShaderCache.h : Keys of the content-addressed cache of compiled compute shaders.
+// precompile_shaders.py fills the cache offline with DXC and computes the same
+// keys, so nothing here depends on D3D and the keys can be checked on any platform.
+
+#pragma once
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// (name, value) pairs of the preprocessor defines a shader is compiled with.
+typedef std::vector<std::pair<std::string, std::string>> ShaderDefines;
+
+// Directory of the cached blobs, relative to the working directory the .hlsl
+// files are loaded from.
+const char* const SHADER_CACHE_DIR = "shader_cache";
+
+// 16 hex digits of the 64-bit FNV-1a hash of
+//     target "\n" entryPoint "\n" { name "=" value "\n" sorted by name } "\n" source
+// Carriage returns in the source are skipped, so a CRLF checkout on Windows and
+// an LF checkout on the build host produce the same key. The source must not
+// #include other files, since only its own text is hashed.
+std::string ShaderCacheKey(const void* source, size_t sourceSize, const std::string& entryPoint,
+                           const std::string& target, const ShaderDefines& defines);
+
+// Path of the blob with the given key in cacheDir.
+std::string ShaderCachePath(const std::string& cacheDir, const std::string& key);
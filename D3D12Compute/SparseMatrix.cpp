@@ -0,0 +1,261 @@
+// SparseMatrix.cpp : CSR and blocked ELL storage of pruned weight matrices.
+//
+
+#include "pch.h"
+#include "SparseMatrix.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <tuple>
+
+CsrMatrix CsrFromDense(const float* A, int rows, int cols)
+{
+    CsrMatrix csr = {};
+    csr.rows = rows;
+    csr.cols = cols;
+    csr.rowPtr.reserve(size_t(rows) + 1);
+    csr.rowPtr.push_back(0);
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            const float value = A[size_t(r) * cols + c];
+            if (value != 0.0f)
+            {
+                csr.colIdx.push_back(c);
+                csr.values.push_back(value);
+            }
+        }
+        csr.rowPtr.push_back(int(csr.values.size()));
+    }
+    return csr;
+}
+
+void CsrToDense(const CsrMatrix& A, float* dense)
+{
+    std::fill(dense, dense + size_t(A.rows) * A.cols, 0.0f);
+    for (int r = 0; r < A.rows; r++)
+    {
+        for (int p = A.rowPtr[r]; p < A.rowPtr[r + 1]; p++)
+        {
+            dense[size_t(r) * A.cols + A.colIdx[p]] = A.values[p];
+        }
+    }
+}
+
+BlockedEllMatrix BlockedEllFromCsr(const CsrMatrix& A, int blockSize)
+{
+    const int blockRows = (A.rows + blockSize - 1) / blockSize;
+    std::vector<std::vector<int>> rowBlocks(blockRows);
+    int ellCols = 0;
+    for (int br = 0; br < blockRows; br++)
+    {
+        std::vector<int>& blocks = rowBlocks[br];
+        for (int r = br * blockSize; r < std::min(A.rows, (br + 1) * blockSize); r++)
+        {
+            for (int p = A.rowPtr[r]; p < A.rowPtr[r + 1]; p++)
+            {
+                blocks.push_back(A.colIdx[p] / blockSize);
+            }
+        }
+        std::sort(blocks.begin(), blocks.end());
+        blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+        ellCols = std::max(ellCols, int(blocks.size()));
+    }
+
+    BlockedEllMatrix ell = {};
+    ell.rows = A.rows;
+    ell.cols = A.cols;
+    ell.blockSize = blockSize;
+    ell.ellCols = ellCols;
+    ell.blockCols.assign(size_t(blockRows) * ellCols, -1);
+    ell.values.assign(ell.blockCols.size() * blockSize * blockSize, 0.0f);
+    for (int br = 0; br < blockRows; br++)
+    {
+        const std::vector<int>& blocks = rowBlocks[br];
+        std::copy(blocks.begin(), blocks.end(), ell.blockCols.begin() + size_t(br) * ellCols);
+        for (int r = br * blockSize; r < std::min(A.rows, (br + 1) * blockSize); r++)
+        {
+            for (int p = A.rowPtr[r]; p < A.rowPtr[r + 1]; p++)
+            {
+                const int slot = int(std::lower_bound(blocks.begin(), blocks.end(), A.colIdx[p] / blockSize) - blocks.begin());
+                const size_t block = size_t(br) * ellCols + slot;
+                ell.values[(block * blockSize + r % blockSize) * blockSize + A.colIdx[p] % blockSize] = A.values[p];
+            }
+        }
+    }
+    return ell;
+}
+
+CsrMatrix RandomBlockSparse(int rows, int cols, int blockSize, double sparsity, unsigned seed)
+{
+    std::mt19937 generator(seed);
+    std::bernoulli_distribution keep(1.0 - sparsity);
+    std::uniform_real_distribution<float> value(0.0f, 1.0f);
+    const int blockCount = (cols + blockSize - 1) / blockSize;
+
+    CsrMatrix csr = {};
+    csr.rows = rows;
+    csr.cols = cols;
+    csr.rowPtr.reserve(size_t(rows) + 1);
+    csr.rowPtr.push_back(0);
+    std::vector<char> kept(blockCount);
+    for (int r = 0; r < rows; r++)
+    {
+        // The blocks of a block row are drawn on its first row.
+        if (r % blockSize == 0)
+        {
+            for (char& block : kept)
+            {
+                block = keep(generator);
+            }
+        }
+        for (int b = 0; b < blockCount; b++)
+        {
+            if (!kept[b])
+            {
+                continue;
+            }
+            for (int c = b * blockSize; c < std::min(cols, (b + 1) * blockSize); c++)
+            {
+                csr.colIdx.push_back(c);
+                csr.values.push_back(value(generator));
+            }
+        }
+        csr.rowPtr.push_back(int(csr.values.size()));
+    }
+    return csr;
+}
+
+int PruneBlocks(float* A, int rows, int cols, int blockSize, double sparsity, unsigned seed)
+{
+    std::mt19937 generator(seed);
+    std::bernoulli_distribution prune(sparsity);
+    int pruned = 0;
+    for (int r0 = 0; r0 < rows; r0 += blockSize)
+    {
+        for (int c0 = 0; c0 < cols; c0 += blockSize)
+        {
+            if (!prune(generator))
+            {
+                continue;
+            }
+            for (int r = r0; r < std::min(rows, r0 + blockSize); r++)
+            {
+                float* row = A + size_t(r) * cols;
+                std::fill(row + c0, row + std::min(cols, c0 + blockSize), 0.0f);
+            }
+            pruned++;
+        }
+    }
+    return pruned;
+}
+
+double CsrSparsity(const CsrMatrix& A)
+{
+    const double entries = double(A.rows) * A.cols;
+    return entries > 0.0 ? 1.0 - double(A.values.size()) / entries : 0.0;
+}
+
+bool ReadMatrixMarket(const std::string& path, CsrMatrix& A, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "Can't open " + path + ".";
+        return false;
+    }
+    std::string line;
+    std::getline(file, line);
+    std::istringstream banner(line);
+    std::string tag, object, format, field, symmetry;
+    banner >> tag >> object >> format >> field >> symmetry;
+    for (std::string* word : { &object, &format, &field, &symmetry })
+    {
+        std::transform(word->begin(), word->end(), word->begin(), [](char c) { return char(std::tolower((unsigned char)c)); });
+    }
+    if (tag != "%%MatrixMarket" || object != "matrix" || format != "coordinate")
+    {
+        error = path + " isn't a coordinate Matrix Market file.";
+        return false;
+    }
+    if ((field != "real" && field != "integer" && field != "pattern") || (symmetry != "general" && symmetry != "symmetric"))
+    {
+        error = "Only real, integer or pattern matrices that are general or symmetric are supported, not " + field + " " + symmetry + ".";
+        return false;
+    }
+
+    // Comments run up to the size line.
+    while (std::getline(file, line) && (line.empty() || line[0] == '%'))
+    {
+    }
+    long long rows = 0, cols = 0, entries = 0;
+    if (!(std::istringstream(line) >> rows >> cols >> entries) || rows <= 0 || cols <= 0 || entries < 0 ||
+        rows > INT_MAX - 1 || cols > INT_MAX)
+    {
+        error = "Invalid size line in " + path + ".";
+        return false;
+    }
+
+    std::vector<std::tuple<int, int, float>> triplets;
+    triplets.reserve(size_t(entries) * (symmetry == "symmetric" ? 2 : 1));
+    for (long long i = 0; i < entries; i++)
+    {
+        long long r = 0, c = 0;
+        double value = 1.0;
+        if (!(file >> r >> c) || (field != "pattern" && !(file >> value)))
+        {
+            error = path + " ends after " + std::to_string(i) + " of its " + std::to_string(entries) + " entries.";
+            return false;
+        }
+        if (r < 1 || r > rows || c < 1 || c > cols)
+        {
+            error = "Entry " + std::to_string(i + 1) + " of " + path + " is outside the matrix.";
+            return false;
+        }
+        triplets.emplace_back(int(r - 1), int(c - 1), float(value));
+        if (symmetry == "symmetric" && r != c)
+        {
+            triplets.emplace_back(int(c - 1), int(r - 1), float(value));
+        }
+    }
+    if (triplets.size() > size_t(INT_MAX))
+    {
+        error = path + " has more nonzeros than 32-bit offsets can index.";
+        return false;
+    }
+    std::sort(triplets.begin(), triplets.end(), [](const std::tuple<int, int, float>& a, const std::tuple<int, int, float>& b) {
+        return std::get<0>(a) != std::get<0>(b) ? std::get<0>(a) < std::get<0>(b) : std::get<1>(a) < std::get<1>(b);
+    });
+
+    A = {};
+    A.rows = int(rows);
+    A.cols = int(cols);
+    A.rowPtr.assign(size_t(rows) + 1, 0);
+    int lastRow = -1;
+    int lastCol = -1;
+    for (const std::tuple<int, int, float>& triplet : triplets)
+    {
+        const int r = std::get<0>(triplet);
+        const int c = std::get<1>(triplet);
+        if (r == lastRow && c == lastCol)
+        {
+            A.values.back() += std::get<2>(triplet);
+            continue;
+        }
+        A.colIdx.push_back(c);
+        A.values.push_back(std::get<2>(triplet));
+        A.rowPtr[r + 1] = int(A.values.size());
+        lastRow = r;
+        lastCol = c;
+    }
+    // Rows without entries end where the row before them does.
+    for (size_t r = 1; r < A.rowPtr.size(); r++)
+    {
+        A.rowPtr[r] = std::max(A.rowPtr[r], A.rowPtr[r - 1]);
+    }
+    return true;
+}
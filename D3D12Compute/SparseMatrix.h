@@ -0,0 +1,65 @@
+// SparseMatrix.h : Storage formats of pruned weight matrices for SLM_SpMM.hlsl and
+// the CPU SpMM: compressed sparse rows (CSR) and blocked ELL, with a Matrix
+// Market reader and a generator of random block-pruned matrices. Nothing here
+// depends on D3D12, so it can be built and verified on any platform.
+
+#pragma once
+#include <string>
+#include <vector>
+
+// Compressed sparse rows: the nonzeros of row r are values[rowPtr[r], rowPtr[r + 1])
+// at columns colIdx[rowPtr[r], rowPtr[r + 1]), which ascend within the row.
+struct CsrMatrix
+{
+    int rows;
+    int cols;
+    std::vector<int> rowPtr;    // rows + 1 offsets.
+    std::vector<int> colIdx;
+    std::vector<float> values;
+};
+
+// Blocked ELL: the rows are cut into block rows of blockSize rows, each storing
+// ellCols blockSize x blockSize blocks, as many as the fullest block row needs.
+// Every block row has the same amount of work, and a block's values are read
+// with one index, at the cost of storing zeros in the blocks and padding.
+struct BlockedEllMatrix
+{
+    int rows;
+    int cols;
+    int blockSize;
+    int ellCols;
+    // Block column of each stored block, ascending within a block row, with the
+    // unused slots at its end set to -1. ceil(rows / blockSize) x ellCols.
+    std::vector<int> blockCols;
+    // The blocks in the order of blockCols, each row-major. Padding slots and
+    // the parts of edge blocks beyond rows or cols are zero.
+    std::vector<float> values;
+};
+
+// The nonzeros of the dense row-major rows x cols matrix A.
+CsrMatrix CsrFromDense(const float* A, int rows, int cols);
+
+// Writes A as a dense row-major rows x cols matrix.
+void CsrToDense(const CsrMatrix& A, float* dense);
+
+// A with every blockSize x blockSize block that holds a nonzero stored whole.
+BlockedEllMatrix BlockedEllFromCsr(const CsrMatrix& A, int blockSize);
+
+// A rows x cols matrix cut into blockSize x blockSize blocks, each of which is
+// pruned (all zeros) with probability sparsity and otherwise holds values in
+// [0, 1). A blockSize of 1 prunes single weights, as magnitude pruning does;
+// larger blocks model structured pruning. The same seed gives the same matrix.
+CsrMatrix RandomBlockSparse(int rows, int cols, int blockSize, double sparsity, unsigned seed);
+
+// Zeroes each blockSize x blockSize block of the dense row-major rows x cols
+// matrix A with probability sparsity, drawing the blocks row by row as
+// RandomBlockSparse does, and returns the number of blocks zeroed.
+int PruneBlocks(float* A, int rows, int cols, int blockSize, double sparsity, unsigned seed);
+
+// Fraction of the rows x cols entries that aren't stored.
+double CsrSparsity(const CsrMatrix& A);
+
+// Reads a coordinate Matrix Market file (real, integer or pattern; general or
+// symmetric). Pattern entries become 1 and duplicate entries are summed.
+// Returns false with a message in error if the file can't be read.
+bool ReadMatrixMarket(const std::string& path, CsrMatrix& A, std::string& error);
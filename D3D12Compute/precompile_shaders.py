@@ -0,0 +1,244 @@
+#!/usr/bin/env python3
+"""Precompiles every compute shader variant of D3D12Compute with DXC.
+
+The blobs go into the content-addressed cache that LoadAssets() reads, keyed
+exactly as ShaderCacheKey() in ShaderCache.cpp keys them. A variant is a kernel
+with one storage type, local group size, accumulation mode, int4 group size and
+the defines that kernel adds (transposes, GEMV rows, edge tiles). The table
+below mirrors the kernel setup in D3D12Sample::Start() and the defines built in
+LoadAssets(); a variant missing here only costs a compile at run time.
+
+DXC runs on Linux and Windows:
+    python3 precompile_shaders.py --dxc /opt/dxc/bin/dxc
+    python3 precompile_shaders.py --local-sizes 16x4,16x16 --accumulate 0,1,2
+Copy the output directory next to the .hlsl files on the target machine.
+DXIL (cs_6_0) is loaded by D3D12 on devices with shader model 6.0. With
+--spirv the same variants are also written as SPIR-V (.spv) for Vulkan ports;
+the D3D samples don't read those.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+DXIL_TARGET = "cs_6_0"
+SPIRV_TARGET = "spirv_cs_6_0"
+
+ALL_STORAGE = ("byteAddress_buffer", "structured_buffer", "texture")
+BUFFER_STORAGE = ("byteAddress_buffer", "structured_buffer")
+STORAGE_DEFINES = {
+    "byteAddress_buffer": [],
+    "structured_buffer": [("USE_STRUCTURED_BUFFERS", "1")],
+    "texture": [("USE_TEXTURE", "1")],
+}
+
+# (--kernel name, source, entry point, WORK_PER_THREAD_X, WORK_PER_THREAD_Y, storage types)
+KERNELS = [
+    ("SLM_8X8_4X16", "SLM_8X8_4X16.hlsl", "CSMain", 8, 8, ALL_STORAGE),
+    ("SLM_8X8_4X16_packed", "SLM_8X8_4X16.hlsl", "CSMain", 8, 8, BUFFER_STORAGE),
+    ("SLM_4x4_16x16_v4", "SLM_4X4_16X16_vec4.hlsl", "main", 4, 4, ALL_STORAGE),
+    ("SLM_4x4_shared_A", "SLM_4X4_shared_A.hlsl", "main", 4, 4, ALL_STORAGE),
+    ("SLM_4x4_16x16_float", "SLM_4X4_16X16.hlsl", "main", 4, 4, ALL_STORAGE),
+    ("SLM_4x4_16x16_float_coalesced", "SLM_4X4_16X16_coalesced.hlsl", "main", 4, 4, ALL_STORAGE),
+    ("SLM_4x4_16x16_4_FLOATS", "SLM_4X4_16X16_4_floats.hlsl", "main", 4, 4, ALL_STORAGE),
+    ("MatMul_4x4_16x4_float", "Matmul_4x4_16x4.hlsl", "main", 4, 4, ALL_STORAGE),
+    ("MatMul_vector_float", "Matmul_vector.hlsl", "main", 2, 1, ALL_STORAGE),
+    ("SLM_MatMul_vector_float", "SLM_Matmul_vector.hlsl", "main", 2, 1, ALL_STORAGE),
+    ("SLM_MatMul_vector_matrix_float", "SLM_Matmul_vector_matrix.hlsl", "main", 4, 1, ALL_STORAGE),
+    ("SLM_MatMul_vector_matrix_one", "SLM_Matmul_vector_matrix_one.hlsl", "main", 1, 1, ALL_STORAGE),
+    ("SLM_MatMul_vector_matrix_chunked", "SLM_Matmul_vector_matrix_chunked.hlsl", "main", 4, 1, BUFFER_STORAGE),
+    ("SLM_MatMul_vector_chunked", "SLM_Matmul_vector_chunked.hlsl", "main", 1, 1, BUFFER_STORAGE),
+    ("SLM_MatMul_small_m", "SLM_Matmul_vector_matrix_chunked.hlsl", "main", 4, 1, BUFFER_STORAGE),
+    ("SLM_Stream_K", "SLM_Stream_K.hlsl", "main", 4, 4, BUFFER_STORAGE),
+    ("SLM_Attention", "SLM_Attention.hlsl", "main", 1, 4, BUFFER_STORAGE),
+    ("SLM_SpMM", "SLM_SpMM.hlsl", "main", 8, 1, BUFFER_STORAGE),
+    ("SLM_Grouped_GEMM", "SLM_Grouped_GEMM.hlsl", "main", 4, 4, BUFFER_STORAGE),
+    # The rows per thread of the square tiles for the default 16x4 local size.
+    ("SLM_SYRK", "SLM_SYRK.hlsl", "main", 4, 16, BUFFER_STORAGE),
+    ("SLM_TRMM", "SLM_SYRK.hlsl", "main", 4, 16, BUFFER_STORAGE),
+    ("SLM_INT8_4x4_16x16", "SLM_INT8_4X4_16X16.hlsl", "main", 4, 4, BUFFER_STORAGE),
+    ("SLM_MatMul_vector_matrix_int4", "SLM_Matmul_vector_matrix_int4.hlsl", "main", 8, 1, BUFFER_STORAGE),
+    ("SLM_DGEMM_4x4", "SLM_DGEMM.hlsl", "main", 4, 4, BUFFER_STORAGE),
+    ("SLM_DGEMM_8x8", "SLM_DGEMM.hlsl", "main", 8, 8, BUFFER_STORAGE),
+    ("SLM_4x4_16x16_trans", "SLM_4X4_16X16_trans.hlsl", "main", 4, 4, BUFFER_STORAGE),
+]
+
+FNV_OFFSET_BASIS = 14695981039346656037
+FNV_PRIME = 1099511628211
+
+
+def fnv1a(hash_value, data):
+    for byte in data:
+        hash_value ^= byte
+        hash_value = (hash_value * FNV_PRIME) & 0xFFFFFFFFFFFFFFFF
+    return hash_value
+
+
+def cache_key(source, entry, target, defines):
+    """Same key as ShaderCacheKey() in ShaderCache.cpp."""
+    h = fnv1a(FNV_OFFSET_BASIS, (target + "\n" + entry + "\n").encode())
+    for name, value in sorted(defines):
+        h = fnv1a(h, (name + "=" + value + "\n").encode())
+    h = fnv1a(h, b"\n")
+    h = fnv1a(h, source.replace(b"\r", b""))
+    return "%016x" % h
+
+
+# --raster column, grouped, morton and hilbert with the default --raster-group.
+RASTER_DEFINES = [[("RASTER", str(raster)), ("RASTER_GROUP_M", "8")] for raster in range(1, 5)]
+
+
+def kernel_variants(kernel):
+    """The defines a kernel adds after TRANS_A/TRANS_B, as lists of pairs."""
+    if kernel == "SLM_4x4_16x16_trans":
+        return [[("TRANS_A", a), ("TRANS_B", b), ("GEMV_ROWS", "1")] for a in "01" for b in "01"]
+    if kernel == "SLM_SYRK":
+        # --trans NN and TN, each with --uplo lower and upper.
+        return [[("TRANS_A", a), ("TRANS_B", "0"), ("GEMV_ROWS", "1"), ("TRMM", "0"), ("UPPER", upper)]
+                for a in "01" for upper in "01"]
+    base = [("TRANS_A", "0"), ("TRANS_B", "0")]
+    if kernel == "SLM_MatMul_small_m":
+        return [base + [("GEMV_ROWS", str(rows))] for rows in range(1, 17)]
+    defines = base + [("GEMV_ROWS", "1")]
+    if kernel == "SLM_Stream_K":
+        # The default --groups, then the main and the fix-up pipelines.
+        defines += [("STREAM_K_GROUPS", "64"), ("STREAM_K_DEPTH", "16")]
+        return [defines, defines + [("FIXUP", "1")]]
+    if kernel == "SLM_Attention":
+        # The head dimension (--N) is compiled in; these are the common ones.
+        return [defines + [("ATTENTION_HEAD_DIM", str(dim))] for dim in (32, 64, 128)]
+    if kernel == "SLM_TRMM":
+        return [defines + [("TRMM", "1"), ("UPPER", upper)] for upper in "01"]
+    if kernel == "SLM_SpMM":
+        # CSR SpMM and SpMV. Blocked ELL compiles in the block count of its
+        # matrix (BELL_COLS), so it is left to run time.
+        return [defines, defines + [("SPMV", "1")]]
+    if kernel in ("SLM_8X8_4X16", "SLM_8X8_4X16_packed"):
+        if kernel.endswith("_packed"):
+            defines.append(("PACKED_B", "1"))
+        # --edges checked, then the two pipelines of --edges split, each with
+        # --prefetch single and double.
+        edges = [defines, defines + [("BOUNDS_CHECK", "0")], defines + [("EDGE_TILES", "1")]]
+        prefetch = edges + [variant + [("DOUBLE_BUFFER", "1")] for variant in edges]
+        # --raster only changes the pipeline of the checked or full tiles.
+        rasters = [variant + raster for variant in prefetch if ("EDGE_TILES", "1") not in variant
+                   for raster in RASTER_DEFINES]
+        # --block-sparse runs the checked tiles with single prefetch.
+        block_sparse = [] if kernel.endswith("_packed") else [defines + [("BLOCK_SPARSE", "1")]]
+        return prefetch + rasters + block_sparse
+    if kernel in ("SLM_4x4_16x16_v4", "SLM_4x4_shared_A", "SLM_4x4_16x16_4_FLOATS"):
+        # --prefetch single and double.
+        return [defines, defines + [("DOUBLE_BUFFER", "1")]]
+    if kernel == "SLM_4x4_16x16_float":
+        return [defines] + [defines + raster for raster in RASTER_DEFINES]
+    return [defines]
+
+
+def implements_accumulate(source_dir, source):
+    """Whether the shader reads ACCUMULATE_MODE. D3D12Sample rejects kahan and
+    fp64 for the kernels whose shaders don't, so they only need the naive variant."""
+    with open(os.path.join(source_dir, source), encoding="utf-8") as f:
+        return "ACCUMULATE_MODE" in f.read()
+
+
+def variants(args):
+    for kernel, source, entry, wpt_x, wpt_y, storage_types in KERNELS:
+        accumulate_modes = args.accumulate if implements_accumulate(args.source_dir, source) else [0]
+        for storage in storage_types:
+            for local_x, local_y in args.local_sizes:
+                for accumulate in accumulate_modes:
+                    for group_size in args.group_sizes:
+                        common = STORAGE_DEFINES[storage] + [
+                            ("LOCAL_GROUP_SIZE_X", str(local_x)),
+                            ("LOCAL_GROUP_SIZE_Y", str(local_y)),
+                            ("WORK_PER_THREAD_X", str(wpt_x)),
+                            ("WORK_PER_THREAD_Y", str(wpt_y)),
+                            ("INT4_GROUP_SIZE", str(group_size)),
+                            ("ACCUMULATE_MODE", str(accumulate)),
+                        ]
+                        for extra in kernel_variants(kernel):
+                            yield kernel, source, entry, common + extra
+
+
+def parse_local_sizes(text):
+    sizes = []
+    for item in text.split(","):
+        x, y = item.lower().split("x")
+        sizes.append((int(x), int(y)))
+    return sizes
+
+
+def parse_ints(text):
+    return [int(item) for item in text.split(",")]
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--dxc", default="dxc", help="Path of the dxc executable.")
+    parser.add_argument("--source-dir", default=here, help="Directory of the .hlsl files.")
+    parser.add_argument("--out", default=os.path.join(here, "shader_cache"), help="Cache directory to fill.")
+    parser.add_argument("--local-sizes", type=parse_local_sizes, default=parse_local_sizes("16x4"),
+                        help="Comma-separated XxY local group sizes (--localX/--localY). Default 16x4.")
+    parser.add_argument("--accumulate", type=parse_ints, default=[0],
+                        help="Comma-separated ACCUMULATE_MODE values: 0 naive, 1 kahan, 2 fp64. Default 0.")
+    parser.add_argument("--group-sizes", type=parse_ints, default=[128],
+                        help="Comma-separated int4 group sizes (--group-size). Default 128.")
+    parser.add_argument("--spirv", action="store_true", help="Also write SPIR-V for each variant.")
+    parser.add_argument("--dry-run", action="store_true", help="Print the variants and keys without compiling.")
+    parser.add_argument("--jobs", type=int, default=os.cpu_count() or 1, help="Parallel dxc processes.")
+    args = parser.parse_args()
+
+    sources = {}
+    jobs = []
+    for kernel, source, entry, defines in variants(args):
+        if source not in sources:
+            with open(os.path.join(args.source_dir, source), "rb") as f:
+                sources[source] = f.read()
+        targets = [(DXIL_TARGET, ".cso", [])]
+        if args.spirv:
+            targets.append((SPIRV_TARGET, ".spv", ["-spirv", "-fspv-target-env=vulkan1.1"]))
+        for target, ext, extra_args in targets:
+            key = cache_key(sources[source], entry, target, defines)
+            jobs.append((kernel, source, entry, defines, target, os.path.join(args.out, key + ext), extra_args))
+
+    if args.dry_run:
+        for kernel, source, entry, defines, target, path, _ in jobs:
+            print("%s %s %s %s" % (os.path.basename(path), target, kernel,
+                                   " ".join("%s=%s" % d for d in defines)))
+        return 0
+
+    os.makedirs(args.out, exist_ok=True)
+
+    def compile_one(job):
+        kernel, source, entry, defines, target, path, extra_args = job
+        if os.path.exists(path):
+            return None
+        # Write next to the final name and rename, so an interrupted run never
+        # leaves a truncated blob under a valid key.
+        temp = path + ".tmp%d" % os.getpid()
+        cmd = [args.dxc, "-nologo", "-T", "cs_6_0", "-E", entry, "-HV", "2018", "-Fo", temp] + extra_args
+        for name, value in defines:
+            cmd += ["-D", "%s=%s" % (name, value)]
+        cmd.append(os.path.join(args.source_dir, source))
+        result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+        if result.returncode != 0:
+            if os.path.exists(temp):
+                os.remove(temp)
+            return "%s (%s, %s): %s" % (kernel, target, " ".join("%s=%s" % d for d in defines),
+                                        result.stdout.decode(errors="replace").strip())
+        os.replace(temp, path)
+        return None
+
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        errors = [e for e in pool.map(compile_one, jobs) if e]
+    for error in errors:
+        print(error, file=sys.stderr)
+    print("%d variants, %d failed." % (len(jobs), len(errors)))
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
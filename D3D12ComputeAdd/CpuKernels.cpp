@@ -0,0 +1,863 @@
+// CpuKernels.cpp : Host-side reference and SIMD implementations of the kernels.
+//
+
+#include "pch.h"
+#include "CpuKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+void ParallelFor(int begin, int end, const std::function<void(int, int)>& func)
+{
+    int count = end - begin;
+    if (count <= 0)
+    {
+        return;
+    }
+    int threadCount = std::max(1, std::min(count, int(std::thread::hardware_concurrency())));
+    int chunk = (count + threadCount - 1) / threadCount;
+    std::vector<std::thread> threads;
+    for (int start = begin; start < end; start += chunk)
+    {
+        int stop = std::min(end, start + chunk);
+        threads.emplace_back(func, start, stop);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+const char* RowOpName(RowOp op)
+{
+    switch (op)
+    {
+    case ROW_SOFTMAX: return "softmax";
+    case ROW_LAYERNORM: return "layernorm";
+    case ROW_RMSNORM: return "rmsnorm";
+    }
+    return "unknown";
+}
+
+int RowOpInputPasses(RowOp op, bool singlePass)
+{
+    return op == ROW_RMSNORM || singlePass ? 2 : 3;
+}
+
+void CpuRowOpReference(RowOp op, const float* x, const float* gamma, const float* beta, double* y, int rows, int cols)
+{
+    ParallelFor(0, rows, [=](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; r++)
+        {
+            const float* in = x + size_t(r) * cols;
+            double* out = y + size_t(r) * cols;
+            if (op == ROW_SOFTMAX)
+            {
+                double rowMax = *std::max_element(in, in + cols);
+                double sum = 0.0;
+                for (int c = 0; c < cols; c++)
+                {
+                    out[c] = std::exp(in[c] - rowMax);
+                    sum += out[c];
+                }
+                for (int c = 0; c < cols; c++)
+                {
+                    out[c] /= sum;
+                }
+                continue;
+            }
+            double mean = 0.0;
+            if (op == ROW_LAYERNORM)
+            {
+                for (int c = 0; c < cols; c++)
+                {
+                    mean += in[c];
+                }
+                mean /= cols;
+            }
+            double squares = 0.0;
+            for (int c = 0; c < cols; c++)
+            {
+                squares += (in[c] - mean) * (in[c] - mean);
+            }
+            const double scale = 1.0 / std::sqrt(squares / cols + ROW_NORM_EPSILON);
+            for (int c = 0; c < cols; c++)
+            {
+                out[c] = (in[c] - mean) * scale * gamma[c] + (op == ROW_LAYERNORM ? beta[c] : 0.0);
+            }
+        }
+    });
+}
+
+namespace
+{
+    // Running statistics of one lane (or one row, once the lanes are merged).
+    struct SoftmaxStats
+    {
+        float max;
+        float sum;  // Sum of exp(x - max) so far.
+    };
+
+    struct WelfordStats
+    {
+        float count;
+        float mean;
+        float m2;   // Sum of squared deviations from mean.
+    };
+
+    inline SoftmaxStats MergeSoftmax(SoftmaxStats a, SoftmaxStats b)
+    {
+        const float rowMax = std::max(a.max, b.max);
+        return { rowMax, a.sum * std::exp(a.max - rowMax) + b.sum * std::exp(b.max - rowMax) };
+    }
+
+    // Chan et al.'s pairwise combination of two Welford states.
+    inline WelfordStats MergeWelford(WelfordStats a, WelfordStats b)
+    {
+        const float count = a.count + b.count;
+        if (count == 0.0f)
+        {
+            return a;
+        }
+        const float delta = b.mean - a.mean;
+        return { count, a.mean + delta * b.count / count, a.m2 + b.m2 + delta * delta * a.count * b.count / count };
+    }
+
+#if defined(__AVX2__)
+    inline float HorizontalSum(__m256 v)
+    {
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+        return _mm_cvtss_f32(half);
+    }
+
+    inline float HorizontalMax(__m256 v)
+    {
+        __m128 half = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        half = _mm_max_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_max_ss(half, _mm_shuffle_ps(half, half, 1));
+        return _mm_cvtss_f32(half);
+    }
+
+    // exp(x) as 2^n * p(r) with x = n ln2 + r, |r| <= ln2 / 2, and a degree-6
+    // polynomial for e^r. The relative error is a few ulp, and inputs below
+    // -87 flush to 0, which is all the softmax needs.
+    inline __m256 Exp256(__m256 x)
+    {
+        x = _mm256_max_ps(_mm256_min_ps(x, _mm256_set1_ps(88.0f)), _mm256_set1_ps(-87.0f));
+        const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+        r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+        __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+        p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+        const __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+    }
+#endif
+
+    float RowMax(const float* in, int cols)
+    {
+        int c = 0;
+        float rowMax = -HUGE_VALF;
+#if defined(__AVX2__)
+        __m256 vmax = _mm256_set1_ps(-HUGE_VALF);
+        for (; c + 8 <= cols; c += 8)
+        {
+            vmax = _mm256_max_ps(vmax, _mm256_loadu_ps(in + c));
+        }
+        rowMax = HorizontalMax(vmax);
+#endif
+        for (; c < cols; c++)
+        {
+            rowMax = std::max(rowMax, in[c]);
+        }
+        return rowMax;
+    }
+
+    // Sum of exp(x - rowMax) over the row.
+    float RowExpSum(const float* in, int cols, float rowMax)
+    {
+        int c = 0;
+        float sum = 0.0f;
+#if defined(__AVX2__)
+        const __m256 vmax = _mm256_set1_ps(rowMax);
+        __m256 vsum = _mm256_setzero_ps();
+        for (; c + 8 <= cols; c += 8)
+        {
+            vsum = _mm256_add_ps(vsum, Exp256(_mm256_sub_ps(_mm256_loadu_ps(in + c), vmax)));
+        }
+        sum = HorizontalSum(vsum);
+#endif
+        for (; c < cols; c++)
+        {
+            sum += std::exp(in[c] - rowMax);
+        }
+        return sum;
+    }
+
+    // The online softmax normaliser: every lane keeps a running maximum and a
+    // sum rescaled whenever the maximum grows, and the lanes are merged last.
+    SoftmaxStats RowSoftmaxStats(const float* in, int cols)
+    {
+        int c = 0;
+        SoftmaxStats stats = { -HUGE_VALF, 0.0f };
+#if defined(__AVX2__)
+        if (cols >= 8)
+        {
+            __m256 vmax = _mm256_loadu_ps(in);
+            __m256 vsum = _mm256_set1_ps(1.0f);
+            for (c = 8; c + 8 <= cols; c += 8)
+            {
+                const __m256 v = _mm256_loadu_ps(in + c);
+                const __m256 newMax = _mm256_max_ps(vmax, v);
+                vsum = _mm256_fmadd_ps(vsum, Exp256(_mm256_sub_ps(vmax, newMax)), Exp256(_mm256_sub_ps(v, newMax)));
+                vmax = newMax;
+            }
+            float laneMax[8];
+            float laneSum[8];
+            _mm256_storeu_ps(laneMax, vmax);
+            _mm256_storeu_ps(laneSum, vsum);
+            for (int lane = 0; lane < 8; lane++)
+            {
+                stats = MergeSoftmax(stats, { laneMax[lane], laneSum[lane] });
+            }
+        }
+#endif
+        for (; c < cols; c++)
+        {
+            stats = MergeSoftmax(stats, { in[c], 1.0f });
+        }
+        return stats;
+    }
+
+    float RowSum(const float* in, int cols)
+    {
+        int c = 0;
+        float sum = 0.0f;
+#if defined(__AVX2__)
+        __m256 vsum = _mm256_setzero_ps();
+        for (; c + 8 <= cols; c += 8)
+        {
+            vsum = _mm256_add_ps(vsum, _mm256_loadu_ps(in + c));
+        }
+        sum = HorizontalSum(vsum);
+#endif
+        for (; c < cols; c++)
+        {
+            sum += in[c];
+        }
+        return sum;
+    }
+
+    // Sum of (x - center)^2 over the row.
+    float RowSquares(const float* in, int cols, float center)
+    {
+        int c = 0;
+        float sum = 0.0f;
+#if defined(__AVX2__)
+        const __m256 vcenter = _mm256_set1_ps(center);
+        __m256 vsum = _mm256_setzero_ps();
+        for (; c + 8 <= cols; c += 8)
+        {
+            const __m256 d = _mm256_sub_ps(_mm256_loadu_ps(in + c), vcenter);
+            vsum = _mm256_fmadd_ps(d, d, vsum);
+        }
+        sum = HorizontalSum(vsum);
+#endif
+        for (; c < cols; c++)
+        {
+            sum += (in[c] - center) * (in[c] - center);
+        }
+        return sum;
+    }
+
+    // Welford's running mean and M2, one state per lane, merged with Chan's
+    // formula at the end of the row.
+    WelfordStats RowWelford(const float* in, int cols)
+    {
+        int c = 0;
+        WelfordStats stats = { 0.0f, 0.0f, 0.0f };
+#if defined(__AVX2__)
+        __m256 vmean = _mm256_setzero_ps();
+        __m256 vm2 = _mm256_setzero_ps();
+        float count = 0.0f;
+        for (; c + 8 <= cols; c += 8)
+        {
+            count += 1.0f;
+            const __m256 v = _mm256_loadu_ps(in + c);
+            const __m256 delta = _mm256_sub_ps(v, vmean);
+            vmean = _mm256_fmadd_ps(delta, _mm256_set1_ps(1.0f / count), vmean);
+            vm2 = _mm256_fmadd_ps(delta, _mm256_sub_ps(v, vmean), vm2);
+        }
+        float laneMean[8];
+        float laneM2[8];
+        _mm256_storeu_ps(laneMean, vmean);
+        _mm256_storeu_ps(laneM2, vm2);
+        for (int lane = 0; lane < 8; lane++)
+        {
+            stats = MergeWelford(stats, { count, laneMean[lane], laneM2[lane] });
+        }
+#endif
+        for (; c < cols; c++)
+        {
+            stats.count += 1.0f;
+            const float delta = in[c] - stats.mean;
+            stats.mean += delta / stats.count;
+            stats.m2 += delta * (in[c] - stats.mean);
+        }
+        return stats;
+    }
+
+    // out = exp(x - rowMax) * scale.
+    void WriteSoftmax(const float* in, float* out, int cols, float rowMax, float scale)
+    {
+        int c = 0;
+#if defined(__AVX2__)
+        const __m256 vmax = _mm256_set1_ps(rowMax);
+        const __m256 vscale = _mm256_set1_ps(scale);
+        for (; c + 8 <= cols; c += 8)
+        {
+            _mm256_storeu_ps(out + c, _mm256_mul_ps(Exp256(_mm256_sub_ps(_mm256_loadu_ps(in + c), vmax)), vscale));
+        }
+#endif
+        for (; c < cols; c++)
+        {
+            out[c] = std::exp(in[c] - rowMax) * scale;
+        }
+    }
+
+    // out = (x - center) * scale * gamma + beta, without beta when it's null.
+    void WriteNormalized(const float* in, float* out, int cols, float center, float scale, const float* gamma, const float* beta)
+    {
+        int c = 0;
+#if defined(__AVX2__)
+        const __m256 vcenter = _mm256_set1_ps(center);
+        const __m256 vscale = _mm256_set1_ps(scale);
+        for (; c + 8 <= cols; c += 8)
+        {
+            const __m256 v = _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(in + c), vcenter), vscale), _mm256_loadu_ps(gamma + c));
+            _mm256_storeu_ps(out + c, beta ? _mm256_add_ps(v, _mm256_loadu_ps(beta + c)) : v);
+        }
+#endif
+        for (; c < cols; c++)
+        {
+            out[c] = (in[c] - center) * scale * gamma[c] + (beta ? beta[c] : 0.0f);
+        }
+    }
+}
+
+void CpuRowOp(RowOp op, bool singlePass, const float* x, const float* gamma, const float* beta, float* y, int rows, int cols)
+{
+    ParallelFor(0, rows, [=](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; r++)
+        {
+            const float* in = x + size_t(r) * cols;
+            float* out = y + size_t(r) * cols;
+            if (op == ROW_SOFTMAX)
+            {
+                SoftmaxStats stats;
+                if (singlePass)
+                {
+                    stats = RowSoftmaxStats(in, cols);
+                }
+                else
+                {
+                    stats.max = RowMax(in, cols);
+                    stats.sum = RowExpSum(in, cols, stats.max);
+                }
+                WriteSoftmax(in, out, cols, stats.max, 1.0f / stats.sum);
+            }
+            else if (op == ROW_LAYERNORM)
+            {
+                float mean;
+                float variance;
+                if (singlePass)
+                {
+                    const WelfordStats stats = RowWelford(in, cols);
+                    mean = stats.mean;
+                    variance = stats.m2 / cols;
+                }
+                else
+                {
+                    mean = RowSum(in, cols) / cols;
+                    variance = RowSquares(in, cols, mean) / cols;
+                }
+                WriteNormalized(in, out, cols, mean, 1.0f / std::sqrt(variance + ROW_NORM_EPSILON), gamma, beta);
+            }
+            else
+            {
+                const float meanSquare = RowSquares(in, cols, 0.0f) / cols;
+                WriteNormalized(in, out, cols, 0.0f, 1.0f / std::sqrt(meanSquare + ROW_NORM_EPSILON), gamma, nullptr);
+            }
+        }
+    });
+}
+
+void CpuElementwiseExprReference(const ElementwiseExpr& expr, const float* const* inputs, double* out, int count)
+{
+    ParallelFor(0, count, [&](int begin, int end) {
+        std::vector<double> values(expr.nodes.size());
+        for (int i = begin; i < end; i++)
+        {
+            for (size_t n = 0; n < expr.nodes.size(); n++)
+            {
+                const ExprNode& node = expr.nodes[n];
+                const double x = node.args[0] >= 0 ? values[node.args[0]] : 0.0;
+                const double y = node.args[1] >= 0 ? values[node.args[1]] : 0.0;
+                const double z = node.args[2] >= 0 ? values[node.args[2]] : 0.0;
+                switch (node.op)
+                {
+                case EXPR_INPUT: values[n] = inputs[node.input][i]; break;
+                case EXPR_CONST: values[n] = node.value; break;
+                case EXPR_ADD: values[n] = x + y; break;
+                case EXPR_SUB: values[n] = x - y; break;
+                case EXPR_MUL: values[n] = x * y; break;
+                case EXPR_FMA: values[n] = x * y + z; break;
+                case EXPR_NEG: values[n] = -x; break;
+                case EXPR_RELU: values[n] = x > 0.0 ? x : 0.0; break;
+                case EXPR_GELU: values[n] = 0.5 * x * (1.0 + std::tanh(0.7978845608028654 * (x + 0.044715 * x * x * x))); break;
+                case EXPR_HALF: values[n] = RoundToHalf(float(x)); break;
+                case EXPR_INT: values[n] = std::trunc(x); break;
+                }
+            }
+            out[i] = values.back();
+        }
+    });
+}
+
+namespace
+{
+    // An operand of one op over a range: an array, or a constant when data is null.
+    struct ExprOperand
+    {
+        const float* data;
+        float value;
+    };
+
+    // out[i] = op(args[0][i], args[1][i], args[2][i]) for i < n.
+    void ApplyExprOp(ExprOp op, const ExprOperand* args, float* out, int n)
+    {
+        auto at = [](const ExprOperand& a, int i) { return a.data ? a.data[i] : a.value; };
+        int i = 0;
+#if defined(__AVX2__)
+        auto load = [](const ExprOperand& a, int i) { return a.data ? _mm256_loadu_ps(a.data + i) : _mm256_set1_ps(a.value); };
+        const int operands = op == EXPR_FMA ? 3 : op == EXPR_ADD || op == EXPR_SUB || op == EXPR_MUL ? 2 : 1;
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m256 x = load(args[0], i);
+            const __m256 y = operands > 1 ? load(args[1], i) : x;
+            const __m256 z = operands > 2 ? load(args[2], i) : x;
+            __m256 result;
+            switch (op)
+            {
+            case EXPR_ADD: result = _mm256_add_ps(x, y); break;
+            case EXPR_SUB: result = _mm256_sub_ps(x, y); break;
+            case EXPR_MUL: result = _mm256_mul_ps(x, y); break;
+            case EXPR_FMA: result = _mm256_fmadd_ps(x, y, z); break;
+            case EXPR_NEG: result = _mm256_xor_ps(x, _mm256_set1_ps(-0.0f)); break;
+            case EXPR_RELU: result = _mm256_max_ps(x, _mm256_setzero_ps()); break;
+            case EXPR_GELU:
+            {
+                const __m256 inner = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_mul_ps(x, x), x), _mm256_set1_ps(0.044715f), x);
+                const __m256 e = Exp256(_mm256_mul_ps(inner, _mm256_set1_ps(-1.5957691216f)));
+                result = _mm256_div_ps(x, _mm256_add_ps(e, _mm256_set1_ps(1.0f)));
+                break;
+            }
+#if defined(__F16C__) || defined(_MSC_VER)
+            case EXPR_HALF: result = _mm256_cvtph_ps(_mm256_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT)); break;
+#endif
+            case EXPR_INT: result = _mm256_round_ps(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); break;
+            default:
+            {
+                alignas(32) float lanes[8];
+                _mm256_store_ps(lanes, x);
+                for (float& lane : lanes)
+                {
+                    lane = EvaluateExprOp(op, lane, 0.0f, 0.0f);
+                }
+                result = _mm256_load_ps(lanes);
+                break;
+            }
+            }
+            _mm256_storeu_ps(out + i, result);
+        }
+#endif
+        for (; i < n; i++)
+        {
+            out[i] = EvaluateExprOp(op, at(args[0], i), at(args[1], i), at(args[2], i));
+        }
+    }
+
+    // Evaluates expr over [begin, end) into out, keeping the intermediate values
+    // in scratch, blockSize floats per node; the last op writes out directly.
+    void EvaluateExprRange(const ElementwiseExpr& expr, const float* const* inputs, float* out, int begin, int end,
+                           float* scratch, int blockSize)
+    {
+        const size_t last = expr.nodes.size() - 1;
+        std::vector<ExprOperand> values(expr.nodes.size());
+        for (int start = begin; start < end; start += blockSize)
+        {
+            const int n = std::min(blockSize, end - start);
+            for (size_t i = 0; i < expr.nodes.size(); i++)
+            {
+                const ExprNode& node = expr.nodes[i];
+                if (node.op == EXPR_INPUT)
+                {
+                    values[i] = { inputs[node.input] + start, 0.0f };
+                    continue;
+                }
+                if (node.op == EXPR_CONST)
+                {
+                    values[i] = { nullptr, node.value };
+                    continue;
+                }
+                const ExprOperand args[3] =
+                {
+                    values[node.args[0]],
+                    node.args[1] >= 0 ? values[node.args[1]] : ExprOperand{ nullptr, 0.0f },
+                    node.args[2] >= 0 ? values[node.args[2]] : ExprOperand{ nullptr, 0.0f },
+                };
+                float* result = i == last ? out + start : scratch + i * blockSize;
+                ApplyExprOp(node.op, args, result, n);
+                values[i] = { result, 0.0f };
+            }
+            // An expression without ops is a copy of its input.
+            if (expr.nodes[last].op == EXPR_INPUT)
+            {
+                std::copy(values[last].data, values[last].data + n, out + start);
+            }
+        }
+    }
+}
+
+void CpuElementwiseExpr(const ElementwiseExpr& expr, const float* const* inputs, float* out, int count)
+{
+    // 512 floats per node: a dozen intermediate values fill 24 KB of L1.
+    const int blockSize = 512;
+    ParallelFor(0, (count + blockSize - 1) / blockSize, [&](int blockBegin, int blockEnd) {
+        std::vector<float> scratch(expr.nodes.size() * blockSize);
+        EvaluateExprRange(expr, inputs, out, blockBegin * blockSize, std::min(count, blockEnd * blockSize), scratch.data(), blockSize);
+    });
+}
+
+void CpuElementwiseExprUnfused(const ElementwiseExpr& expr, const float* const* inputs, float* out, int count)
+{
+    const size_t last = expr.nodes.size() - 1;
+    std::vector<std::vector<float>> temporaries(expr.nodes.size());
+    std::vector<ExprOperand> values(expr.nodes.size());
+    for (size_t i = 0; i < expr.nodes.size(); i++)
+    {
+        const ExprNode& node = expr.nodes[i];
+        if (node.op == EXPR_INPUT)
+        {
+            values[i] = { inputs[node.input], 0.0f };
+            continue;
+        }
+        if (node.op == EXPR_CONST)
+        {
+            values[i] = { nullptr, node.value };
+            continue;
+        }
+        const ExprOperand args[3] =
+        {
+            values[node.args[0]],
+            node.args[1] >= 0 ? values[node.args[1]] : ExprOperand{ nullptr, 0.0f },
+            node.args[2] >= 0 ? values[node.args[2]] : ExprOperand{ nullptr, 0.0f },
+        };
+        if (i != last)
+        {
+            temporaries[i].resize(count);
+        }
+        float* result = i == last ? out : temporaries[i].data();
+        ParallelFor(0, count, [&](int begin, int end) {
+            ExprOperand shifted[3];
+            for (int a = 0; a < 3; a++)
+            {
+                shifted[a] = { args[a].data ? args[a].data + begin : nullptr, args[a].value };
+            }
+            ApplyExprOp(node.op, shifted, result + begin, end - begin);
+        });
+        values[i] = { result, 0.0f };
+    }
+    if (expr.nodes[last].op == EXPR_INPUT)
+    {
+        std::copy(values[last].data, values[last].data + count, out);
+    }
+}
+
+const char* StreamOpName(StreamOp op)
+{
+    switch (op)
+    {
+    case STREAM_COPY: return "copy";
+    case STREAM_SCALE: return "scale";
+    case STREAM_ADD: return "add";
+    case STREAM_TRIAD: return "triad";
+    }
+    return "unknown";
+}
+
+int StreamOpArrays(StreamOp op)
+{
+    return op == STREAM_COPY || op == STREAM_SCALE ? 2 : 3;
+}
+
+namespace
+{
+    // One STREAM kernel over [begin, end), reps times. op is a template
+    // argument so that the branches on it fold away in the loops.
+    template <StreamOp op>
+    void StreamLoop(const float* x, const float* y, float* out, int begin, int end, int reps)
+    {
+        for (int rep = 0; rep < reps; rep++)
+        {
+            int i = begin;
+#if defined(__AVX2__)
+            const __m256 scalar = _mm256_set1_ps(STREAM_SCALAR);
+            for (; i + 8 <= end; i += 8)
+            {
+                const __m256 vx = _mm256_loadu_ps(x + i);
+                __m256 result = vx;
+                if (op == STREAM_SCALE)
+                {
+                    result = _mm256_mul_ps(scalar, vx);
+                }
+                else if (op == STREAM_ADD)
+                {
+                    result = _mm256_add_ps(vx, _mm256_loadu_ps(y + i));
+                }
+                else if (op == STREAM_TRIAD)
+                {
+                    result = _mm256_fmadd_ps(scalar, _mm256_loadu_ps(y + i), vx);
+                }
+                _mm256_storeu_ps(out + i, result);
+            }
+#endif
+            for (; i < end; i++)
+            {
+                float result = x[i];
+                if (op == STREAM_SCALE)
+                {
+                    result = STREAM_SCALAR * x[i];
+                }
+                else if (op == STREAM_ADD)
+                {
+                    result = x[i] + y[i];
+                }
+                else if (op == STREAM_TRIAD)
+                {
+                    result = x[i] + STREAM_SCALAR * y[i];
+                }
+                out[i] = result;
+            }
+        }
+    }
+}
+
+void CpuStream(StreamOp op, const float* x, const float* y, float* out, int count, int reps)
+{
+    ParallelFor(0, count, [=](int begin, int end) {
+        switch (op)
+        {
+        case STREAM_COPY: StreamLoop<STREAM_COPY>(x, y, out, begin, end, reps); break;
+        case STREAM_SCALE: StreamLoop<STREAM_SCALE>(x, y, out, begin, end, reps); break;
+        case STREAM_ADD: StreamLoop<STREAM_ADD>(x, y, out, begin, end, reps); break;
+        case STREAM_TRIAD: StreamLoop<STREAM_TRIAD>(x, y, out, begin, end, reps); break;
+        }
+    });
+}
+
+const char* DeviceOpName(DeviceOp op)
+{
+    switch (op)
+    {
+    case DEVICE_SUM: return "sum";
+    case DEVICE_MAX: return "max";
+    case DEVICE_ARGMAX: return "argmax";
+    case DEVICE_SCAN: return "scan";
+    }
+    return "unknown";
+}
+
+ReduceResult CpuReduceReference(DeviceOp op, const float* x, int count)
+{
+    ReduceResult result = { op == DEVICE_SUM ? 0.0 : -HUGE_VAL, -1 };
+    for (int i = 0; i < count; i++)
+    {
+        if (op == DEVICE_SUM)
+        {
+            result.value += x[i];
+        }
+        else if (x[i] > result.value)
+        {
+            result = { x[i], i };
+        }
+    }
+    return result;
+}
+
+namespace
+{
+    // Elements each reduction and scan block covers: small enough for the
+    // float partial sums to stay accurate, large enough for thousands of them
+    // to cost nothing to combine.
+    const int kReduceBlock = 4096;
+
+    // Folds the result of a later block into that of an earlier one, keeping
+    // the first maximum.
+    inline void CombineReduce(DeviceOp op, ReduceResult& result, const ReduceResult& other)
+    {
+        if (op == DEVICE_SUM)
+        {
+            result.value += other.value;
+        }
+        else if (other.value > result.value)
+        {
+            result = other;
+        }
+    }
+
+    ReduceResult ReduceBlock(DeviceOp op, const float* x, int begin, int end)
+    {
+        int i = begin;
+        float sum = 0.0f;
+        float blockMax = -HUGE_VALF;
+#if defined(__AVX2__)
+        if (end - begin >= 32)
+        {
+            // Four accumulators hide the latency of the adds and maxes.
+            __m256 acc[4];
+            for (int a = 0; a < 4; a++)
+            {
+                acc[a] = op == DEVICE_SUM ? _mm256_setzero_ps() : _mm256_set1_ps(-HUGE_VALF);
+            }
+            for (; i + 32 <= end; i += 32)
+            {
+                for (int a = 0; a < 4; a++)
+                {
+                    const __m256 v = _mm256_loadu_ps(x + i + 8 * a);
+                    acc[a] = op == DEVICE_SUM ? _mm256_add_ps(acc[a], v) : _mm256_max_ps(acc[a], v);
+                }
+            }
+            float lanes[8];
+            if (op == DEVICE_SUM)
+            {
+                _mm256_storeu_ps(lanes, _mm256_add_ps(_mm256_add_ps(acc[0], acc[1]), _mm256_add_ps(acc[2], acc[3])));
+                for (float lane : lanes)
+                {
+                    sum += lane;
+                }
+            }
+            else
+            {
+                _mm256_storeu_ps(lanes, _mm256_max_ps(_mm256_max_ps(acc[0], acc[1]), _mm256_max_ps(acc[2], acc[3])));
+                blockMax = *std::max_element(lanes, lanes + 8);
+            }
+        }
+#endif
+        for (; i < end; i++)
+        {
+            sum += x[i];
+            blockMax = std::max(blockMax, x[i]);
+        }
+        if (op == DEVICE_SUM)
+        {
+            return { sum, -1 };
+        }
+        // Argmax finds the maximum with the SIMD loop first, then its first
+        // occurrence, which is cheap as the block is in L1 by now.
+        int index = -1;
+        if (op == DEVICE_ARGMAX)
+        {
+            index = int(std::find(x + begin, x + end, blockMax) - x);
+        }
+        return { blockMax, index };
+    }
+
+#if defined(__AVX2__)
+    // Inclusive prefix sum of the eight lanes: a scan within each 128-bit half,
+    // then the low half's total added to the high half.
+    inline __m256 ScanLanes(__m256 v)
+    {
+        v = _mm256_add_ps(v, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(v), 4)));
+        v = _mm256_add_ps(v, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(v), 8)));
+        const __m256 lowTotal = _mm256_permute_ps(v, _MM_SHUFFLE(3, 3, 3, 3));
+        return _mm256_add_ps(v, _mm256_permute2f128_ps(lowTotal, lowTotal, 0x08));
+    }
+#endif
+
+    void ScanBlock(const float* x, float* y, int begin, int end, float carry)
+    {
+        int i = begin;
+#if defined(__AVX2__)
+        __m256 vcarry = _mm256_set1_ps(carry);
+        for (; i + 8 <= end; i += 8)
+        {
+            const __m256 v = _mm256_loadu_ps(x + i);
+            const __m256 inclusive = _mm256_add_ps(vcarry, ScanLanes(v));
+            _mm256_storeu_ps(y + i, _mm256_sub_ps(inclusive, v));
+            const __m256 high = _mm256_permute2f128_ps(inclusive, inclusive, 0x11);
+            vcarry = _mm256_permute_ps(high, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+        carry = _mm256_cvtss_f32(vcarry);
+#endif
+        for (; i < end; i++)
+        {
+            y[i] = carry;
+            carry += x[i];
+        }
+    }
+}
+
+ReduceResult CpuReduce(DeviceOp op, const float* x, int count)
+{
+    const int blocks = (count + kReduceBlock - 1) / kReduceBlock;
+    std::vector<ReduceResult> blockResults(blocks);
+    ParallelFor(0, blocks, [&](int blockBegin, int blockEnd) {
+        for (int b = blockBegin; b < blockEnd; b++)
+        {
+            blockResults[b] = ReduceBlock(op, x, b * kReduceBlock, std::min(count, (b + 1) * kReduceBlock));
+        }
+    });
+    ReduceResult result = { op == DEVICE_SUM ? 0.0 : -HUGE_VAL, -1 };
+    for (const ReduceResult& blockResult : blockResults)
+    {
+        CombineReduce(op, result, blockResult);
+    }
+    return result;
+}
+
+void CpuExclusiveScan(const float* x, float* y, int count)
+{
+    const int blocks = (count + kReduceBlock - 1) / kReduceBlock;
+    std::vector<ReduceResult> blockSums(blocks);
+    ParallelFor(0, blocks, [&](int blockBegin, int blockEnd) {
+        for (int b = blockBegin; b < blockEnd; b++)
+        {
+            blockSums[b] = ReduceBlock(DEVICE_SUM, x, b * kReduceBlock, std::min(count, (b + 1) * kReduceBlock));
+        }
+    });
+    std::vector<float> offsets(blocks);
+    double offset = 0.0;
+    for (int b = 0; b < blocks; b++)
+    {
+        offsets[b] = float(offset);
+        offset += blockSums[b].value;
+    }
+    ParallelFor(0, blocks, [&](int blockBegin, int blockEnd) {
+        for (int b = blockBegin; b < blockEnd; b++)
+        {
+            ScanBlock(x, y, b * kReduceBlock, std::min(count, (b + 1) * kReduceBlock), offsets[b]);
+        }
+    });
+}
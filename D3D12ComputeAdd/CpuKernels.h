@@ -0,0 +1,107 @@
+// CpuKernels.h : Host-side reference and SIMD implementations of the kernels in
+// this project. Nothing here depends on D3D12, so it can be built and verified
+// on any platform.
+
+#pragma once
+#include "ElementwiseExpr.h"
+#include <functional>
+
+// Splits [begin, end) into one contiguous chunk per hardware thread and runs
+// func(chunkBegin, chunkEnd) for each of them.
+void ParallelFor(int begin, int end, const std::function<void(int, int)>& func);
+
+// The row-wise operations of SLM_Row_Reduce.hlsl; the values match ROW_OP.
+// Each normalises every row of a rows x cols matrix independently.
+enum RowOp
+{
+    ROW_SOFTMAX = 1,
+    ROW_LAYERNORM = 2,  // (x - mean) / sqrt(var + eps) * gamma + beta
+    ROW_RMSNORM = 3,    // x / sqrt(mean(x^2) + eps) * gamma
+};
+const float ROW_NORM_EPSILON = 1e-5f;
+
+const char* RowOpName(RowOp op);
+
+// Reads of the input row each implementation makes. The two-pass softmax finds
+// the maximum, then the sum of exps; the two-pass layernorm the mean, then the
+// variance. Single-pass, the softmax keeps a running maximum and rescaled sum
+// and the layernorm Welford's running mean and M2. Either way one more read
+// produces the output.
+int RowOpInputPasses(RowOp op, bool singlePass);
+
+// Row-wise op in fp64, as the ground truth for the GPU and the SIMD versions.
+// gamma and beta hold cols values each; softmax ignores them and RMSnorm beta.
+void CpuRowOpReference(RowOp op, const float* x, const float* gamma, const float* beta, double* y, int rows, int cols);
+
+// Row-wise op vectorized with AVX2/FMA when available, rows spread over all
+// hardware threads, with the same passes as the GPU kernel.
+void CpuRowOp(RowOp op, bool singlePass, const float* x, const float* gamma, const float* beta, float* y, int rows, int cols);
+
+// out[i] = expr over inputs[0..expr.inputCount)[i] in fp64, with half() and
+// int() rounding as the kernels do, as the ground truth for both.
+void CpuElementwiseExprReference(const ElementwiseExpr& expr, const float* const* inputs, double* out, int count);
+
+// The fused CPU kernel: each thread walks its elements in blocks small enough
+// for every intermediate value to stay in L1, applying the ops with AVX2 when
+// available, so memory sees one read per input and one write.
+void CpuElementwiseExpr(const ElementwiseExpr& expr, const float* const* inputs, float* out, int count);
+
+// The same ops run one after another over the whole arrays, each writing a
+// full-size temporary, as a chain of separate kernels would.
+void CpuElementwiseExprUnfused(const ElementwiseExpr& expr, const float* const* inputs, float* out, int count);
+
+// The four kernels of McCalpin's STREAM benchmark, with its scalar.
+enum StreamOp
+{
+    STREAM_COPY,    // out = x
+    STREAM_SCALE,   // out = s * x
+    STREAM_ADD,     // out = x + y
+    STREAM_TRIAD,   // out = x + s * y
+};
+const float STREAM_SCALAR = 3.0f;
+
+const char* StreamOpName(StreamOp op);
+
+// Arrays each kernel reads or writes per element, as STREAM counts its bytes:
+// 2 for copy and scale, 3 for add and triad.
+int StreamOpArrays(StreamOp op);
+
+// Runs op reps times over count elements, vectorised with AVX2 when
+// available. Every thread keeps to its own slice through all the reps, as
+// STREAM's OpenMP loops do, so arrays that fit the caches are measured at
+// cache bandwidth rather than at the cost of starting threads.
+void CpuStream(StreamOp op, const float* x, const float* y, float* out, int count, int reps);
+
+// The device-wide primitives of SLM_Device_Reduce.hlsl; the values match
+// DEVICE_OP.
+enum DeviceOp
+{
+    DEVICE_SUM = 1,
+    DEVICE_MAX = 2,
+    DEVICE_ARGMAX = 3,  // Index of the first maximum.
+    DEVICE_SCAN = 4,    // Exclusive: y[i] = x[0] + ... + x[i - 1].
+};
+
+const char* DeviceOpName(DeviceOp op);
+
+// Result of a reduction: the sum or maximum, and for argmax the index of the
+// first element equal to it.
+struct ReduceResult
+{
+    double value;
+    int index;
+};
+
+// Reductions in fp64, as the ground truth for the GPU and the SIMD versions.
+ReduceResult CpuReduceReference(DeviceOp op, const float* x, int count);
+
+// Sum, max or argmax over all hardware threads, vectorised with AVX2 when
+// available. Every thread reduces fixed blocks of the input, and the block
+// results are combined in order, so the sum is the same whatever the thread
+// count, and more accurate than one running float.
+ReduceResult CpuReduce(DeviceOp op, const float* x, int count);
+
+// Exclusive prefix sum, reduce-then-scan like the GPU: the blocks are summed
+// in parallel, their sums scanned in fp64, and each block scanned again from
+// its offset with an in-register AVX2 scan.
+void CpuExclusiveScan(const float* x, float* y, int count);
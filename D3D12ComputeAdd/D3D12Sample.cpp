@@ -13,13 +13,45 @@
 #include "stdafx.h"
 #include "D3D12Sample.h"
 #include <chrono>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
 
-//#define USE_STRUCTURED_BUFFERS
-//#define USE_VEC4
 #define PRINT_DATA
 
 namespace
 {
+	// The STREAM kernels as expressions over the inputs: copy, scale, add and
+	// triad with STREAM's scalar of 3.
+	struct StreamKernel
+	{
+		StreamOp op;
+		const char* expr;
+	};
+	const StreamKernel kStreamKernels[] =
+	{
+		{ STREAM_COPY, "a" },
+		{ STREAM_SCALE, "3.0 * a" },
+		{ STREAM_ADD, "a + b" },
+		{ STREAM_TRIAD, "a + 3.0 * b" },
+	};
+
+	// "--stream-bench" starts at 4 KB arrays, which stay in L1, and quadruples
+	// the size up to --stream-max-size, far beyond the last-level cache.
+	const UINT kStreamMinSize = 1024;
+
+	// "--reduce-bench" runs every device-wide op from 1K elements, quadrupling
+	// the size up to --reduce-max-size, at most 2^30 floats, the most the
+	// shader's 32-bit byte offsets reach.
+	const DeviceOp kReduceOps[] = { DEVICE_SUM, DEVICE_MAX, DEVICE_ARGMAX, DEVICE_SCAN };
+	const UINT kReduceMinSize = 1024;
+	const UINT kReduceMaxSize = 1 << 30;
+
+	// Groups of the device-wide ops beyond which each group takes on a longer
+	// range instead, plenty to fill a GPU; it bounds the partials the last
+	// group or the spine has to go through.
+	const UINT kDeviceOpMaxGroups = 1024;
+
 	//--------------------------------------------------------------------------------------
 	// Inserts a resource transition operation in the command list
 	//--------------------------------------------------------------------------------------
@@ -42,17 +74,275 @@ D3D12Sample::D3D12Sample() :
     m_pCbSrvDataBegin(nullptr),
     m_cbSrvDescriptorSize(0),
     m_constantBufferData{},
+    m_op(ADD),
+    m_deviceOp(DEVICE_SUM),
+    m_rows(4096),
+    m_cols(1024),
+    m_singlePass(false),
     m_dataSize(1024*1024),
     m_workGroupSizeX(128),
-    m_componentSize(1)
+    m_componentSize(1),
+    m_inputCount(2),
+    m_storageType(BYTEADDRESS_BUFFER),
+    m_streamMaxSize(64 * 1024 * 1024),
+    m_reduceMaxSize(kReduceMaxSize),
+    m_runResult{}
 {
-#ifdef USE_VEC4
-	m_componentSize = 4;
-#endif
 }
 
-void D3D12Sample::Start()
+void D3D12Sample::Start(int argc, char *argv[])
 {
+    bool runStreamBenchmark = false;
+    bool runReduceBenchmark = false;
+    for (int i = 0; i < argc; ++i)
+    {
+        std::string cmd(argv[i]);
+        if (cmd == "-h" || cmd == "--help")
+        {
+            std::cout << "-h, --help     List all the supported command flags." << std::endl;
+            std::cout << "--op add|softmax|layernorm|rmsnorm|sum|max|argmax|scan     Choose the elementwise add, a row-wise op, or a device-wide reduction or exclusive scan of --size elements. The default one is add." << std::endl;
+            std::cout << "--rows int_value     Rows of the row-wise ops, one group each. The default value is 4096" << std::endl;
+            std::cout << "--cols int_value     Columns of the row-wise ops, a multiple of 4. The default value is 1024" << std::endl;
+            std::cout << "--passes two|single     single gathers the softmax and layernorm statistics in one read of the row, with an online softmax and Welford's algorithm. The default one is two." << std::endl;
+            std::cout << "--expr expression     Generate and run one fused kernel for an elementwise expression over the inputs a to h, e.g. \"gelu(fma(a, b, c)) * 0.5\", with +, -, *, add, sub, mul, fma, relu, gelu, half, int and constants." << std::endl;
+            std::cout << "--size int_value     Elements of the add, of --expr and of the reductions and scan. The default value is 1048576" << std::endl;
+            std::cout << "--group-size int_value     Threads per group. The default value is 128" << std::endl;
+            std::cout << "--storage-type structured_buffer|byteAddress_buffer     Choose using which storage type to load/store data. The default one is byteAddress_buffer." << std::endl;
+            std::cout << "--vec-width 1|2|4     Floats each thread loads and stores at once. The add takes 1 or 4, and the row-wise ops always use 4. The default value is 1" << std::endl;
+            std::cout << "--num-dispatch int_value     Determines how many command lists will be executed. The default value is 2000" << std::endl;
+            std::cout << "--stream-bench     Run the STREAM copy, scale, add and triad kernels over every storage type and vector width and a sweep of sizes, and print their GB/s next to a CPU STREAM." << std::endl;
+            std::cout << "--stream-max-size int_value     Elements of the largest --stream-bench arrays. The default value is 67108864" << std::endl;
+            std::cout << "--reduce-bench     Run the sum, max, argmax and scan over a sweep of sizes, and print their GB/s next to the multithreaded CPU versions." << std::endl;
+            std::cout << "--reduce-max-size int_value     Elements of the largest --reduce-bench input. The default value is 1073741824" << std::endl;
+            return;
+        }
+        else if (cmd == "--op")
+        {
+            std::string op = argv[i++ + 1];
+            if (op == "add")
+            {
+                m_op = ADD;
+            }
+            else if (op == "softmax")
+            {
+                m_op = SOFTMAX;
+            }
+            else if (op == "layernorm")
+            {
+                m_op = LAYERNORM;
+            }
+            else if (op == "rmsnorm")
+            {
+                m_op = RMSNORM;
+            }
+            else
+            {
+                m_op = DEVICE;
+                for (DeviceOp deviceOp : kReduceOps)
+                {
+                    if (op == DeviceOpName(deviceOp))
+                    {
+                        m_deviceOp = deviceOp;
+                        op.clear();
+                    }
+                }
+                if (!op.empty())
+                {
+                    std::cerr << "Unsupported op. Please input add, softmax, layernorm, rmsnorm, sum, max, argmax or scan." << std::endl;
+                    return;
+                }
+            }
+        }
+        else if (cmd == "--rows" || cmd == "--cols")
+        {
+            char *pNext;
+            int value = strtol(argv[i++ + 1], &pNext, 10);
+            if (value <= 0)
+            {
+                std::cerr << "The rows and columns should be larger than 0." << std::endl;
+                return;
+            }
+            (cmd == "--rows" ? m_rows : m_cols) = value;
+        }
+        else if (cmd == "--expr")
+        {
+            std::string error;
+            if (!ParseElementwiseExpr(argv[i++ + 1], m_expr, error))
+            {
+                std::cerr << error << std::endl;
+                return;
+            }
+            m_op = EXPR;
+        }
+        else if (cmd == "--size" || cmd == "--group-size")
+        {
+            char *pNext;
+            int value = strtol(argv[i++ + 1], &pNext, 10);
+            if (value <= 0)
+            {
+                std::cerr << "The size and the group size should be larger than 0." << std::endl;
+                return;
+            }
+            (cmd == "--size" ? m_dataSize : m_workGroupSizeX) = value;
+        }
+        else if (cmd == "--storage-type")
+        {
+            std::string storageType = argv[i++ + 1];
+            if (storageType == "structured_buffer")
+            {
+                m_storageType = STRUCTURED_BUFFER;
+            }
+            else if (storageType == "byteAddress_buffer")
+            {
+                m_storageType = BYTEADDRESS_BUFFER;
+            }
+            else
+            {
+                std::cerr << "Unsupported storage type. Please input structured_buffer or byteAddress_buffer." << std::endl;
+                return;
+            }
+        }
+        else if (cmd == "--vec-width")
+        {
+            char *pNext;
+            m_componentSize = strtol(argv[i++ + 1], &pNext, 10);
+            if (m_componentSize != 1 && m_componentSize != 2 && m_componentSize != 4)
+            {
+                std::cerr << "The vector width should be 1, 2 or 4." << std::endl;
+                return;
+            }
+        }
+        else if (cmd == "--num-dispatch")
+        {
+            char *pNext;
+            m_computeCount = strtol(argv[i++ + 1], &pNext, 10);
+            if (m_computeCount < 2)
+            {
+                std::cerr << "Dispatch count should be at least 2, as the first dispatch isn't timed." << std::endl;
+                return;
+            }
+        }
+        else if (cmd == "--stream-bench")
+        {
+            runStreamBenchmark = true;
+        }
+        else if (cmd == "--stream-max-size")
+        {
+            char *pNext;
+            int value = strtol(argv[i++ + 1], &pNext, 10);
+            if (value < int(kStreamMinSize))
+            {
+                std::cerr << "The largest STREAM arrays should have at least " << kStreamMinSize << " elements." << std::endl;
+                return;
+            }
+            m_streamMaxSize = value;
+        }
+        else if (cmd == "--reduce-bench")
+        {
+            runReduceBenchmark = true;
+        }
+        else if (cmd == "--reduce-max-size")
+        {
+            char *pNext;
+            long long value = strtoll(argv[i++ + 1], &pNext, 10);
+            if (value < kReduceMinSize || value > kReduceMaxSize)
+            {
+                std::cerr << "The largest reduction input should have " << kReduceMinSize << " to " << kReduceMaxSize << " elements." << std::endl;
+                return;
+            }
+            m_reduceMaxSize = UINT(value);
+        }
+        else if (cmd == "--passes")
+        {
+            std::string passes = argv[i++ + 1];
+            if (passes != "two" && passes != "single")
+            {
+                std::cerr << "Unsupported pass count. Please input two or single." << std::endl;
+                return;
+            }
+            m_singlePass = passes == "single";
+        }
+    }
+
+    if (runStreamBenchmark)
+    {
+        RunStreamBenchmark(argc, argv);
+        return;
+    }
+    if (runReduceBenchmark)
+    {
+        RunReduceBenchmark(argc, argv);
+        return;
+    }
+
+    if (m_workGroupSizeX > D3D12_CS_THREAD_GROUP_MAX_THREADS_PER_GROUP)
+    {
+        std::cerr << "A group can have at most " << D3D12_CS_THREAD_GROUP_MAX_THREADS_PER_GROUP << " threads." << std::endl;
+        return;
+    }
+    if (m_op == ADD && m_componentSize == 2)
+    {
+        std::cerr << "The add loads floats or float4s, so its vector width should be 1 or 4." << std::endl;
+        return;
+    }
+    if (m_op == ADD && m_dataSize % (m_workGroupSizeX * m_componentSize) != 0)
+    {
+        std::cerr << "The add has no bounds checks, so the size should be a multiple of the group size * " << m_componentSize << "." << std::endl;
+        return;
+    }
+    if (m_op == EXPR)
+    {
+        if (m_dataSize % m_componentSize != 0)
+        {
+            std::cerr << "The expression is evaluated on vectors of " << m_componentSize << ", so the size should be a multiple of it." << std::endl;
+            return;
+        }
+        m_inputCount = m_expr.inputCount;
+        std::cout << " " << ElementwiseExprText(m_expr) << ", " << ElementwiseExprOpCount(m_expr) << " op(s) over " << m_inputCount << " input(s), size = " << m_dataSize << std::endl;
+    }
+    if (m_op == DEVICE)
+    {
+        if ((m_workGroupSizeX & (m_workGroupSizeX - 1)) != 0)
+        {
+            std::cerr << "The reductions and the scan work in trees, so the group size should be a power of 2." << std::endl;
+            return;
+        }
+        if (m_dataSize % 4 != 0 || m_dataSize > kReduceMaxSize)
+        {
+            std::cerr << "The reductions and the scan load float4s with 32-bit byte offsets, so the size should be a multiple of 4 up to " << kReduceMaxSize << "." << std::endl;
+            return;
+        }
+        m_inputCount = 1;
+        m_componentSize = 4;
+        std::cout << " " << DeviceOpName(m_deviceOp) << ", size = " << m_dataSize << ", " << DispatchCount() << " group(s)" << std::endl;
+    }
+    if (IsRowOp())
+    {
+        if ((m_workGroupSizeX & (m_workGroupSizeX - 1)) != 0)
+        {
+            std::cerr << "The row-wise ops reduce in a tree, so the group size should be a power of 2." << std::endl;
+            return;
+        }
+        if (m_cols % 4 != 0)
+        {
+            std::cerr << "The row-wise ops load float4s, so the columns should be a multiple of 4." << std::endl;
+            return;
+        }
+        if (m_rows > D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION)
+        {
+            std::cerr << "The row-wise ops run one group per row, so there can be at most " << D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION << " rows." << std::endl;
+            return;
+        }
+        m_dataSize = m_rows * m_cols;
+        m_componentSize = 4;
+        std::cout << " " << RowOpName(RowOp(m_op)) << ", " << (m_singlePass ? "single" : "two") << " pass, rows = " << m_rows << ", cols = " << m_cols << std::endl;
+    }
+    if (DispatchCount() > D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION)
+    {
+        std::cerr << "The dispatch would need " << DispatchCount() << " groups, more than " << D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION << ". Please use a larger group or a smaller size." << std::endl;
+        return;
+    }
+
     LoadPipeline();
     LoadAssets();
     RunCompute();
@@ -144,7 +434,7 @@ void D3D12Sample::LoadPipeline()
         // Flags indicate that this descriptor heap can be bound to the pipeline 
         // and that descriptors contained in it can be referenced by a root table.
         D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
-        heapDesc.NumDescriptors = 4;  // 1 constant buffer, 2 SRV, 1 UAV.
+        heapDesc.NumDescriptors = m_inputCount + (m_op == DEVICE ? 3 : 2);  // 1 constant buffer, m_inputCount SRV, 1 UAV and the partials UAV of DEVICE.
         heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
         heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
         ThrowIfFailed(m_d3d12Device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&m_cbSrvHeap)));
@@ -172,8 +462,8 @@ void D3D12Sample::LoadAssets()
         }
         // Root signature for compute pass.
         ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE);
-        ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE);
-        ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE);
+        ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, m_inputCount, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE);
+        ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, m_op == DEVICE ? 2 : 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE);
         rootParameters[0].InitAsDescriptorTable(1, &ranges[0], D3D12_SHADER_VISIBILITY_ALL);
         rootParameters[1].InitAsDescriptorTable(1, &ranges[1], D3D12_SHADER_VISIBILITY_ALL);
         rootParameters[2].InitAsDescriptorTable(1, &ranges[2], D3D12_SHADER_VISIBILITY_ALL);
@@ -195,21 +485,80 @@ void D3D12Sample::LoadAssets()
 #ifdef USE_SLM_8X8_4X16
     ThrowIfFailed(D3DCompileFromFile(L"SLM_8X8_4X16.hlsl", nullptr, nullptr, "CSMain", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
 #else
-    const D3D_SHADER_MACRO defines[] =
+    std::vector<D3D_SHADER_MACRO> defines;
+    if (m_storageType == STRUCTURED_BUFFER)
     {
-#ifdef USE_STRUCTURED_BUFFERS
-        "USE_STRUCTURED_BUFFERS", "1",
-#endif
-#ifdef USE_VEC4
-		"USE_VEC4", "1",
-#endif
-        nullptr, nullptr
-    };
-    ThrowIfFailed(D3DCompileFromFile(L"SLM_4x4_16x16.hlsl", defines, nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, nullptr));
+        defines.push_back({ "USE_STRUCTURED_BUFFERS", "1" });
+    }
+    const std::string rowOp = std::to_string(int(m_op));
+    const std::string deviceOp = std::to_string(int(m_deviceOp));
+    const char* const scanPasses[] = { "1", "2", "3" };
+    const std::string groupSize = std::to_string(m_workGroupSizeX);
+    std::wstring shaderFile = L"SLM_4x4_16x16.hlsl";
+    if (m_op == ADD || m_op == EXPR)
+    {
+        if (m_componentSize == 4)
+        {
+            defines.push_back({ "USE_VEC4", "1" });
+        }
+        else if (m_componentSize == 2)
+        {
+            defines.push_back({ "USE_VEC2", "1" });
+        }
+        defines.push_back({ "LOCAL_GROUP_SIZE_X", groupSize.c_str() });
+    }
+    else if (m_op == DEVICE)
+    {
+        defines.push_back({ "DEVICE_OP", deviceOp.c_str() });
+        defines.push_back({ "REDUCE_GROUP_SIZE", groupSize.c_str() });
+        defines.push_back({ "SCAN_PASS", scanPasses[0] });
+        shaderFile = L"SLM_Device_Reduce.hlsl";
+    }
+    else
+    {
+        defines.push_back({ "ROW_OP", rowOp.c_str() });
+        defines.push_back({ "ROW_GROUP_SIZE", groupSize.c_str() });
+        defines.push_back({ "SINGLE_PASS", m_singlePass ? "1" : "0" });
+        shaderFile = L"SLM_Row_Reduce.hlsl";
+    }
+    if (m_op == EXPR)
+    {
+        const std::string generatedDir = "generated";
+        if (!WriteGeneratedExpr(m_expr, generatedDir))
+        {
+            throw std::runtime_error("Can't write the generated kernel to " + generatedDir + ".");
+        }
+        const std::string generatedFile = generatedDir + "/" + ElementwiseExprName(m_expr) + ".hlsl";
+        shaderFile = std::wstring(generatedFile.begin(), generatedFile.end());
+    }
+    defines.push_back({ nullptr, nullptr });
+    ComPtr<ID3DBlob> errors;
+    HRESULT hr = D3DCompileFromFile(shaderFile.c_str(), defines.data(), nullptr, "main", "cs_5_0", compileFlags, 0, &computeShader, &errors);
+    if (FAILED(hr) && errors)
+    {
+        std::cerr << static_cast<const char*>(errors->GetBufferPointer()) << std::endl;
+    }
+    ThrowIfFailed(hr);
 #endif
     descComputePSO.CS = CD3DX12_SHADER_BYTECODE(computeShader.Get());
     ThrowIfFailed(m_d3d12Device->CreateComputePipelineState(&descComputePSO, IID_PPV_ARGS(&m_computePSO)));
     m_computePSO->SetName(L"Compute PSO");
+#ifndef USE_SLM_8X8_4X16
+    // The spine and the downsweep of the scan come from the same file.
+    for (UINT pass = 2; m_op == DEVICE && m_deviceOp == DEVICE_SCAN && pass <= 3; pass++)
+    {
+        defines[defines.size() - 2].Definition = scanPasses[pass - 1];     // SCAN_PASS, the last before the terminator.
+        ComPtr<ID3DBlob> passShader;
+        hr = D3DCompileFromFile(shaderFile.c_str(), defines.data(), nullptr, "main", "cs_5_0", compileFlags, 0, &passShader, &errors);
+        if (FAILED(hr) && errors)
+        {
+            std::cerr << static_cast<const char*>(errors->GetBufferPointer()) << std::endl;
+        }
+        ThrowIfFailed(hr);
+        descComputePSO.CS = CD3DX12_SHADER_BYTECODE(passShader.Get());
+        ThrowIfFailed(m_d3d12Device->CreateComputePipelineState(&descComputePSO, IID_PPV_ARGS(&m_scanPSOs[pass - 2])));
+    }
+#endif
 
     // Create the command list.
     ThrowIfFailed(
@@ -239,7 +588,14 @@ void D3D12Sample::LoadAssets()
             IID_PPV_ARGS(&m_constantBuffer)));
 
         ResourceBarrier(m_commandList.Get(), m_constantBuffer.Get(), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_RESOURCE_STATE_COPY_DEST);
-        m_constantBufferData.M = m_dataSize;
+        m_constantBufferData.M = m_op == ADD ? m_dataSize : m_op == EXPR || m_op == DEVICE ? m_dataSize / m_componentSize : m_rows;
+        m_constantBufferData.K = DispatchCount() * m_workGroupSizeX;
+        m_constantBufferData.N = m_cols;
+        if (m_op == DEVICE)
+        {
+            m_constantBufferData.K = DispatchCount();
+            m_constantBufferData.N = (m_constantBufferData.M + DispatchCount() - 1) / DispatchCount();
+        }
 		D3D12_SUBRESOURCE_DATA bufferData = {};
         bufferData.pData = &m_constantBufferData;
         bufferData.RowPitch = sizeof(m_constantBufferData);
@@ -283,115 +639,79 @@ void D3D12Sample::LoadAssets()
 }
 
 
-void D3D12Sample::LoadSizeDependentResources()
+void D3D12Sample::CreateInputBuffer(UINT index, UINT elementCount)
 {
+    // The expressions get negative values too, for relu and gelu to matter.
+    const float scale = m_op == EXPR ? 4.0f : 1.0f;
+    const float offset = m_op == EXPR ? -2.0f : 0.0f;
+    std::vector<float>& data = m_inputData[index];
+    for ( int i = 0; i < elementCount; ++i )
     {
-        // Create the buffer1.
-        const UINT elementCount = m_dataSize;
-        for ( int i = 0; i < elementCount; ++i )
-        {
-            buf1Data.push_back((float) rand() / float(RAND_MAX));
-        }
-        const UINT bufferSize = buf1Data.size() * sizeof(float);
+        data.push_back(scale * (float) rand() / float(RAND_MAX) + offset);
+    }
+    const UINT64 bufferSize = data.size() * sizeof(float);
 
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
-            D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(&m_intermediatebuffer1)));
+    ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&m_intermediateInputBuffers[index])));
 
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
-            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
-            nullptr,
-            IID_PPV_ARGS(&m_buffer1)));
-
-        ResourceBarrier(m_commandList.Get(), m_buffer1.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
-        D3D12_SUBRESOURCE_DATA bufferData = {};
-        bufferData.pData = buf1Data.data();
-        bufferData.RowPitch = bufferSize;
-        UpdateSubresources(m_commandList.Get(), m_buffer1.Get(), m_intermediatebuffer1.Get(), 0, 0, 1, &bufferData);
-        ResourceBarrier(m_commandList.Get(), m_buffer1.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-
-        // Create SRV for the buffer1
-        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-        srvDesc.Buffer.FirstElement = 0;
-#ifdef USE_STRUCTURED_BUFFERS
+    ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+        nullptr,
+        IID_PPV_ARGS(&m_inputBuffers[index])));
+
+    ResourceBarrier(m_commandList.Get(), m_inputBuffers[index].Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
+    D3D12_SUBRESOURCE_DATA bufferData = {};
+    bufferData.pData = data.data();
+    bufferData.RowPitch = bufferSize;
+    UpdateSubresources(m_commandList.Get(), m_inputBuffers[index].Get(), m_intermediateInputBuffers[index].Get(), 0, 0, 1, &bufferData);
+    ResourceBarrier(m_commandList.Get(), m_inputBuffers[index].Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+    // Create SRV for the input
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+    srvDesc.Buffer.FirstElement = 0;
+    if (m_storageType == STRUCTURED_BUFFER)
+    {
         srvDesc.Format = DXGI_FORMAT_UNKNOWN;
         srvDesc.Buffer.NumElements = elementCount / m_componentSize;
         srvDesc.Buffer.StructureByteStride = m_componentSize * sizeof(float);
         srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
-#else
+    }
+    else
+    {
         srvDesc.Format = DXGI_FORMAT_R32_TYPELESS;
         srvDesc.Buffer.NumElements = elementCount;
         srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
-#endif // USE_STRUCTURED_BUFFERS
-        CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
-        srvHandle.Offset(1, m_cbSrvDescriptorSize); // First one is for constant buffer.
-        m_d3d12Device->CreateShaderResourceView(m_buffer1.Get(), &srvDesc, srvHandle);
     }
+    CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
+    srvHandle.Offset(1 + index, m_cbSrvDescriptorSize); // First one is for constant buffer.
+    m_d3d12Device->CreateShaderResourceView(m_inputBuffers[index].Get(), &srvDesc, srvHandle);
+}
 
-	{
-        // create the buffer2
-        const UINT elementCount = m_dataSize;
-        for ( int i = 0; i < elementCount; ++i )
-        {
-            buf2Data.push_back((float) rand() / float(RAND_MAX));
-        }
-        const UINT bufferSize = buf2Data.size() * sizeof(float);
-
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
-            D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(&m_intermediatebuffer2)));
+void D3D12Sample::LoadSizeDependentResources()
+{
+    m_inputBuffers.resize(m_inputCount);
+    m_intermediateInputBuffers.resize(m_inputCount);
+    m_inputData.resize(m_inputCount);
+    for (UINT i = 0; i < m_inputCount; i++)
+    {
+        // The row-wise ops read gamma and beta of one row from the second input.
+        CreateInputBuffer(i, IsRowOp() && i == 1 ? 2 * m_cols : m_dataSize);
+    }
 
-        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-            D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
-            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
-            nullptr,
-            IID_PPV_ARGS(&m_buffer2)));
-
-        ResourceBarrier(m_commandList.Get(), m_buffer2.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
-        D3D12_SUBRESOURCE_DATA bufferData = {};
-        bufferData.pData = buf2Data.data();
-        bufferData.RowPitch = bufferSize;
-        UpdateSubresources(m_commandList.Get(), m_buffer2.Get(), m_intermediatebuffer2.Get(), 0, 0, 1, &bufferData);
-        ResourceBarrier(m_commandList.Get(), m_buffer2.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-
-        // Create SRV for buffer2
-        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-        srvDesc.Buffer.FirstElement = 0;
-#ifdef USE_STRUCTURED_BUFFERS
-        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
-        srvDesc.Buffer.NumElements = elementCount / m_componentSize;
-        srvDesc.Buffer.StructureByteStride = m_componentSize * sizeof(float);
-        srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
-#else
-        srvDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-        srvDesc.Buffer.NumElements = elementCount;
-        srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
-#endif
-        CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
-        srvHandle.Offset(2, m_cbSrvDescriptorSize); // First one is for constant buffer. Senond one is for buffer1
-        m_d3d12Device->CreateShaderResourceView(m_buffer2.Get(), &srvDesc, srvHandle);
-	}
         // Create bufferResult and UAV for it.
         {
-        const UINT elementCount = m_dataSize;
-        const UINT bufferSize = elementCount * sizeof(float);
+        const UINT elementCount = ResultCount();
+        const UINT64 bufferSize = UINT64(elementCount) * sizeof(float);
 
             ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
                 &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
@@ -406,21 +726,49 @@ void D3D12Sample::LoadSizeDependentResources()
             D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
             uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
             uavDesc.Buffer.FirstElement = 0;
-#ifdef USE_STRUCTURED_BUFFERS
-            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
-            uavDesc.Buffer.NumElements = elementCount / m_componentSize;
-            uavDesc.Buffer.StructureByteStride = m_componentSize * sizeof(float);
-            uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
-#else
-            uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-            uavDesc.Buffer.NumElements = elementCount;
-            uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
-#endif
+            if (m_storageType == STRUCTURED_BUFFER)
+            {
+                uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+                uavDesc.Buffer.NumElements = elementCount / m_componentSize;
+                uavDesc.Buffer.StructureByteStride = m_componentSize * sizeof(float);
+                uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
+            }
+            else
+            {
+                uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+                uavDesc.Buffer.NumElements = elementCount;
+                uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
+            }
             CD3DX12_CPU_DESCRIPTOR_HANDLE uavHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
-            uavHandle.Offset(3, m_cbSrvDescriptorSize); // First one is for constant buffer. Senond one is for buffer1. Third one is for buffer2.
+            uavHandle.Offset(1 + m_inputCount, m_cbSrvDescriptorSize); // First one is for constant buffer, then one per input.
             m_d3d12Device->CreateUnorderedAccessView(m_bufferResult.Get(), nullptr, &uavDesc, uavHandle);
         }
 
+    // Create the partials buffer of the device-wide ops and its raw UAV, right
+    // after the output's. Committed resources start zeroed, which the ticket
+    // counter relies on.
+    if (m_op == DEVICE)
+    {
+        const UINT partialsSize = 16 + 8 * DispatchCount();
+        ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(partialsSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+            D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+            nullptr,
+            IID_PPV_ARGS(&m_partialsBuffer)));
+
+        D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+        uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+        uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+        uavDesc.Buffer.FirstElement = 0;
+        uavDesc.Buffer.NumElements = partialsSize / sizeof(UINT);
+        uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
+        CD3DX12_CPU_DESCRIPTOR_HANDLE uavHandle(m_cbSrvHeap->GetCPUDescriptorHandleForHeapStart());
+        uavHandle.Offset(2 + m_inputCount, m_cbSrvDescriptorSize);
+        m_d3d12Device->CreateUnorderedAccessView(m_partialsBuffer.Get(), nullptr, &uavDesc, uavHandle);
+    }
+
     // Create the query result buffer.
     {
         // Two timestamps for each frame.
@@ -462,7 +810,7 @@ void D3D12Sample::RunCompute()
         m_commandList->SetComputeRootDescriptorTable(0, gpuSrvDescriptorHandle);
         gpuSrvDescriptorHandle.Offset(1, m_cbSrvDescriptorSize);
         m_commandList->SetComputeRootDescriptorTable(1, gpuSrvDescriptorHandle);
-        gpuSrvDescriptorHandle.Offset(2, m_cbSrvDescriptorSize);
+        gpuSrvDescriptorHandle.Offset(m_inputCount, m_cbSrvDescriptorSize);
         m_commandList->SetComputeRootDescriptorTable(2, gpuSrvDescriptorHandle);
 
         m_commandList->SetPipelineState(m_computePSO.Get());
@@ -470,7 +818,19 @@ void D3D12Sample::RunCompute()
         // Get a timestamp at the before and after dispatch command.
         const UINT timestampHeapIndex = 2 * it;
         m_commandList->EndQuery(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampHeapIndex);
-        m_commandList->Dispatch(m_dataSize / (m_workGroupSizeX * m_componentSize), 1, 1);
+        m_commandList->Dispatch(DispatchCount(), 1, 1);
+        if (m_op == DEVICE && m_deviceOp == DEVICE_SCAN)
+        {
+            // The spine scans the group sums in one group once the upsweep has
+            // written them all, and the downsweep starts from its results.
+            const CD3DX12_RESOURCE_BARRIER uavBarrier = CD3DX12_RESOURCE_BARRIER::UAV(m_partialsBuffer.Get());
+            m_commandList->ResourceBarrier(1, &uavBarrier);
+            m_commandList->SetPipelineState(m_scanPSOs[0].Get());
+            m_commandList->Dispatch(1, 1, 1);
+            m_commandList->ResourceBarrier(1, &uavBarrier);
+            m_commandList->SetPipelineState(m_scanPSOs[1].Get());
+            m_commandList->Dispatch(DispatchCount(), 1, 1);
+        }
         m_commandList->EndQuery(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampHeapIndex + 1);
         m_commandList->ResolveQueryData(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampHeapIndex, 2, m_queryResult.Get(), timestampHeapIndex * sizeof(UINT64));
 
@@ -522,12 +882,56 @@ void D3D12Sample::RunCompute()
     avg_kernel = total_kernel / (m_computeCount - 1);
     printf("Avg_time = %f us, Avg_kernel_time = %f us, min_time = %f us\n",
            avg_time, avg_kernel, minTime);
+    if (m_op == ADD)
+    {
+        const double bytes = 3.0 * m_dataSize * sizeof(float);
+        m_runResult.bandwidth = bytes / avg_kernel / 1000;
+        m_runResult.peakBandwidth = bytes / minTime / 1000;
+        printf("Avg bandwidth = %f GB/s, peak bandwidth = %f GB/s\n", m_runResult.bandwidth, m_runResult.peakBandwidth);
+    }
+    else if (m_op == EXPR)
+    {
+        // The fused kernel moves each input and the result once; one kernel per
+        // op would move every intermediate value out and back in as well.
+        const double bytes = double(ElementwiseExprFusedTraffic(m_expr)) * m_dataSize * sizeof(float);
+        const double unfusedBytes = double(ElementwiseExprUnfusedTraffic(m_expr)) * m_dataSize * sizeof(float);
+        m_runResult.bandwidth = bytes / avg_kernel / 1000;
+        m_runResult.peakBandwidth = bytes / minTime / 1000;
+        printf("Avg bandwidth = %f GB/s, peak bandwidth = %f GB/s, %f GOPS\n", m_runResult.bandwidth, m_runResult.peakBandwidth,
+               double(ElementwiseExprOpCount(m_expr)) * m_dataSize / avg_kernel / 1000);
+        printf("Fused traffic = %.1f MB; one kernel per op would move %.1f MB, %.2fx as much\n", bytes / 1e6, unfusedBytes / 1e6, unfusedBytes / bytes);
+    }
+    else if (m_op == DEVICE)
+    {
+        // A reduction reads its input once; a scan at best reads it and writes
+        // its output once, and reduce-then-scan reads the input once more.
+        const double bytes = (m_deviceOp == DEVICE_SCAN ? 2.0 : 1.0) * m_dataSize * sizeof(float);
+        m_runResult.bandwidth = bytes / avg_kernel / 1000;
+        m_runResult.peakBandwidth = bytes / minTime / 1000;
+        printf("Effective bandwidth = %f GB/s, peak = %f GB/s, %f Gelements/s\n", m_runResult.bandwidth, m_runResult.peakBandwidth,
+               m_dataSize / avg_kernel / 1000);
+        if (m_deviceOp == DEVICE_SCAN)
+        {
+            printf("2 reads + 1 write issue %f GB/s\n", 1.5 * m_runResult.bandwidth);
+        }
+    }
+    else
+    {
+        // A row-wise op has to read its input and write its output once. Every
+        // pass gathering statistics reads the row once more, from cache at best.
+        const double bytes = 2.0 * m_dataSize * sizeof(float);
+        const int passes = RowOpInputPasses(RowOp(m_op), m_singlePass);
+        m_runResult.bandwidth = bytes / avg_kernel / 1000;
+        m_runResult.peakBandwidth = bytes / minTime / 1000;
+        printf("Effective bandwidth = %f GB/s, peak = %f GB/s; %d reads + 1 write issue %f GB/s, %.0f%% of it needed\n",
+               bytes / avg_kernel / 1000, bytes / minTime / 1000, passes, bytes * (passes + 1) / 2 / avg_kernel / 1000, 200.0 / (passes + 1));
+    }
 
     m_computeAllocator->Reset();
     m_commandList->Reset(m_computeAllocator.Get(), m_computePSO.Get());
 #ifdef PRINT_DATA
     // Read data back to verify the result
-    UINT64 outputBufferSize = m_dataSize * sizeof(float);
+    UINT64 outputBufferSize = UINT64(ResultCount()) * sizeof(float);
     ComPtr<ID3D12Resource> readbackBuffer;
     ThrowIfFailed(m_d3d12Device->CreateCommittedResource(
         &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
@@ -554,10 +958,10 @@ void D3D12Sample::RunCompute()
         &readbackBufferRange,
         reinterpret_cast<void**>(&pReadbackBufferData)));
 	bool hasError = false;
-	for (int i = 0; i < m_dataSize; i++)
+	for (int i = 0; m_op == ADD && i < m_dataSize; i++)
 	{
 		float gpuResult = pReadbackBufferData[i];
-		float cpuResult = buf1Data[i] + buf2Data[i];
+		float cpuResult = m_inputData[0][i] + m_inputData[1][i];
 		if (abs(gpuResult - cpuResult) > 0.003)
 		{
 			hasError = true;
@@ -565,10 +969,344 @@ void D3D12Sample::RunCompute()
 			break;
 		}
 	}
+    if (m_op == EXPR)
+    {
+        ReportExpr(pReadbackBufferData);
+    }
+    else if (m_op == DEVICE)
+    {
+        ReportDeviceOp(pReadbackBufferData);
+    }
+    else if (IsRowOp())
+    {
+        ReportRowOp(pReadbackBufferData);
+    }
     readbackBuffer->Unmap(0, &emptyRange);
 #endif // PRINT_DATA
 }
 
+// Checks a row-wise op against the fp64 reference and times the SIMD CPU version,
+// which makes the same passes over each row.
+void D3D12Sample::ReportRowOp(const float* pGpuResult)
+{
+    const RowOp op = RowOp(m_op);
+    const float* gamma = m_inputData[1].data();
+    const float* beta = gamma + m_cols;
+    std::vector<double> reference(m_dataSize);
+    CpuRowOpReference(op, m_inputData[0].data(), gamma, beta, reference.data(), m_rows, m_cols);
+
+    std::vector<float> cpuResult(m_dataSize);
+    auto start = std::chrono::steady_clock::now();
+    CpuRowOp(op, m_singlePass, m_inputData[0].data(), gamma, beta, cpuResult.data(), m_rows, m_cols);
+    auto end = std::chrono::steady_clock::now();
+    double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+    double maxGpuError = 0.0;
+    double maxCpuError = 0.0;
+    double maxReference = 0.0;
+    for (UINT i = 0; i < m_dataSize; i++)
+    {
+        maxGpuError = (std::max)(maxGpuError, std::abs(pGpuResult[i] - reference[i]));
+        maxCpuError = (std::max)(maxCpuError, std::abs(cpuResult[i] - reference[i]));
+        maxReference = (std::max)(maxReference, std::abs(reference[i]));
+    }
+    printf("Max rel error vs fp64: GPU = %e, CPU = %e\n", maxGpuError / maxReference, maxCpuError / maxReference);
+    printf("CPU time = %f us, CPU effective bandwidth = %f GB/s\n", cpuTimeUS, 2.0 * m_dataSize * sizeof(float) / cpuTimeUS / 1000);
+}
+
+// Checks a generated kernel against the expression in fp64, and times the CPU
+// evaluating it fused and one op at a time.
+void D3D12Sample::ReportExpr(const float* pGpuResult)
+{
+    std::vector<const float*> inputs;
+    for (const std::vector<float>& data : m_inputData)
+    {
+        inputs.push_back(data.data());
+    }
+    std::vector<double> reference(m_dataSize);
+    CpuElementwiseExprReference(m_expr, inputs.data(), reference.data(), m_dataSize);
+
+    std::vector<float> cpuResult(m_dataSize);
+    auto start = std::chrono::steady_clock::now();
+    CpuElementwiseExpr(m_expr, inputs.data(), cpuResult.data(), m_dataSize);
+    auto middle = std::chrono::steady_clock::now();
+    std::vector<float> unfusedResult(m_dataSize);
+    CpuElementwiseExprUnfused(m_expr, inputs.data(), unfusedResult.data(), m_dataSize);
+    auto end = std::chrono::steady_clock::now();
+    double fusedTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(middle - start).count());
+    double unfusedTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - middle).count());
+
+    double maxGpuError = 0.0;
+    double maxCpuError = 0.0;
+    double maxReference = 0.0;
+    for (UINT i = 0; i < m_dataSize; i++)
+    {
+        maxGpuError = (std::max)(maxGpuError, std::abs(pGpuResult[i] - reference[i]));
+        maxCpuError = (std::max)(maxCpuError, std::abs(cpuResult[i] - reference[i]));
+        maxReference = (std::max)(maxReference, std::abs(reference[i]));
+    }
+    // half() and int() turn tiny differences upstream into a step of the
+    // rounding, so expressions using them can show larger errors.
+    m_runResult.maxRelError = maxGpuError / (std::max)(maxReference, 1e-30);
+    printf("Max rel error vs fp64: GPU = %e, CPU = %e\n", m_runResult.maxRelError, maxCpuError / (std::max)(maxReference, 1e-30));
+    const double bytes = double(ElementwiseExprFusedTraffic(m_expr)) * m_dataSize * sizeof(float);
+    printf("CPU fused time = %f us, %f GB/s; one pass per op = %f us, %.2fx slower\n", fusedTimeUS, bytes / fusedTimeUS / 1000,
+           unfusedTimeUS, unfusedTimeUS / fusedTimeUS);
+}
+
+// Checks a reduction or the scan against fp64 and times the multithreaded CPU
+// version on the same input.
+void D3D12Sample::ReportDeviceOp(const float* pGpuResult)
+{
+    const float* x = m_inputData[0].data();
+    if (m_deviceOp != DEVICE_SCAN)
+    {
+        const ReduceResult reference = CpuReduceReference(m_deviceOp, x, m_dataSize);
+        auto start = std::chrono::steady_clock::now();
+        const ReduceResult cpuResult = CpuReduce(m_deviceOp, x, m_dataSize);
+        auto end = std::chrono::steady_clock::now();
+        double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+        // The GPU stores the index of argmax as the bits of the second float.
+        const UINT gpuIndex = reinterpret_cast<const UINT*>(pGpuResult)[1];
+        const double scale = (std::max)(std::abs(reference.value), 1e-30);
+        m_runResult.maxRelError = std::abs(pGpuResult[0] - reference.value) / scale;
+        printf("Result: fp64 = %f, GPU = %f, CPU = %f; rel error GPU = %e, CPU = %e\n", reference.value, pGpuResult[0], cpuResult.value,
+               m_runResult.maxRelError, std::abs(cpuResult.value - reference.value) / scale);
+        if (m_deviceOp == DEVICE_ARGMAX)
+        {
+            printf("Index: expected %d, GPU = %u, CPU = %d%s\n", reference.index, gpuIndex, cpuResult.index,
+                   int(gpuIndex) == reference.index && cpuResult.index == reference.index ? "" : ", not the first maximum");
+        }
+        printf("CPU time = %f us, CPU effective bandwidth = %f GB/s\n", cpuTimeUS, double(m_dataSize) * sizeof(float) / cpuTimeUS / 1000);
+        return;
+    }
+
+    std::vector<float> cpuResult(m_dataSize);
+    auto start = std::chrono::steady_clock::now();
+    CpuExclusiveScan(x, cpuResult.data(), m_dataSize);
+    auto end = std::chrono::steady_clock::now();
+    double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+    // The fp64 prefix is accumulated on the fly rather than stored, which for
+    // 2^30 elements would take 8 GB.
+    double prefix = 0.0;
+    double maxGpuError = 0.0;
+    double maxCpuError = 0.0;
+    for (UINT i = 0; i < m_dataSize; i++)
+    {
+        maxGpuError = (std::max)(maxGpuError, std::abs(pGpuResult[i] - prefix));
+        maxCpuError = (std::max)(maxCpuError, std::abs(cpuResult[i] - prefix));
+        prefix += x[i];
+    }
+    // The inputs aren't negative, so the last prefix is the largest.
+    const double maxReference = (std::max)(prefix - x[m_dataSize - 1], 1e-30);
+    m_runResult.maxRelError = maxGpuError / maxReference;
+    printf("Max rel error vs fp64: GPU = %e, CPU = %e\n", m_runResult.maxRelError, maxCpuError / maxReference);
+    printf("CPU time = %f us, CPU effective bandwidth = %f GB/s\n", cpuTimeUS, 2.0 * m_dataSize * sizeof(float) / cpuTimeUS / 1000);
+}
+
+UINT D3D12Sample::DispatchCount() const
+{
+    if (m_op == ADD)
+    {
+        return m_dataSize / (m_workGroupSizeX * m_componentSize);
+    }
+    if (m_op == EXPR)
+    {
+        // The generated kernels stride over whatever the groups don't cover.
+        const UINT values = m_dataSize / m_componentSize;
+        return (std::min)((values + m_workGroupSizeX - 1) / m_workGroupSizeX, UINT(D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION));
+    }
+    if (m_op == DEVICE)
+    {
+        // One float4 per thread until the groups run out, then longer ranges.
+        const UINT vectors = m_dataSize / 4;
+        return (std::min)((vectors + m_workGroupSizeX - 1) / m_workGroupSizeX, kDeviceOpMaxGroups);
+    }
+    return m_rows;
+}
+
+// Floats of the output: one float4 for the reductions, else one per element.
+UINT D3D12Sample::ResultCount() const
+{
+    return m_op == DEVICE && m_deviceOp != DEVICE_SCAN ? 4 : m_dataSize;
+}
+
+// Runs every STREAM kernel as a generated expression over each storage type,
+// vector width and size in a D3D12Sample of its own, times CpuStream on the
+// same sizes, and prints one GB/s curve per configuration, size by size.
+void D3D12Sample::RunStreamBenchmark(int argc, char *argv[])
+{
+    const STORAGETYPE storageTypes[] = { STRUCTURED_BUFFER, BYTEADDRESS_BUFFER };
+    const char* const storageNames[] = { "structured_buffer", "byteAddress_buffer" };
+    const UINT vecWidths[] = { 1, 2, 4 };
+    std::vector<UINT> sizes;
+    for (UINT64 size = kStreamMinSize; size <= m_streamMaxSize; size *= 4)
+    {
+        sizes.push_back(UINT(size));
+    }
+
+    for (const StreamKernel& kernel : kStreamKernels)
+    {
+        // gpuBandwidth[size][storage type * 3 + vector width index]
+        std::vector<std::vector<double>> gpuBandwidth(sizes.size());
+        std::vector<double> cpuBandwidth(sizes.size());
+        for (size_t s = 0; s < sizes.size(); s++)
+        {
+            // Enough dispatches to move about 4 GB, so that the small sizes get
+            // past the timer resolution and the large ones don't take minutes.
+            const double bytes = double(StreamOpArrays(kernel.op)) * sizes[s] * sizeof(float);
+            const UINT dispatches = UINT((std::min)((std::max)(4e9 / bytes, 20.0), 2000.0));
+            for (UINT t = 0; t < _countof(storageTypes); t++)
+            {
+                for (UINT vecWidth : vecWidths)
+                {
+                    std::vector<std::string> args;
+                    for (int i = 0; i < argc; i++)
+                    {
+                        if (std::string(argv[i]) != "--stream-bench")
+                        {
+                            args.push_back(argv[i]);
+                        }
+                    }
+                    args.insert(args.end(), { "--expr", kernel.expr, "--size", std::to_string(sizes[s]), "--storage-type", storageNames[t],
+                                              "--vec-width", std::to_string(vecWidth), "--num-dispatch", std::to_string(dispatches) });
+                    std::vector<char*> runArgv;
+                    for (std::string& arg : args)
+                    {
+                        runArgv.push_back(&arg[0]);
+                    }
+
+                    std::cout << "=== STREAM " << StreamOpName(kernel.op) << ", " << sizes[s] << " elements, " << storageNames[t] << ", vec" << vecWidth << " ===" << std::endl;
+                    D3D12Sample sample;
+                    sample.Start(int(runArgv.size()), runArgv.data());
+                    gpuBandwidth[s].push_back(sample.GetRunResult().bandwidth);
+                }
+            }
+
+            std::vector<float> x(sizes[s], 1.0f);
+            std::vector<float> y(sizes[s], 2.0f);
+            std::vector<float> out(sizes[s]);
+            const int reps = int((std::min)((std::max)(4e9 / bytes, 5.0), 1e6));
+            CpuStream(kernel.op, x.data(), y.data(), out.data(), sizes[s], 1);
+            auto start = std::chrono::steady_clock::now();
+            CpuStream(kernel.op, x.data(), y.data(), out.data(), sizes[s], reps);
+            auto end = std::chrono::steady_clock::now();
+            const double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+            cpuBandwidth[s] = bytes * reps / cpuTimeUS / 1000;
+        }
+
+        printf("\nSTREAM %s (%s), GB/s over the average dispatch; %d arrays per element\n", StreamOpName(kernel.op), kernel.expr, StreamOpArrays(kernel.op));
+        printf("%12s %12s", "Elements", "Array KB");
+        for (UINT t = 0; t < _countof(storageTypes); t++)
+        {
+            for (UINT vecWidth : vecWidths)
+            {
+                printf(" %10s%u", t == 0 ? "struct vec" : "byte vec", vecWidth);
+            }
+        }
+        printf(" %11s\n", "CPU");
+        for (size_t s = 0; s < sizes.size(); s++)
+        {
+            printf("%12u %12.0f", sizes[s], sizes[s] * sizeof(float) / 1024.0);
+            for (double bandwidth : gpuBandwidth[s])
+            {
+                printf(" %11.1f", bandwidth);
+            }
+            printf(" %11.1f\n", cpuBandwidth[s]);
+        }
+    }
+}
+
+// Runs the reductions and the scan in a D3D12Sample of its own for every size
+// from kReduceMinSize to m_reduceMaxSize, times the CPU versions on the same
+// sizes, and prints GB/s per op, size by size. Sizes a device can't allocate
+// are reported as 0.
+void D3D12Sample::RunReduceBenchmark(int argc, char *argv[])
+{
+    std::vector<UINT> sizes;
+    for (UINT64 size = kReduceMinSize; size <= m_reduceMaxSize; size *= 4)
+    {
+        sizes.push_back(UINT(size));
+    }
+
+    for (DeviceOp op : kReduceOps)
+    {
+        std::vector<RunResult> gpuResults(sizes.size());
+        std::vector<double> cpuBandwidth(sizes.size());
+        for (size_t s = 0; s < sizes.size(); s++)
+        {
+            // Enough dispatches to move about 4 GB, as --stream-bench does.
+            const double bytes = (op == DEVICE_SCAN ? 2.0 : 1.0) * sizes[s] * sizeof(float);
+            const UINT dispatches = UINT((std::min)((std::max)(4e9 / bytes, 10.0), 2000.0));
+            {
+                std::vector<std::string> args;
+                for (int i = 0; i < argc; i++)
+                {
+                    if (std::string(argv[i]) != "--reduce-bench")
+                    {
+                        args.push_back(argv[i]);
+                    }
+                }
+                args.insert(args.end(), { "--op", DeviceOpName(op), "--size", std::to_string(sizes[s]), "--num-dispatch", std::to_string(dispatches) });
+                std::vector<char*> runArgv;
+                for (std::string& arg : args)
+                {
+                    runArgv.push_back(&arg[0]);
+                }
+
+                std::cout << "=== " << DeviceOpName(op) << ", " << sizes[s] << " elements ===" << std::endl;
+                D3D12Sample sample;
+                try
+                {
+                    sample.Start(int(runArgv.size()), runArgv.data());
+                }
+                catch (const std::exception& e)
+                {
+                    std::cerr << "Skipped: " << e.what() << std::endl;
+                }
+                gpuResults[s] = sample.GetRunResult();
+            }
+
+            std::vector<float> x(sizes[s]);
+            for (float& value : x)
+            {
+                value = (float) rand() / float(RAND_MAX);
+            }
+            std::vector<float> y(op == DEVICE_SCAN ? sizes[s] : 0);
+            const int reps = int((std::min)((std::max)(4e9 / bytes, 3.0), 10000.0));
+            auto run = [&]() {
+                if (op == DEVICE_SCAN)
+                {
+                    CpuExclusiveScan(x.data(), y.data(), int(sizes[s]));
+                }
+                else
+                {
+                    CpuReduce(op, x.data(), int(sizes[s]));
+                }
+            };
+            run();
+            auto start = std::chrono::steady_clock::now();
+            for (int rep = 0; rep < reps; rep++)
+            {
+                run();
+            }
+            auto end = std::chrono::steady_clock::now();
+            const double cpuTimeUS = double(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+            cpuBandwidth[s] = bytes * reps / cpuTimeUS / 1000;
+        }
+
+        printf("\n%s, effective GB/s: the input read once%s\n", DeviceOpName(op), op == DEVICE_SCAN ? " and the output written once" : "");
+        printf("%12s %12s %12s %12s %12s %12s\n", "Elements", "Input KB", "GPU", "GPU peak", "GPU error", "CPU");
+        for (size_t s = 0; s < sizes.size(); s++)
+        {
+            printf("%12u %12.0f %12.1f %12.1f %12.1e %12.1f\n", sizes[s], sizes[s] * sizeof(float) / 1024.0, gpuResults[s].bandwidth,
+                   gpuResults[s].peakBandwidth, gpuResults[s].maxRelError, cpuBandwidth[s]);
+        }
+    }
+}
+
 // Wait for pending GPU work to complete.
 void D3D12Sample::WaitForGpu()
 {
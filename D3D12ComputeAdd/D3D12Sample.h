@@ -11,6 +11,7 @@
 
 #pragma once
 #include <stdexcept>
+#include "CpuKernels.h"
 using namespace DirectX;
 
 // Note that while ComPtr is used to manage the lifetime of resources on the CPU,
@@ -49,7 +50,18 @@ public:
         throw HrException(hr);
     }
 }
-    void Start();
+    void Start(int argc, char *argv[]);
+
+    // Speed and accuracy of the last run. The error compares the GPU result
+    // with an fp64 CPU reference and is only filled in for --expr when
+    // PRINT_DATA is defined.
+    struct RunResult
+    {
+        double bandwidth;       // GB/s over the average kernel time.
+        double peakBandwidth;   // GB/s over the fastest dispatch.
+        double maxRelError;     // max |dst - ref| / max |ref|
+    };
+    inline const RunResult& GetRunResult() const { return m_runResult; }
 
 private:
     struct SceneConstantBuffer
@@ -68,17 +80,19 @@ private:
     ComPtr<ID3D12DescriptorHeap> m_cbSrvHeap;
     ComPtr<ID3D12QueryHeap> m_queryHeap;
     ComPtr<ID3D12PipelineState> m_computePSO;
+    ComPtr<ID3D12PipelineState> m_scanPSOs[2];  // The spine and downsweep of DEVICE_SCAN; m_computePSO is its upsweep.
     ComPtr<ID3D12GraphicsCommandList> m_commandList;
     UINT m_cbSrvDescriptorSize;
 
     // App resources.
     ComPtr<ID3D12Resource> m_intermediateBuffer;
     ComPtr<ID3D12Resource> m_constantBuffer;
-    ComPtr<ID3D12Resource> m_intermediatebuffer1;
-    ComPtr<ID3D12Resource> m_intermediatebuffer2;
-    ComPtr<ID3D12Resource> m_buffer1;
-    ComPtr<ID3D12Resource> m_buffer2;
+    // The inputs bound to t0, t1, ...: the addends, the rows and gamma/beta of
+    // the row-wise ops, or the inputs of an expression.
+    std::vector<ComPtr<ID3D12Resource>> m_intermediateInputBuffers;
+    std::vector<ComPtr<ID3D12Resource>> m_inputBuffers;
     ComPtr<ID3D12Resource> m_bufferResult;
+    ComPtr<ID3D12Resource> m_partialsBuffer;    // Per-group results of the device-wide ops, bound to u1.
     ComPtr<ID3D12Resource> m_queryResult;
 
     SceneConstantBuffer m_constantBufferData;
@@ -90,18 +104,57 @@ private:
     UINT64 m_computeFenceValue;
     UINT64 m_timestampFrequency;
 
+    // ADD is the elementwise add of SLM_4X4_16X16.hlsl; SOFTMAX to RMSNORM are
+    // the row-wise ops of SLM_Row_Reduce.hlsl, with the same values as RowOp;
+    // EXPR is a kernel ElementwiseExpr generates for --expr; DEVICE is the
+    // reduction or scan of SLM_Device_Reduce.hlsl m_deviceOp selects.
+    enum OPTYPE : short
+    {
+        ADD = 0,
+        SOFTMAX = ROW_SOFTMAX,
+        LAYERNORM = ROW_LAYERNORM,
+        RMSNORM = ROW_RMSNORM,
+        EXPR,
+        DEVICE,
+    };
+    OPTYPE m_op;
+    ElementwiseExpr m_expr;
+    DeviceOp m_deviceOp;
+    inline bool IsRowOp() const { return m_op == SOFTMAX || m_op == LAYERNORM || m_op == RMSNORM; }
+    enum STORAGETYPE : short
+    {
+        STRUCTURED_BUFFER,
+        BYTEADDRESS_BUFFER,
+    };
+    STORAGETYPE m_storageType;
+    // The row-wise ops normalise m_rows rows of m_cols floats, one group per row.
+    UINT m_rows;
+    UINT m_cols;
+    bool m_singlePass;
+
 	UINT m_dataSize;
 	UINT m_workGroupSizeX;
 	UINT m_componentSize;
 	UINT m_computeCount = 2000;
-	std::vector<float> buf1Data;
-	std::vector<float> buf2Data;
+	UINT m_inputCount;
+	std::vector<std::vector<float>> m_inputData;   // The second input of the row-wise ops holds gamma, then beta.
+	UINT m_streamMaxSize;   // Largest array of --stream-bench, in elements.
+	UINT m_reduceMaxSize;   // Largest input of --reduce-bench, in elements.
+	RunResult m_runResult;
 
 	void GetHardwareAdapter(IDXGIFactory2* pFactory, IDXGIAdapter1** ppAdapter);
     void CreateDevice(const ComPtr<IDXGIFactory4>& factory);
     void LoadPipeline();
     void LoadAssets();
     void LoadSizeDependentResources();
+    void CreateInputBuffer(UINT index, UINT elementCount);
+    UINT DispatchCount() const;
+    UINT ResultCount() const;
+    void ReportRowOp(const float* pGpuResult);
+    void ReportExpr(const float* pGpuResult);
+    void ReportDeviceOp(const float* pGpuResult);
+    void RunStreamBenchmark(int argc, char *argv[]);
+    void RunReduceBenchmark(int argc, char *argv[]);
     void WaitForGpu();
     void RunCompute();
 };
@@ -0,0 +1,749 @@
+// ElementwiseExpr.cpp : Compiles elementwise expressions into fused kernels.
+//
+// The parser builds the node list directly, sharing equal nodes and folding
+// constants as it goes. Both outputs then give every node one local variable,
+// so the generated code is a straight run of assignments between the loads of
+// the inputs and the store of the result.
+
+#include "pch.h"
+#include "ElementwiseExpr.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    const char kHlslTemplate[] = R"HLSL(// Generated by ElementwiseExpr for $TEXT$. Regenerate it with
+// "D3D12ComputeAdd --expr <expression>" instead of editing it.
+//
+// dst = $TEXT$ over M values. Every input is loaded once and the $OPS$ op(s)
+// in between stay in registers. The threads stride over the values K apart, so
+// one dispatch of at most 65535 groups covers any M.
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;      // Values of dst: floats, or float2s/float4s with USE_VEC2/USE_VEC4.
+    int K;      // Threads of the dispatch.
+    int N;
+    int TILE_K;
+}
+
+struct CS_INPUT
+{
+    uint3 dx_GlobalInvocationID : SV_DispatchThreadID;
+};
+
+#ifdef USE_VEC4
+#define VALUE float4
+#define VALUE_BYTES 16
+#define LOAD Load4
+#define STORE Store4
+#elif defined(USE_VEC2)
+#define VALUE float2
+#define VALUE_BYTES 8
+#define LOAD Load2
+#define STORE Store2
+#else
+#define VALUE float
+#define VALUE_BYTES 4
+#define LOAD Load
+#define STORE Store
+#endif  // USE_VEC4
+
+#ifdef USE_STRUCTURED_BUFFERS
+$STRUCTURED_BUFFERS$RWStructuredBuffer<VALUE> dst : register(u0);
+
+$STRUCTURED_READS$void mm_write(int index, VALUE value) {
+    dst[index] = value;
+}
+#else
+$RAW_BUFFERS$RWByteAddressBuffer dst : register(u0);
+
+$RAW_READS$void mm_write(int index, VALUE value) {
+    dst.STORE(VALUE_BYTES * index, asuint(value));
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+[numthreads(LOCAL_GROUP_SIZE_X, 1, 1)]
+void main(CS_INPUT input)
+{
+    for (int index = int(input.dx_GlobalInvocationID.x); index < M; index += K) {
+$BODY$        mm_write(index, $RESULT$);
+    }
+}
+)HLSL";
+
+    const char kCpuTemplate[] = R"CPP(// Generated by ElementwiseExpr for $TEXT$. Regenerate it with
+// "D3D12ComputeAdd --expr <expression>" instead of editing it.
+//
+// The CPU counterpart of $NAME$.hlsl: out = $TEXT$ over count
+// elements, in one loop that keeps every intermediate value in a register.
+
+#pragma once
+#include "CpuKernels.h"
+#include <cmath>
+$HELPERS$
+inline void CpuExpr_$NAME$(const float* const* inputs, float* out, int count)
+{
+$INPUTS$    ParallelFor(0, count, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+$BODY$            out[i] = $RESULT$;
+        }
+    });
+}
+)CPP";
+
+    const char kHalfHelper[] = R"CPP(
+// f16tof32(f32tof16(x)): x rounded to 10 bits below its leading one, or to the
+// subnormal step 2^-24, ties to even, and beyond 65504 to infinity.
+inline float ExprRoundToHalf(float x)
+{
+    int exponent;
+    std::frexp(x, &exponent);
+    const float step = std::ldexp(1.0f, (exponent - 1 > -14 ? exponent - 1 : -14) - 10);
+    const float rounded = std::nearbyint(x / step) * step;
+    return std::fabs(rounded) > 65504.0f ? std::copysign(HUGE_VALF, x) : rounded;
+}
+)CPP";
+
+    // gelu(x) = 0.5 * x * (1 + tanh(u)) with u = sqrt(2 / pi) * (x + 0.044715 x^3),
+    // which is x / (1 + exp(-2u)): one exp and no tanh.
+    const float kGeluScale = 1.5957691216f;     // 2 * sqrt(2 / pi)
+    const float kGeluCubic = 0.044715f;
+
+    // Replaces every $KEY$ in text by values[KEY].
+    std::string Substitute(const char* text, const std::map<std::string, std::string>& values)
+    {
+        std::string result;
+        for (const char* p = text; *p; )
+        {
+            const char* close = p[0] == '$' ? std::strchr(p + 1, '$') : nullptr;
+            auto it = close ? values.find(std::string(p + 1, close)) : values.end();
+            if (it != values.end())
+            {
+                result += it->second;
+                p = close + 1;
+            }
+            else
+            {
+                result += *p++;
+            }
+        }
+        return result;
+    }
+
+    bool MakeDirectory(const std::string& dir)
+    {
+#ifdef _WIN32
+        return _mkdir(dir.c_str()) == 0 || errno == EEXIST;
+#else
+        return mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+    }
+
+    // The shortest text that reads back as value, always with a '.' or an
+    // exponent so that it is a float literal in HLSL and C++.
+    std::string FormatFloat(float value)
+    {
+        char text[32];
+        for (int precision = 6; precision <= 9; precision++)
+        {
+            snprintf(text, sizeof(text), "%.*g", precision, value);
+            if (std::strtof(text, nullptr) == value)
+            {
+                break;
+            }
+        }
+        std::string result = text;
+        if (result.find_first_of(".e") == std::string::npos)
+        {
+            result += ".0";
+        }
+        return result;
+    }
+
+    int OperandCount(ExprOp op)
+    {
+        switch (op)
+        {
+        case EXPR_INPUT:
+        case EXPR_CONST:
+            return 0;
+        case EXPR_ADD:
+        case EXPR_SUB:
+        case EXPR_MUL:
+            return 2;
+        case EXPR_FMA:
+            return 3;
+        default:
+            return 1;
+        }
+    }
+
+    struct ExprCall
+    {
+        const char* name;
+        ExprOp op;
+    };
+
+    const ExprCall kCalls[] =
+    {
+        { "add", EXPR_ADD },
+        { "sub", EXPR_SUB },
+        { "mul", EXPR_MUL },
+        { "fma", EXPR_FMA },
+        { "relu", EXPR_RELU },
+        { "gelu", EXPR_GELU },
+        { "half", EXPR_HALF },
+        { "int", EXPR_INT },
+    };
+
+    // Recursive descent over
+    //     sum     = product { ("+" | "-") product }
+    //     product = unary { "*" unary }
+    //     unary   = "-" unary | primary
+    //     primary = number | input | call "(" sum { "," sum } ")" | "(" sum ")"
+    // Every rule returns the index of its node, or -1 once error is set.
+    class ExprParser
+    {
+    public:
+        ExprParser(const std::string& text, ElementwiseExpr& expr, std::string& error) :
+            m_text(text), m_pos(0), m_expr(expr), m_error(error)
+        {
+        }
+
+        bool Parse()
+        {
+            m_expr.nodes.clear();
+            m_expr.inputCount = 0;
+            int result = Sum();
+            SkipSpaces();
+            if (result >= 0 && m_pos < m_text.size())
+            {
+                return Fail("Unexpected '" + m_text.substr(m_pos, 1) + "'");
+            }
+            if (result < 0)
+            {
+                return false;
+            }
+            if (m_expr.inputCount == 0)
+            {
+                m_error = "The expression should read at least one input.";
+                return false;
+            }
+            // Drop the nodes folding or sharing left unused, keeping the order.
+            std::vector<bool> used(m_expr.nodes.size(), false);
+            used[result] = true;
+            for (int i = result; i >= 0; i--)
+            {
+                for (int a = 0; used[i] && a < OperandCount(m_expr.nodes[i].op); a++)
+                {
+                    used[m_expr.nodes[i].args[a]] = true;
+                }
+            }
+            std::vector<int> remap(m_expr.nodes.size(), -1);
+            std::vector<ExprNode> nodes;
+            for (int i = 0; i <= result; i++)
+            {
+                if (used[i])
+                {
+                    ExprNode node = m_expr.nodes[i];
+                    for (int a = 0; a < OperandCount(node.op); a++)
+                    {
+                        node.args[a] = remap[node.args[a]];
+                    }
+                    remap[i] = int(nodes.size());
+                    nodes.push_back(node);
+                }
+            }
+            m_expr.nodes = nodes;
+            return true;
+        }
+
+    private:
+        bool Fail(const std::string& message)
+        {
+            if (m_error.empty())
+            {
+                m_error = message + " at offset " + std::to_string(m_pos) + " of \"" + m_text + "\".";
+            }
+            return false;
+        }
+
+        void SkipSpaces()
+        {
+            while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos])))
+            {
+                m_pos++;
+            }
+        }
+
+        bool Accept(char c)
+        {
+            SkipSpaces();
+            if (m_pos < m_text.size() && m_text[m_pos] == c)
+            {
+                m_pos++;
+                return true;
+            }
+            return false;
+        }
+
+        // Appends the node, unless an equal one exists or it can be folded.
+        int AddNode(ExprNode node)
+        {
+            const int operands = OperandCount(node.op);
+            for (int a = operands; a < 3; a++)
+            {
+                node.args[a] = -1;
+            }
+            if (node.op != EXPR_INPUT)
+            {
+                node.input = -1;
+            }
+            if (node.op != EXPR_CONST)
+            {
+                node.value = 0.0f;
+            }
+            bool constant = operands > 0;
+            float values[3] = { 0.0f, 0.0f, 0.0f };
+            for (int a = 0; a < operands; a++)
+            {
+                const ExprNode& arg = m_expr.nodes[node.args[a]];
+                constant = constant && arg.op == EXPR_CONST;
+                values[a] = arg.value;
+            }
+            if (constant)
+            {
+                node = { EXPR_CONST, { -1, -1, -1 }, -1, EvaluateExprOp(node.op, values[0], values[1], values[2]) };
+            }
+            for (size_t i = 0; i < m_expr.nodes.size(); i++)
+            {
+                const ExprNode& other = m_expr.nodes[i];
+                if (other.op == node.op && other.input == node.input && other.value == node.value &&
+                    std::equal(node.args, node.args + 3, other.args))
+                {
+                    return int(i);
+                }
+            }
+            m_expr.nodes.push_back(node);
+            return int(m_expr.nodes.size()) - 1;
+        }
+
+        int Sum()
+        {
+            int left = Product();
+            while (left >= 0)
+            {
+                ExprOp op;
+                if (Accept('+'))
+                {
+                    op = EXPR_ADD;
+                }
+                else if (Accept('-'))
+                {
+                    op = EXPR_SUB;
+                }
+                else
+                {
+                    break;
+                }
+                int right = Product();
+                left = right < 0 ? -1 : AddNode({ op, { left, right, -1 }, -1, 0.0f });
+            }
+            return left;
+        }
+
+        int Product()
+        {
+            int left = Unary();
+            while (left >= 0 && Accept('*'))
+            {
+                int right = Unary();
+                left = right < 0 ? -1 : AddNode({ EXPR_MUL, { left, right, -1 }, -1, 0.0f });
+            }
+            return left;
+        }
+
+        int Unary()
+        {
+            if (Accept('-'))
+            {
+                int operand = Unary();
+                return operand < 0 ? -1 : AddNode({ EXPR_NEG, { operand, -1, -1 }, -1, 0.0f });
+            }
+            return Primary();
+        }
+
+        int Primary()
+        {
+            SkipSpaces();
+            if (m_pos == m_text.size())
+            {
+                Fail("Unexpected end");
+                return -1;
+            }
+            if (Accept('('))
+            {
+                int inner = Sum();
+                if (inner >= 0 && !Accept(')'))
+                {
+                    Fail("Expected ')'");
+                    return -1;
+                }
+                return inner;
+            }
+            const char* begin = m_text.c_str() + m_pos;
+            if (std::isdigit(static_cast<unsigned char>(*begin)) || *begin == '.')
+            {
+                char* end;
+                float value = std::strtof(begin, &end);
+                if (end == begin || !std::isfinite(value))
+                {
+                    Fail("Invalid number");
+                    return -1;
+                }
+                m_pos += end - begin;
+                return AddNode({ EXPR_CONST, { -1, -1, -1 }, -1, value });
+            }
+            size_t nameEnd = m_pos;
+            while (nameEnd < m_text.size() && std::isalpha(static_cast<unsigned char>(m_text[nameEnd])))
+            {
+                nameEnd++;
+            }
+            std::string name = m_text.substr(m_pos, nameEnd - m_pos);
+            if (name.empty())
+            {
+                Fail("Unexpected '" + m_text.substr(m_pos, 1) + "'");
+                return -1;
+            }
+            if (name.size() == 1)
+            {
+                int input = name[0] - 'a';
+                if (input < 0 || input >= EXPR_MAX_INPUTS)
+                {
+                    Fail("Inputs are named a to " + std::string(1, char('a' + EXPR_MAX_INPUTS - 1)));
+                    return -1;
+                }
+                m_pos = nameEnd;
+                m_expr.inputCount = (std::max)(m_expr.inputCount, input + 1);
+                return AddNode({ EXPR_INPUT, { -1, -1, -1 }, input, 0.0f });
+            }
+            const ExprCall* call = nullptr;
+            for (const ExprCall& candidate : kCalls)
+            {
+                if (name == candidate.name)
+                {
+                    call = &candidate;
+                }
+            }
+            if (!call)
+            {
+                Fail("Unknown function \"" + name + "\"");
+                return -1;
+            }
+            m_pos = nameEnd;
+            if (!Accept('('))
+            {
+                Fail("Expected '(' after " + name);
+                return -1;
+            }
+            ExprNode node = { call->op, { -1, -1, -1 }, -1, 0.0f };
+            const int operands = OperandCount(call->op);
+            for (int a = 0; a < operands; a++)
+            {
+                if (a > 0 && !Accept(','))
+                {
+                    Fail(name + " takes " + std::to_string(operands) + " operands; expected ','");
+                    return -1;
+                }
+                node.args[a] = Sum();
+                if (node.args[a] < 0)
+                {
+                    return -1;
+                }
+            }
+            if (!Accept(')'))
+            {
+                Fail(name + " takes " + std::to_string(operands) + " operands; expected ')'");
+                return -1;
+            }
+            return AddNode(node);
+        }
+
+        const std::string& m_text;
+        size_t m_pos;
+        ElementwiseExpr& m_expr;
+        std::string& m_error;
+    };
+
+    std::string NodeText(const ElementwiseExpr& expr, int index)
+    {
+        const ExprNode& node = expr.nodes[index];
+        switch (node.op)
+        {
+        case EXPR_INPUT:
+            return std::string(1, char('a' + node.input));
+        case EXPR_CONST:
+            return FormatFloat(node.value);
+        case EXPR_NEG:
+            return "-" + NodeText(expr, node.args[0]);
+        default:
+            break;
+        }
+        std::string text;
+        for (const ExprCall& call : kCalls)
+        {
+            if (call.op == node.op)
+            {
+                text = call.name;
+            }
+        }
+        for (int a = 0; a < OperandCount(node.op); a++)
+        {
+            text += (a ? ", " : "(") + NodeText(expr, node.args[a]);
+        }
+        return text + ")";
+    }
+
+    // Right-hand side of node index in either language, with tN for node N.
+    // C++ has no float4, so the languages differ in the casts and the constants.
+    std::string NodeCode(const ExprNode& node, bool hlsl)
+    {
+        std::string t[3];
+        for (int a = 0; a < OperandCount(node.op); a++)
+        {
+            t[a] = "t" + std::to_string(node.args[a]);
+        }
+        const std::string f = hlsl ? "" : "f";
+        switch (node.op)
+        {
+        case EXPR_INPUT:
+            return hlsl ? "mm_read" + std::to_string(node.input) + "(index)" : "in" + std::to_string(node.input) + "[i]";
+        case EXPR_CONST:
+            return hlsl ? "(VALUE)" + FormatFloat(node.value) : FormatFloat(node.value) + "f";
+        case EXPR_ADD:
+            return t[0] + " + " + t[1];
+        case EXPR_SUB:
+            return t[0] + " - " + t[1];
+        case EXPR_MUL:
+            return t[0] + " * " + t[1];
+        case EXPR_FMA:
+            // HLSL's fma() is for doubles only; mad() may or may not fuse, and
+            // so may the C++ compiler.
+            return hlsl ? "mad(" + t[0] + ", " + t[1] + ", " + t[2] + ")" : t[0] + " * " + t[1] + " + " + t[2];
+        case EXPR_NEG:
+            return "-" + t[0];
+        case EXPR_RELU:
+            return hlsl ? "max(" + t[0] + ", (VALUE)0.0)" : "(" + t[0] + " > 0.0f ? " + t[0] + " : 0.0f)";
+        case EXPR_GELU:
+            return t[0] + " / (1.0" + f + " + " + (hlsl ? "exp(" : "std::exp(") + "-" + FormatFloat(kGeluScale) + f + " * (" + t[0] +
+                   " + " + FormatFloat(kGeluCubic) + f + " * " + t[0] + " * " + t[0] + " * " + t[0] + ")))";
+        case EXPR_HALF:
+            return hlsl ? "f16tof32(f32tof16(" + t[0] + "))" : "ExprRoundToHalf(" + t[0] + ")";
+        case EXPR_INT:
+            // float(int(x)) for every x an int holds.
+            return (hlsl ? "trunc(" : "std::trunc(") + t[0] + ")";
+        }
+        return "";
+    }
+
+    std::map<std::string, std::string> CommonValues(const ElementwiseExpr& expr)
+    {
+        std::map<std::string, std::string> values;
+        values["TEXT"] = "\"" + ElementwiseExprText(expr) + "\"";
+        values["NAME"] = ElementwiseExprName(expr);
+        values["OPS"] = std::to_string(ElementwiseExprOpCount(expr));
+        values["RESULT"] = "t" + std::to_string(expr.nodes.size() - 1);
+        return values;
+    }
+}
+
+bool ParseElementwiseExpr(const std::string& text, ElementwiseExpr& expr, std::string& error)
+{
+    error.clear();
+    ExprParser parser(text, expr, error);
+    return parser.Parse();
+}
+
+std::string ElementwiseExprText(const ElementwiseExpr& expr)
+{
+    return NodeText(expr, int(expr.nodes.size()) - 1);
+}
+
+std::string ElementwiseExprName(const ElementwiseExpr& expr)
+{
+    // 32-bit FNV-1a.
+    unsigned int hash = 2166136261u;
+    for (char c : ElementwiseExprText(expr))
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    char name[16];
+    snprintf(name, sizeof(name), "EXPR_%08x", hash);
+    return name;
+}
+
+int ElementwiseExprOpCount(const ElementwiseExpr& expr)
+{
+    return int(std::count_if(expr.nodes.begin(), expr.nodes.end(),
+        [](const ExprNode& node) { return OperandCount(node.op) > 0; }));
+}
+
+int ElementwiseExprFusedTraffic(const ElementwiseExpr& expr)
+{
+    return int(std::count_if(expr.nodes.begin(), expr.nodes.end(),
+        [](const ExprNode& node) { return node.op == EXPR_INPUT; })) + 1;
+}
+
+int ElementwiseExprUnfusedTraffic(const ElementwiseExpr& expr)
+{
+    int traffic = 0;
+    for (const ExprNode& node : expr.nodes)
+    {
+        for (int a = 0; a < OperandCount(node.op); a++)
+        {
+            // A constant operand is a kernel argument, not a buffer.
+            traffic += expr.nodes[node.args[a]].op != EXPR_CONST;
+        }
+        traffic += OperandCount(node.op) > 0;
+    }
+    // An expression without ops is a copy.
+    return (std::max)(traffic, 2);
+}
+
+std::string GenerateExprHlslKernel(const ElementwiseExpr& expr)
+{
+    std::map<std::string, std::string> values = CommonValues(expr);
+    std::string structuredBuffers, structuredReads, rawBuffers, rawReads;
+    for (int input = 0; input < expr.inputCount; input++)
+    {
+        const std::string i = std::to_string(input);
+        structuredBuffers += "StructuredBuffer<VALUE> src" + i + " : register(t" + i + ");\n";
+        structuredReads += "VALUE mm_read" + i + "(int index) {\n    return src" + i + "[index];\n}\n\n";
+        rawBuffers += "ByteAddressBuffer src" + i + " : register(t" + i + ");\n";
+        rawReads += "VALUE mm_read" + i + "(int index) {\n    return asfloat(src" + i + ".LOAD(VALUE_BYTES * index));\n}\n\n";
+    }
+    values["STRUCTURED_BUFFERS"] = structuredBuffers;
+    values["STRUCTURED_READS"] = structuredReads;
+    values["RAW_BUFFERS"] = rawBuffers;
+    values["RAW_READS"] = rawReads;
+    std::string body;
+    for (size_t n = 0; n < expr.nodes.size(); n++)
+    {
+        body += "        VALUE t" + std::to_string(n) + " = " + NodeCode(expr.nodes[n], true) + ";\n";
+    }
+    values["BODY"] = body;
+    return Substitute(kHlslTemplate, values);
+}
+
+std::string GenerateExprCpuKernel(const ElementwiseExpr& expr)
+{
+    std::map<std::string, std::string> values = CommonValues(expr);
+    std::string inputs;
+    for (int input = 0; input < expr.inputCount; input++)
+    {
+        const std::string i = std::to_string(input);
+        inputs += "    const float* in" + i + " = inputs[" + i + "];\n";
+    }
+    values["INPUTS"] = inputs;
+    bool half = false;
+    std::string body;
+    for (size_t n = 0; n < expr.nodes.size(); n++)
+    {
+        half = half || expr.nodes[n].op == EXPR_HALF;
+        body += "            const float t" + std::to_string(n) + " = " + NodeCode(expr.nodes[n], false) + ";\n";
+    }
+    values["BODY"] = body;
+    values["HELPERS"] = half ? kHalfHelper : "";
+    return Substitute(kCpuTemplate, values);
+}
+
+bool WriteGeneratedExpr(const ElementwiseExpr& expr, const std::string& dir)
+{
+    if (!MakeDirectory(dir))
+    {
+        return false;
+    }
+    std::string stem = dir + "/" + ElementwiseExprName(expr);
+    std::ofstream hlsl(stem + ".hlsl", std::ios::binary);
+    hlsl << GenerateExprHlslKernel(expr);
+    std::ofstream cpu(stem + ".h", std::ios::binary);
+    cpu << GenerateExprCpuKernel(expr);
+    return bool(hlsl) && bool(cpu);
+}
+
+float RoundToHalf(float x)
+{
+    if (x == 0.0f || !std::isfinite(x))
+    {
+        return x;
+    }
+    int exponent;
+    std::frexp(x, &exponent);
+    // 10 bits below the leading one, whose weight is 2^(exponent - 1), but no
+    // finer than the subnormal step 2^-24. Dividing by the step is exact.
+    const float step = std::ldexp(1.0f, (std::max)(exponent - 1, -14) - 10);
+    const float rounded = std::nearbyint(x / step) * step;
+    return std::fabs(rounded) > 65504.0f ? std::copysign(HUGE_VALF, x) : rounded;
+}
+
+float EvaluateExprOp(ExprOp op, float x, float y, float z)
+{
+    switch (op)
+    {
+    case EXPR_ADD: return x + y;
+    case EXPR_SUB: return x - y;
+    case EXPR_MUL: return x * y;
+    case EXPR_FMA: return x * y + z;
+    case EXPR_NEG: return -x;
+    case EXPR_RELU: return x > 0.0f ? x : 0.0f;
+    case EXPR_GELU: return x / (1.0f + std::exp(-kGeluScale * (x + kGeluCubic * x * x * x)));
+    case EXPR_HALF: return RoundToHalf(x);
+    case EXPR_INT: return std::trunc(x);
+    default: return x;
+    }
+}
+
+#ifdef ELEMENTWISE_EXPR_MAIN
+// Standalone build for hosts without D3D12:
+//     g++ -std=c++14 -DELEMENTWISE_EXPR_MAIN ElementwiseExpr.cpp -o elementwise_expr
+//     ./elementwise_expr generated "gelu(fma(a, b, c))" "relu(a - b) * 2"
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <output dir> <expression>...\n", argv[0]);
+        return 1;
+    }
+    for (int i = 2; i < argc; i++)
+    {
+        ElementwiseExpr expr;
+        std::string error;
+        if (!ParseElementwiseExpr(argv[i], expr, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        if (!WriteGeneratedExpr(expr, argv[1]))
+        {
+            fprintf(stderr, "Can't write %s to %s.\n", ElementwiseExprName(expr).c_str(), argv[1]);
+            return 1;
+        }
+        printf("%s/%s.hlsl, .h: %s\n", argv[1], ElementwiseExprName(expr).c_str(), ElementwiseExprText(expr).c_str());
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,88 @@
+// ElementwiseExpr.h : Compiles an elementwise expression over up to
+// EXPR_MAX_INPUTS buffers into one fused HLSL compute shader and a C++ CPU
+// counterpart, so a chain of ops reads its inputs and writes its result once
+// instead of once per op. Nothing here depends on D3D12, so expressions can be
+// compiled on any platform.
+
+#pragma once
+#include <string>
+#include <vector>
+
+// The inputs are named a, b, c, ... and bound to t0, t1, t2, ...
+const int EXPR_MAX_INPUTS = 8;
+
+enum ExprOp
+{
+    EXPR_INPUT,
+    EXPR_CONST,
+    EXPR_ADD,
+    EXPR_SUB,
+    EXPR_MUL,
+    EXPR_FMA,   // fma(x, y, z) = x * y + z
+    EXPR_NEG,
+    EXPR_RELU,
+    EXPR_GELU,  // The tanh approximation, written as x * sigmoid(2 * u).
+    EXPR_HALF,  // half(x): x rounded to fp16 precision and back.
+    EXPR_INT,   // int(x): x truncated toward zero.
+};
+
+struct ExprNode
+{
+    ExprOp op;
+    int args[3];    // Indices of earlier nodes.
+    int input;      // EXPR_INPUT only.
+    float value;    // EXPR_CONST only.
+};
+
+// The expression as a list of nodes in evaluation order, the last one being
+// the result. Equal subexpressions share one node, so every input is read
+// once, and ops on constants only are folded.
+struct ElementwiseExpr
+{
+    std::vector<ExprNode> nodes;
+    int inputCount;     // One past the highest input used.
+};
+
+// Parses infix +, - and * with parentheses, numeric constants, the inputs
+// a..h and the calls add, sub, mul, fma, relu, gelu, half and int, e.g.
+// "gelu(fma(a, b, c)) * 0.5 + relu(a)". Returns false with a message in error
+// if the text is invalid.
+bool ParseElementwiseExpr(const std::string& text, ElementwiseExpr& expr, std::string& error);
+
+// The expression written back in call form, the same for every text that
+// parses to the same nodes.
+std::string ElementwiseExprText(const ElementwiseExpr& expr);
+
+// Stem of the generated files and suffix of the CPU function: "EXPR_" and a
+// hash of ElementwiseExprText.
+std::string ElementwiseExprName(const ElementwiseExpr& expr);
+
+// Ops the expression evaluates per element, leaving out inputs and constants.
+int ElementwiseExprOpCount(const ElementwiseExpr& expr);
+
+// Floats per element a fused kernel moves (one read per input and one write),
+// and what running every op as a kernel of its own would move, each reading
+// its operands from memory and writing its result back.
+int ElementwiseExprFusedTraffic(const ElementwiseExpr& expr);
+int ElementwiseExprUnfusedTraffic(const ElementwiseExpr& expr);
+
+// Source of the compute shader, entry point "main". The threads of
+// LOCAL_GROUP_SIZE_X groups stride over the M values (vectors) of dst, K
+// threads apart: floats, or float2s/float4s with USE_VEC2/USE_VEC4, in
+// byteAddress or structured buffers.
+std::string GenerateExprHlslKernel(const ElementwiseExpr& expr);
+
+// Source of a header defining CpuExpr_<ElementwiseExprName>(inputs, out, count),
+// a single loop over the elements that compilers vectorise.
+std::string GenerateExprCpuKernel(const ElementwiseExpr& expr);
+
+// Writes <dir>/<ElementwiseExprName>.hlsl and .h, creating dir if needed.
+// Returns false if a file can't be written.
+bool WriteGeneratedExpr(const ElementwiseExpr& expr, const std::string& dir);
+
+// x rounded to the nearest fp16 value, ties to even, as f32tof16 does.
+float RoundToHalf(float x);
+
+// One op on scalars, as the generated kernels compute it; y and z are ignored
+// by the ops that take fewer operands.
+float EvaluateExprOp(ExprOp op, float x, float y, float z);
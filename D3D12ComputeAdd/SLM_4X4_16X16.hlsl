@@ -90,7 +90,7 @@ void mm_write(int index, float value) {
 #endif  // USE_VEC4
 #endif  // USE_STRUCTURED_BUFFERS
 
-[numthreads(128, 1, 1)]
+[numthreads(LOCAL_GROUP_SIZE_X, 1, 1)]
 void main(CS_INPUT input)
 {
     initGLBuiltins(input);
@@ -0,0 +1,221 @@
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;      // float4s of the input.
+    int K;      // Groups of the reductions and of the scan's upsweep and downsweep.
+    int N;      // float4s each of those groups covers, M / K rounded up.
+    int TILE_K;
+}
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+};
+
+// src0 is the input and dst the output, both read and written as float4s like
+// SLM_Row_Reduce.hlsl, with unsigned byte offsets so that they can hold up to
+// 2^30 floats. dst gets the scan, or (value, asfloat(index), 0, 0) for the
+// reductions.
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<float4> src0 : register(t0);
+RWStructuredBuffer<float4> dst : register(u0);
+
+float4 mm_readA(int index) {
+    return src0[index];
+}
+
+void mm_write(int index, float4 value) {
+    dst[index] = value;
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+RWByteAddressBuffer dst : register(u0);
+
+float4 mm_readA(int index) {
+    return asfloat(src0.Load4(uint(index) * 16));
+}
+
+void mm_write(int index, float4 value) {
+    dst.Store4(uint(index) * 16, asuint(value));
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+// What the groups hand on: a ticket counter at byte 0, then from byte PARTIALS
+// one (value, index) pair per group for the reductions, or one sum per group
+// for the scan. globallycoherent makes the stores of one group visible to the
+// loads of another past the caches that aren't coherent across the GPU.
+globallycoherent RWByteAddressBuffer partials : register(u1);
+#define PARTIALS 16
+
+// Device-wide sum (DEVICE_OP 1), max (2), argmax (3) and exclusive scan (4).
+// Group g covers the float4s [g * N, g * N + N), each of its REDUCE_GROUP_SIZE
+// threads a strided share of them.
+//
+// A reduction takes one dispatch. Each group reduces its range in a
+// groupshared tree and stores the result to partials; the last group to take a
+// ticket, which then sees all the others' results, reduces them in the same
+// fixed order every time, writes dst and resets the counter for the next
+// dispatch.
+//
+// The scan is reduce-then-scan over three dispatches, SCAN_PASS 1 to 3: the
+// upsweep sums each group's range, the spine scans the sums in one group and
+// the downsweep scans each range again from its group's offset, a tile of
+// GROUP_SIZE float4s at a time. That reads the input twice where a decoupled
+// look-back reads it once, but no group ever waits for another to make
+// progress, which D3D12 doesn't guarantee.
+#define GROUP_SIZE REDUCE_GROUP_SIZE
+#define LOWEST -3.402823466e+38
+
+groupshared float reduce0[GROUP_SIZE];
+groupshared uint reduce1[GROUP_SIZE];
+groupshared bool isLastGroup;
+
+// Folds (otherValue, otherIndex) into (value, index). Argmax keeps the first
+// maximum, so equal values go to the lower index.
+void combine(inout float value, inout uint index, float otherValue, uint otherIndex) {
+#if DEVICE_OP == 2
+    value = max(value, otherValue);
+#elif DEVICE_OP == 3
+    if (otherValue > value || (otherValue == value && otherIndex < index)) {
+        value = otherValue;
+        index = otherIndex;
+    }
+#else
+    value += otherValue;
+#endif
+}
+
+// Returns the (value, index) of the whole group to every thread.
+void group_reduce(int tid, inout float value, inout uint index) {
+    reduce0[tid] = value;
+    reduce1[tid] = index;
+    GroupMemoryBarrierWithGroupSync();
+    for (int stride = GROUP_SIZE / 2; stride > 0; stride >>= 1) {
+        if (tid < stride) {
+            float v = reduce0[tid];
+            uint i = reduce1[tid];
+            combine(v, i, reduce0[tid + stride], reduce1[tid + stride]);
+            reduce0[tid] = v;
+            reduce1[tid] = i;
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+    value = reduce0[0];
+    index = reduce1[0];
+    // Nobody may start the next reduction before everyone has read this one.
+    GroupMemoryBarrierWithGroupSync();
+}
+
+// Hillis and Steele's scan of one value per thread in log2(GROUP_SIZE) steps.
+// Returns the sum of the values of the threads before this one, and the sum of
+// all of them in total.
+float group_exclusive_scan(int tid, float value, out float total) {
+    reduce0[tid] = value;
+    GroupMemoryBarrierWithGroupSync();
+    for (int offset = 1; offset < GROUP_SIZE; offset <<= 1) {
+        float addend = tid >= offset ? reduce0[tid - offset] : 0.0;
+        GroupMemoryBarrierWithGroupSync();
+        reduce0[tid] += addend;
+        GroupMemoryBarrierWithGroupSync();
+    }
+    float prefix = tid > 0 ? reduce0[tid - 1] : 0.0;
+    total = reduce0[GROUP_SIZE - 1];
+    GroupMemoryBarrierWithGroupSync();
+    return prefix;
+}
+
+float sum4(float4 v) {
+    return dot(v, float4(1.0, 1.0, 1.0, 1.0));
+}
+
+[numthreads(REDUCE_GROUP_SIZE, 1, 1)]
+void main(CS_INPUT input)
+{
+    int tid = int(input.dx_LocalInvocationID.x);
+    int group = int(input.dx_WorkGroupID.x);
+    int begin = group * N;
+    int end = min(begin + N, M);
+
+#if DEVICE_OP != 4
+    const float identity = DEVICE_OP == 1 ? 0.0 : LOWEST;
+    float value = identity;
+    uint index = 0xffffffff;
+    for (int i = begin + tid; i < end; i += GROUP_SIZE) {
+        float4 x = mm_readA(i);
+#if DEVICE_OP == 1
+        value += sum4(x);
+#else
+        for (int c = 0; c < 4; c++) {
+            combine(value, index, x[c], uint(i) * 4 + c);
+        }
+#endif
+    }
+    group_reduce(tid, value, index);
+    if (tid == 0) {
+        partials.Store2(PARTIALS + group * 8, uint2(asuint(value), index));
+    }
+    // The result has to be visible before the ticket that announces it.
+    DeviceMemoryBarrierWithGroupSync();
+    if (tid == 0) {
+        uint ticket;
+        partials.InterlockedAdd(0, 1, ticket);
+        isLastGroup = ticket == uint(K - 1);
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // Every group runs the final tree so that the barriers in it stay in
+    // uniform control flow, but only the last one loads and writes anything.
+    value = identity;
+    index = 0xffffffff;
+    if (isLastGroup) {
+        for (int j = tid; j < K; j += GROUP_SIZE) {
+            uint2 partial = partials.Load2(PARTIALS + j * 8);
+            combine(value, index, asfloat(partial.x), partial.y);
+        }
+    }
+    group_reduce(tid, value, index);
+    if (isLastGroup && tid == 0) {
+        mm_write(0, float4(value, asfloat(index), 0.0, 0.0));
+        partials.Store(0, 0);
+    }
+#elif SCAN_PASS == 1
+    float sum = 0.0;
+    for (int i = begin + tid; i < end; i += GROUP_SIZE) {
+        sum += sum4(mm_readA(i));
+    }
+    uint unused = 0;
+    group_reduce(tid, sum, unused);
+    if (tid == 0) {
+        partials.Store(PARTIALS + group * 4, asuint(sum));
+    }
+#elif SCAN_PASS == 2
+    // One group replaces the K group sums by their exclusive prefix sums.
+    float carry = 0.0;
+    for (int base = 0; base < K; base += GROUP_SIZE) {
+        int j = base + tid;
+        float sum = j < K ? asfloat(partials.Load(PARTIALS + j * 4)) : 0.0;
+        float total;
+        float prefix = group_exclusive_scan(tid, sum, total);
+        if (j < K) {
+            partials.Store(PARTIALS + j * 4, asuint(carry + prefix));
+        }
+        carry += total;
+    }
+#else
+    float carry = asfloat(partials.Load(PARTIALS + group * 4));
+    for (int tile = begin; tile < end; tile += GROUP_SIZE) {
+        int i = tile + tid;
+        float4 x = i < end ? mm_readA(i) : float4(0.0, 0.0, 0.0, 0.0);
+        float4 inclusive = x;
+        inclusive.y += inclusive.x;
+        inclusive.z += inclusive.y;
+        inclusive.w += inclusive.z;
+        float total;
+        float prefix = carry + group_exclusive_scan(tid, inclusive.w, total);
+        if (i < end) {
+            mm_write(i, prefix + float4(0.0, inclusive.xyz));
+        }
+        carry += total;
+    }
+#endif  // DEVICE_OP
+}
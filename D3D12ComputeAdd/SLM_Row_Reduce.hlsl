@@ -0,0 +1,236 @@
+cbuffer SceneConstantBuffer : register( b0 )
+{
+    int M;      // Rows.
+    int K;
+    int N;      // Columns, a multiple of 4.
+    int TILE_K;
+}
+
+struct CS_INPUT
+{
+    uint3 dx_WorkGroupID : SV_GroupID;
+    uint3 dx_LocalInvocationID : SV_GroupThreadID;
+};
+
+// src0 is the M x N input and dst the output, both read and written as float4s
+// like the USE_VEC4 path of SLM_4X4_16X16.hlsl. src1 holds gamma, then beta,
+// N values each.
+#ifdef USE_STRUCTURED_BUFFERS
+StructuredBuffer<float4> src0 : register(t0);
+StructuredBuffer<float4> src1 : register(t1);
+RWStructuredBuffer<float4> dst : register(u0);
+
+float4 mm_readA(int index) {
+    return src0[index];
+}
+
+float4 mm_readB(int index) {
+    return src1[index];
+}
+
+void mm_write(int index, float4 value) {
+    dst[index] = value;
+}
+#else
+ByteAddressBuffer src0 : register(t0);
+ByteAddressBuffer src1 : register(t1);
+RWByteAddressBuffer dst : register(u0);
+
+float4 mm_readA(int index) {
+    return asfloat(src0.Load4(4 * (index * 4)));
+}
+
+float4 mm_readB(int index) {
+    return asfloat(src1.Load4(4 * (index * 4)));
+}
+
+void mm_write(int index, float4 value) {
+    dst.Store4(4 * (index * 4), asuint(value));
+}
+#endif  // USE_STRUCTURED_BUFFERS
+
+// Row-wise softmax (ROW_OP 1), layernorm (2) and RMSnorm (3). One group of
+// ROW_GROUP_SIZE threads, a power of two, normalises one row: each thread
+// gathers statistics over a strided share of the row's float4s, a groupshared
+// tree combines them in log2(ROW_GROUP_SIZE) steps, and a last pass over the
+// row writes the output.
+//
+// With SINGLE_PASS, softmax keeps a running maximum and a sum of exps rescaled
+// whenever the maximum grows, and layernorm keeps Welford's running mean and
+// M2, so the statistics take one read of the row instead of two. The partial
+// states are combined pairwise in the tree.
+#define GROUP_SIZE ROW_GROUP_SIZE
+#define EPSILON 1e-5
+#define LOWEST -3.402823466e+38
+
+groupshared float reduce0[GROUP_SIZE];
+groupshared float reduce1[GROUP_SIZE];
+groupshared float reduce2[GROUP_SIZE];
+
+// The tree functions return the value of the whole group to every thread.
+float group_sum(int tid, float value) {
+    reduce0[tid] = value;
+    GroupMemoryBarrierWithGroupSync();
+    for (int stride = GROUP_SIZE / 2; stride > 0; stride >>= 1) {
+        if (tid < stride) {
+            reduce0[tid] += reduce0[tid + stride];
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+    float result = reduce0[0];
+    // Nobody may start the next reduction before everyone has read this one.
+    GroupMemoryBarrierWithGroupSync();
+    return result;
+}
+
+float group_max(int tid, float value) {
+    reduce0[tid] = value;
+    GroupMemoryBarrierWithGroupSync();
+    for (int stride = GROUP_SIZE / 2; stride > 0; stride >>= 1) {
+        if (tid < stride) {
+            reduce0[tid] = max(reduce0[tid], reduce0[tid + stride]);
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+    float result = reduce0[0];
+    GroupMemoryBarrierWithGroupSync();
+    return result;
+}
+
+// (max, sum of exp(x - max)) of two parts of a row, as one.
+void merge_softmax(inout float rowMax, inout float sum, float otherMax, float otherSum) {
+    float newMax = max(rowMax, otherMax);
+    sum = sum * exp(rowMax - newMax) + otherSum * exp(otherMax - newMax);
+    rowMax = newMax;
+}
+
+void group_softmax(int tid, inout float rowMax, inout float sum) {
+    reduce0[tid] = rowMax;
+    reduce1[tid] = sum;
+    GroupMemoryBarrierWithGroupSync();
+    for (int stride = GROUP_SIZE / 2; stride > 0; stride >>= 1) {
+        if (tid < stride) {
+            float m = reduce0[tid];
+            float s = reduce1[tid];
+            merge_softmax(m, s, reduce0[tid + stride], reduce1[tid + stride]);
+            reduce0[tid] = m;
+            reduce1[tid] = s;
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+    rowMax = reduce0[0];
+    sum = reduce1[0];
+    GroupMemoryBarrierWithGroupSync();
+}
+
+// Chan et al.'s combination of two Welford states (count, mean, M2).
+void merge_welford(inout float count, inout float mean, inout float m2, float otherCount, float otherMean, float otherM2) {
+    float total = count + otherCount;
+    if (total > 0.0) {
+        float delta = otherMean - mean;
+        mean += delta * otherCount / total;
+        m2 += otherM2 + delta * delta * count * otherCount / total;
+        count = total;
+    }
+}
+
+void group_welford(int tid, inout float count, inout float mean, inout float m2) {
+    reduce0[tid] = count;
+    reduce1[tid] = mean;
+    reduce2[tid] = m2;
+    GroupMemoryBarrierWithGroupSync();
+    for (int stride = GROUP_SIZE / 2; stride > 0; stride >>= 1) {
+        if (tid < stride) {
+            float c = reduce0[tid];
+            float m = reduce1[tid];
+            float q = reduce2[tid];
+            merge_welford(c, m, q, reduce0[tid + stride], reduce1[tid + stride], reduce2[tid + stride]);
+            reduce0[tid] = c;
+            reduce1[tid] = m;
+            reduce2[tid] = q;
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+    count = reduce0[0];
+    mean = reduce1[0];
+    m2 = reduce2[0];
+    GroupMemoryBarrierWithGroupSync();
+}
+
+float max4(float4 v) {
+    return max(max(v.x, v.y), max(v.z, v.w));
+}
+
+float sum4(float4 v) {
+    return dot(v, float4(1.0, 1.0, 1.0, 1.0));
+}
+
+[numthreads(ROW_GROUP_SIZE, 1, 1)]
+void main(CS_INPUT input)
+{
+    int tid = int(input.dx_LocalInvocationID.x);
+    int vectors = N / 4;
+    int base = int(input.dx_WorkGroupID.x) * vectors;
+
+#if ROW_OP == 1
+    float rowMax = LOWEST;
+    float sum = 0.0;
+#if SINGLE_PASS
+    for (int i = tid; i < vectors; i += GROUP_SIZE) {
+        float4 x = mm_readA(base + i);
+        merge_softmax(rowMax, sum, max4(x), sum4(exp(x - max4(x))));
+    }
+    group_softmax(tid, rowMax, sum);
+#else
+    for (int i = tid; i < vectors; i += GROUP_SIZE) {
+        rowMax = max(rowMax, max4(mm_readA(base + i)));
+    }
+    rowMax = group_max(tid, rowMax);
+    for (int j = tid; j < vectors; j += GROUP_SIZE) {
+        sum += sum4(exp(mm_readA(base + j) - rowMax));
+    }
+    sum = group_sum(tid, sum);
+#endif  // SINGLE_PASS
+    float scale = 1.0 / sum;
+    for (int k = tid; k < vectors; k += GROUP_SIZE) {
+        mm_write(base + k, exp(mm_readA(base + k) - rowMax) * scale);
+    }
+#elif ROW_OP == 2
+    float mean = 0.0;
+    float m2 = 0.0;
+#if SINGLE_PASS
+    float count = 0.0;
+    for (int i = tid; i < vectors; i += GROUP_SIZE) {
+        // The float4 is folded in as a batch of four with its own mean and M2.
+        float4 x = mm_readA(base + i);
+        float4 d = x - sum4(x) * 0.25;
+        merge_welford(count, mean, m2, 4.0, sum4(x) * 0.25, dot(d, d));
+    }
+    group_welford(tid, count, mean, m2);
+#else
+    for (int i = tid; i < vectors; i += GROUP_SIZE) {
+        mean += sum4(mm_readA(base + i));
+    }
+    mean = group_sum(tid, mean) / N;
+    for (int j = tid; j < vectors; j += GROUP_SIZE) {
+        float4 d = mm_readA(base + j) - mean;
+        m2 += dot(d, d);
+    }
+    m2 = group_sum(tid, m2);
+#endif  // SINGLE_PASS
+    float scale = rsqrt(m2 / N + EPSILON);
+    for (int k = tid; k < vectors; k += GROUP_SIZE) {
+        mm_write(base + k, (mm_readA(base + k) - mean) * scale * mm_readB(k) + mm_readB(vectors + k));
+    }
+#else
+    float squares = 0.0;
+    for (int i = tid; i < vectors; i += GROUP_SIZE) {
+        float4 x = mm_readA(base + i);
+        squares += dot(x, x);
+    }
+    float scale = rsqrt(group_sum(tid, squares) / N + EPSILON);
+    for (int k = tid; k < vectors; k += GROUP_SIZE) {
+        mm_write(base + k, mm_readA(base + k) * scale * mm_readB(k));
+    }
+#endif  // ROW_OP
+}